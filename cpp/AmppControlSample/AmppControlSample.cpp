@@ -2,13 +2,40 @@
 // Copyright Grass Valley
 //
 
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <fstream>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <sstream>
 #include <stdlib.h>
+#include <thread>
 
 #include "AmppControlUtil.h"
+#include "AudioMixerChannelState.h"
+#include "AsyncRestClient.h"
 #include "BearerToken.h"
+#include "ConflatingQueue.h"
+#include "FleetDiscovery.h"
+#include "HttpCache.h"
+#include "KeyframesClient.h"
+#include "MacroClient.h"
+#include "MailboxClient.h"
+#include "MeterAggregator.h"
+#include "NotificationGateway.h"
 #include "PushNotificationServer.h"
+#include "RenewalScheduler.h"
+#include "RestClient.h"
+#include "RouteTracker.h"
+#include "RoutingClient.h"
 #include "RpcProtocol.h"
+#include "SalvoEngine.h"
+#include "SchemaValidator.h"
+#include "SignalRProtocol.h"
+#include "SoundProbeClient.h"
 #include "Sockets.h"
 #include "Util.h"
 
@@ -40,9 +67,32 @@ IMPORTANT NOTES:
 
     - All websocket received messages are handle by the on_message() method in "Sockets.h". This sample application
       doesn't process or try to associate messages to their originating commands; it just prints them to the screen.
+      Notifications are handed to the endpoint's NotificationDispatcher, which runs the handlers on a thread pool,
+      in order per workload.
 
-    - At the top of the "Sockets.h" file, the sub-protocol used can be changed between "json-rpc" and "bson-rpc".
-      We recommend leaving it at "bson-rpc" since it is the most efficient.
+    - The transport is chosen per connection with "--transport <name>": "bson-rpc" (default) and "json-rpc" are the
+      sub-protocols of /pushnotifications-ws, "signalr-json" and "signalr-messagepack" the hub protocols of the
+      SignalR hub /pushnotificationshub. "--benchmark-transports" compares their encoding costs offline.
+
+    - With "--mailbox <topic>", the application receives the notifications of a topic for 30 seconds through a
+      notification service mailbox polled over HTTPS after step 1), for networks where websockets are blocked.
+
+    - Steps 2) and 3) are done for every application at once by FleetDiscovery: the workloads of all applications
+      are requested concurrently (at most 16 requests in flight) and indexed by application and by workload.
+
+    - All REST calls go through RestClient, which reuses its curl handles and keep-alive connections and accepts
+      compressed responses. The bytes received and decoded per endpoint are printed after the discovery.
+      With "--cache <file>", GET responses are kept in that file and only revalidated by the next runs: an unchanged
+      response (e.g. the application list of "--benchmark-rest") is answered with a 304 and read from the file.
+      Listings parsed as they arrive are not cached, so that they are never held whole in memory.
+      "--benchmark-rest <count>" repeats step 2) count times and prints the latency of each call, then sends the
+      same count of requests at once with AsyncRestClient, which runs them all on the websocket io thread.
+
+    - After step 3), the command schemas of the target application are fetched from its schemaversions endpoint and
+      compiled once by SchemaCache; the payload of step 7) is validated locally before it is sent.
+
+    - The payload of step 7) and the channelstate notifications are encoded and decoded by AudioMixerChannelState,
+      a struct generated at build time from schemas/AudioMixer.channelstate.json by tools/generate_payload.py.
 
     - This sample application assumes that the targeted workload is running. There isn't currently any way to tell
       if a workload is running beside not receiving any notification after the .getstate command.
@@ -50,12 +100,893 @@ IMPORTANT NOTES:
     - In a real world application, it is assumed that the user will already know what the targeted workload is so
       steps 2) and 3) are optionals.
 
+    - With "--macro <name>", the application lists the macros defined in Ampp Control after step 1) and executes the
+      named one. With "--macros <name>,<name>...", it executes the listed macros concurrently. MacroClient keeps the
+      catalog indexed by name and uuid.
+
+    - With "--fabric <id> --source <producer> --destination <consumer>", the application routes a producer to a
+      consumer of that fabric after step 1). RoutingClient fetches the producers and consumers of the fabric once and
+      indexes them by name, alias and id, so the route costs a single REST call. The tables then follow the
+      inventory notifications of the fabric and are revalidated every minute.
+
+    - With "--salvo <name>", the application executes that router salvo. With "--fabric <id> --routes <file>", it
+      executes a client-side salvo instead: the "<source>,<destination>" lines of the file are resolved to ids by
+      SalvoEngine, then every route request is sent at once over the AsyncRestClient. RouteTracker confirms each
+      route with its routemade notification, and only polls the status of the routes not notified in time.
+
+    - With "--keyframes <file>", the application receives the keyframes of the "<node>,<flow>" lines of the file
+      over the websocket. KeyframesClient keeps the last frames of every flow in preallocated buffers, read without
+      copying them, and with "--folder <path>" writes the latest frame of each flow there from a background thread.
+
+    - With "--audiometer <file>", the application meters the sound flows of the "<node>,<flow>" lines of the file.
+      SoundProbeClient parses the rms and peak arrays of every update straight into float arrays and publishes them
+      through a seqlock per probe, read 60 times a second without any lock. MeterAggregator folds every new update
+      into the peak hold, RMS windows and decimated history of the probe with SIMD kernels; "--benchmark-meters"
+      times them offline against the scalar ones for 200 probes of 64 channels.
+
+    - Keyframe requests and audio meter probes must be renewed every minute. RenewalScheduler republishes them from
+      a timer wheel, each at its own point of the minute, instead of renewing every subscription at once.
+
+    - With "--uuid 7", the request ids are time-ordered UUIDs (version 7) instead of random ones: they sort in the
+      order the requests were sent, and getUuidTime() reads back when a request was sent from the id echoed in its
+      response.
+
+    - With "--gateway <name>", the application only opens the websocket after step 1) and shares it with the other
+      processes of the host: they run "AmppControlSample --subscriber <name> <topic>" and receive notifications
+      through shared memory instead of opening their own websocket with their own bearer token.
+
  * ================================================================================================
 */
 
 
+// Returns the websocket URI of the push notification server for the given transport.
+bool getNotificationServerUri( const std::string& in_baseSite, const std::string& in_bearerToken,
+    TransportProtocol in_transport, std::string& out_uri )
+{
+    if ( in_transport == TRANSPORT_BSON_RPC || in_transport == TRANSPORT_JSON_RPC )
+    {
+        out_uri = "wss://" + in_baseSite + "/pushnotifications-ws?access_token=" + in_bearerToken;
+        return true;
+    }
+
+    std::string connectionToken;
+    if ( !negotiateSignalRConnection( "https://" + in_baseSite + "/pushnotificationshub", in_bearerToken, connectionToken ) )
+    {
+        return false;
+    }
+    out_uri = "wss://" + in_baseSite + "/pushnotificationshub?id=" + connectionToken + "&access_token=" + in_bearerToken;
+    return true;
+}
+
+// Opens the websocket and shares it with the local subscriber processes until Enter is pressed.
+int runGateway( const std::string& in_notificationServerUri, TransportProtocol in_transport,
+    const std::string& in_gatewayName )
+{
+    websocket_endpoint endpoint;
+    int id = endpoint.connect( in_notificationServerUri, in_transport );
+    if ( id == -1 )
+    {
+        return -1;
+    }
+
+#ifdef _WIN32
+    Sleep( 5000 ); // Milliseconds
+#else
+    sleep( 5 ); // Seconds
+#endif
+
+    NotificationGateway gateway( endpoint, id, in_gatewayName );
+    if ( !gateway.start() )
+    {
+        return -1;
+    }
+
+    std::cout << "Press Enter to stop the gateway." << std::endl;
+    std::cin.get();
+    gateway.stop();
+
+    std::cout << "Gateway published " << gateway.getPublishedCount() << " notifications ("
+        << gateway.getOversizedCount() << " too large), executed "
+        << gateway.getCommandCount() << " commands (" << gateway.getBadCommandCount() << " corrupt skipped)." << std::endl;
+    return 0;
+}
+
+// Receives for 30 seconds the keyframes of the flows of a file of "<node>,<flow>" lines, written to a folder if one
+// is given.
+int runKeyframes( const std::string& in_notificationServerUri, TransportProtocol in_transport,
+    const std::string& in_flowsFile, const std::string& in_folder )
+{
+    std::ifstream file( in_flowsFile.c_str() );
+    if ( !file )
+    {
+        std::cout << "Could not open " << in_flowsFile << "." << std::endl;
+        return -1;
+    }
+
+    websocket_endpoint endpoint;
+    int id = endpoint.connect( in_notificationServerUri, in_transport );
+    if ( id == -1 )
+    {
+        return -1;
+    }
+
+#ifdef _WIN32
+    Sleep( 5000 ); // Milliseconds
+#else
+    sleep( 5 ); // Seconds
+#endif
+
+    RenewalScheduler renewals( endpoint );
+    renewals.start();
+
+    KeyframesClient::Options options;
+    options.folder = in_folder;
+    KeyframesClient keyframes( endpoint, id, renewals, options );
+    std::vector<std::string> flowIds;
+    std::string line;
+    while ( std::getline( file, line ) )
+    {
+        size_t comma = line.find( ',' );
+        if ( comma != std::string::npos )
+        {
+            flowIds.push_back( line.substr( comma + 1 ) );
+            keyframes.addFlow( line.substr( 0, comma ), flowIds.back() );
+        }
+    }
+    endpoint.get_dispatcher().setHandler( [&keyframes]( const ReceivedNotificationModel& in_notification )
+    {
+        keyframes.onNotification( in_notification );
+    } );
+    keyframes.start();
+
+#ifdef _WIN32
+    Sleep( 30000 ); // Milliseconds
+#else
+    sleep( 30 ); // Seconds
+#endif
+
+    size_t flowsReceived = 0;
+    for ( size_t i = 0; i < flowIds.size(); ++i )
+    {
+        if ( keyframes.getLatestFrame( flowIds[ i ] ) )
+        {
+            ++flowsReceived;
+        }
+    }
+    keyframes.stop();
+    endpoint.get_dispatcher().setHandler( []( const ReceivedNotificationModel& ) {} );
+
+    KeyframesClient::Stats stats = keyframes.getStats();
+    std::cout << "Keyframes: " << stats.received << " received from " << flowsReceived << " of " << flowIds.size()
+        << " flows, " << stats.ignored << " ignored, " << stats.oversized << " larger than their buffer, "
+        << stats.framesAdded << " buffers added, " << stats.written << " written (" << stats.writeFailures
+        << " failed)" << std::endl;
+    return 0;
+}
+
+// Meters for 30 seconds the sound flows of a file of "<node>,<flow>" lines, read 60 times a second as a meter
+// bridge would.
+int runAudioMeters( const std::string& in_notificationServerUri, TransportProtocol in_transport,
+    const std::string& in_flowsFile )
+{
+    std::ifstream file( in_flowsFile.c_str() );
+    if ( !file )
+    {
+        std::cout << "Could not open " << in_flowsFile << "." << std::endl;
+        return -1;
+    }
+
+    websocket_endpoint endpoint;
+    int id = endpoint.connect( in_notificationServerUri, in_transport );
+    if ( id == -1 )
+    {
+        return -1;
+    }
+
+#ifdef _WIN32
+    Sleep( 5000 ); // Milliseconds
+#else
+    sleep( 5 ); // Seconds
+#endif
+
+    RenewalScheduler renewals( endpoint );
+    renewals.start();
+
+    SoundProbeClient probes( endpoint, id, renewals );
+    std::vector<SoundProbeClient::MeterBufferPtr> meters;
+    std::string line;
+    while ( std::getline( file, line ) )
+    {
+        size_t comma = line.find( ',' );
+        if ( comma != std::string::npos )
+        {
+            meters.push_back( probes.getMeters( probes.addProbe( line.substr( 0, comma ), line.substr( comma + 1 ) ) ) );
+        }
+    }
+    endpoint.get_dispatcher().setHandler( [&probes]( const ReceivedNotificationModel& in_notification )
+    {
+        probes.onNotification( in_notification );
+    } );
+    probes.start();
+
+    // Probes are added to the aggregator on their first update, with the
+    // channel count it carries.
+    const size_t NO_PROBE = std::numeric_limits<size_t>::max();
+    MeterAggregator aggregator;
+    std::vector<size_t> aggregated( meters.size(), NO_PROBE );
+    std::vector<uint64_t> updates( meters.size(), 0 );
+    std::vector<double> updateTimes( meters.size(), 0.0 );
+    std::vector<std::chrono::steady_clock::time_point> receiveTimes( meters.size() );
+
+    SoundProbeClient::Meters latest;
+    uint64_t reads = 0;
+    std::chrono::nanoseconds readTime( 0 );
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() + std::chrono::seconds( 30 );
+    for ( std::chrono::steady_clock::time_point frame = std::chrono::steady_clock::now(); frame < end; frame += std::chrono::milliseconds( 16 ) )
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for ( size_t i = 0; i < meters.size(); ++i )
+        {
+            uint64_t update = meters[ i ]->read( latest );
+            if ( update != updates[ i ] )
+            {
+                // The first update has no previous one to be timed from. Updates
+                // without an updateTime are timed from when they were read, or
+                // the peak hold would never decay.
+                float elapsed = 0.0f;
+                if ( aggregated[ i ] == NO_PROBE )
+                {
+                    aggregated[ i ] = aggregator.addProbe( std::max( latest.rmsCount, latest.peakCount ) );
+                }
+                else if ( latest.updateTimeMs > 0.0 && updateTimes[ i ] > 0.0 )
+                {
+                    elapsed = static_cast<float>( ( latest.updateTimeMs - updateTimes[ i ] ) / 1000.0 );
+                }
+                else
+                {
+                    elapsed = std::chrono::duration<float>( start - receiveTimes[ i ] ).count();
+                }
+                aggregator.update( aggregated[ i ], latest, elapsed );
+                updates[ i ] = update;
+                updateTimes[ i ] = latest.updateTimeMs;
+                receiveTimes[ i ] = start;
+            }
+        }
+        readTime += std::chrono::steady_clock::now() - start;
+        reads += meters.size();
+        std::this_thread::sleep_until( frame + std::chrono::milliseconds( 16 ) );
+    }
+    probes.stop();
+    endpoint.get_dispatcher().setHandler( []( const ReceivedNotificationModel& ) {} );
+
+    for ( size_t i = 0; i < meters.size(); ++i )
+    {
+        uint64_t update = meters[ i ]->read( latest );
+        std::cout << "Probe " << i << ": " << update << " updates";
+        if ( aggregated[ i ] != NO_PROBE && latest.rmsCount > 0 && latest.peakCount > 0 )
+        {
+            float hold[ SoundProbeClient::MAX_CHANNELS ];
+            float window[ SoundProbeClient::MAX_CHANNELS ];
+            aggregator.getPeakHold( aggregated[ i ], hold );
+            aggregator.getRmsLevels( aggregated[ i ], 0, window );
+            std::cout << ", channel 1 rms = " << latest.rms[ 0 ] << ", peak = " << latest.peak[ 0 ]
+                << ", peak hold = " << hold[ 0 ] << ", rms over 3 updates = " << window[ 0 ];
+        }
+        std::cout << std::endl;
+    }
+    SoundProbeClient::Stats stats = probes.getStats();
+    std::cout << "Audio meters: " << stats.received << " received (" << stats.averageDecodeUs << " us each), "
+        << stats.rejected << " rejected, " << stats.droppedChannels << " channels dropped, "
+        << ( reads > 0 ? readTime.count() / reads : 0 ) << " ns per read (aggregation included, "
+        << aggregator.getKernelName() << " kernels)" << std::endl;
+    return 0;
+}
+
+// Receives the notifications of a topic through a local gateway for 30 seconds.
+int runGatewaySubscriber( const std::string& in_gatewayName, const std::string& in_topic )
+{
+    GatewaySubscriber subscriber( in_gatewayName );
+    if ( !subscriber.open() )
+    {
+        return -1;
+    }
+
+    std::cout << ">>>>>>>>>>>>> Subscribing to \"" << in_topic << "\" through gateway \"" << in_gatewayName << "\"" << std::endl;
+    subscriber.subscribe( in_topic );
+
+    ReceivedNotificationModel notification;
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() + std::chrono::seconds( 30 );
+    while ( std::chrono::steady_clock::now() < end )
+    {
+        if ( subscriber.receive( notification, std::chrono::milliseconds( 100 ) ) )
+        {
+            std::cout << "Received notification on \"" << notification.getTopic() << "\":" << std::endl;
+            std::cout << notification.getContent() << std::endl;
+        }
+    }
+
+    std::cout << "Lost notifications: " << subscriber.getLostCount() << std::endl;
+    return 0;
+}
+
+// Receives the notifications of a topic through a long-polled mailbox for 30 seconds.
+int runMailbox( const std::string& in_baseUrl, TokenManager& in_tokenManager, const std::string& in_topic )
+{
+    NotificationDispatcher dispatcher;
+    dispatcher.setHandler( []( const ReceivedNotificationModel& in_notification )
+    {
+        std::cout << "Received notification on \"" << in_notification.getTopic() << "\":" << std::endl;
+        std::cout << in_notification.getContent() << std::endl;
+    } );
+
+    MailboxClient mailbox( dispatcher, in_baseUrl, in_tokenManager );
+    if ( !mailbox.open() )
+    {
+        return -1;
+    }
+
+    std::cout << ">>>>>>>>>>>>> Subscribing to \"" << in_topic << "\" through a mailbox" << std::endl;
+    if ( !mailbox.subscribe( in_topic ) )
+    {
+        return -1;
+    }
+
+    std::this_thread::sleep_for( std::chrono::seconds( 30 ) );
+    mailbox.close();
+
+    MailboxClient::Stats stats = mailbox.getStats();
+    std::cout << "Mailbox: polls = " << stats.polls << " (" << stats.failedPolls << " failed)"
+        << ", received = " << stats.received << ", batch size = " << stats.batchSize
+        << ", avg latency = " << stats.averageLatencyMs << " ms"
+        << ", max latency = " << stats.maxLatencyMs << " ms" << std::endl;
+    return 0;
+}
+
+// Resolves a producer and a consumer of a fabric by name and routes one to the other. The inventory of the fabric
+// follows its notifications, received through a mailbox, while the route is made.
+int runRoute( const std::string& in_baseUrl, TokenManager& in_tokenManager, const std::string& in_fabricId,
+    const std::string& in_source, const std::string& in_destination )
+{
+    RoutingClient routing( in_baseUrl, in_tokenManager, std::chrono::seconds( 60 ) );
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::shared_ptr<const RoutingClient::Fabric> fabric = routing.getFabric( in_fabricId );
+    if ( !fabric )
+    {
+        return -1;
+    }
+    std::cout << "Fabric " << in_fabricId << ": " << fabric->producers->size() << " producers, "
+        << fabric->consumers->size() << " consumers, fetched and indexed in "
+        << std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::steady_clock::now() - start ).count()
+        << " ms" << std::endl;
+
+    RouteTracker tracker( routing );
+    tracker.start();
+
+    NotificationDispatcher dispatcher;
+    dispatcher.setHandler( [&routing, &tracker]( const ReceivedNotificationModel& in_notification )
+    {
+        tracker.onNotification( in_notification );
+        routing.onNotification( in_notification );
+    } );
+    MailboxClient mailbox( dispatcher, in_baseUrl, in_tokenManager );
+    if ( !mailbox.open() || !mailbox.subscribe( FabricInventory::getTopic( in_fabricId ) ) )
+    {
+        std::cout << "The inventory of fabric " << in_fabricId << " will only be revalidated periodically." << std::endl;
+    }
+    if ( !mailbox.subscribe( RouteTracker::getTopic( in_fabricId ) ) )
+    {
+        std::cout << "The route will be confirmed by polling its status." << std::endl;
+    }
+
+    // Every producer resolved once by name, as makeRoute() does for its source.
+    const std::vector<EndpointTable::Endpoint>& producers = fabric->producers->getEndpoints();
+    size_t found = 0;
+    start = std::chrono::steady_clock::now();
+    for ( size_t i = 0; i < producers.size(); ++i )
+    {
+        found += ( fabric->producers->find( producers[ i ].name ) != NULL ) ? 1 : 0;
+    }
+    long long lookupNs = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start ).count();
+    std::cout << found << " producers resolved by name, "
+        << ( producers.empty() ? 0 : lookupNs / static_cast<long long>( producers.size() ) ) << " ns per lookup" << std::endl;
+
+    const EndpointTable::Endpoint* source = fabric->producers->find( in_source );
+    const EndpointTable::Endpoint* destination = fabric->consumers->find( in_destination );
+    if ( source == NULL || destination == NULL )
+    {
+        std::cout << "Unknown " << ( source == NULL ? "producer \"" + in_source : "consumer \"" + in_destination )
+            << "\" in fabric " << in_fabricId << "." << std::endl;
+        return -1;
+    }
+
+    // Tracked before the request: the notification may come before its answer.
+    std::shared_future<RouteTracker::Result> made = tracker.track( source->id, destination->id );
+    std::string requestId;
+    start = std::chrono::steady_clock::now();
+    if ( !routing.makeRoute( in_fabricId, source->id, destination->id, requestId ) )
+    {
+        tracker.fail( source->id, destination->id, "Route request failed" );
+        return -1;
+    }
+    tracker.setRequestId( source->id, destination->id, requestId );
+    std::cout << "Route \"" << in_source << "\" -> \"" << in_destination << "\" requested in "
+        << std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::steady_clock::now() - start ).count()
+        << " ms, request id " << requestId << std::endl;
+
+    const RouteTracker::Result& result = made.get();
+    if ( result.outcome == RouteTracker::ROUTE_MADE )
+    {
+        std::cout << "Route made after " << result.latency.count() / 1000.0 << " ms, confirmed by "
+            << ( result.polled ? "its status" : "its routemade notification" ) << std::endl;
+    }
+    else
+    {
+        std::cout << "Route not made: " << result.error << std::endl;
+    }
+
+    mailbox.close();
+    FabricInventory::Stats stats = routing.getInventory( in_fabricId )->getStats();
+    std::cout << "Inventory: version " << stats.version << ", " << stats.updatesApplied << " updates applied ("
+        << stats.averageUpdateUs << " us each), " << stats.updatesIgnored << " notifications ignored, "
+        << stats.revalidations << " revalidations (" << stats.revalidationChanges << " stale)" << std::endl;
+    return 0;
+}
+
+// Executes a server salvo by name, or the client-side salvo read from a file of "<source>,<destination>" lines,
+// and reports when each route was made.
+int runSalvo( const std::string& in_baseUrl, TokenManager& in_tokenManager, const std::string& in_fabricId,
+    const std::string& in_salvoName, const std::string& in_routesFile )
+{
+    websocket_endpoint endpoint;
+    AsyncRestClient asyncClient( endpoint.get_io_service() );
+    RoutingClient routing( in_baseUrl, in_tokenManager, std::chrono::seconds( 60 ) );
+    RouteTracker tracker( routing );
+    tracker.start();
+    SalvoEngine salvos( asyncClient, routing, tracker, in_baseUrl, in_tokenManager );
+
+    NotificationDispatcher dispatcher;
+    dispatcher.setHandler( [&routing, &tracker]( const ReceivedNotificationModel& in_notification )
+    {
+        tracker.onNotification( in_notification );
+        routing.onNotification( in_notification );
+    } );
+    MailboxClient mailbox( dispatcher, in_baseUrl, in_tokenManager );
+    if ( !mailbox.open() || !mailbox.subscribe( RouteTracker::getTopic( in_fabricId.empty() ? "*" : in_fabricId ) ) )
+    {
+        return -1;
+    }
+
+    if ( !in_salvoName.empty() )
+    {
+        if ( !salvos.refreshSalvos() )
+        {
+            return -1;
+        }
+
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool done = false;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        bool found = salvos.executeSalvo( in_salvoName, [&]( const std::string&, bool in_success )
+        {
+            std::cout << "Executed salvo \"" << in_salvoName << "\" " << ( in_success ? "successfully" : "with errors" ) << " in "
+                << std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::steady_clock::now() - start ).count()
+                << " ms" << std::endl;
+            std::lock_guard<std::mutex> lock( mutex );
+            done = true;
+            condition.notify_one();
+        } );
+        if ( !found )
+        {
+            std::cout << "No salvo named \"" << in_salvoName << "\"." << std::endl;
+            return -1;
+        }
+        std::unique_lock<std::mutex> lock( mutex );
+        condition.wait( lock, [&]()
+        {
+            return done;
+        } );
+    }
+
+    if ( in_routesFile.empty() )
+    {
+        return 0;
+    }
+
+    std::ifstream file( in_routesFile.c_str() );
+    if ( !file )
+    {
+        std::cout << "Could not open " << in_routesFile << "." << std::endl;
+        return -1;
+    }
+    std::vector<std::pair<std::string, std::string> > pairs;
+    std::string line;
+    while ( std::getline( file, line ) )
+    {
+        size_t comma = line.find( ',' );
+        if ( comma != std::string::npos )
+        {
+            pairs.push_back( std::make_pair( line.substr( 0, comma ), line.substr( comma + 1 ) ) );
+        }
+    }
+    if ( !mailbox.subscribe( FabricInventory::getTopic( in_fabricId ) ) )
+    {
+        std::cout << "The inventory of fabric " << in_fabricId << " will only be revalidated periodically." << std::endl;
+    }
+
+    SalvoEngine::RouteSet routeSet;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if ( !salvos.buildRouteSet( in_fabricId, pairs, routeSet ) )
+    {
+        return -1;
+    }
+    std::cout << routeSet.routes.size() << " routes resolved in "
+        << std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::steady_clock::now() - start ).count()
+        << " ms" << std::endl;
+
+    std::shared_ptr<SalvoEngine::Execution> execution = salvos.execute( routeSet );
+    execution->wait( std::chrono::seconds( 30 ) );
+    std::cout << "Salvo of " << execution->getRouteCount() << " routes: " << execution->getMadeCount() << " made, "
+        << execution->getFailedCount() << " failed, last request answered after "
+        << execution->getTimeToLastRequest().count() / 1000.0 << " ms, last route after "
+        << execution->getTimeToLastRoute().count() / 1000.0 << " ms" << std::endl;
+    mailbox.close();
+
+    RouteTracker::Stats stats = tracker.getStats();
+    std::cout << "Routes confirmed: " << stats.madeByNotification << " by notification, " << stats.madeByPoll
+        << " by polling (" << stats.polls << " polls), " << stats.timedOut << " timed out, avg latency = "
+        << stats.averageLatencyMs << " ms, max latency = " << stats.maxLatencyMs << " ms" << std::endl;
+    return 0;
+}
+
+// Lists the macros, then executes the named one if any, then the listed ones concurrently if any.
+int runMacro( const std::string& in_baseUrl, TokenManager& in_tokenManager, const std::string& in_name,
+    const std::vector<std::string>& in_names )
+{
+    websocket_endpoint endpoint;
+    AsyncRestClient asyncClient( endpoint.get_io_service() );
+    MacroClient macros( asyncClient, in_baseUrl, in_tokenManager );
+    if ( !macros.refreshCatalog() )
+    {
+        return -1;
+    }
+
+    std::vector<MacroClient::Macro> catalog = macros.getMacros();
+    std::cout << "Ampp Control has the following macros defined:" << std::endl;
+    for ( size_t i = 0; i < catalog.size(); ++i )
+    {
+        std::cout << "    " << catalog[ i ].name << " (" << catalog[ i ].uuid << ")" << std::endl;
+    }
+
+    if ( !in_name.empty() )
+    {
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool done = false;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        bool found = macros.executeMacroByName( in_name, getUuid(), [&]( const std::string&, bool in_success, const RestClient::Response& )
+        {
+            std::cout << "Executed macro \"" << in_name << "\" " << ( in_success ? "successfully" : "with errors" ) << " in "
+                << std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::steady_clock::now() - start ).count()
+                << " ms" << std::endl;
+            std::lock_guard<std::mutex> lock( mutex );
+            done = true;
+            condition.notify_one();
+        } );
+        if ( !found )
+        {
+            std::cout << "No macro named \"" << in_name << "\"." << std::endl;
+            return -1;
+        }
+        std::unique_lock<std::mutex> lock( mutex );
+        condition.wait( lock, [&]()
+        {
+            return done;
+        } );
+    }
+
+    if ( in_names.empty() )
+    {
+        return 0;
+    }
+
+    // Every name is resolved before any macro is executed.
+    std::vector<std::string> uuids;
+    for ( size_t i = 0; i < in_names.size(); ++i )
+    {
+        MacroClient::Macro macro;
+        if ( !macros.findMacroByName( in_names[ i ], macro ) )
+        {
+            std::cout << "No macro named \"" << in_names[ i ] << "\"." << std::endl;
+            return -1;
+        }
+        uuids.push_back( macro.uuid );
+    }
+    std::shared_ptr<MacroClient::Batch> batch = macros.executeMacros( uuids, getUuid() );
+    batch->wait( std::chrono::seconds( 30 ) );
+    std::cout << "Executed " << uuids.size() << " macros concurrently: " << batch->getSucceededCount() << " succeeded, "
+        << batch->getPendingCount() << " pending after " << batch->getElapsedTime().count() << " ms" << std::endl;
+    return 0;
+}
+
+// Prints the bytes and time spent per REST endpoint since the start.
+void printEndpointStats()
+{
+    std::map<std::string, RestClient::EndpointStats> endpoints = RestClient::getInstance().getEndpointStats();
+    for ( std::map<std::string, RestClient::EndpointStats>::const_iterator it = endpoints.begin(); it != endpoints.end(); ++it )
+    {
+        const RestClient::EndpointStats& stats = it->second;
+        std::cout << it->first << ": " << stats.requests << " requests, " << stats.wireBytes << " bytes received, "
+            << stats.decodedBytes << " decoded";
+        if ( stats.decodedBytes > 0 )
+        {
+            std::cout << " (" << 100 * stats.wireBytes / stats.decodedBytes << "%)";
+        }
+        std::cout << ", " << stats.totalTimeMs << " ms" << std::endl;
+    }
+}
+
+// Repeats the applications request sequentially, then concurrently, and prints the REST client statistics.
+int runRestBenchmark( const std::string& in_baseUrl, TokenManager& in_tokenManager, int in_count )
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for ( int i = 0; i < in_count; ++i )
+    {
+        std::string applicationInfo;
+        if ( !getAmppControlApplications( in_baseUrl, in_tokenManager, applicationInfo ) )
+        {
+            return -1;
+        }
+    }
+
+    RestClient::Stats stats = RestClient::getInstance().getStats();
+    std::cout << "REST calls = " << stats.calls << ", new connections = " << stats.newConnections
+        << ", avg time = " << stats.averageTimeMs << " ms"
+        << ", token requests = " << in_tokenManager.getRefreshCount()
+        << ", wall time = " << std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start ).count() << " ms" << std::endl;
+
+    // The same requests, all in flight at once on the io thread of a websocket endpoint.
+    websocket_endpoint endpoint;
+    AsyncRestClient asyncClient( endpoint.get_io_service() );
+
+    RestClient::Request request;
+    request.url = in_baseUrl + "/ampp/control/api/v1/control/application/references";
+    request.headers.push_back( "Accept: application/json" );
+    request.headers.push_back( "Authorization: Bearer " + in_tokenManager.getBearerToken() );
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    int completed = 0;
+    int succeeded = 0;
+    int newConnections = 0;
+    start = std::chrono::steady_clock::now();
+    for ( int i = 0; i < in_count; ++i )
+    {
+        asyncClient.perform( request, [&]( const RestClient::Response& in_response )
+        {
+            std::lock_guard<std::mutex> lock( mutex );
+            succeeded += ( in_response.httpCode >= 200 && in_response.httpCode <= 299 ) ? 1 : 0;
+            newConnections += in_response.newConnection ? 1 : 0;
+            ++completed;
+            condition.notify_one();
+        } );
+    }
+
+    std::unique_lock<std::mutex> lock( mutex );
+    condition.wait( lock, [&]()
+    {
+        return completed == in_count;
+    } );
+    std::cout << "Async REST calls = " << completed << " (" << succeeded << " succeeded)"
+        << ", new connections = " << newConnections
+        << ", wall time = " << std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start ).count() << " ms" << std::endl;
+    printEndpointStats();
+    return 0;
+}
+
+// Times the encoding of an outgoing PublishNotification and the decoding of an
+// incoming notification with each transport, without any network involved.
+int runTransportBenchmark()
+{
+    const int iterations = 100000;
+    const std::string content = "{ \"Key\" : \"TestApplication\", \"Payload\" : {\"Index\": 1,\"Level\": 33} }";
+
+    PublishNotification notif;
+    notif.setRequestId( getUuid() );
+    notif.setHubName( "" );
+    notif.setHubMethod( RpcRequest::HubMethod::PUBLISH_NOTIFICATION );
+    notif.setId( getUuid() );
+    notif.setTime( getCurrentTimeString() );
+    notif.setTopic( "gv.ampp.control.620a89fc-ace8-441b-a423-733b54aec299.channelstate" );
+    notif.setSource( "TestApplication" );
+    notif.setTtl( 30000 );
+    notif.setContent( content );
+    notif.setContentType( "application/json" );
+    notif.setContentLength( static_cast<uint16_t>( content.size() ) );
+    const std::string request = notif.toJson().dump();
+
+    json received;
+    received[ "Account" ] = "";
+    received[ "Id" ] = getUuid();
+    received[ "Time" ] = getCurrentTimeString();
+    received[ "Topic" ] = "gv.ampp.control.620a89fc-ace8-441b-a423-733b54aec299.channelstate.notify";
+    received[ "Source" ] = "AudioMixer";
+    received[ "Content" ] = content;
+    received[ "TTL" ] = 30000;
+
+    json packet;
+    packet[ "PacketType" ] = "RpcRequest";
+    packet[ "Payload" ][ "HubMethod" ] = "ReceiveNotification";
+    packet[ "Payload" ][ "Arguments" ] = json::array( { received } );
+
+    SignalRMessage invocation;
+    invocation.type = SignalRMessage::INVOCATION;
+    invocation.target = "ReceiveNotification";
+    invocation.arguments = json::array( { received } );
+
+    const char* names[] = { "bson-rpc", "json-rpc", "signalr-json", "signalr-messagepack" };
+    for ( int transport = TRANSPORT_BSON_RPC; transport <= TRANSPORT_SIGNALR_MESSAGEPACK; ++transport )
+    {
+        SignalRHubProtocol signalr( transport == TRANSPORT_SIGNALR_JSON ? SignalRHubProtocol::JSON : SignalRHubProtocol::MESSAGEPACK );
+
+        // Incoming message as it would arrive on the websocket.
+        std::string wire;
+        if ( transport == TRANSPORT_BSON_RPC )
+        {
+            std::vector<std::uint8_t> bson = json::to_bson( packet );
+            wire.assign( bson.begin(), bson.end() );
+        }
+        else if ( transport == TRANSPORT_JSON_RPC )
+        {
+            wire = packet.dump();
+        }
+        else
+        {
+            signalr.encode( invocation, wire );
+        }
+
+        size_t sentBytes = 0;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for ( int i = 0; i < iterations; ++i )
+        {
+            if ( transport == TRANSPORT_BSON_RPC )
+            {
+                sentBytes = json::to_bson( json::parse( request ) ).size();
+            }
+            else if ( transport == TRANSPORT_JSON_RPC )
+            {
+                sentBytes = request.size();
+            }
+            else
+            {
+                std::string frame;
+                signalr.encode( SignalRMessage::fromRpcPacket( json::parse( request ) ), frame );
+                sentBytes = frame.size();
+            }
+        }
+        std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+
+        size_t decoded = 0;
+        for ( int i = 0; i < iterations; ++i )
+        {
+            ReceivedNotificationModel notification;
+            if ( transport == TRANSPORT_BSON_RPC || transport == TRANSPORT_JSON_RPC )
+            {
+                json j = ( transport == TRANSPORT_BSON_RPC ) ? json::from_bson( wire.begin(), wire.end() ) : json::parse( wire );
+                decoded += notification.setFromJson( j[ "Payload" ][ "Arguments" ][ 0 ] );
+            }
+            else
+            {
+                std::vector<SignalRMessage> messages;
+                signalr.decode( wire, messages );
+                decoded += !messages.empty() && notification.setFromJson( messages[ 0 ].arguments[ 0 ] );
+            }
+        }
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+        std::cout << names[ transport ] << ": send = "
+            << std::chrono::duration_cast<std::chrono::nanoseconds>( middle - start ).count() / iterations << " ns, "
+            << sentBytes << " bytes; receive = "
+            << std::chrono::duration_cast<std::chrono::nanoseconds>( end - middle ).count() / iterations << " ns, "
+            << wire.size() << " bytes" << ( decoded == iterations ? "" : " (decode errors)" ) << std::endl;
+    }
+    return 0;
+}
+
+// Times the aggregation of the meters of 200 probes of 64 channels with the
+// scalar kernels and the vectorized ones of the host, without any network involved.
+int runMeterBenchmark()
+{
+    const size_t probeCount = 200;
+    const int rounds = 2000;
+
+    // Levels as a 4 Hz update would bring them, some missing.
+    std::vector<SoundProbeClient::Meters> updates( 64 );
+    for ( size_t u = 0; u < updates.size(); ++u )
+    {
+        updates[ u ].updateTimeMs = 250.0 * u;
+        updates[ u ].rmsCount = SoundProbeClient::MAX_CHANNELS;
+        updates[ u ].peakCount = SoundProbeClient::MAX_CHANNELS;
+        for ( size_t i = 0; i < SoundProbeClient::MAX_CHANNELS; ++i )
+        {
+            updates[ u ].rms[ i ] = -90.0f + static_cast<float>( ( u * 37 + i * 11 ) % 90 );
+            updates[ u ].peak[ i ] = updates[ u ].rms[ i ] + static_cast<float>( ( u + i ) % 12 );
+        }
+        updates[ u ].rms[ u ] = std::numeric_limits<float>::quiet_NaN();
+    }
+
+    const MeterKernels* kernels[] = { &getScalarMeterKernels(), &getBestMeterKernels() };
+    MeterAggregator scalar( MeterAggregator::Options(), *kernels[ 0 ] );
+    MeterAggregator best( MeterAggregator::Options(), *kernels[ 1 ] );
+    MeterAggregator* aggregators[] = { &scalar, &best };
+    for ( int k = 0; k < 2; ++k )
+    {
+        for ( size_t p = 0; p < probeCount; ++p )
+        {
+            aggregators[ k ]->addProbe( SoundProbeClient::MAX_CHANNELS );
+        }
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for ( int r = 0; r < rounds; ++r )
+        {
+            for ( size_t p = 0; p < probeCount; ++p )
+            {
+                aggregators[ k ]->update( p, updates[ ( p + r ) % updates.size() ], 0.25f );
+            }
+        }
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+        std::cout << aggregators[ k ]->getKernelName() << ": "
+            << std::chrono::duration_cast<std::chrono::nanoseconds>( end - start ).count() / rounds / 1000.0
+            << " us per update of all probes, state = " << aggregators[ k ]->getStateBytes() / 1024 << " KB, history = "
+            << aggregators[ k ]->getHistoryBytes() / 1024 << " KB" << std::endl;
+    }
+
+    // The vectorized kernels approximate the scalar ones.
+    float difference = 0.0f;
+    for ( size_t p = 0; p < probeCount; ++p )
+    {
+        float levels[ 2 ][ SoundProbeClient::MAX_CHANNELS ];
+        for ( int k = 0; k < 2; ++k )
+        {
+            aggregators[ k ]->getRmsLevels( p, 1, levels[ k ] );
+        }
+        for ( size_t i = 0; i < SoundProbeClient::MAX_CHANNELS; ++i )
+        {
+            difference = std::max( difference, std::fabs( levels[ 0 ][ i ] - levels[ 1 ][ i ] ) );
+        }
+    }
+    std::cout << "Largest difference of the RMS levels: " << difference << " dB" << std::endl;
+    return 0;
+}
+
+
 int main( int argc, char* argv[] )
 {
+    if ( argc >= 4 && std::string( argv[ 1 ] ) == "--subscriber" )
+    {
+        return runGatewaySubscriber( argv[ 2 ], argv[ 3 ] );
+    }
+    if ( argc >= 2 && std::string( argv[ 1 ] ) == "--benchmark-transports" )
+    {
+        return runTransportBenchmark();
+    }
+    if ( argc >= 2 && std::string( argv[ 1 ] ) == "--benchmark-meters" )
+    {
+        return runMeterBenchmark();
+    }
+
+    // Moving a fader emits one channelstate notification per step. Slow consumers
+    // only need the newest level of each channel, so these notifications go
+    // through a latest-value-wins queue keyed by channel index.
+    // Declared before the endpoint so it outlives the dispatcher threads pushing to it.
+    ConflatingQueue channelStates( "payload.Index" );
+
+    // Declared before the endpoint so it outlives the asynchronous requests.
+    HttpCache httpCache;
+
     client c;
     websocket_endpoint endpoint;
     websocketpp::lib::error_code ec;
@@ -71,23 +1002,132 @@ int main( int argc, char* argv[] )
     }
     else
     {
-        std::cout << "Usage: AmppControlSample <baseSite> <api_key>" << std::endl;
+        std::cout << "Usage: AmppControlSample <baseSite> <api_key> [--transport <name>] [--gateway <name>]"
+            << " [--mailbox <topic>] [--benchmark-rest <count>] [--cache <file>] [--macro <name>]"
+            << " [--macros <name>,<name>...]"
+            << " [--fabric <id> --source <producer> --destination <consumer>]"
+            << " [--salvo <name>] [--fabric <id> --routes <file>] [--keyframes <file> [--folder <path>]]"
+            << " [--audiometer <file>] [--uuid <4|7>]" << std::endl;
+        std::cout << "       AmppControlSample --subscriber <name> <topic>" << std::endl;
+        std::cout << "       AmppControlSample --benchmark-transports" << std::endl;
+        std::cout << "       AmppControlSample --benchmark-meters" << std::endl;
         std::cout << "Ex: ./AmppControlSample \"xxx.yyy.grassvalley.com\" " <<
             "\"NWVkYjE4ZjM3OTA3NDUzYzgzZjY0MmYzOWU5MTMwZDA6bU...\"" << std::endl;
         return -1;
     }
 
+    std::string gatewayName;
+    std::string mailboxTopic;
+    std::string macroName;
+    std::vector<std::string> macroNames;
+    std::string fabricId;
+    std::string routeSource;
+    std::string routeDestination;
+    std::string salvoName;
+    std::string routesFile;
+    std::string flowsFile;
+    std::string keyframesFolder;
+    std::string audioFlowsFile;
+    int restBenchmarkCount = 0;
+    TransportProtocol transport = DEFAULT_TRANSPORT;
+    for ( int i = 3; i + 1 < argc; i += 2 )
+    {
+        std::string option = argv[ i ];
+        if ( option == "--gateway" )
+        {
+            gatewayName = argv[ i + 1 ];
+        }
+        else if ( option == "--mailbox" )
+        {
+            mailboxTopic = argv[ i + 1 ];
+        }
+        else if ( option == "--benchmark-rest" )
+        {
+            restBenchmarkCount = atoi( argv[ i + 1 ] );
+        }
+        else if ( option == "--macro" )
+        {
+            macroName = argv[ i + 1 ];
+        }
+        else if ( option == "--macros" )
+        {
+            std::istringstream names( argv[ i + 1 ] );
+            std::string name;
+            while ( std::getline( names, name, ',' ) )
+            {
+                if ( !name.empty() )
+                {
+                    macroNames.push_back( name );
+                }
+            }
+        }
+        else if ( option == "--fabric" )
+        {
+            fabricId = argv[ i + 1 ];
+        }
+        else if ( option == "--source" )
+        {
+            routeSource = argv[ i + 1 ];
+        }
+        else if ( option == "--destination" )
+        {
+            routeDestination = argv[ i + 1 ];
+        }
+        else if ( option == "--salvo" )
+        {
+            salvoName = argv[ i + 1 ];
+        }
+        else if ( option == "--routes" )
+        {
+            routesFile = argv[ i + 1 ];
+        }
+        else if ( option == "--keyframes" )
+        {
+            flowsFile = argv[ i + 1 ];
+        }
+        else if ( option == "--audiometer" )
+        {
+            audioFlowsFile = argv[ i + 1 ];
+        }
+        else if ( option == "--folder" )
+        {
+            keyframesFolder = argv[ i + 1 ];
+        }
+        else if ( option == "--uuid" )
+        {
+            if ( !setUuidVersion( atoi( argv[ i + 1 ] ) ) )
+            {
+                std::cout << "Invalid option: " << option << " " << argv[ i + 1 ] << std::endl;
+                return -1;
+            }
+        }
+        else if ( option == "--cache" )
+        {
+            if ( !httpCache.open( argv[ i + 1 ] ) )
+            {
+                return -1;
+            }
+            RestClient::getInstance().setCache( &httpCache );
+        }
+        else if ( option != "--transport" || !getTransportProtocol( argv[ i + 1 ], transport ) )
+        {
+            std::cout << "Invalid option: " << option << " " << argv[ i + 1 ] << std::endl;
+            return -1;
+        }
+    }
+
     //********************************************************************************
     //********************************************************************************
     // 1) Request a bearer token through a REST API call using the provided API_KEY.
     //********************************************************************************
     //********************************************************************************
-    bool tokenResult = false;
-    unsigned int expiresIn = 0;
-    std::string bearer_token;
-    std::string baseNotificationServerUri = "wss://" + baseSite + "/pushnotifications-ws";
-
-    tokenResult = getToken( baseUrl, credentials, bearer_token, expiresIn );
+    // The token manager caches the token and refreshes it in the background
+    // before it expires; the REST calls below all reuse it.
+    TokenManager tokenManager( baseUrl, credentials );
+    bool tokenResult = tokenManager.start();
+    std::shared_ptr<const TokenManager::Token> token = tokenManager.getToken();
+    std::string bearer_token = token ? token->value : "";
+    unsigned int expiresIn = token ? token->expiresIn : 0;
 
     std::cout << "*******************************************" << std::endl;
     std::cout << "Current time is: " << getCurrentTimeString() << std::endl;
@@ -97,6 +1137,53 @@ int main( int argc, char* argv[] )
     std::cout << "expiresIn = " << expiresIn << std::endl;
     std::cout << "*******************************************" << std::endl;
 
+    if ( restBenchmarkCount > 0 )
+    {
+        return runRestBenchmark( baseUrl, tokenManager, restBenchmarkCount );
+    }
+
+    if ( !mailboxTopic.empty() )
+    {
+        return runMailbox( baseUrl, tokenManager, mailboxTopic );
+    }
+
+    if ( !macroName.empty() || !macroNames.empty() )
+    {
+        return runMacro( baseUrl, tokenManager, macroName, macroNames );
+    }
+
+    if ( !salvoName.empty() || !routesFile.empty() )
+    {
+        return runSalvo( baseUrl, tokenManager, fabricId, salvoName, routesFile );
+    }
+
+    if ( !fabricId.empty() )
+    {
+        return runRoute( baseUrl, tokenManager, fabricId, routeSource, routeDestination );
+    }
+
+    std::string notificationServerUri;
+    if ( !getNotificationServerUri( baseSite, bearer_token, transport, notificationServerUri ) )
+    {
+        std::cout << "Could not negotiate a SignalR connection." << std::endl;
+        return -1;
+    }
+
+    if ( !gatewayName.empty() )
+    {
+        return runGateway( notificationServerUri, transport, gatewayName );
+    }
+
+    if ( !flowsFile.empty() )
+    {
+        return runKeyframes( notificationServerUri, transport, flowsFile, keyframesFolder );
+    }
+
+    if ( !audioFlowsFile.empty() )
+    {
+        return runAudioMeters( notificationServerUri, transport, audioFlowsFile );
+    }
+
 
     //********************************************************************************
     //********************************************************************************
@@ -106,25 +1193,38 @@ int main( int argc, char* argv[] )
     std::string targetApp = "AudioMixer";
     std::string targetAppWorkload;
 
-
-    bool applicationsResult = false;
-    std::string applicationInfo;
-    applicationsResult = getAmppControlApplications( baseUrl, credentials, applicationInfo );
-    json applicationsJson = json::parse( applicationInfo );
+    // The workloads of all the applications are requested concurrently, on the
+    // io thread of the endpoint, and indexed both ways.
+    AsyncRestClient asyncClient( endpoint.get_io_service() );
+    FleetDiscovery discovery( asyncClient, baseUrl, tokenManager );
+    bool applicationsResult = discovery.discover();
+    FleetDiscovery::Stats discoveryStats = discovery.getStats();
     std::cout << "applicationsResult = " << applicationsResult << std::endl;
-    std::cout << "applications size = " << applicationsJson.size() << std::endl;
-    // Cycle through the array of application object to see if our app is found
-    bool foundApp = false;
-    for ( auto it = applicationsJson.begin(); it != applicationsJson.end() && !foundApp; ++it )
+    std::cout << "applications size = " << discoveryStats.applications << std::endl;
+    std::cout << "workloads size = " << discoveryStats.workloads
+        << " (" << discoveryStats.failedApplications << " applications failed)" << std::endl;
+    std::cout << "discovery wall time = " << discoveryStats.wallTimeMs << " ms" << std::endl;
+    if ( RestClient::getInstance().getCache() )
     {
-        if ( it.value()[ "name" ] == targetApp )
-        {
-            foundApp = true;
-            break;
-        }
+        HttpCache::Stats cacheStats = httpCache.getStats();
+        std::cout << "cache: " << cacheStats.revalidated << " not modified (" << cacheStats.savedBytes
+            << " bytes not downloaded), " << cacheStats.stored << " stored, " << cacheStats.entries
+            << " entries" << std::endl;
     }
+    printEndpointStats();
+
+    const std::vector<std::string>* workloads = discovery.getWorkloads( targetApp );
+    bool foundApp = ( workloads != NULL );
 
     std::cout << targetApp << ( foundApp ? " was found." : " was not found." ) << std::endl;
+
+    // The command schemas of the application are fetched and compiled once, so
+    // the payloads sent below are checked locally first.
+    SchemaCache schemaCache( baseUrl, tokenManager );
+    if ( foundApp && !schemaCache.load( targetApp ) )
+    {
+        std::cout << "Could not retrieve the command schemas of " << targetApp << "." << std::endl;
+    }
     std::cout << "*******************************************" << std::endl;
 
 
@@ -133,24 +1233,13 @@ int main( int argc, char* argv[] )
     // 3) For a specific application, request the list of all its workload IDs (instances), running or not.
     //********************************************************************************
     //********************************************************************************
-    json workloadsJson;
-    if ( foundApp )
+    if ( foundApp && !workloads->empty() )
     {
-        bool workloadsResult = false;
-        std::string workloadsInfo;
-        // The following call will return an array of workload IDs for the specified app.
-        workloadsResult = getAmppControlWorkloads( baseUrl, credentials, targetApp, workloadsInfo );
-
-        // workloadsInfo is a string of format: "[ "xxx-yyy-zzz", "aaa-bbb-ccc", ... ]".
-        // In order for json::parse() to accept this string, we must inclose it in curly brackets {}
-        // and add a key to make it a legitimate JSON string
-        workloadsJson = json::parse( "{ \"workloads\" : " + workloadsInfo + "}" );
-        std::cout << "workloadsResult = " << workloadsResult << std::endl;
-        std::cout << "workloads array size = " << workloadsJson[ "workloads" ].size() << std::endl;
+        std::cout << "workloads array size = " << workloads->size() << std::endl;
 
         // For our example, we will simply take the first one. In real life, it is most probable that
         // the user will already know the workload id for his/her target application.
-        targetAppWorkload = workloadsJson[ "workloads" ][ 0 ];
+        targetAppWorkload = workloads->front();
         std::cout << "Workload for app \"" << targetApp << "\" is " << targetAppWorkload << std::endl;
         std::cout << "*******************************************" << std::endl;
 
@@ -159,15 +1248,50 @@ int main( int argc, char* argv[] )
     // Force a workload that we know is running.
     targetAppWorkload = "620a89fc-ace8-441b-a423-733b54aec299"; // AudioMixer
     // Check if it is in the list we just got (optional)
-    for ( int i = 0; i < workloadsJson[ "workloads" ].size(); ++i )
+    const std::string* workloadApp = discovery.getApplication( targetAppWorkload );
+    if ( workloadApp && *workloadApp == targetApp )
     {
-        if ( targetAppWorkload == workloadsJson[ "workloads" ][ i ] )
-        {
-            std::cout << "---- FOUND RUNNING WORKLOAD IN LIST ----" << std::endl;
-        }
+        std::cout << "---- FOUND RUNNING WORKLOAD IN LIST ----" << std::endl;
     }
     std::cout << "*******************************************" << std::endl;
 
+    endpoint.get_dispatcher().setHandler( [&channelStates]( const ReceivedNotificationModel& in_notification )
+    {
+        const std::string& topic = in_notification.getTopic();
+        const std::string suffix = ".channelstate.notify";
+        if ( topic.size() > suffix.size() && topic.compare( topic.size() - suffix.size(), suffix.size(), suffix ) == 0 )
+        {
+            channelStates.push( in_notification );
+            return;
+        }
+        std::cout << "Received notification on \"" << topic << "\":" << std::endl;
+        std::cout << in_notification.getContent() << std::endl;
+    } );
+
+    std::thread channelStateConsumer( [&channelStates]()
+    {
+        ReceivedNotificationModel notification;
+        uint64_t dropped = 0;
+        while ( !channelStates.isClosed() || channelStates.size() > 0 )
+        {
+            if ( channelStates.pop( notification, dropped ) )
+            {
+                // Read straight into the generated struct, without building a JSON document.
+                AudioMixerChannelState channelState;
+                if ( channelState.decodeContent( notification.getContent() ) && channelState.hasIndex() )
+                {
+                    std::cout << "Channel " << channelState.index << " state (" << dropped << " older updates dropped): level = "
+                        << channelState.level << ", mute = " << channelState.mute << ", label = " << channelState.label << std::endl;
+                }
+                else
+                {
+                    std::cout << "Channel state (" << dropped << " older updates dropped): "
+                        << notification.getContent() << std::endl;
+                }
+            }
+        }
+    } );
+
     try
     {
         //********************************************************************************
@@ -180,8 +1304,7 @@ int main( int argc, char* argv[] )
         //    - Any number of connections can be created, used and closed independently.
         //    - The endpoint keeps a list of all its connections and refers to them by their
         //      id (simple index int) returned by the .connect() method.
-        std::string uri = baseNotificationServerUri + "?access_token=" + bearer_token;
-        int id = endpoint.connect( uri );
+        int id = endpoint.connect( notificationServerUri, transport );
         if ( id != -1 )
         {
             std::cout << "> Created connection with id " << id << std::endl;
@@ -241,12 +1364,35 @@ int main( int argc, char* argv[] )
         // - Since we have previously sent the .getstate command, we will receive a RpcRequest ("ReceiveNotification")
         //   for this state change.
         //
-        std::string channelStatePayload = "{ \"Key\" : \"TestApplication\", \"Payload\" : {\"Index\": 1,\"Level\": 33} }";
+        // The payload struct is generated from schemas/AudioMixer.channelstate.json; only the members set are sent.
+        AudioMixerChannelState channelState;
+        channelState.setIndex( 1 );
+        channelState.setLevel( 33 );
+        std::string channelStatePayload;
+        channelState.encodeContent( "TestApplication", channelStatePayload );
 
         std::string channelStateCommand = "gv.ampp.control." + targetAppWorkload + ".channelstate";
-        std::cout << std::endl << ">>>>>>>>>>>>> Sending command \"" << channelStateCommand << "\" with payload \""
-            << channelStatePayload << "\"" << std::endl << std::endl;
-        pushNotificationServerSendNotification( endpoint, id, getUuid(), channelStateCommand, channelStatePayload );
+        std::shared_ptr<const PayloadValidator> channelStateValidator =
+            schemaCache.getValidator( targetApp, "channelstate", targetAppWorkload );
+        std::string validationError;
+        bool validPayload = true;
+        if ( channelStateValidator )
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            validPayload = channelStateValidator->validateContent( channelStatePayload, validationError );
+            std::cout << "channelstate payload validated in " << std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start ).count() << " ns" << std::endl;
+        }
+        if ( !validPayload )
+        {
+            std::cout << "Not sending command \"" << channelStateCommand << "\": " << validationError << std::endl;
+        }
+        else
+        {
+            std::cout << std::endl << ">>>>>>>>>>>>> Sending command \"" << channelStateCommand << "\" with payload \""
+                << channelStatePayload << "\"" << std::endl << std::endl;
+            pushNotificationServerSendNotification( endpoint, id, getUuid(), channelStateCommand, channelStatePayload );
+        }
 
         // Wait a little, maybe try to modify a control in the online app itself and see if we get a notification...
 #ifdef _WIN32
@@ -255,6 +1401,18 @@ int main( int argc, char* argv[] )
         sleep( 30 ); // Seconds
 #endif
 
+        // Notification handlers run on the endpoint's dispatcher, one ordered lane per workload.
+        std::vector<NotificationDispatcher::LaneStats> laneStats = endpoint.get_dispatcher().getLaneStats();
+        for ( size_t i = 0; i < laneStats.size(); ++i )
+        {
+            std::cout << "Lane " << laneStats[ i ].key << ": processed = " << laneStats[ i ].processed
+                << ", queue depth = " << laneStats[ i ].queueDepth << " (max " << laneStats[ i ].maxQueueDepth << ")"
+                << ", avg queue delay = " << laneStats[ i ].averageQueueDelayUs << " us"
+                << ", avg handler = " << laneStats[ i ].averageHandlerUs << " us"
+                << ", max handler = " << laneStats[ i ].maxHandlerUs << " us" << std::endl;
+        }
+        std::cout << "*******************************************" << std::endl;
+
         // Note:
         //    No need to call close as the destructor will close
         //    the connection for us. If we call the .close() first,
@@ -270,4 +1428,9 @@ int main( int argc, char* argv[] )
     {
         std::cout << e.what() << std::endl;
     }
+
+    channelStates.close();
+    channelStateConsumer.join();
+    std::cout << "Channel states: pushed = " << channelStates.getPushedCount()
+        << ", dropped = " << channelStates.getDroppedCount() << std::endl;
 }
@@ -2,166 +2,183 @@
 // Copyright Grass Valley
 //
 
-#include "BearerToken.h"
+#include "AmppControlUtil.h"
+#include "RestClient.h"
 
-#include <curl/curl.h>
 #include <iostream>
 #include <string>
 
 using namespace std;
 
+const char* const APPLICATIONS_ENDPOINT = "/ampp/control/api/v1/control/application/references";
+const char* const WORKLOADS_ENDPOINT = "/ampp/control/api/v1/control/application/{name}/workloads";
+const char* const MACROS_ENDPOINT = "/ampp/control/api/v1/macro";
+const char* const SCHEMAVERSIONS_ENDPOINT = "/ampp/control/api/v1/control/application/{name}/schemaversions";
+const char* const PRODUCERS_ENDPOINT = "/cluster/matrix/api/v2/producers";
+const char* const CONSUMERS_ENDPOINT = "/cluster/matrix/api/v1/consumers";
+const char* const SALVOS_ENDPOINT = "/cluster/matrix/api/v1/salvos";
+
 namespace
 {
-    size_t writeFunction( void* ptr, size_t size, size_t nmemb, std::string* data )
+    // GET request on the AMPP Control API, authorized with a bearer token.
+    // With in_onBody, the body is passed to it and out_response is left empty.
+    bool getAmppControlResource( const UString& in_url, const UString& in_endpoint, const UString& in_bearerToken,
+        const char* in_description, const RestClient::BodyHandler& in_onBody, UString& out_response )
     {
-        data->append( ( char* ) ptr, size * nmemb );
-        return size * nmemb;
-    }
-}
-
+        RestClient::Request request;
+        request.url = in_url;
+        request.endpoint = in_endpoint;
+        request.onBody = in_onBody;
+        request.headers.push_back( "Content-Type: application/json" );
+        request.headers.push_back( "Accept: application/json" );
+        request.headers.push_back( "Authorization: Bearer " + in_bearerToken );
+
+        RestClient::Response response;
+        if ( !RestClient::getInstance().perform( request, response ) )
+        {
+            std::cout << in_description << " error: " << response.error << std::endl;
+            return false;
+        }
 
-// Refer to: https://{platform}/ampp/control/swagger/index.html
-bool getAmppControlApplications( const UString& in_baseUrl, const UString& in_credentials, UString& out_applications )
-{
-    bool result = false;
+        std::cout << in_description << ": " << response.totalTimeMs << " ms, "
+            << response.wireBytes << " bytes received, " << response.decodedBytes << " decoded"
+            << ( response.newConnection ? " (new connection)" : "" )
+            << ( response.fromCache ? " (not modified)" : "" ) << std::endl;
 
-    unsigned int expiresIn = 0;
-    std::string bearer_token;
+        if ( response.httpCode >= 200 && response.httpCode <= 299 )
+        {
+            out_response.swap( response.body );
+            return true;
+        }
 
-    if ( !getToken( in_baseUrl, in_credentials, bearer_token, expiresIn ) )
-    {
-        std::cout << "Could not retrieve bearer token." << std::endl;
+        std::cout << in_description << " error. Returned http code: " << response.httpCode << std::endl;
         return false;
     }
 
-    curl_global_init( CURL_GLOBAL_DEFAULT );
-    auto curl = curl_easy_init();
-    if ( curl )
+    // GET request of a JSON array, parsed as it is received. With in_key, the
+    // array is that member of the object received.
+    bool streamAmppControlArray( const UString& in_url, const UString& in_endpoint, TokenManager& in_tokenManager,
+        const char* in_description, const JsonArrayStream::ElementCallback& in_callback, const std::string& in_key = "" )
     {
-        std::string fullUrl = in_baseUrl + "/ampp/control/api/v1/control/application/references";
-        std::string response_string;
-        std::string header_string;
-
-        /* ask libcurl to show us the verbose output */
-        //curl_easy_setopt( curl, CURLOPT_VERBOSE, 1L );
-
-        curl_easy_setopt( curl, CURLOPT_URL, fullUrl.c_str() );
-        curl_easy_setopt( curl, CURLOPT_HTTPGET, 1 );
-        curl_easy_setopt( curl, CURLOPT_TCP_KEEPALIVE, 10L );
-        curl_easy_setopt( curl, CURLOPT_WRITEFUNCTION, writeFunction );
-        curl_easy_setopt( curl, CURLOPT_WRITEDATA, &response_string );
-        curl_easy_setopt( curl, CURLOPT_HEADERDATA, &header_string );
-        curl_easy_setopt( curl, CURLOPT_USERAGENT, "AmppNativeApi" );
-        //curl_easy_setopt( curl, CURLOPT_XOAUTH2_BEARER, bearer_token.c_str() );
-        //curl_easy_setopt( curl, CURLOPT_HTTPAUTH, CURLAUTH_BEARER );
-
-        std::string bearerHeaderString = "Authorization: Bearer " + bearer_token;
-
-        struct curl_slist* headers = NULL;
-        headers = curl_slist_append( headers, "Content-Type: application/json" );
-        headers = curl_slist_append( headers, "Accept: application/json" );
-        headers = curl_slist_append( headers, bearerHeaderString.c_str() );
-
-        curl_easy_setopt( curl, CURLOPT_HTTPHEADER, headers );
+        std::string bearer_token = in_tokenManager.getBearerToken();
+        if ( bearer_token.empty() )
+        {
+            std::cout << "Could not retrieve bearer token." << std::endl;
+            return false;
+        }
 
-        curl_easy_perform( curl );
+        JsonArrayStream stream( in_callback, in_key );
+        std::string unused;
+        if ( !getAmppControlResource( in_url, in_endpoint, bearer_token, in_description, [&stream]( const char* in_data, size_t in_length )
+        {
+            return stream.feed( in_data, in_length );
+        }, unused ) )
+        {
+            return false;
+        }
 
-        long httpCode = 999;
-        int ret = curl_easy_getinfo( curl, CURLINFO_RESPONSE_CODE, &httpCode );
-        if ( !ret )
+        if ( !stream.isComplete() )
         {
-            if ( httpCode >= 200 && httpCode <= 299 )
-            {
-                out_applications = response_string;
-                result = true;
-            }
-            else
-            {
-                std::cout << "Get Ampp Applications error. Returned http code: " << httpCode << std::endl;
-            }
+            std::cout << in_description << " error: invalid JSON array received." << std::endl;
+            return false;
         }
+        return true;
+    }
+}
 
-        curl_easy_cleanup( curl );
-        curl_global_cleanup();
-        curl_slist_free_all( headers );
-        curl = NULL;
+
+// Refer to: https://{platform}/ampp/control/swagger/index.html
+bool getAmppControlApplications( const UString& in_baseUrl, TokenManager& in_tokenManager, UString& out_applications )
+{
+    std::string bearer_token = in_tokenManager.getBearerToken();
+    if ( bearer_token.empty() )
+    {
+        std::cout << "Could not retrieve bearer token." << std::endl;
+        return false;
     }
 
-    return result;
+    return getAmppControlResource( in_baseUrl + APPLICATIONS_ENDPOINT, APPLICATIONS_ENDPOINT,
+        bearer_token, "Get Ampp Applications", RestClient::BodyHandler(), out_applications );
 }
 
 
 // Refer to: https://{platform}/ampp/control/swagger/index.html
 bool getAmppControlWorkloads( const UString& in_baseUrl,
-    const UString& in_credentials, const UString& in_application,
+    TokenManager& in_tokenManager, const UString& in_application,
     UString& out_workloads )
 {
-    bool result = false;
-
-    unsigned int expiresIn = 0;
-    std::string bearer_token;
-
-    if ( !getToken( in_baseUrl, in_credentials, bearer_token, expiresIn ) )
+    std::string bearer_token = in_tokenManager.getBearerToken();
+    if ( bearer_token.empty() )
     {
         std::cout << "Could not retrieve bearer token." << std::endl;
         return false;
     }
 
-    curl_global_init( CURL_GLOBAL_DEFAULT );
-    auto curl = curl_easy_init();
-    if ( curl )
-    {
-        std::string fullUrl = in_baseUrl + "/ampp/control/api/v1/control/application/" + in_application + "/workloads";
-        std::string response_string;
-        std::string header_string;
+    return getAmppControlResource( in_baseUrl + "/ampp/control/api/v1/control/application/" + in_application + "/workloads",
+        WORKLOADS_ENDPOINT, bearer_token, "Get Ampp Workloads", RestClient::BodyHandler(), out_workloads );
+}
+
 
-        /* ask libcurl to show us the verbose output */
-        // curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
+// Refer to: https://{platform}/ampp/control/swagger/index.html
+bool getAmppControlApplications( const UString& in_baseUrl, TokenManager& in_tokenManager,
+    const JsonArrayStream::ElementCallback& in_callback )
+{
+    return streamAmppControlArray( in_baseUrl + APPLICATIONS_ENDPOINT, APPLICATIONS_ENDPOINT,
+        in_tokenManager, "Get Ampp Applications", in_callback );
+}
 
-        curl_easy_setopt( curl, CURLOPT_URL, fullUrl.c_str() );
-        curl_easy_setopt( curl, CURLOPT_HTTPGET, 1 );
-        curl_easy_setopt( curl, CURLOPT_TCP_KEEPALIVE, 1L );
-        curl_easy_setopt( curl, CURLOPT_WRITEFUNCTION, writeFunction );
-        curl_easy_setopt( curl, CURLOPT_WRITEDATA, &response_string );
-        curl_easy_setopt( curl, CURLOPT_HEADERDATA, &header_string );
-        curl_easy_setopt( curl, CURLOPT_USERAGENT, "AmppNativeApi" );
-        //curl_easy_setopt( curl, CURLOPT_XOAUTH2_BEARER, bearer_token.c_str() );
-        //curl_easy_setopt( curl, CURLOPT_HTTPAUTH, CURLAUTH_BEARER );
 
-        std::string bearerHeaderString = "Authorization: Bearer " + bearer_token;
+// Refer to: https://{platform}/ampp/control/swagger/index.html
+bool getAmppControlWorkloads( const UString& in_baseUrl,
+    TokenManager& in_tokenManager, const UString& in_application,
+    const JsonArrayStream::ElementCallback& in_callback )
+{
+    return streamAmppControlArray( in_baseUrl + "/ampp/control/api/v1/control/application/" + in_application + "/workloads",
+        WORKLOADS_ENDPOINT, in_tokenManager, "Get Ampp Workloads", in_callback );
+}
 
-        struct curl_slist* headers = NULL;
-        headers = curl_slist_append( headers, "Content-Type: application/json" );
-        headers = curl_slist_append( headers, "Accept: application/json" );
-        headers = curl_slist_append( headers, bearerHeaderString.c_str() );
 
-        curl_easy_setopt( curl, CURLOPT_HTTPHEADER, headers );
+// Refer to: https://{platform}/ampp/control/swagger/index.html
+bool getAmppControlMacros( const UString& in_baseUrl, TokenManager& in_tokenManager,
+    const JsonArrayStream::ElementCallback& in_callback )
+{
+    return streamAmppControlArray( in_baseUrl + MACROS_ENDPOINT, MACROS_ENDPOINT,
+        in_tokenManager, "Get Ampp Macros", in_callback );
+}
 
-        curl_easy_perform( curl );
 
-        long httpCode = 999;
-        int ret = curl_easy_getinfo( curl, CURLINFO_RESPONSE_CODE, &httpCode );
-        if ( !ret )
-        {
-            if ( httpCode >= 200 && httpCode <= 299 )
-            {
-                out_workloads = response_string;
-                result = true;
-            }
-            else
-            {
-                std::cout << "Get Ampp Workloads error. Returned http code: " << httpCode << std::endl;
-            }
-        }
+// Refer to: https://{platform}/ampp/control/swagger/index.html
+bool getAmppControlSchemaVersions( const UString& in_baseUrl,
+    TokenManager& in_tokenManager, const UString& in_application,
+    const JsonArrayStream::ElementCallback& in_callback )
+{
+    return streamAmppControlArray( in_baseUrl + "/ampp/control/api/v1/control/application/" + in_application + "/schemaversions",
+        SCHEMAVERSIONS_ENDPOINT, in_tokenManager, "Get Ampp Schema Versions", in_callback );
+}
 
-        curl_easy_cleanup( curl );
-        curl_global_cleanup();
-        curl_slist_free_all( headers );
-        curl = NULL;
-    }
 
-    return result;
+// Refer to: https://{platform}/cluster/matrix/swagger/index.html
+bool getMatrixProducers( const UString& in_baseUrl, TokenManager& in_tokenManager,
+    const UString& in_fabricId, const JsonArrayStream::ElementCallback& in_callback )
+{
+    return streamAmppControlArray( in_baseUrl + PRODUCERS_ENDPOINT + "?fabricId=" + in_fabricId + "&type=Fabric",
+        PRODUCERS_ENDPOINT, in_tokenManager, "Get Matrix Producers", in_callback, "producers" );
 }
 
 
+// Refer to: https://{platform}/cluster/matrix/swagger/index.html
+bool getMatrixConsumers( const UString& in_baseUrl, TokenManager& in_tokenManager,
+    const UString& in_fabricId, const JsonArrayStream::ElementCallback& in_callback )
+{
+    return streamAmppControlArray( in_baseUrl + CONSUMERS_ENDPOINT + "?fabricId=" + in_fabricId + "&type=Fabric",
+        CONSUMERS_ENDPOINT, in_tokenManager, "Get Matrix Consumers", in_callback, "consumers" );
+}
 
+
+// Refer to: https://{platform}/cluster/matrix/swagger/index.html
+bool getMatrixSalvos( const UString& in_baseUrl, TokenManager& in_tokenManager,
+    const JsonArrayStream::ElementCallback& in_callback )
+{
+    return streamAmppControlArray( in_baseUrl + SALVOS_ENDPOINT, SALVOS_ENDPOINT,
+        in_tokenManager, "Get Matrix Salvos", in_callback );
+}
@@ -5,19 +5,76 @@
 #ifndef AMPPCONTROL_H_
 #define AMPPCONTROL_H_
 
+#include "JsonArrayStream.h"
+#include "TokenManager.h"
+
+#include <string>
+
 typedef std::string UString;
 
+// Endpoint names under which the calls below are counted by RestClient.
+extern const char* const APPLICATIONS_ENDPOINT;
+extern const char* const WORKLOADS_ENDPOINT;
+extern const char* const MACROS_ENDPOINT;
+extern const char* const SCHEMAVERSIONS_ENDPOINT;
+extern const char* const PRODUCERS_ENDPOINT;
+extern const char* const CONSUMERS_ENDPOINT;
+extern const char* const SALVOS_ENDPOINT;
+
 // Generates a REST API call to retrieve the list of applications registered to
 // Ampp Control.
 // Please refer to: https://{platform}/ampp/control/swagger/index.html
 bool getAmppControlApplications( const UString& in_baseUrl,
-    const UString& in_credentials, UString& out_applications );
+    TokenManager& in_tokenManager, UString& out_applications );
 
 // Generates a REST API call to retrieve the list of workload IDs associated with
 // a specific application.
 // Please refer to: https://{platform}/ampp/control/swagger/index.html
 bool getAmppControlWorkloads( const UString& in_baseUrl,
-    const UString& in_credentials, const UString& in_application,
+    TokenManager& in_tokenManager, const UString& in_application,
     UString& out_workloads );
 
+// Same as above, but each application reference is passed to in_callback as
+// it is received; the response is never held in full.
+bool getAmppControlApplications( const UString& in_baseUrl,
+    TokenManager& in_tokenManager, const JsonArrayStream::ElementCallback& in_callback );
+
+// Same as above, but each workload ID is passed to in_callback as it is received.
+bool getAmppControlWorkloads( const UString& in_baseUrl,
+    TokenManager& in_tokenManager, const UString& in_application,
+    const JsonArrayStream::ElementCallback& in_callback );
+
+// Generates a REST API call to retrieve the macros defined in Ampp Control.
+// Each macro is passed to in_callback as it is received.
+// Please refer to: https://{platform}/ampp/control/swagger/index.html
+bool getAmppControlMacros( const UString& in_baseUrl,
+    TokenManager& in_tokenManager, const JsonArrayStream::ElementCallback& in_callback );
+
+// Generates a REST API call to retrieve the command schemas of the workloads of
+// an application. Each entry is passed to in_callback as it is received.
+// Please refer to: https://{platform}/ampp/control/swagger/index.html
+bool getAmppControlSchemaVersions( const UString& in_baseUrl,
+    TokenManager& in_tokenManager, const UString& in_application,
+    const JsonArrayStream::ElementCallback& in_callback );
+
+// Generates a REST API call to retrieve the producers (sources) of a fabric.
+// Each entry, { "producer" : {...} }, is passed to in_callback as it is received.
+// Please refer to: https://{platform}/cluster/matrix/swagger/index.html
+bool getMatrixProducers( const UString& in_baseUrl,
+    TokenManager& in_tokenManager, const UString& in_fabricId,
+    const JsonArrayStream::ElementCallback& in_callback );
+
+// Generates a REST API call to retrieve the consumers (destinations) of a fabric.
+// Each entry, { "consumer" : {...} }, is passed to in_callback as it is received.
+// Please refer to: https://{platform}/cluster/matrix/swagger/index.html
+bool getMatrixConsumers( const UString& in_baseUrl,
+    TokenManager& in_tokenManager, const UString& in_fabricId,
+    const JsonArrayStream::ElementCallback& in_callback );
+
+// Generates a REST API call to retrieve the router salvos. Each salvo is passed
+// to in_callback as it is received.
+// Please refer to: https://{platform}/cluster/matrix/swagger/index.html
+bool getMatrixSalvos( const UString& in_baseUrl,
+    TokenManager& in_tokenManager, const JsonArrayStream::ElementCallback& in_callback );
+
 #endif /* AMPPCONTROL_H_ */
@@ -0,0 +1,305 @@
+//
+// Copyright Grass Valley
+//
+
+#include "AsyncRestClient.h"
+
+#include <future>
+
+//********************************************************************************
+// AsyncRestClient
+//********************************************************************************
+
+AsyncRestClient::AsyncRestClient( websocketpp::lib::asio::io_service& in_ioService )
+    : mIoService( in_ioService )
+    , mTimer( in_ioService )
+    , mMulti( NULL )
+    , mPending( 0 )
+{
+    // Makes sure libcurl is initialized.
+    RestClient::getInstance();
+
+    mMulti = curl_multi_init();
+    curl_multi_setopt( mMulti, CURLMOPT_SOCKETFUNCTION, &AsyncRestClient::socketCallback );
+    curl_multi_setopt( mMulti, CURLMOPT_SOCKETDATA, this );
+    curl_multi_setopt( mMulti, CURLMOPT_TIMERFUNCTION, &AsyncRestClient::timerCallback );
+    curl_multi_setopt( mMulti, CURLMOPT_TIMERDATA, this );
+#ifdef CURLPIPE_MULTIPLEX
+    // Many requests to the same host share one HTTP/2 connection when possible.
+    curl_multi_setopt( mMulti, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX );
+#endif
+}
+
+AsyncRestClient::~AsyncRestClient()
+{
+    std::promise<void> done;
+    mIoService.post( [this, &done]()
+    {
+        cleanup();
+        done.set_value();
+    } );
+    done.get_future().wait();
+}
+
+void AsyncRestClient::perform( const RestClient::Request& in_request, Callback in_callback )
+{
+    Transfer* transfer = new Transfer();
+    transfer->handle = NULL;
+    transfer->headers = NULL;
+    transfer->request = in_request;
+    transfer->callback = in_callback;
+
+    ++mPending;
+    mIoService.post( [this, transfer]()
+    {
+        start( transfer );
+    } );
+}
+
+void AsyncRestClient::start( Transfer* in_transfer )
+{
+    CURL* curl = curl_easy_init();
+    if ( !curl )
+    {
+        in_transfer->response.error = "Could not create a curl handle";
+        --mPending;
+        in_transfer->callback( in_transfer->response );
+        delete in_transfer;
+        return;
+    }
+    in_transfer->handle = curl;
+
+    const RestClient::Request& request = in_transfer->request;
+    curl_easy_setopt( curl, CURLOPT_URL, request.url.c_str() );
+    if ( request.method == "GET" )
+    {
+        curl_easy_setopt( curl, CURLOPT_HTTPGET, 1L );
+    }
+    else
+    {
+        curl_easy_setopt( curl, CURLOPT_CUSTOMREQUEST, request.method.c_str() );
+        curl_easy_setopt( curl, CURLOPT_POSTFIELDS, request.body.c_str() );
+        curl_easy_setopt( curl, CURLOPT_POSTFIELDSIZE, static_cast<long>( request.body.size() ) );
+    }
+    curl_easy_setopt( curl, CURLOPT_TCP_KEEPALIVE, 1L );
+    curl_easy_setopt( curl, CURLOPT_USERAGENT, "AmppNativeApi" );
+    curl_easy_setopt( curl, CURLOPT_PRIVATE, in_transfer );
+    curl_easy_setopt( curl, CURLOPT_OPENSOCKETFUNCTION, &AsyncRestClient::openSocket );
+    curl_easy_setopt( curl, CURLOPT_OPENSOCKETDATA, this );
+    curl_easy_setopt( curl, CURLOPT_CLOSESOCKETFUNCTION, &AsyncRestClient::closeSocket );
+    curl_easy_setopt( curl, CURLOPT_CLOSESOCKETDATA, this );
+
+    for ( size_t i = 0; i < request.headers.size(); ++i )
+    {
+        in_transfer->headers = curl_slist_append( in_transfer->headers, request.headers[ i ].c_str() );
+    }
+    in_transfer->writer.handle = curl;
+    in_transfer->writer.request = &in_transfer->request;
+    in_transfer->writer.response = &in_transfer->response;
+    RestClient::prepareTransfer( in_transfer->writer, in_transfer->headers );
+    curl_easy_setopt( curl, CURLOPT_HTTPHEADER, in_transfer->headers );
+
+    mTransfers[ curl ] = in_transfer;
+
+    // Schedules an immediate timeout through timerCallback(), which starts the transfer.
+    curl_multi_add_handle( mMulti, curl );
+}
+
+curl_socket_t AsyncRestClient::openSocket( void* in_client, curlsocktype in_purpose, struct curl_sockaddr* in_address )
+{
+    AsyncRestClient* client = static_cast<AsyncRestClient*>( in_client );
+    if ( in_purpose != CURLSOCKTYPE_IPCXN || ( in_address->family != AF_INET && in_address->family != AF_INET6 ) )
+    {
+        return CURL_SOCKET_BAD;
+    }
+
+    SocketStatePtr state = std::make_shared<SocketState>( client->mIoService );
+    websocketpp::lib::asio::error_code ec;
+    state->socket.open( in_address->family == AF_INET ?
+        websocketpp::lib::asio::ip::tcp::v4() : websocketpp::lib::asio::ip::tcp::v6(), ec );
+    if ( ec )
+    {
+        return CURL_SOCKET_BAD;
+    }
+
+    curl_socket_t fd = state->socket.native_handle();
+    client->mSockets[ fd ] = state;
+    return fd;
+}
+
+int AsyncRestClient::closeSocket( void* in_client, curl_socket_t in_fd )
+{
+    AsyncRestClient* client = static_cast<AsyncRestClient*>( in_client );
+    std::map<curl_socket_t, SocketStatePtr>::iterator it = client->mSockets.find( in_fd );
+    if ( it != client->mSockets.end() )
+    {
+        // Pending waits complete with operation_aborted.
+        it->second->closed = true;
+        websocketpp::lib::asio::error_code ec;
+        it->second->socket.close( ec );
+        client->mSockets.erase( it );
+    }
+    return 0;
+}
+
+int AsyncRestClient::socketCallback( CURL*, curl_socket_t in_fd, int in_what, void* in_client, void* )
+{
+    AsyncRestClient* client = static_cast<AsyncRestClient*>( in_client );
+    std::map<curl_socket_t, SocketStatePtr>::iterator it = client->mSockets.find( in_fd );
+    if ( it == client->mSockets.end() )
+    {
+        return 0;
+    }
+
+    if ( in_what == CURL_POLL_REMOVE )
+    {
+        it->second->wanted = 0;
+    }
+    else
+    {
+        it->second->wanted = in_what;
+        client->waitForSocket( it->second, in_fd );
+    }
+    return 0;
+}
+
+int AsyncRestClient::timerCallback( CURLM*, long in_timeoutMs, void* in_client )
+{
+    AsyncRestClient* client = static_cast<AsyncRestClient*>( in_client );
+    if ( in_timeoutMs < 0 )
+    {
+        client->mTimer.cancel();
+        return 0;
+    }
+
+    // libcurl must not be re-entered from this callback, so even a zero
+    // timeout goes through the io_service.
+    client->mTimer.expires_from_now( std::chrono::milliseconds( in_timeoutMs ) );
+    client->mTimer.async_wait( [client]( const websocketpp::lib::asio::error_code& in_error )
+    {
+        if ( !in_error )
+        {
+            client->onTimeout();
+        }
+    } );
+    return 0;
+}
+
+void AsyncRestClient::waitForSocket( const SocketStatePtr& in_state, curl_socket_t in_fd )
+{
+    // null_buffers waits for readiness without reading, which is all libcurl
+    // needs; it is also what the asio 1.10 used on Windows supports.
+    if ( ( in_state->wanted & CURL_POLL_IN ) && !in_state->readPending )
+    {
+        in_state->readPending = true;
+        in_state->socket.async_read_some( websocketpp::lib::asio::null_buffers(),
+            [this, in_state, in_fd]( const websocketpp::lib::asio::error_code& in_error, size_t )
+        {
+            onSocketEvent( in_state, in_fd, CURL_CSELECT_IN, in_error );
+        } );
+    }
+    if ( ( in_state->wanted & CURL_POLL_OUT ) && !in_state->writePending )
+    {
+        in_state->writePending = true;
+        in_state->socket.async_write_some( websocketpp::lib::asio::null_buffers(),
+            [this, in_state, in_fd]( const websocketpp::lib::asio::error_code& in_error, size_t )
+        {
+            onSocketEvent( in_state, in_fd, CURL_CSELECT_OUT, in_error );
+        } );
+    }
+}
+
+void AsyncRestClient::onSocketEvent( const SocketStatePtr& in_state, curl_socket_t in_fd, int in_event,
+    const websocketpp::lib::asio::error_code& in_error )
+{
+    if ( in_event == CURL_CSELECT_IN )
+    {
+        in_state->readPending = false;
+    }
+    else
+    {
+        in_state->writePending = false;
+    }
+
+    // Only the socket state may be used once the socket is closed: the client
+    // itself may be gone.
+    if ( in_state->closed || in_error == websocketpp::lib::asio::error::operation_aborted )
+    {
+        return;
+    }
+    if ( !( in_state->wanted & ( in_event == CURL_CSELECT_IN ? CURL_POLL_IN : CURL_POLL_OUT ) ) )
+    {
+        return;
+    }
+
+    int running = 0;
+    curl_multi_socket_action( mMulti, in_fd, in_error ? CURL_CSELECT_ERR : in_event, &running );
+    processCompleted();
+
+    if ( !in_state->closed )
+    {
+        waitForSocket( in_state, in_fd );
+    }
+}
+
+void AsyncRestClient::onTimeout()
+{
+    int running = 0;
+    curl_multi_socket_action( mMulti, CURL_SOCKET_TIMEOUT, 0, &running );
+    processCompleted();
+}
+
+void AsyncRestClient::processCompleted()
+{
+    int queued = 0;
+    while ( CURLMsg* message = curl_multi_info_read( mMulti, &queued ) )
+    {
+        if ( message->msg != CURLMSG_DONE )
+        {
+            continue;
+        }
+
+        CURL* curl = message->easy_handle;
+        CURLcode result = message->data.result;
+        Transfer* transfer = NULL;
+        curl_easy_getinfo( curl, CURLINFO_PRIVATE, &transfer );
+
+        RestClient::completeTransfer( transfer->writer, result );
+
+        // The connection stays in the multi handle's cache for the next requests.
+        curl_multi_remove_handle( mMulti, curl );
+        curl_easy_cleanup( curl );
+        curl_slist_free_all( transfer->headers );
+        mTransfers.erase( curl );
+        --mPending;
+
+        transfer->callback( transfer->response );
+        delete transfer;
+    }
+}
+
+void AsyncRestClient::cleanup()
+{
+    // Callbacks of unfinished requests are not called.
+    for ( std::map<CURL*, Transfer*>::iterator it = mTransfers.begin(); it != mTransfers.end(); ++it )
+    {
+        curl_multi_remove_handle( mMulti, it->first );
+        curl_easy_cleanup( it->first );
+        curl_slist_free_all( it->second->headers );
+        delete it->second;
+    }
+    mTransfers.clear();
+
+    // Closes the cached connections through closeSocket().
+    curl_multi_cleanup( mMulti );
+    mMulti = NULL;
+
+    mTimer.cancel();
+    for ( std::map<curl_socket_t, SocketStatePtr>::iterator it = mSockets.begin(); it != mSockets.end(); ++it )
+    {
+        it->second->closed = true;
+        websocketpp::lib::asio::error_code ec;
+        it->second->socket.close( ec );
+    }
+    mSockets.clear();
+}
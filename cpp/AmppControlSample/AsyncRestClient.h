@@ -0,0 +1,99 @@
+//
+// Copyright Grass Valley
+//
+
+#ifndef ASYNC_REST_CLIENT_H_
+#define ASYNC_REST_CLIENT_H_
+
+#include "RestClient.h"
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <websocketpp/common/asio.hpp>
+
+// Non-blocking HTTP client running on an asio io_service, typically the one of
+// the websocket_endpoint (see websocket_endpoint::get_io_service()).
+//
+// curl_multi is driven through its socket and timer callbacks: libcurl opens
+// its sockets as asio tcp::sockets, asio reports their readiness and its timer
+// fires libcurl's timeouts. Any number of requests can be in flight on the io
+// thread without blocking the websocket processing sharing it.
+//
+// perform() may be called from any thread; callbacks run on the io thread.
+// The client must be destroyed while its io_service is still running, and not
+// from the io thread itself.
+class AsyncRestClient
+{
+public:
+    typedef std::function<void( const RestClient::Response& )> Callback;
+
+    explicit AsyncRestClient( websocketpp::lib::asio::io_service& in_ioService );
+    ~AsyncRestClient();
+
+    void perform( const RestClient::Request& in_request, Callback in_callback );
+
+    // Requests queued or in flight.
+    size_t getPendingCount() const
+    {
+        return mPending.load();
+    }
+
+private:
+    typedef websocketpp::lib::asio::ip::tcp::socket Socket;
+
+    struct Transfer
+    {
+        CURL* handle;
+        struct curl_slist* headers;
+        RestClient::BodyWriter writer;
+        RestClient::Request request;
+        RestClient::Response response;
+        Callback callback;
+    };
+
+    struct SocketState
+    {
+        SocketState( websocketpp::lib::asio::io_service& in_ioService )
+            : socket( in_ioService )
+            , wanted( 0 )
+            , readPending( false )
+            , writePending( false )
+            , closed( false )
+        {
+        }
+
+        Socket socket;
+        int wanted; // CURL_POLL_IN / CURL_POLL_OUT bits.
+        bool readPending;
+        bool writePending;
+        bool closed;
+    };
+    typedef std::shared_ptr<SocketState> SocketStatePtr;
+
+    void start( Transfer* in_transfer );
+    void waitForSocket( const SocketStatePtr& in_state, curl_socket_t in_fd );
+    void onSocketEvent( const SocketStatePtr& in_state, curl_socket_t in_fd, int in_event,
+        const websocketpp::lib::asio::error_code& in_error );
+    void onTimeout();
+    void processCompleted();
+    void cleanup();
+
+    static int socketCallback( CURL* in_handle, curl_socket_t in_fd, int in_what, void* in_client, void* in_socket );
+    static int timerCallback( CURLM* in_multi, long in_timeoutMs, void* in_client );
+    static curl_socket_t openSocket( void* in_client, curlsocktype in_purpose, struct curl_sockaddr* in_address );
+    static int closeSocket( void* in_client, curl_socket_t in_fd );
+
+    websocketpp::lib::asio::io_service& mIoService;
+    websocketpp::lib::asio::steady_timer mTimer;
+    CURLM* mMulti;
+
+    // Only used on the io thread.
+    std::map<curl_socket_t, SocketStatePtr> mSockets;
+    std::map<CURL*, Transfer*> mTransfers;
+
+    std::atomic<size_t> mPending;
+};
+
+#endif /* ASYNC_REST_CLIENT_H_ */
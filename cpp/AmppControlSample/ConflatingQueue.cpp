@@ -0,0 +1,226 @@
+//
+// Copyright Grass Valley
+//
+
+#include "ConflatingQueue.h"
+
+namespace
+{
+    // Appends to out_entries a copy of io_root for each element of the arrays
+    // found along in_path[ in_depth.. ] below io_value (a value of io_root),
+    // with the arrays replaced by that element, and sets io_split if there was
+    // any. io_root is left modified.
+    void splitEntries( json& io_root, json& io_value, const std::vector<std::string>& in_path, size_t in_depth,
+        std::vector<json>& out_entries, bool& io_split )
+    {
+        if ( io_value.is_array() )
+        {
+            io_split = true;
+            json elements;
+            elements.swap( io_value );
+            for ( json::iterator it = elements.begin(); it != elements.end(); ++it )
+            {
+                io_value = std::move( *it );
+                splitEntries( io_root, io_value, in_path, in_depth, out_entries, io_split );
+            }
+            return;
+        }
+
+        if ( in_depth < in_path.size() && io_value.is_object() )
+        {
+            json::iterator it = io_value.find( in_path[ in_depth ] );
+            if ( it != io_value.end() )
+            {
+                splitEntries( io_root, *it, in_path, in_depth + 1, out_entries, io_split );
+                return;
+            }
+        }
+        out_entries.push_back( io_root );
+    }
+
+    // The value at in_path in an entry without arrays along it, empty if none.
+    std::string getKeyValue( const json& in_entry, const std::vector<std::string>& in_path )
+    {
+        const json* value = &in_entry;
+        for ( size_t i = 0; i < in_path.size(); ++i )
+        {
+            if ( !value->is_object() )
+            {
+                return std::string();
+            }
+            json::const_iterator it = value->find( in_path[ i ] );
+            if ( it == value->end() )
+            {
+                return std::string();
+            }
+            value = &*it;
+        }
+        return value->dump();
+    }
+}
+
+ConflatingQueue::ConflatingQueue( const std::string& in_keyPath )
+    : mPushed( 0 )
+    , mDropped( 0 )
+    , mClosed( false )
+{
+    size_t start = 0;
+    while ( start <= in_keyPath.size() && !in_keyPath.empty() )
+    {
+        size_t end = in_keyPath.find( '.', start );
+        if ( end == std::string::npos )
+        {
+            end = in_keyPath.size();
+        }
+        mKeyPath.push_back( in_keyPath.substr( start, end - start ) );
+        start = end + 1;
+    }
+}
+
+void ConflatingQueue::push( const ReceivedNotificationModel& in_notification )
+{
+    // The content is parsed and split outside the lock so the consumer is
+    // never held up by it.
+    std::string topicKey = in_notification.getTopic();
+    topicKey += '\n';
+
+    std::vector<json> entries;
+    bool split = false;
+    if ( !mKeyPath.empty() )
+    {
+        json content = json::parse( in_notification.getContent(), nullptr, false );
+        if ( !content.is_discarded() )
+        {
+            splitEntries( content, content, mKeyPath, 0, entries, split );
+        }
+    }
+
+    std::vector<std::string> keys;
+    std::vector<ReceivedNotificationModel> parts;
+    for ( size_t i = 0; i < entries.size(); ++i )
+    {
+        keys.push_back( topicKey + getKeyValue( entries[ i ], mKeyPath ) );
+    }
+    if ( split )
+    {
+        // Each entry is a notification of its own, with the content of the entry.
+        json notification = in_notification.toJson();
+        for ( size_t i = 0; i < entries.size(); ++i )
+        {
+            notification[ "Content" ] = entries[ i ].dump();
+            parts.push_back( ReceivedNotificationModel() );
+            parts.back().setFromJson( notification );
+        }
+    }
+    else if ( keys.empty() )
+    {
+        keys.push_back( topicKey );
+    }
+
+    bool added = false;
+    {
+        std::lock_guard<std::mutex> lock( mMutex );
+        for ( size_t i = 0; i < keys.size(); ++i )
+        {
+            added = pushEntry( keys[ i ], parts.empty() ? in_notification : parts[ i ] ) || added;
+        }
+    }
+    if ( added )
+    {
+        mCondition.notify_one();
+    }
+}
+
+bool ConflatingQueue::pushEntry( std::string& io_key, const ReceivedNotificationModel& in_notification )
+{
+    ++mPushed;
+
+    std::unordered_map<std::string, size_t>::iterator it = mIndex.find( io_key );
+    if ( it != mIndex.end() )
+    {
+        Slot& slot = mSlots[ it->second ];
+        slot.notification = in_notification;
+        ++slot.dropped;
+        ++mDropped;
+        return false;
+    }
+
+    size_t index;
+    if ( !mFreeSlots.empty() )
+    {
+        index = mFreeSlots.back();
+        mFreeSlots.pop_back();
+    }
+    else
+    {
+        index = mSlots.size();
+        mSlots.push_back( Slot() );
+    }
+    Slot& slot = mSlots[ index ];
+    slot.notification = in_notification;
+    slot.dropped = 0;
+    slot.key.swap( io_key );
+    mIndex.insert( std::make_pair( slot.key, index ) );
+    mReady.push_back( index );
+    return true;
+}
+
+bool ConflatingQueue::pop( ReceivedNotificationModel& out_notification, uint64_t& out_dropped,
+    std::chrono::milliseconds in_timeout )
+{
+    std::unique_lock<std::mutex> lock( mMutex );
+    if ( !mCondition.wait_for( lock, in_timeout, [this]() { return mClosed || !mReady.empty(); } ) )
+    {
+        return false;
+    }
+    if ( mReady.empty() )
+    {
+        return false;
+    }
+
+    size_t index = mReady.front();
+    mReady.pop_front();
+
+    // The key is forgotten until pushed again, and its slot reused.
+    Slot& slot = mSlots[ index ];
+    out_notification = std::move( slot.notification );
+    out_dropped = slot.dropped;
+    slot.notification = ReceivedNotificationModel();
+    mIndex.erase( slot.key );
+    slot.key.clear();
+    mFreeSlots.push_back( index );
+    return true;
+}
+
+void ConflatingQueue::close()
+{
+    {
+        std::lock_guard<std::mutex> lock( mMutex );
+        mClosed = true;
+    }
+    mCondition.notify_all();
+}
+
+bool ConflatingQueue::isClosed() const
+{
+    std::lock_guard<std::mutex> lock( mMutex );
+    return mClosed;
+}
+
+size_t ConflatingQueue::size() const
+{
+    std::lock_guard<std::mutex> lock( mMutex );
+    return mReady.size();
+}
+
+uint64_t ConflatingQueue::getPushedCount() const
+{
+    std::lock_guard<std::mutex> lock( mMutex );
+    return mPushed;
+}
+
+uint64_t ConflatingQueue::getDroppedCount() const
+{
+    std::lock_guard<std::mutex> lock( mMutex );
+    return mDropped;
+}
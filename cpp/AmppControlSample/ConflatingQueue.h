@@ -0,0 +1,86 @@
+//
+// Copyright Grass Valley
+//
+
+#ifndef CONFLATING_QUEUE_H_
+#define CONFLATING_QUEUE_H_
+
+#include "RpcProtocol.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A latest-value-wins queue for high rate state notifications.
+//
+// Notifications are keyed by their topic and the value found at a configurable
+// path in their content (e.g. "payload.Index"). While a key is waiting for the
+// consumer, newer notifications for that key replace the queued one instead of
+// being appended, so a consumer that falls behind only sees the newest state
+// per key. A key is forgotten once popped, and its slot reused: memory is
+// bounded by the number of keys pending at once, not of keys ever seen.
+//
+// If a path element is an array, the notification is split into one entry per
+// element, each with the array replaced by that element: a full state
+// notification with one entry per channel updates the key of every channel,
+// exactly as the notifications of a single channel do, so a channel never has
+// more than one pending state. Notifications whose content has no value at the
+// path are keyed by topic only.
+class ConflatingQueue
+{
+public:
+    explicit ConflatingQueue( const std::string& in_keyPath );
+
+    // Queues a notification, or each of its entries, replacing the pending one
+    // with the same key.
+    void push( const ReceivedNotificationModel& in_notification );
+
+    // Waits up to in_timeout for a pending notification. out_dropped receives
+    // the number of updates of that key replaced since it was last popped.
+    // Returns false on timeout or once the queue is closed and empty.
+    bool pop( ReceivedNotificationModel& out_notification, uint64_t& out_dropped,
+        std::chrono::milliseconds in_timeout = std::chrono::milliseconds( 1000 ) );
+
+    // Wakes up the consumer; pop() fails once the pending entries are drained.
+    void close();
+
+    bool isClosed() const;
+
+    // Number of keys with a pending notification.
+    size_t size() const;
+
+    // Total number of entries pushed and replaced before being popped.
+    uint64_t getPushedCount() const;
+    uint64_t getDroppedCount() const;
+
+private:
+    // Holds the notification of a pending key.
+    struct Slot
+    {
+        std::string key;
+        ReceivedNotificationModel notification;
+        uint64_t dropped;
+    };
+
+    // Adds the key of an entry to mIndex and mReady, or replaces its pending
+    // notification. Called with mMutex held; returns false if replaced.
+    bool pushEntry( std::string& io_key, const ReceivedNotificationModel& in_notification );
+
+    std::vector<std::string> mKeyPath;
+
+    mutable std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::unordered_map<std::string, size_t> mIndex;
+    std::vector<Slot> mSlots;
+    std::vector<size_t> mFreeSlots;
+    std::deque<size_t> mReady;
+    uint64_t mPushed;
+    uint64_t mDropped;
+    bool mClosed;
+};
+
+#endif /* CONFLATING_QUEUE_H_ */
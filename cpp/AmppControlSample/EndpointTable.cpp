@@ -0,0 +1,133 @@
+//
+// Copyright Grass Valley
+//
+
+#include "EndpointTable.h"
+
+#include <functional>
+
+namespace
+{
+    size_t hashKey( const std::string& in_key )
+    {
+        return std::hash<std::string>()( in_key );
+    }
+}
+
+//********************************************************************************
+// EndpointTable::Index
+//********************************************************************************
+
+EndpointTable::Index::Index()
+    : mMask( 0 )
+{
+}
+
+void EndpointTable::Index::build( const std::vector<Endpoint>& in_endpoints, std::string Endpoint::* in_field )
+{
+    // A power of two at least twice the number of endpoints.
+    size_t capacity = 16;
+    while ( capacity < in_endpoints.size() * 2 )
+    {
+        capacity *= 2;
+    }
+
+    Slot empty = { 0, EMPTY };
+    mSlots.assign( capacity, empty );
+    mMask = capacity - 1;
+
+    for ( size_t i = 0; i < in_endpoints.size(); ++i )
+    {
+        const std::string& key = in_endpoints[ i ].*in_field;
+        if ( key.empty() )
+        {
+            continue;
+        }
+
+        size_t hash = hashKey( key );
+        size_t slot = hash & mMask;
+        bool duplicate = false;
+        while ( mSlots[ slot ].position != EMPTY )
+        {
+            if ( mSlots[ slot ].hash == static_cast<uint32_t>( hash ) && in_endpoints[ mSlots[ slot ].position ].*in_field == key )
+            {
+                duplicate = true;
+                break;
+            }
+            slot = ( slot + 1 ) & mMask;
+        }
+        if ( !duplicate )
+        {
+            mSlots[ slot ].hash = static_cast<uint32_t>( hash );
+            mSlots[ slot ].position = static_cast<uint32_t>( i );
+        }
+    }
+}
+
+const EndpointTable::Endpoint* EndpointTable::Index::find( const std::vector<Endpoint>& in_endpoints,
+    std::string Endpoint::* in_field, const std::string& in_key ) const
+{
+    if ( mSlots.empty() || in_key.empty() )
+    {
+        return NULL;
+    }
+
+    size_t hash = hashKey( in_key );
+    for ( size_t slot = hash & mMask; mSlots[ slot ].position != EMPTY; slot = ( slot + 1 ) & mMask )
+    {
+        if ( mSlots[ slot ].hash == static_cast<uint32_t>( hash ) )
+        {
+            const Endpoint& endpoint = in_endpoints[ mSlots[ slot ].position ];
+            if ( endpoint.*in_field == in_key )
+            {
+                return &endpoint;
+            }
+        }
+    }
+    return NULL;
+}
+
+//********************************************************************************
+// EndpointTable
+//********************************************************************************
+
+EndpointTable::EndpointTable()
+{
+}
+
+EndpointTable::EndpointTable( std::vector<Endpoint>& io_endpoints )
+{
+    mEndpoints.swap( io_endpoints );
+    mById.build( mEndpoints, &Endpoint::id );
+    mByName.build( mEndpoints, &Endpoint::name );
+    mByAlias.build( mEndpoints, &Endpoint::alias );
+}
+
+const EndpointTable::Endpoint* EndpointTable::findById( const std::string& in_id ) const
+{
+    return mById.find( mEndpoints, &Endpoint::id, in_id );
+}
+
+const EndpointTable::Endpoint* EndpointTable::findByName( const std::string& in_name ) const
+{
+    return mByName.find( mEndpoints, &Endpoint::name, in_name );
+}
+
+const EndpointTable::Endpoint* EndpointTable::findByAlias( const std::string& in_alias ) const
+{
+    return mByAlias.find( mEndpoints, &Endpoint::alias, in_alias );
+}
+
+const EndpointTable::Endpoint* EndpointTable::find( const std::string& in_key ) const
+{
+    const Endpoint* endpoint = findByName( in_key );
+    if ( !endpoint )
+    {
+        endpoint = findByAlias( in_key );
+    }
+    if ( !endpoint )
+    {
+        endpoint = findById( in_key );
+    }
+    return endpoint;
+}
@@ -0,0 +1,89 @@
+//
+// Copyright Grass Valley
+//
+
+#ifndef ENDPOINT_TABLE_H_
+#define ENDPOINT_TABLE_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Producers or consumers of a fabric, indexed by id, name and alias.
+//
+// Each index is an open-addressing hash table with linear probing, kept at most
+// half full. A slot only holds part of the hash and the position of the
+// endpoint; keys are compared in the endpoints themselves, so they are not
+// copied. A lookup hashes the key once and, short of a hash collision, compares
+// one string.
+//
+// A table is built once and never modified; refreshing a fabric builds a new
+// one, so it can be read from any number of threads.
+class EndpointTable
+{
+public:
+    struct Endpoint
+    {
+        std::string id;
+        std::string name;
+        std::string alias;
+        std::string workloadId;
+        std::string nodeId;
+        std::string groupName;
+        std::string type;
+    };
+
+    EndpointTable();
+
+    // The endpoints are moved into the table. When several endpoints share a
+    // name or an alias, the first one is found, as with a linear search.
+    explicit EndpointTable( std::vector<Endpoint>& io_endpoints );
+
+    // Return NULL if there is no such endpoint.
+    const Endpoint* findById( const std::string& in_id ) const;
+    const Endpoint* findByName( const std::string& in_name ) const;
+    const Endpoint* findByAlias( const std::string& in_alias ) const;
+
+    // By name, then by alias, then by id.
+    const Endpoint* find( const std::string& in_key ) const;
+
+    const std::vector<Endpoint>& getEndpoints() const
+    {
+        return mEndpoints;
+    }
+
+    size_t size() const
+    {
+        return mEndpoints.size();
+    }
+
+private:
+    class Index
+    {
+    public:
+        Index();
+
+        void build( const std::vector<Endpoint>& in_endpoints, std::string Endpoint::* in_field );
+        const Endpoint* find( const std::vector<Endpoint>& in_endpoints, std::string Endpoint::* in_field,
+            const std::string& in_key ) const;
+
+    private:
+        static const uint32_t EMPTY = 0xFFFFFFFF;
+
+        struct Slot
+        {
+            uint32_t hash;
+            uint32_t position;
+        };
+
+        std::vector<Slot> mSlots;
+        size_t mMask;
+    };
+
+    std::vector<Endpoint> mEndpoints;
+    Index mById;
+    Index mByName;
+    Index mByAlias;
+};
+
+#endif /* ENDPOINT_TABLE_H_ */
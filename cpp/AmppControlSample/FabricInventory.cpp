@@ -0,0 +1,439 @@
+//
+// Copyright Grass Valley
+//
+
+#include "FabricInventory.h"
+#include "AmppControlUtil.h"
+
+#include <algorithm>
+#include <cctype>
+#include <functional>
+#include <iostream>
+
+namespace
+{
+    const char* const TOPIC_PREFIX = "gv.cluster.matrix.";
+
+    std::string getString( const json& in_object, const char* in_key )
+    {
+        json::const_iterator it = in_object.find( in_key );
+        return ( it != in_object.end() && it->is_string() ) ? it->get<std::string>() : std::string();
+    }
+
+    // An endpoint is either the object itself or its in_member, as in the
+    // listings.
+    bool parseEndpoint( const json& in_object, const char* in_member, EndpointTable::Endpoint& out_endpoint )
+    {
+        if ( !in_object.is_object() )
+        {
+            return false;
+        }
+        json::const_iterator member = in_object.find( in_member );
+        const json& data = ( member != in_object.end() && member->is_object() ) ? *member : in_object;
+
+        out_endpoint.id = getString( data, "id" );
+        out_endpoint.name = getString( data, "name" );
+        out_endpoint.alias = getString( data, "alias" );
+        out_endpoint.workloadId = getString( data, "workloadId" );
+        out_endpoint.nodeId = getString( data, "nodeId" );
+        out_endpoint.groupName = getString( data, "groupName" );
+        out_endpoint.type = getString( data, "type" );
+        return !out_endpoint.id.empty();
+    }
+
+    JsonArrayStream::ElementCallback collectEndpoints( const char* in_member, std::vector<EndpointTable::Endpoint>& io_endpoints )
+    {
+        return [in_member, &io_endpoints]( json& in_entry )
+        {
+            EndpointTable::Endpoint endpoint;
+            if ( in_entry.find( in_member ) != in_entry.end() && parseEndpoint( in_entry, in_member, endpoint ) )
+            {
+                io_endpoints.push_back( std::move( endpoint ) );
+            }
+            return true;
+        };
+    }
+
+    uint64_t hashEndpoint( const EndpointTable::Endpoint& in_endpoint )
+    {
+        const std::string* fields[] = { &in_endpoint.id, &in_endpoint.name, &in_endpoint.alias, &in_endpoint.workloadId,
+            &in_endpoint.nodeId, &in_endpoint.groupName, &in_endpoint.type };
+
+        uint64_t hash = 0;
+        for ( size_t i = 0; i < sizeof( fields ) / sizeof( fields[ 0 ] ); ++i )
+        {
+            hash ^= static_cast<uint64_t>( std::hash<std::string>()( *fields[ i ] ) ) + 0x9E3779B97F4A7C15ULL + ( hash << 6 ) + ( hash >> 2 );
+        }
+        return hash;
+    }
+
+    // A sum, so an endpoint can be added or removed without hashing the others.
+    uint64_t digestEndpoints( const std::vector<EndpointTable::Endpoint>& in_endpoints )
+    {
+        uint64_t digest = 0;
+        for ( size_t i = 0; i < in_endpoints.size(); ++i )
+        {
+            digest += hashEndpoint( in_endpoints[ i ] );
+        }
+        return digest;
+    }
+
+    bool isSameEndpoint( const EndpointTable::Endpoint& in_left, const EndpointTable::Endpoint& in_right )
+    {
+        return in_left.id == in_right.id && in_left.name == in_right.name && in_left.alias == in_right.alias
+            && in_left.workloadId == in_right.workloadId && in_left.nodeId == in_right.nodeId
+            && in_left.groupName == in_right.groupName && in_left.type == in_right.type;
+    }
+}
+
+//********************************************************************************
+// FabricInventory::Edit
+//********************************************************************************
+
+FabricInventory::Edit::Edit( const EndpointTable* in_table, uint64_t in_digest )
+    : table( in_table )
+    , digest( in_digest )
+    , changed( false )
+{
+}
+
+//********************************************************************************
+// FabricInventory
+//********************************************************************************
+
+FabricInventory::FabricInventory( const std::string& in_baseUrl, TokenManager& in_tokenManager, const std::string& in_fabricId )
+    : mBaseUrl( in_baseUrl )
+    , mTokenManager( in_tokenManager )
+    , mFabricId( in_fabricId )
+    , mFetches( 0 )
+    , mPublishedUpdates( 0 )
+    , mTotalUpdateNs( 0 )
+    , mRunning( false )
+{
+    mStats.version = 0;
+    mStats.updatesApplied = 0;
+    mStats.updatesIgnored = 0;
+    mStats.updateSnapshots = 0;
+    mStats.revalidations = 0;
+    mStats.revalidationChanges = 0;
+    mStats.averageUpdateUs = 0;
+}
+
+FabricInventory::~FabricInventory()
+{
+    stop();
+}
+
+bool FabricInventory::load()
+{
+    return synchronize( true );
+}
+
+bool FabricInventory::revalidate()
+{
+    return synchronize( false );
+}
+
+void FabricInventory::start( std::chrono::seconds in_interval )
+{
+    std::lock_guard<std::mutex> lock( mRunMutex );
+    if ( !mRunning )
+    {
+        mRunning = true;
+        mThread = std::thread( &FabricInventory::run, this, in_interval );
+    }
+}
+
+void FabricInventory::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock( mRunMutex );
+        if ( !mRunning )
+        {
+            return;
+        }
+        mRunning = false;
+    }
+    mRunCondition.notify_all();
+    mThread.join();
+}
+
+bool FabricInventory::applyNotification( const ReceivedNotificationModel& in_notification )
+{
+    const std::string& topic = in_notification.getTopic();
+    std::string event;
+    if ( getFabricId( topic ) == mFabricId )
+    {
+        event = topic.substr( std::char_traits<char>::length( TOPIC_PREFIX ) + mFabricId.size() + 1 );
+        std::transform( event.begin(), event.end(), event.begin(), []( char c )
+        {
+            return static_cast<char>( std::tolower( static_cast<unsigned char>( c ) ) );
+        } );
+    }
+
+    Update update;
+    update.producer = ( event.find( "producer" ) != std::string::npos );
+    update.removed = ( event.find( "removed" ) != std::string::npos || event.find( "deleted" ) != std::string::npos );
+    bool valid = update.producer || event.find( "consumer" ) != std::string::npos;
+    if ( valid )
+    {
+        json content = json::parse( in_notification.getContent(), nullptr, false );
+        valid = parseEndpoint( content, update.producer ? "producer" : "consumer", update.endpoint );
+    }
+
+    {
+        std::lock_guard<std::mutex> lock( mPendingMutex );
+        if ( !valid )
+        {
+            ++mStats.updatesIgnored;
+            return false;
+        }
+        ++mStats.updatesApplied;
+        mPending.push_back( std::move( update ) );
+    }
+
+    // Whoever gets the update mutex first applies every pending update, so a
+    // burst of notifications rebuilds the tables once.
+    std::lock_guard<std::mutex> lock( mUpdateMutex );
+    std::vector<Update> updates;
+    {
+        std::lock_guard<std::mutex> pendingLock( mPendingMutex );
+        updates.swap( mPending );
+    }
+    if ( updates.empty() )
+    {
+        return true;
+    }
+    if ( mFetches > 0 )
+    {
+        mReplay.insert( mReplay.end(), updates.begin(), updates.end() );
+    }
+
+    std::shared_ptr<const Snapshot> snapshot = std::atomic_load( &mSnapshot );
+    if ( !snapshot )
+    {
+        // Nothing to update yet; the load in progress, if any, replays them.
+        return true;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    Edit producers( snapshot->producers.get(), snapshot->producersDigest );
+    Edit consumers( snapshot->consumers.get(), snapshot->consumersDigest );
+    for ( size_t i = 0; i < updates.size(); ++i )
+    {
+        // Each table is only copied if one of the updates concerns it.
+        Edit& edit = updates[ i ].producer ? producers : consumers;
+        if ( !edit.changed && edit.endpoints.empty() )
+        {
+            edit.endpoints = edit.table->getEndpoints();
+        }
+        edit.changed = applyUpdate( updates[ i ], edit ) || edit.changed;
+    }
+    if ( !producers.changed && !consumers.changed )
+    {
+        return true;
+    }
+
+    publish( producers.changed ? std::make_shared<EndpointTable>( producers.endpoints ) : snapshot->producers, producers.digest,
+        consumers.changed ? std::make_shared<EndpointTable>( consumers.endpoints ) : snapshot->consumers, consumers.digest );
+    ++mPublishedUpdates;
+    mTotalUpdateNs += std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start ).count();
+    return true;
+}
+
+std::shared_ptr<const FabricInventory::Snapshot> FabricInventory::getSnapshot() const
+{
+    return std::atomic_load( &mSnapshot );
+}
+
+FabricInventory::Stats FabricInventory::getStats() const
+{
+    std::lock_guard<std::mutex> lock( mUpdateMutex );
+    std::lock_guard<std::mutex> pendingLock( mPendingMutex );
+    Stats stats = mStats;
+    stats.updateSnapshots = mPublishedUpdates;
+    stats.averageUpdateUs = mPublishedUpdates > 0 ? mTotalUpdateNs / 1000.0 / mPublishedUpdates : 0;
+    return stats;
+}
+
+std::string FabricInventory::getTopic( const std::string& in_fabricId )
+{
+    return TOPIC_PREFIX + in_fabricId + ".*";
+}
+
+std::string FabricInventory::getFabricId( const std::string& in_topic )
+{
+    size_t prefixLength = std::char_traits<char>::length( TOPIC_PREFIX );
+    if ( in_topic.compare( 0, prefixLength, TOPIC_PREFIX ) != 0 )
+    {
+        return std::string();
+    }
+    size_t end = in_topic.find( '.', prefixLength );
+    if ( end == std::string::npos )
+    {
+        return std::string();
+    }
+    return in_topic.substr( prefixLength, end - prefixLength );
+}
+
+bool FabricInventory::fetch( std::vector<EndpointTable::Endpoint>& out_producers, std::vector<EndpointTable::Endpoint>& out_consumers )
+{
+    return getMatrixProducers( mBaseUrl, mTokenManager, mFabricId, collectEndpoints( "producer", out_producers ) )
+        && getMatrixConsumers( mBaseUrl, mTokenManager, mFabricId, collectEndpoints( "consumer", out_consumers ) );
+}
+
+bool FabricInventory::findEndpoint( const Edit& in_edit, const std::string& in_id, size_t& out_position )
+{
+    // Either position is checked: an endpoint removed or moved since leaves a
+    // stale one behind.
+    std::unordered_map<std::string, size_t>::const_iterator moved = in_edit.moved.find( in_id );
+    if ( moved != in_edit.moved.end() )
+    {
+        out_position = moved->second;
+    }
+    else if ( const EndpointTable::Endpoint* endpoint = in_edit.table ? in_edit.table->findById( in_id ) : NULL )
+    {
+        out_position = static_cast<size_t>( endpoint - in_edit.table->getEndpoints().data() );
+    }
+    else
+    {
+        return false;
+    }
+    return out_position < in_edit.endpoints.size() && in_edit.endpoints[ out_position ].id == in_id;
+}
+
+bool FabricInventory::applyUpdate( const Update& in_update, Edit& io_edit )
+{
+    std::vector<EndpointTable::Endpoint>& endpoints = io_edit.endpoints;
+    const std::string& id = in_update.endpoint.id;
+    size_t position;
+    bool found = findEndpoint( io_edit, id, position );
+
+    if ( in_update.removed )
+    {
+        if ( !found )
+        {
+            return false;
+        }
+        io_edit.digest -= hashEndpoint( endpoints[ position ] );
+        io_edit.moved.erase( id );
+        if ( position + 1 < endpoints.size() )
+        {
+            endpoints[ position ] = std::move( endpoints.back() );
+            io_edit.moved[ endpoints[ position ].id ] = position;
+        }
+        endpoints.pop_back();
+        return true;
+    }
+
+    if ( !found )
+    {
+        io_edit.moved[ id ] = endpoints.size();
+        endpoints.push_back( in_update.endpoint );
+    }
+    else if ( isSameEndpoint( endpoints[ position ], in_update.endpoint ) )
+    {
+        return false;
+    }
+    else
+    {
+        io_edit.digest -= hashEndpoint( endpoints[ position ] );
+        endpoints[ position ] = in_update.endpoint;
+    }
+    io_edit.digest += hashEndpoint( in_update.endpoint );
+    return true;
+}
+
+bool FabricInventory::synchronize( bool in_force )
+{
+    size_t replayStart;
+    {
+        std::lock_guard<std::mutex> lock( mUpdateMutex );
+        ++mFetches;
+        replayStart = mReplay.size();
+    }
+
+    std::vector<EndpointTable::Endpoint> producers;
+    std::vector<EndpointTable::Endpoint> consumers;
+    bool result = fetch( producers, consumers );
+
+    std::lock_guard<std::mutex> lock( mUpdateMutex );
+    if ( result )
+    {
+        // The listings may predate the notifications received meanwhile.
+        Edit producerEdit( NULL, digestEndpoints( producers ) );
+        Edit consumerEdit( NULL, digestEndpoints( consumers ) );
+        producerEdit.endpoints.swap( producers );
+        consumerEdit.endpoints.swap( consumers );
+        if ( replayStart < mReplay.size() )
+        {
+            // Without a table, every endpoint is found through moved.
+            for ( size_t i = 0; i < producerEdit.endpoints.size(); ++i )
+            {
+                producerEdit.moved.insert( std::make_pair( producerEdit.endpoints[ i ].id, i ) );
+            }
+            for ( size_t i = 0; i < consumerEdit.endpoints.size(); ++i )
+            {
+                consumerEdit.moved.insert( std::make_pair( consumerEdit.endpoints[ i ].id, i ) );
+            }
+        }
+        for ( size_t i = replayStart; i < mReplay.size(); ++i )
+        {
+            applyUpdate( mReplay[ i ], mReplay[ i ].producer ? producerEdit : consumerEdit );
+        }
+        producers.swap( producerEdit.endpoints );
+        consumers.swap( consumerEdit.endpoints );
+        uint64_t producersDigest = producerEdit.digest;
+        uint64_t consumersDigest = consumerEdit.digest;
+
+        std::shared_ptr<const Snapshot> snapshot = std::atomic_load( &mSnapshot );
+        bool changed = !snapshot || snapshot->producersDigest != producersDigest || snapshot->consumersDigest != consumersDigest;
+        if ( !in_force )
+        {
+            ++mStats.revalidations;
+            mStats.revalidationChanges += changed ? 1 : 0;
+        }
+        if ( in_force || changed )
+        {
+            publish( std::make_shared<EndpointTable>( producers ), producersDigest,
+                std::make_shared<EndpointTable>( consumers ), consumersDigest );
+        }
+    }
+
+    if ( --mFetches == 0 )
+    {
+        mReplay.clear();
+    }
+    return result;
+}
+
+void FabricInventory::publish( const std::shared_ptr<const EndpointTable>& in_producers, uint64_t in_producersDigest,
+    const std::shared_ptr<const EndpointTable>& in_consumers, uint64_t in_consumersDigest )
+{
+    std::shared_ptr<Snapshot> snapshot = std::make_shared<Snapshot>();
+    snapshot->version = ++mStats.version;
+    snapshot->producers = in_producers;
+    snapshot->consumers = in_consumers;
+    snapshot->producersDigest = in_producersDigest;
+    snapshot->consumersDigest = in_consumersDigest;
+    std::atomic_store( &mSnapshot, std::shared_ptr<const Snapshot>( snapshot ) );
+}
+
+void FabricInventory::run( std::chrono::seconds in_interval )
+{
+    std::unique_lock<std::mutex> lock( mRunMutex );
+    while ( mRunning )
+    {
+        if ( mRunCondition.wait_for( lock, in_interval, [this]()
+        {
+            return !mRunning;
+        } ) )
+        {
+            break;
+        }
+
+        lock.unlock();
+        revalidate();
+        lock.lock();
+    }
+}
@@ -0,0 +1,174 @@
+//
+// Copyright Grass Valley
+//
+
+#ifndef FABRIC_INVENTORY_H_
+#define FABRIC_INVENTORY_H_
+
+#include "EndpointTable.h"
+#include "RpcProtocol.h"
+#include "TokenManager.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Producers and consumers of one fabric, kept up to date.
+//
+// load() takes a full snapshot of the fabric. applyNotification() then applies
+// the inventory changes published on "gv.cluster.matrix.<fabric>.*": an event
+// naming a producer or a consumer adds or replaces it (by id) with the endpoint
+// carried in the content, or removes it if the event name contains "removed"
+// or "deleted". Other events, such as routemade, are ignored.
+//
+// A background thread started by start() revalidates the snapshot
+// periodically, in case a notification was missed: the listings are fetched
+// again (only their headers if an HttpCache is installed and nothing changed)
+// and their digest compared with the snapshot's. A new snapshot is only built
+// if they differ.
+//
+// Every change publishes a new immutable snapshot with the next version, so
+// readers on any thread get consistent lookups without taking a lock; a
+// snapshot they hold stays valid after it is replaced.
+class FabricInventory
+{
+public:
+    struct Snapshot
+    {
+        uint64_t version; // 1 for the first load, incremented by every change.
+        // Shared with the next snapshot when a change leaves them untouched.
+        std::shared_ptr<const EndpointTable> producers;
+        std::shared_ptr<const EndpointTable> consumers;
+
+        // Order-independent hashes of the endpoints of each table.
+        uint64_t producersDigest;
+        uint64_t consumersDigest;
+    };
+
+    struct Stats
+    {
+        uint64_t version;
+        uint64_t updatesApplied;
+        uint64_t updatesIgnored; // Notifications that were not inventory changes of this fabric.
+        uint64_t updateSnapshots; // Snapshots published by updates, fewer when they came in bursts.
+        uint64_t revalidations;
+        uint64_t revalidationChanges; // Revalidations that found the snapshot stale.
+        double averageUpdateUs; // Time taken to publish a snapshot updated by notifications.
+    };
+
+    FabricInventory( const std::string& in_baseUrl, TokenManager& in_tokenManager, const std::string& in_fabricId );
+
+    // Stops the revalidation.
+    ~FabricInventory();
+
+    // Fetches the producers and consumers and publishes them as a new snapshot.
+    bool load();
+
+    // Fetches the producers and consumers and publishes them only if they
+    // differ from the current snapshot. Notifications applied while they were
+    // fetched are applied again on top of them.
+    bool revalidate();
+
+    // Starts revalidating every in_interval.
+    void start( std::chrono::seconds in_interval );
+
+    void stop();
+
+    // Applies an inventory notification of this fabric, along with any other
+    // received meanwhile. Returns false if it was not an inventory change.
+    // May be called from several threads at once.
+    bool applyNotification( const ReceivedNotificationModel& in_notification );
+
+    // The current snapshot, a null pointer before the first load().
+    std::shared_ptr<const Snapshot> getSnapshot() const;
+
+    const std::string& getFabricId() const
+    {
+        return mFabricId;
+    }
+
+    Stats getStats() const;
+
+    // The topic of the notifications of a fabric.
+    static std::string getTopic( const std::string& in_fabricId );
+
+    // The fabric id of a "gv.cluster.matrix.<fabric>.<event>" topic, empty for
+    // any other topic.
+    static std::string getFabricId( const std::string& in_topic );
+
+private:
+    struct Update
+    {
+        bool producer;
+        bool removed;
+        EndpointTable::Endpoint endpoint;
+    };
+
+    FabricInventory( const FabricInventory& );
+    FabricInventory& operator=( const FabricInventory& );
+
+    bool fetch( std::vector<EndpointTable::Endpoint>& out_producers, std::vector<EndpointTable::Endpoint>& out_consumers );
+
+    // Endpoints being updated: a copy of those of a table, found by id through
+    // the index of the table, or through moved once an update moved them.
+    struct Edit
+    {
+        Edit( const EndpointTable* in_table, uint64_t in_digest );
+
+        const EndpointTable* table; // NULL if the endpoints are not a copy of a table.
+        std::vector<EndpointTable::Endpoint> endpoints;
+        std::unordered_map<std::string, size_t> moved; // Position by id, when not the one in the table.
+        uint64_t digest;
+        bool changed;
+    };
+
+    // The position of an endpoint in in_edit.endpoints. Returns false if there is none.
+    static bool findEndpoint( const Edit& in_edit, const std::string& in_id, size_t& out_position );
+
+    // Applies an update to the endpoints. Removed endpoints are replaced by the
+    // last one. Returns false if it changes nothing.
+    static bool applyUpdate( const Update& in_update, Edit& io_edit );
+
+    // Fetches the listings, applies the updates received meanwhile and
+    // publishes them, unconditionally or only if they changed.
+    bool synchronize( bool in_force );
+
+    // Publishes a snapshot with the next version. Called with mUpdateMutex held.
+    void publish( const std::shared_ptr<const EndpointTable>& in_producers, uint64_t in_producersDigest,
+        const std::shared_ptr<const EndpointTable>& in_consumers, uint64_t in_consumersDigest );
+
+    void run( std::chrono::seconds in_interval );
+
+    std::string mBaseUrl;
+    TokenManager& mTokenManager;
+    std::string mFabricId;
+
+    // Read with std::atomic_load, replaced with std::atomic_store.
+    std::shared_ptr<const Snapshot> mSnapshot;
+
+    // Serializes the writers; readers never take it. Taken before
+    // mPendingMutex when both are needed.
+    mutable std::mutex mUpdateMutex;
+    uint64_t mFetches; // Fetches in progress, during which updates are kept in mReplay.
+    std::vector<Update> mReplay;
+    uint64_t mPublishedUpdates;
+    uint64_t mTotalUpdateNs;
+
+    // Updates not applied yet. The notification counters of mStats are
+    // written under this mutex, the others under mUpdateMutex.
+    mutable std::mutex mPendingMutex;
+    std::vector<Update> mPending;
+    Stats mStats;
+
+    std::mutex mRunMutex;
+    std::condition_variable mRunCondition;
+    bool mRunning;
+    std::thread mThread;
+};
+
+#endif /* FABRIC_INVENTORY_H_ */
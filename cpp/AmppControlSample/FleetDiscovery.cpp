@@ -0,0 +1,155 @@
+//
+// Copyright Grass Valley
+//
+
+#include "FleetDiscovery.h"
+#include "AmppControlUtil.h"
+#include "RpcProtocol.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+const size_t FleetDiscovery::DEFAULT_WINDOW;
+
+//********************************************************************************
+// FleetDiscovery
+//********************************************************************************
+
+FleetDiscovery::FleetDiscovery( AsyncRestClient& in_client, const std::string& in_baseUrl,
+    TokenManager& in_tokenManager )
+    : mClient( in_client )
+    , mBaseUrl( in_baseUrl )
+    , mTokenManager( in_tokenManager )
+    , mNext( 0 )
+    , mCompleted( 0 )
+{
+    mStats = Stats();
+}
+
+bool FleetDiscovery::discover( size_t in_window )
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    mApplications.clear();
+    mWorkloadsByApplication.clear();
+    mApplicationByWorkload.clear();
+    mStats = Stats();
+
+    // The references are parsed one by one as they arrive.
+    bool result = getAmppControlApplications( mBaseUrl, mTokenManager, [this]( json& in_application )
+    {
+        if ( in_application.is_object() )
+        {
+            json::const_iterator name = in_application.find( "name" );
+            if ( name != in_application.end() && name->is_string() )
+            {
+                mApplications.push_back( name->get<std::string>() );
+            }
+        }
+        return true;
+    } );
+    if ( !result )
+    {
+        return false;
+    }
+    mWorkloadsByApplication.reserve( mApplications.size() );
+
+    std::unique_lock<std::mutex> lock( mMutex );
+    // One token for the whole burst; the token manager keeps it valid for minutes.
+    mHeaders.clear();
+    mHeaders.push_back( "Content-Type: application/json" );
+    mHeaders.push_back( "Accept: application/json" );
+    mHeaders.push_back( "Authorization: Bearer " + mTokenManager.getBearerToken() );
+    mCompleted = 0;
+    mNext = 0;
+    while ( mNext < mApplications.size() && mNext < std::max<size_t>( in_window, 1 ) )
+    {
+        requestWorkloads( mNext++ );
+    }
+
+    mCondition.wait( lock, [this]()
+    {
+        return mCompleted == mApplications.size();
+    } );
+
+    mStats.applications = mApplications.size();
+    mStats.workloads = mApplicationByWorkload.size();
+    mStats.wallTimeMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start ).count();
+    return true;
+}
+
+const std::vector<std::string>* FleetDiscovery::getWorkloads( const std::string& in_application ) const
+{
+    std::unordered_map<std::string, std::vector<std::string> >::const_iterator it = mWorkloadsByApplication.find( in_application );
+    return it != mWorkloadsByApplication.end() ? &it->second : NULL;
+}
+
+const std::string* FleetDiscovery::getApplication( const std::string& in_workload ) const
+{
+    std::unordered_map<std::string, std::string>::const_iterator it = mApplicationByWorkload.find( in_workload );
+    return it != mApplicationByWorkload.end() ? &it->second : NULL;
+}
+
+void FleetDiscovery::requestWorkloads( size_t in_index )
+{
+    // The workload IDs are collected as the response arrives, then indexed at once.
+    std::shared_ptr<std::vector<std::string> > workloads = std::make_shared<std::vector<std::string> >();
+    std::shared_ptr<JsonArrayStream> stream = std::make_shared<JsonArrayStream>( [workloads]( json& in_workload )
+    {
+        if ( in_workload.is_string() )
+        {
+            workloads->push_back( in_workload.get<std::string>() );
+        }
+        return true;
+    } );
+
+    RestClient::Request request;
+    request.url = mBaseUrl + "/ampp/control/api/v1/control/application/" + mApplications[ in_index ] + "/workloads";
+    request.endpoint = WORKLOADS_ENDPOINT;
+    request.headers = mHeaders;
+    request.onBody = [stream]( const char* in_data, size_t in_length )
+    {
+        return stream->feed( in_data, in_length );
+    };
+
+    mClient.perform( request, [this, in_index, stream, workloads]( const RestClient::Response& in_response )
+    {
+        bool success = in_response.httpCode >= 200 && in_response.httpCode <= 299 && stream->isComplete();
+        onWorkloads( in_index, success, in_response, *workloads );
+    } );
+}
+
+void FleetDiscovery::onWorkloads( size_t in_index, bool in_success, const RestClient::Response& in_response,
+    std::vector<std::string>& io_workloads )
+{
+    const std::string& application = mApplications[ in_index ];
+
+    std::lock_guard<std::mutex> lock( mMutex );
+    if ( in_success )
+    {
+        for ( size_t i = 0; i < io_workloads.size(); ++i )
+        {
+            mApplicationByWorkload[ io_workloads[ i ] ] = application;
+        }
+        mWorkloadsByApplication[ application ].swap( io_workloads );
+    }
+    else
+    {
+        mWorkloadsByApplication[ application ];
+        ++mStats.failedApplications;
+        std::cout << "Get Ampp Workloads of " << application << " error: "
+            << ( !in_response.error.empty() ? in_response.error
+                : in_response.httpCode >= 200 && in_response.httpCode <= 299 ? std::string( "invalid JSON array" )
+                : "http code " + std::to_string( in_response.httpCode ) )
+            << std::endl;
+    }
+
+    if ( mNext < mApplications.size() )
+    {
+        requestWorkloads( mNext++ );
+    }
+    ++mCompleted;
+    mCondition.notify_one();
+}
@@ -0,0 +1,85 @@
+//
+// Copyright Grass Valley
+//
+
+#ifndef FLEET_DISCOVERY_H_
+#define FLEET_DISCOVERY_H_
+
+#include "AsyncRestClient.h"
+#include "TokenManager.h"
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Discovers every application registered to Ampp Control and all of their
+// workloads.
+//
+// The application references are requested first, then the workloads of all
+// applications through an AsyncRestClient, at most a window of requests in
+// flight at a time, all with the same bearer token. Responses are parsed as
+// they arrive (see JsonArrayStream). The result is indexed both ways: the
+// workloads of an application and the application of a workload are both
+// found with one hash lookup.
+class FleetDiscovery
+{
+public:
+    // Workload requests in flight at once, by default.
+    static const size_t DEFAULT_WINDOW = 16;
+
+    struct Stats
+    {
+        size_t applications;
+        size_t workloads;
+        size_t failedApplications; // Applications whose workloads could not be retrieved.
+        long long wallTimeMs;
+    };
+
+    FleetDiscovery( AsyncRestClient& in_client, const std::string& in_baseUrl, TokenManager& in_tokenManager );
+
+    // Replaces the index with the current state of the fleet. Returns false if
+    // the application references could not be retrieved.
+    bool discover( size_t in_window = DEFAULT_WINDOW );
+
+    const std::vector<std::string>& getApplications() const
+    {
+        return mApplications;
+    }
+
+    // Returns NULL if the application is unknown.
+    const std::vector<std::string>* getWorkloads( const std::string& in_application ) const;
+
+    // Returns NULL if the workload is unknown.
+    const std::string* getApplication( const std::string& in_workload ) const;
+
+    Stats getStats() const
+    {
+        return mStats;
+    }
+
+private:
+    void requestWorkloads( size_t in_index );
+    void onWorkloads( size_t in_index, bool in_success, const RestClient::Response& in_response,
+        std::vector<std::string>& io_workloads );
+
+    AsyncRestClient& mClient;
+    std::string mBaseUrl;
+    TokenManager& mTokenManager;
+
+    std::vector<std::string> mApplications;
+    std::unordered_map<std::string, std::vector<std::string> > mWorkloadsByApplication;
+    std::unordered_map<std::string, std::string> mApplicationByWorkload;
+    Stats mStats;
+
+    // Guards the state of a discover() in progress, updated on the io thread.
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::vector<std::string> mHeaders;
+    size_t mNext;
+    size_t mCompleted;
+};
+
+#endif /* FLEET_DISCOVERY_H_ */
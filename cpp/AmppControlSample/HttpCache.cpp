@@ -0,0 +1,450 @@
+//
+// Copyright Grass Valley
+//
+
+#include "HttpCache.h"
+
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    const uint32_t MAGIC = 0x43485041; // "APHC"
+    const uint32_t VERSION = 1;
+    const size_t INITIAL_SIZE = 1024 * 1024;
+    const size_t RECORD_ALIGNMENT = 8;
+
+    struct FileHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t used; // Bytes of the file holding complete records, header included.
+    };
+
+    size_t alignUp( size_t in_value, size_t in_alignment )
+    {
+        return ( in_value + in_alignment - 1 ) & ~( in_alignment - 1 );
+    }
+
+    // Size of a record, header and padding included.
+    template <typename Record>
+    size_t getRecordSize( const Record* in_record )
+    {
+        return alignUp( sizeof( Record ) + static_cast<size_t>( in_record->urlLength ) + in_record->etagLength
+            + in_record->lastModifiedLength + in_record->bodyLength, RECORD_ALIGNMENT );
+    }
+
+    bool equalsNoCase( const char* in_data, size_t in_length, const char* in_name )
+    {
+        size_t nameLength = strlen( in_name );
+        if ( in_length != nameLength )
+        {
+            return false;
+        }
+        for ( size_t i = 0; i < in_length; ++i )
+        {
+            if ( tolower( static_cast<unsigned char>( in_data[ i ] ) ) != in_name[ i ] )
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+//********************************************************************************
+// HttpCache
+//********************************************************************************
+
+HttpCache::HttpCache()
+    : mData( nullptr )
+    , mSize( 0 )
+#ifdef _WIN32
+    , mFile( INVALID_HANDLE_VALUE )
+    , mMapping( nullptr )
+#else
+    , mFile( -1 )
+#endif
+    , mDeadBytes( 0 )
+{
+    mStats = Stats();
+}
+
+HttpCache::~HttpCache()
+{
+    close();
+}
+
+bool HttpCache::open( const std::string& in_path )
+{
+    std::lock_guard<std::mutex> lock( mMutex );
+    unmap();
+    mIndex.clear();
+    mDeadBytes = 0;
+    mStats = Stats();
+
+    size_t fileSize = 0;
+#ifdef _WIN32
+    mFile = CreateFileA( in_path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL, NULL );
+    LARGE_INTEGER size;
+    if ( mFile == INVALID_HANDLE_VALUE || !GetFileSizeEx( mFile, &size ) )
+    {
+        std::cout << "> Could not open the HTTP cache \"" << in_path << "\": " << GetLastError() << std::endl;
+        unmap();
+        return false;
+    }
+    fileSize = static_cast<size_t>( size.QuadPart );
+#else
+    mFile = ::open( in_path.c_str(), O_RDWR | O_CREAT, 0600 );
+    struct stat info;
+    if ( mFile < 0 || fstat( mFile, &info ) != 0 )
+    {
+        std::cout << "> Could not open the HTTP cache \"" << in_path << "\": " << strerror( errno ) << std::endl;
+        unmap();
+        return false;
+    }
+    fileSize = static_cast<size_t>( info.st_size );
+#endif
+    mPath = in_path;
+
+    if ( !map( fileSize > INITIAL_SIZE ? fileSize : INITIAL_SIZE ) )
+    {
+        return false;
+    }
+
+    FileHeader* header = reinterpret_cast<FileHeader*>( mData );
+    if ( fileSize < sizeof( FileHeader ) || header->magic != MAGIC || header->version != VERSION
+        || header->used < sizeof( FileHeader ) || header->used > mSize )
+    {
+        header->magic = MAGIC;
+        header->version = VERSION;
+        header->used = sizeof( FileHeader );
+    }
+
+    // Indexes the records; a later record for a URL replaces the earlier one.
+    size_t offset = sizeof( FileHeader );
+    while ( offset + sizeof( RecordHeader ) <= header->used )
+    {
+        const RecordHeader* record = getRecord( offset );
+        size_t recordSize = getRecordSize( record );
+        if ( offset + recordSize > header->used )
+        {
+            break;
+        }
+
+        std::string url( reinterpret_cast<const char*>( record + 1 ), record->urlLength );
+        std::unordered_map<std::string, size_t>::iterator it = mIndex.find( url );
+        if ( it != mIndex.end() )
+        {
+            const RecordHeader* old = getRecord( it->second );
+            mDeadBytes += getRecordSize( old );
+            it->second = offset;
+        }
+        else
+        {
+            mIndex[ url ] = offset;
+        }
+        offset += recordSize;
+    }
+    header->used = offset;
+
+    mStats.entries = mIndex.size();
+    mStats.fileSize = mSize;
+    return true;
+}
+
+void HttpCache::close()
+{
+    std::lock_guard<std::mutex> lock( mMutex );
+    unmap();
+    mIndex.clear();
+}
+
+bool HttpCache::map( size_t in_size )
+{
+#ifdef _WIN32
+    unsigned long long size = in_size;
+    mMapping = CreateFileMappingA( mFile, NULL, PAGE_READWRITE,
+        static_cast<DWORD>( size >> 32 ), static_cast<DWORD>( size & 0xFFFFFFFF ), NULL );
+    if ( mMapping )
+    {
+        mData = static_cast<uint8_t*>( MapViewOfFile( mMapping, FILE_MAP_ALL_ACCESS, 0, 0, in_size ) );
+    }
+    if ( !mData )
+    {
+        std::cout << "> Could not map the HTTP cache \"" << mPath << "\": " << GetLastError() << std::endl;
+        unmap();
+        return false;
+    }
+#else
+    struct stat info;
+    if ( fstat( mFile, &info ) != 0
+        || ( static_cast<size_t>( info.st_size ) < in_size && ftruncate( mFile, static_cast<off_t>( in_size ) ) != 0 ) )
+    {
+        std::cout << "> Could not size the HTTP cache \"" << mPath << "\": " << strerror( errno ) << std::endl;
+        unmap();
+        return false;
+    }
+
+    void* data = mmap( nullptr, in_size, PROT_READ | PROT_WRITE, MAP_SHARED, mFile, 0 );
+    if ( data == MAP_FAILED )
+    {
+        std::cout << "> Could not map the HTTP cache \"" << mPath << "\": " << strerror( errno ) << std::endl;
+        unmap();
+        return false;
+    }
+    mData = static_cast<uint8_t*>( data );
+#endif
+    mSize = in_size;
+    return true;
+}
+
+void HttpCache::unmap()
+{
+#ifdef _WIN32
+    if ( mData )
+    {
+        UnmapViewOfFile( mData );
+    }
+    if ( mMapping )
+    {
+        CloseHandle( mMapping );
+        mMapping = nullptr;
+    }
+    if ( mFile != INVALID_HANDLE_VALUE )
+    {
+        CloseHandle( mFile );
+        mFile = INVALID_HANDLE_VALUE;
+    }
+#else
+    if ( mData )
+    {
+        munmap( mData, mSize );
+    }
+    if ( mFile >= 0 )
+    {
+        ::close( mFile );
+        mFile = -1;
+    }
+#endif
+    mData = nullptr;
+    mSize = 0;
+}
+
+const HttpCache::RecordHeader* HttpCache::getRecord( size_t in_offset ) const
+{
+    return reinterpret_cast<const RecordHeader*>( mData + in_offset );
+}
+
+bool HttpCache::reserve( size_t in_size )
+{
+    FileHeader* header = reinterpret_cast<FileHeader*>( mData );
+    if ( header->used + in_size <= mSize )
+    {
+        return true;
+    }
+
+    if ( mDeadBytes > header->used / 2 )
+    {
+        compact();
+        header = reinterpret_cast<FileHeader*>( mData );
+        if ( header->used + in_size <= mSize )
+        {
+            return true;
+        }
+    }
+
+    size_t size = mSize;
+    while ( header->used + in_size > size )
+    {
+        size *= 2;
+    }
+
+    // Remaps the file at its new size; the file itself stays open.
+#ifdef _WIN32
+    UnmapViewOfFile( mData );
+    CloseHandle( mMapping );
+    mMapping = nullptr;
+#else
+    munmap( mData, mSize );
+#endif
+    mData = nullptr;
+    if ( !map( size ) )
+    {
+        mIndex.clear();
+        return false;
+    }
+    mStats.fileSize = mSize;
+    return true;
+}
+
+void HttpCache::compact()
+{
+    FileHeader* header = reinterpret_cast<FileHeader*>( mData );
+    std::string live;
+    live.reserve( header->used - mDeadBytes );
+    for ( std::unordered_map<std::string, size_t>::iterator it = mIndex.begin(); it != mIndex.end(); ++it )
+    {
+        const RecordHeader* record = getRecord( it->second );
+        size_t recordSize = getRecordSize( record );
+        it->second = sizeof( FileHeader ) + live.size();
+        live.append( reinterpret_cast<const char*>( record ), recordSize );
+    }
+
+    // Records are only moved towards the start of the file.
+    header->used = sizeof( FileHeader );
+    memcpy( mData + sizeof( FileHeader ), live.data(), live.size() );
+    header->used = sizeof( FileHeader ) + live.size();
+    mDeadBytes = 0;
+}
+
+void HttpCache::store( const std::string& in_url, const Validators& in_validators, const std::string& in_body )
+{
+    size_t recordSize = alignUp( sizeof( RecordHeader ) + in_url.size() + in_validators.etag.size()
+        + in_validators.lastModified.size() + in_body.size(), RECORD_ALIGNMENT );
+    if ( !mData || in_body.size() > UINT32_MAX || !reserve( recordSize ) )
+    {
+        return;
+    }
+
+    FileHeader* header = reinterpret_cast<FileHeader*>( mData );
+    size_t offset = static_cast<size_t>( header->used );
+    RecordHeader* record = reinterpret_cast<RecordHeader*>( mData + offset );
+    record->urlLength = static_cast<uint32_t>( in_url.size() );
+    record->etagLength = static_cast<uint32_t>( in_validators.etag.size() );
+    record->lastModifiedLength = static_cast<uint32_t>( in_validators.lastModified.size() );
+    record->bodyLength = static_cast<uint32_t>( in_body.size() );
+    uint8_t* data = reinterpret_cast<uint8_t*>( record + 1 );
+    memcpy( data, in_url.data(), in_url.size() );
+    data += in_url.size();
+    memcpy( data, in_validators.etag.data(), in_validators.etag.size() );
+    data += in_validators.etag.size();
+    memcpy( data, in_validators.lastModified.data(), in_validators.lastModified.size() );
+    data += in_validators.lastModified.size();
+    memcpy( data, in_body.data(), in_body.size() );
+    header->used = offset + recordSize;
+
+    std::unordered_map<std::string, size_t>::iterator it = mIndex.find( in_url );
+    if ( it != mIndex.end() )
+    {
+        const RecordHeader* old = getRecord( it->second );
+        mDeadBytes += getRecordSize( old );
+        it->second = offset;
+    }
+    else
+    {
+        mIndex[ in_url ] = offset;
+    }
+    ++mStats.stored;
+    mStats.entries = mIndex.size();
+}
+
+void HttpCache::addConditionalHeaders( const std::string& in_url, struct curl_slist*& io_headers )
+{
+    std::lock_guard<std::mutex> lock( mMutex );
+    std::unordered_map<std::string, size_t>::const_iterator it = mIndex.find( in_url );
+    if ( it == mIndex.end() )
+    {
+        return;
+    }
+
+    const RecordHeader* record = getRecord( it->second );
+    const char* etag = reinterpret_cast<const char*>( record + 1 ) + record->urlLength;
+    const char* lastModified = etag + record->etagLength;
+    if ( record->etagLength > 0 )
+    {
+        io_headers = curl_slist_append( io_headers, ( "If-None-Match: " + std::string( etag, record->etagLength ) ).c_str() );
+    }
+    if ( record->lastModifiedLength > 0 )
+    {
+        io_headers = curl_slist_append( io_headers,
+            ( "If-Modified-Since: " + std::string( lastModified, record->lastModifiedLength ) ).c_str() );
+    }
+}
+
+bool HttpCache::complete( const std::string& in_url, const Validators& in_validators,
+    long& io_httpCode, std::string& io_body )
+{
+    std::lock_guard<std::mutex> lock( mMutex );
+    if ( io_httpCode == 304 )
+    {
+        std::unordered_map<std::string, size_t>::const_iterator it = mIndex.find( in_url );
+        if ( it == mIndex.end() )
+        {
+            return false;
+        }
+
+        const RecordHeader* record = getRecord( it->second );
+        const char* body = reinterpret_cast<const char*>( record + 1 )
+            + record->urlLength + record->etagLength + record->lastModifiedLength;
+        io_body.assign( body, record->bodyLength );
+        io_httpCode = 200;
+        ++mStats.revalidated;
+        mStats.savedBytes += record->bodyLength;
+        return true;
+    }
+
+    if ( io_httpCode == 200 && ( !in_validators.etag.empty() || !in_validators.lastModified.empty() ) )
+    {
+        store( in_url, in_validators, io_body );
+    }
+    return false;
+}
+
+HttpCache::Stats HttpCache::getStats() const
+{
+    std::lock_guard<std::mutex> lock( mMutex );
+    return mStats;
+}
+
+size_t HttpCache::headerFunction( char* in_data, size_t in_size, size_t in_count, void* in_validators )
+{
+    Validators* validators = static_cast<Validators*>( in_validators );
+    size_t length = in_size * in_count;
+
+    // A new status line (after a redirect or a 100 Continue) starts a new response.
+    if ( length >= 5 && strncmp( in_data, "HTTP/", 5 ) == 0 )
+    {
+        *validators = Validators();
+        return length;
+    }
+
+    const char* colon = static_cast<const char*>( memchr( in_data, ':', length ) );
+    if ( !colon )
+    {
+        return length;
+    }
+    const char* value = colon + 1;
+    const char* end = in_data + length;
+    while ( value < end && ( *value == ' ' || *value == '\t' ) )
+    {
+        ++value;
+    }
+    while ( end > value && ( end[ -1 ] == '\r' || end[ -1 ] == '\n' || end[ -1 ] == ' ' ) )
+    {
+        --end;
+    }
+
+    size_t nameLength = colon - in_data;
+    if ( equalsNoCase( in_data, nameLength, "etag" ) )
+    {
+        validators->etag.assign( value, end - value );
+    }
+    else if ( equalsNoCase( in_data, nameLength, "last-modified" ) )
+    {
+        validators->lastModified.assign( value, end - value );
+    }
+    return length;
+}
@@ -0,0 +1,109 @@
+//
+// Copyright Grass Valley
+//
+
+#ifndef HTTP_CACHE_H_
+#define HTTP_CACHE_H_
+
+#include <curl/curl.h>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Persistent cache of GET responses revalidated with conditional requests.
+//
+// Responses carrying an ETag or a Last-Modified header are stored with them in
+// a file mapped in memory. The next GET of the same URL, in this process or
+// after a restart, is sent with If-None-Match / If-Modified-Since, and a 304
+// answer is completed with the cached body: only headers cross the network.
+//
+// The file is an append-only log of records behind a small header. A record
+// replacing an older one for the same URL leaves the older one dead; the file
+// is compacted when dead records take more than half of it, and grown when
+// full. The header's used size is written after the record it covers, so an
+// interrupted write is ignored at the next load.
+//
+// RestClient and AsyncRestClient use the cache installed with
+// RestClient::setCache(). All methods may be called from any thread; a file
+// must only be used by one process at a time.
+class HttpCache
+{
+public:
+    // ETag and Last-Modified of a response, collected by headerFunction().
+    struct Validators
+    {
+        std::string etag;
+        std::string lastModified;
+    };
+
+    struct Stats
+    {
+        uint64_t entries;
+        uint64_t revalidated; // 304 answers served from the cache.
+        uint64_t stored;
+        uint64_t savedBytes; // Body bytes not downloaded thanks to 304 answers.
+        uint64_t fileSize;
+    };
+
+    HttpCache();
+    ~HttpCache();
+
+    // Maps the cache file, creating it if needed, and indexes its records.
+    bool open( const std::string& in_path );
+
+    void close();
+
+    // Adds the conditional headers for a GET of in_url, if it is cached.
+    void addConditionalHeaders( const std::string& in_url, struct curl_slist*& io_headers );
+
+    // Completes a GET response: a 304 gets the cached body and becomes a 200,
+    // a 200 with validators is stored. Returns true if the body came from the
+    // cache.
+    bool complete( const std::string& in_url, const Validators& in_validators,
+        long& io_httpCode, std::string& io_body );
+
+    Stats getStats() const;
+
+    // CURLOPT_HEADERFUNCTION collecting the validators into the Validators
+    // passed as CURLOPT_HEADERDATA.
+    static size_t headerFunction( char* in_data, size_t in_size, size_t in_count, void* in_validators );
+
+private:
+    struct RecordHeader
+    {
+        uint32_t urlLength;
+        uint32_t etagLength;
+        uint32_t lastModifiedLength;
+        uint32_t bodyLength;
+    };
+
+    HttpCache( const HttpCache& );
+    HttpCache& operator=( const HttpCache& );
+
+    bool map( size_t in_size );
+    void unmap();
+    bool reserve( size_t in_size );
+    void compact();
+    const RecordHeader* getRecord( size_t in_offset ) const;
+    void store( const std::string& in_url, const Validators& in_validators, const std::string& in_body );
+
+    mutable std::mutex mMutex;
+    std::string mPath;
+    uint8_t* mData;
+    size_t mSize;
+#ifdef _WIN32
+    void* mFile;
+    void* mMapping;
+#else
+    int mFile;
+#endif
+
+    // Offset of the live record of each URL.
+    std::unordered_map<std::string, size_t> mIndex;
+    size_t mDeadBytes;
+    Stats mStats;
+};
+
+#endif /* HTTP_CACHE_H_ */
@@ -0,0 +1,202 @@
+//
+// Copyright Grass Valley
+//
+
+#include "JsonArrayStream.h"
+
+namespace
+{
+    bool isWhitespace( char in_c )
+    {
+        return in_c == ' ' || in_c == '\t' || in_c == '\r' || in_c == '\n';
+    }
+}
+
+//********************************************************************************
+// JsonArrayStream
+//********************************************************************************
+
+JsonArrayStream::JsonArrayStream( ElementCallback in_callback, const std::string& in_key )
+    : mCallback( in_callback )
+    , mKey( in_key )
+    , mStarted( false )
+    , mFailed( false )
+    , mComplete( false )
+    , mCount( 0 )
+    , mDepth( 0 )
+    , mArrayDepth( 0 )
+    , mInString( false )
+    , mEscape( false )
+    , mExpectKey( false )
+{
+}
+
+bool JsonArrayStream::feed( const char* in_data, size_t in_length )
+{
+    for ( size_t i = 0; i < in_length && !mFailed && !mComplete; ++i )
+    {
+        char c = in_data[ i ];
+
+        // Inside a string, only the end of the string matters.
+        if ( mInString )
+        {
+            if ( mEscape )
+            {
+                mEscape = false;
+            }
+            else if ( c == '\\' )
+            {
+                mEscape = true;
+            }
+            else if ( c == '"' )
+            {
+                mInString = false;
+            }
+
+            if ( !mElement.empty() )
+            {
+                mElement += c;
+            }
+            else if ( mInString && mDepth == 1 && mExpectKey )
+            {
+                mCurrentKey += c;
+            }
+            continue;
+        }
+
+        if ( !mElement.empty() )
+        {
+            // An element ends at the separator following it, at the depth of the array.
+            if ( mDepth == mArrayDepth && ( c == ',' || c == ']' || isWhitespace( c ) ) )
+            {
+                if ( !emit() )
+                {
+                    break;
+                }
+            }
+            else
+            {
+                mElement += c;
+                if ( c == '"' )
+                {
+                    mInString = true;
+                }
+                else if ( c == '{' || c == '[' )
+                {
+                    ++mDepth;
+                }
+                else if ( c == '}' || c == ']' )
+                {
+                    --mDepth;
+                }
+                continue;
+            }
+        }
+
+        if ( mArrayDepth > 0 && mDepth == mArrayDepth )
+        {
+            // Between two elements of the array.
+            if ( c == ']' )
+            {
+                --mDepth;
+                mComplete = true;
+            }
+            else if ( c != ',' && !isWhitespace( c ) )
+            {
+                mElement += c;
+                if ( c == '"' )
+                {
+                    mInString = true;
+                }
+                else if ( c == '{' || c == '[' )
+                {
+                    ++mDepth;
+                }
+            }
+            continue;
+        }
+
+        if ( isWhitespace( c ) )
+        {
+            continue;
+        }
+
+        // Looking for the array.
+        if ( !mStarted )
+        {
+            mStarted = true;
+            if ( c != ( mKey.empty() ? '[' : '{' ) )
+            {
+                mFailed = true;
+                break;
+            }
+            mDepth = 1;
+            if ( mKey.empty() )
+            {
+                mArrayDepth = 1;
+            }
+            else
+            {
+                mExpectKey = true;
+            }
+            continue;
+        }
+
+        switch ( c )
+        {
+        case '"':
+            mInString = true;
+            if ( mDepth == 1 && mExpectKey )
+            {
+                mCurrentKey.clear();
+            }
+            break;
+        case ':':
+            if ( mDepth == 1 )
+            {
+                mExpectKey = false;
+            }
+            break;
+        case ',':
+            if ( mDepth == 1 )
+            {
+                mExpectKey = true;
+            }
+            break;
+        case '[':
+            ++mDepth;
+            if ( mDepth == 2 && !mExpectKey && mCurrentKey == mKey )
+            {
+                mArrayDepth = 2;
+            }
+            break;
+        case '{':
+            ++mDepth;
+            break;
+        case '}':
+        case ']':
+            // The document ended without the array.
+            if ( --mDepth <= 0 )
+            {
+                mFailed = true;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    return !mFailed;
+}
+
+bool JsonArrayStream::emit()
+{
+    json element = json::parse( mElement, nullptr, false );
+    mElement.clear();
+    if ( element.is_discarded() || !mCallback( element ) )
+    {
+        mFailed = true;
+        return false;
+    }
+    ++mCount;
+    return true;
+}
@@ -0,0 +1,68 @@
+//
+// Copyright Grass Valley
+//
+
+#ifndef JSON_ARRAY_STREAM_H_
+#define JSON_ARRAY_STREAM_H_
+
+#include "RpcProtocol.h"
+
+#include <functional>
+#include <string>
+
+// Incremental parser of a JSON array received in chunks, e.g. from a curl
+// write callback (see RestClient::Request::onBody).
+//
+// The array is either the whole document or, when a key is given, the member
+// of that name in a top level object. Each element is handed to the callback
+// as soon as its last byte arrives; only the text of the element being
+// received is buffered, never the whole document. Elements are usually small
+// (a workload id, an application reference), so parsing them one by one
+// never builds the DOM of the whole listing.
+class JsonArrayStream
+{
+public:
+    // Returns false to stop the parsing.
+    typedef std::function<bool( json& in_element )> ElementCallback;
+
+    explicit JsonArrayStream( ElementCallback in_callback, const std::string& in_key = "" );
+
+    // Returns false on a syntax error, or if the callback stopped the parsing.
+    bool feed( const char* in_data, size_t in_length );
+
+    // True once the end of the array was received.
+    bool isComplete() const
+    {
+        return mComplete;
+    }
+
+    size_t getCount() const
+    {
+        return mCount;
+    }
+
+private:
+    bool emit();
+
+    ElementCallback mCallback;
+    std::string mKey;
+
+    bool mStarted;
+    bool mFailed;
+    bool mComplete;
+    size_t mCount;
+
+    // Scanner state.
+    int mDepth;
+    int mArrayDepth; // Depth of the elements of the array, 0 until it is found.
+    bool mInString;
+    bool mEscape;
+
+    // Keyed mode: the member name read at depth 1.
+    bool mExpectKey;
+    std::string mCurrentKey;
+
+    std::string mElement;
+};
+
+#endif /* JSON_ARRAY_STREAM_H_ */
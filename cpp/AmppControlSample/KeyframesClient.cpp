@@ -0,0 +1,346 @@
+//
+// Copyright Grass Valley
+//
+
+#include "KeyframesClient.h"
+#include "PushNotificationServer.h"
+#include "Util.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+    const char* getSizeName( KeyframesClient::PreviewSize in_size )
+    {
+        switch ( in_size )
+        {
+        case KeyframesClient::PREVIEW_MEDIUM:
+            return "medium";
+        case KeyframesClient::PREVIEW_LARGE:
+            return "large";
+        default:
+            return "small";
+        }
+    }
+}
+
+//********************************************************************************
+// KeyframesClient
+//********************************************************************************
+
+KeyframesClient::KeyframesClient( websocket_endpoint& in_endpoint, int in_connectionId, RenewalScheduler& in_scheduler,
+    const Options& in_options )
+    : mEndpoint( in_endpoint )
+    , mConnectionId( in_connectionId )
+    , mScheduler( in_scheduler )
+    , mOptions( in_options )
+    , mCatalog( std::make_shared<Catalog>() )
+    , mRunning( false )
+    , mWritePending( false )
+    , mReceived( 0 )
+    , mIgnored( 0 )
+    , mOversized( 0 )
+    , mFramesAdded( 0 )
+    , mWritten( 0 )
+    , mWriteFailures( 0 )
+{
+}
+
+KeyframesClient::~KeyframesClient()
+{
+    stop();
+}
+
+std::string KeyframesClient::addFlow( const std::string& in_nodeId, const std::string& in_flowId )
+{
+    std::string topic = getTopic( in_nodeId, in_flowId, mOptions.previewSize );
+
+    FlowPtr flow = std::make_shared<Flow>();
+    flow->nodeId = in_nodeId;
+    flow->flowId = in_flowId;
+    flow->topic = topic;
+    size_t ringSize = std::max<size_t>( mOptions.framesPerFlow, 1 );
+    flow->frames.resize( ringSize + SPARE_FRAMES );
+    for ( size_t i = 0; i < flow->frames.size(); ++i )
+    {
+        flow->frames[ i ] = std::make_shared<Frame>();
+        flow->frames[ i ]->sequence = 0;
+        flow->frames[ i ]->jpeg.reserve( mOptions.frameCapacity );
+    }
+    flow->ring.resize( ringSize );
+    flow->next = 0;
+    flow->sequence = 0;
+    flow->renewal = 0;
+
+    {
+        std::lock_guard<std::mutex> lock( mCatalogMutex );
+        std::shared_ptr<const Catalog> current = std::atomic_load( &mCatalog );
+        if ( current->byTopic.find( topic ) != current->byTopic.end() )
+        {
+            return topic;
+        }
+        std::shared_ptr<Catalog> catalog = std::make_shared<Catalog>( *current );
+        catalog->byTopic[ topic ] = flow;
+        catalog->byFlowId[ in_flowId ] = flow;
+        std::atomic_store( &mCatalog, std::shared_ptr<const Catalog>( catalog ) );
+    }
+
+    std::lock_guard<std::mutex> lock( mMutex );
+    if ( mRunning )
+    {
+        pushNotificationServerSubscribe( mEndpoint, mConnectionId, getUuid(), topic );
+        requestKeyframes( *flow );
+    }
+    return topic;
+}
+
+void KeyframesClient::start()
+{
+    std::lock_guard<std::mutex> lock( mMutex );
+    if ( mRunning )
+    {
+        return;
+    }
+
+    std::shared_ptr<const Catalog> catalog = std::atomic_load( &mCatalog );
+    for ( std::unordered_map<std::string, FlowPtr>::const_iterator it = catalog->byTopic.begin(); it != catalog->byTopic.end(); ++it )
+    {
+        pushNotificationServerSubscribe( mEndpoint, mConnectionId, getUuid(), it->first );
+        requestKeyframes( *it->second );
+    }
+
+    mRunning = true;
+    mThread = std::thread( &KeyframesClient::run, this );
+}
+
+void KeyframesClient::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock( mMutex );
+        if ( !mRunning )
+        {
+            return;
+        }
+        mRunning = false;
+
+        std::shared_ptr<const Catalog> catalog = std::atomic_load( &mCatalog );
+        for ( std::unordered_map<std::string, FlowPtr>::const_iterator it = catalog->byTopic.begin(); it != catalog->byTopic.end(); ++it )
+        {
+            mScheduler.cancel( it->second->renewal );
+            it->second->renewal = 0;
+        }
+    }
+    mCondition.notify_all();
+    mThread.join();
+
+    std::shared_ptr<const Catalog> catalog = std::atomic_load( &mCatalog );
+    for ( std::unordered_map<std::string, FlowPtr>::const_iterator it = catalog->byTopic.begin(); it != catalog->byTopic.end(); ++it )
+    {
+        pushNotificationServerUnsubscribe( mEndpoint, mConnectionId, getUuid(), it->first );
+    }
+}
+
+void KeyframesClient::onNotification( const ReceivedNotificationModel& in_notification )
+{
+    // Looked up by topic, which needs no allocation.
+    std::shared_ptr<const Catalog> catalog = std::atomic_load( &mCatalog );
+    std::unordered_map<std::string, FlowPtr>::const_iterator it = catalog->byTopic.find( in_notification.getTopic() );
+    if ( it == catalog->byTopic.end() )
+    {
+        return;
+    }
+
+    // As the TypeScript client, the content type may come as the content.
+    const std::vector<uint8_t>& jpeg = in_notification.getBinaryContent();
+    if ( jpeg.empty() || ( in_notification.getContentType() != "image/jpeg" && in_notification.getContent() != "image/jpeg" ) )
+    {
+        ++mIgnored;
+        return;
+    }
+    ++mReceived;
+
+    Flow& flow = *it->second;
+    std::shared_ptr<Frame> frame;
+    {
+        std::lock_guard<std::mutex> lock( flow.mutex );
+        frame = acquireFrame( flow );
+    }
+
+    // The frame is out of the ring and held here: copied without the lock.
+    if ( jpeg.size() > frame->jpeg.capacity() )
+    {
+        ++mOversized;
+    }
+    frame->jpeg.assign( jpeg.begin(), jpeg.end() );
+    frame->received = Clock::now();
+
+    {
+        std::lock_guard<std::mutex> lock( flow.mutex );
+        frame->sequence = ++flow.sequence;
+        flow.ring[ flow.next ] = frame;
+        flow.next = ( flow.next + 1 ) % flow.ring.size();
+    }
+
+    if ( !mOptions.folder.empty() )
+    {
+        {
+            std::lock_guard<std::mutex> lock( mMutex );
+            flow.unwritten = frame;
+            mWritePending = true;
+        }
+        mCondition.notify_all();
+    }
+}
+
+KeyframesClient::FramePtr KeyframesClient::getLatestFrame( const std::string& in_flowId ) const
+{
+    FlowPtr flow = findFlow( in_flowId );
+    if ( !flow )
+    {
+        return FramePtr();
+    }
+    std::lock_guard<std::mutex> lock( flow->mutex );
+    return flow->ring[ ( flow->next + flow->ring.size() - 1 ) % flow->ring.size() ];
+}
+
+bool KeyframesClient::getFrames( const std::string& in_flowId, std::vector<FramePtr>& out_frames ) const
+{
+    out_frames.clear();
+    FlowPtr flow = findFlow( in_flowId );
+    if ( !flow )
+    {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock( flow->mutex );
+    for ( size_t i = 0; i < flow->ring.size(); ++i )
+    {
+        const std::shared_ptr<Frame>& frame = flow->ring[ ( flow->next + i ) % flow->ring.size() ];
+        if ( frame )
+        {
+            out_frames.push_back( frame );
+        }
+    }
+    return true;
+}
+
+KeyframesClient::Stats KeyframesClient::getStats() const
+{
+    Stats stats;
+    stats.received = mReceived.load();
+    stats.ignored = mIgnored.load();
+    stats.oversized = mOversized.load();
+    stats.framesAdded = mFramesAdded.load();
+    stats.written = mWritten.load();
+    stats.writeFailures = mWriteFailures.load();
+    return stats;
+}
+
+std::string KeyframesClient::getTopic( const std::string& in_nodeId, const std::string& in_flowId, PreviewSize in_size )
+{
+    return "gv.ampp.keyframe." + in_nodeId + "." + in_flowId + "." + getSizeName( in_size );
+}
+
+KeyframesClient::FlowPtr KeyframesClient::findFlow( const std::string& in_flowId ) const
+{
+    std::shared_ptr<const Catalog> catalog = std::atomic_load( &mCatalog );
+    std::unordered_map<std::string, FlowPtr>::const_iterator it = catalog->byFlowId.find( in_flowId );
+    return ( it != catalog->byFlowId.end() ) ? it->second : FlowPtr();
+}
+
+std::shared_ptr<KeyframesClient::Frame> KeyframesClient::acquireFrame( Flow& io_flow )
+{
+    // New references to a frame are only taken from the ring, under the flow
+    // lock, or from other references: a frame referenced by io_flow.frames
+    // alone is free, and stays so while the lock is held.
+    for ( size_t i = 0; i < io_flow.frames.size(); ++i )
+    {
+        if ( io_flow.frames[ i ].use_count() == 1 )
+        {
+            // Pairs with the release of the last reader.
+            std::atomic_thread_fence( std::memory_order_acquire );
+            return io_flow.frames[ i ];
+        }
+    }
+
+    ++mFramesAdded;
+    std::shared_ptr<Frame> frame = std::make_shared<Frame>();
+    frame->sequence = 0;
+    frame->jpeg.reserve( mOptions.frameCapacity );
+    io_flow.frames.push_back( frame );
+    return frame;
+}
+
+void KeyframesClient::requestKeyframes( Flow& io_flow )
+{
+    json content;
+    content[ "PreviewSize" ] = static_cast<int>( mOptions.previewSize );
+    content[ "FlowId" ] = io_flow.flowId;
+    std::string topic = "gv.ampp.keyframe." + io_flow.nodeId;
+    std::string request = content.dump();
+    pushNotificationServerSendNotification( mEndpoint, mConnectionId, getUuid(), topic, request );
+    io_flow.renewal = mScheduler.schedule( mConnectionId, topic, request );
+}
+
+void KeyframesClient::writeFrame( const Flow& in_flow, const Frame& in_frame )
+{
+    // Written aside then renamed, so a reader of the file never sees half a frame.
+    std::string path = mOptions.folder + "/" + in_flow.flowId + ".jpg";
+    std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream file( temporaryPath.c_str(), std::ios::binary | std::ios::trunc );
+        file.write( reinterpret_cast<const char*>( in_frame.jpeg.data() ), in_frame.jpeg.size() );
+        if ( !file )
+        {
+            std::cout << "Error saving the keyframe of flow " << in_flow.flowId << " to " << temporaryPath << std::endl;
+            ++mWriteFailures;
+            return;
+        }
+    }
+#ifdef _WIN32
+    std::remove( path.c_str() );
+#endif
+    if ( std::rename( temporaryPath.c_str(), path.c_str() ) != 0 )
+    {
+        std::cout << "Error saving the keyframe of flow " << in_flow.flowId << " to " << path << std::endl;
+        ++mWriteFailures;
+        return;
+    }
+    ++mWritten;
+}
+
+void KeyframesClient::run()
+{
+    std::vector<std::pair<FlowPtr, FramePtr> > writes;
+
+    std::unique_lock<std::mutex> lock( mMutex );
+    while ( mRunning )
+    {
+        if ( !mWritePending )
+        {
+            mCondition.wait( lock );
+            continue;
+        }
+
+        mWritePending = false;
+        std::shared_ptr<const Catalog> catalog = std::atomic_load( &mCatalog );
+        for ( std::unordered_map<std::string, FlowPtr>::const_iterator it = catalog->byTopic.begin(); it != catalog->byTopic.end(); ++it )
+        {
+            if ( it->second->unwritten )
+            {
+                writes.push_back( std::make_pair( it->second, it->second->unwritten ) );
+                it->second->unwritten.reset();
+            }
+        }
+
+        lock.unlock();
+        for ( size_t i = 0; i < writes.size(); ++i )
+        {
+            writeFrame( *writes[ i ].first, *writes[ i ].second );
+        }
+        writes.clear();
+        lock.lock();
+    }
+}
@@ -0,0 +1,177 @@
+//
+// Copyright Grass Valley
+//
+
+#ifndef KEYFRAMES_CLIENT_H_
+#define KEYFRAMES_CLIENT_H_
+
+#include "RenewalScheduler.h"
+#include "RpcProtocol.h"
+#include "Sockets.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Receives the keyframes (JPEG previews) of flows, as the KeyframesClient of
+// the TypeScript SDK, and keeps the last frames of every flow in memory.
+//
+// Each flow is subscribed to on "gv.ampp.keyframe.<node>.<flow>.<size>" and
+// its keyframes are requested from the node, the request being renewed by a
+// RenewalScheduler. The JPEG arrives as the BSON binary content of the
+// notification (bson-rpc transport), and is copied once, into a frame buffer
+// preallocated per flow: a flow has framesPerFlow frames in its ring plus a
+// few spare ones, all reused.
+//
+// Frames are read without copying them: getLatestFrame() and getFrames() hand
+// out shared pointers to the buffers themselves. A frame held by a reader is
+// not reused until released; only when readers hold every frame of a flow is
+// a new one allocated.
+//
+// With a folder, the latest frame of every flow is also written, replacing
+// "<folder>/<flow>.jpg", by a background thread. Frames received while it is
+// writing only replace the frame waiting to be written.
+class KeyframesClient
+{
+public:
+    enum PreviewSize
+    {
+        PREVIEW_SMALL = 120,
+        PREVIEW_MEDIUM = 240,
+        PREVIEW_LARGE = 480
+    };
+
+    struct Options
+    {
+        Options()
+            : previewSize( PREVIEW_SMALL )
+            , framesPerFlow( 8 )
+            , frameCapacity( 64 * 1024 )
+        {
+        }
+
+        PreviewSize previewSize;
+        size_t framesPerFlow;
+        size_t frameCapacity; // Bytes preallocated per frame; a larger frame grows its buffer once.
+        std::string folder; // Where the frames are written, not written if empty.
+    };
+
+    struct Frame
+    {
+        uint64_t sequence; // Per flow, from 1.
+        std::chrono::steady_clock::time_point received;
+        std::vector<uint8_t> jpeg;
+    };
+    typedef std::shared_ptr<const Frame> FramePtr;
+
+    struct Stats
+    {
+        uint64_t received;
+        uint64_t ignored; // Not a JPEG, or of a flow not added.
+        uint64_t oversized; // Larger than the frame capacity.
+        uint64_t framesAdded; // Allocated because readers held every frame of a flow.
+        uint64_t written;
+        uint64_t writeFailures;
+    };
+
+    // The requests are renewed by in_scheduler, which must outlive the client.
+    KeyframesClient( websocket_endpoint& in_endpoint, int in_connectionId, RenewalScheduler& in_scheduler,
+        const Options& in_options = Options() );
+
+    // Unsubscribes and stops the background thread.
+    ~KeyframesClient();
+
+    // Adds a flow of a node and returns its topic. Flows added once started
+    // are subscribed to at once.
+    std::string addFlow( const std::string& in_nodeId, const std::string& in_flowId );
+
+    // Subscribes to every flow, requests their keyframes, schedules the
+    // renewals of the requests and starts the thread writing the frames.
+    void start();
+
+    void stop();
+
+    // Stores the keyframe of a notification. Other notifications are ignored.
+    void onNotification( const ReceivedNotificationModel& in_notification );
+
+    // Latest frame of a flow, null if none was received.
+    FramePtr getLatestFrame( const std::string& in_flowId ) const;
+
+    // Frames of a flow still in its ring, oldest first. Returns false if the
+    // flow was not added.
+    bool getFrames( const std::string& in_flowId, std::vector<FramePtr>& out_frames ) const;
+
+    Stats getStats() const;
+
+    static std::string getTopic( const std::string& in_nodeId, const std::string& in_flowId, PreviewSize in_size );
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Flow
+    {
+        std::string nodeId;
+        std::string flowId;
+        std::string topic;
+
+        std::mutex mutex;
+        std::vector<std::shared_ptr<Frame> > frames; // Every frame of the flow, ring included.
+        std::vector<std::shared_ptr<Frame> > ring; // Of framesPerFlow frames, ring[ next ] the oldest once full.
+        size_t next;
+        uint64_t sequence;
+
+        FramePtr unwritten; // Guarded by the client's mMutex.
+        RenewalScheduler::Handle renewal; // Guarded by the client's mMutex.
+    };
+    typedef std::shared_ptr<Flow> FlowPtr;
+
+    struct Catalog
+    {
+        std::unordered_map<std::string, FlowPtr> byTopic;
+        std::unordered_map<std::string, FlowPtr> byFlowId;
+    };
+
+    // Spare frames of a flow, for the readers and the writer.
+    static const size_t SPARE_FRAMES = 2;
+
+    FlowPtr findFlow( const std::string& in_flowId ) const;
+
+    // A frame of the flow neither in the ring nor held. Called with the flow
+    // locked.
+    std::shared_ptr<Frame> acquireFrame( Flow& io_flow );
+
+    // Requests the keyframes of the flow and schedules the renewal of the request.
+    void requestKeyframes( Flow& io_flow );
+    void writeFrame( const Flow& in_flow, const Frame& in_frame );
+    void run();
+
+    websocket_endpoint& mEndpoint;
+    int mConnectionId;
+    RenewalScheduler& mScheduler;
+    const Options mOptions;
+
+    // Read with std::atomic_load, replaced with std::atomic_store.
+    std::shared_ptr<const Catalog> mCatalog;
+    std::mutex mCatalogMutex; // Serializes the catalog updates.
+
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    bool mRunning;
+    bool mWritePending;
+    std::thread mThread;
+
+    std::atomic<uint64_t> mReceived;
+    std::atomic<uint64_t> mIgnored;
+    std::atomic<uint64_t> mOversized;
+    std::atomic<uint64_t> mFramesAdded;
+    std::atomic<uint64_t> mWritten;
+    std::atomic<uint64_t> mWriteFailures;
+};
+
+#endif /* KEYFRAMES_CLIENT_H_ */
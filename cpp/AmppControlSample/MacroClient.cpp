@@ -0,0 +1,246 @@
+//
+// Copyright Grass Valley
+//
+
+#include "MacroClient.h"
+#include "AmppControlUtil.h"
+
+#include <iostream>
+
+namespace
+{
+    std::string getString( const json& in_object, const char* in_key )
+    {
+        json::const_iterator it = in_object.find( in_key );
+        return ( it != in_object.end() && it->is_string() ) ? it->get<std::string>() : std::string();
+    }
+}
+
+//********************************************************************************
+// MacroClient::Batch
+//********************************************************************************
+
+MacroClient::Batch::Batch( size_t in_count )
+    : mStart( std::chrono::steady_clock::now() )
+    , mEnd( mStart )
+    , mPending( in_count )
+    , mSucceeded( 0 )
+{
+}
+
+bool MacroClient::Batch::wait( std::chrono::milliseconds in_timeout )
+{
+    std::unique_lock<std::mutex> lock( mMutex );
+    return mCondition.wait_for( lock, in_timeout, [this]()
+    {
+        return mPending == 0;
+    } );
+}
+
+size_t MacroClient::Batch::getPendingCount() const
+{
+    std::lock_guard<std::mutex> lock( mMutex );
+    return mPending;
+}
+
+size_t MacroClient::Batch::getSucceededCount() const
+{
+    std::lock_guard<std::mutex> lock( mMutex );
+    return mSucceeded;
+}
+
+std::vector<std::string> MacroClient::Batch::getFailedMacros() const
+{
+    std::lock_guard<std::mutex> lock( mMutex );
+    return mFailed;
+}
+
+std::chrono::milliseconds MacroClient::Batch::getElapsedTime() const
+{
+    std::lock_guard<std::mutex> lock( mMutex );
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        ( mPending == 0 ? mEnd : std::chrono::steady_clock::now() ) - mStart );
+}
+
+void MacroClient::Batch::complete( const std::string& in_uuid, bool in_success )
+{
+    {
+        std::lock_guard<std::mutex> lock( mMutex );
+        if ( in_success )
+        {
+            ++mSucceeded;
+        }
+        else
+        {
+            mFailed.push_back( in_uuid );
+        }
+        if ( --mPending == 0 )
+        {
+            mEnd = std::chrono::steady_clock::now();
+        }
+    }
+    mCondition.notify_all();
+}
+
+//********************************************************************************
+// MacroClient
+//********************************************************************************
+
+MacroClient::MacroClient( AsyncRestClient& in_client, const std::string& in_baseUrl, TokenManager& in_tokenManager )
+    : mClient( in_client )
+    , mBaseUrl( in_baseUrl )
+    , mTokenManager( in_tokenManager )
+{
+}
+
+bool MacroClient::refreshCatalog()
+{
+    std::shared_ptr<Catalog> catalog = std::make_shared<Catalog>();
+    bool result = getAmppControlMacros( mBaseUrl, mTokenManager, [&catalog]( json& in_macro )
+    {
+        if ( !in_macro.is_object() )
+        {
+            return true;
+        }
+
+        Macro macro;
+        macro.uuid = getString( in_macro, "uuid" );
+        macro.name = getString( in_macro, "name" );
+        macro.description = getString( in_macro, "description" );
+        json::iterator commands = in_macro.find( "commands" );
+        if ( commands != in_macro.end() )
+        {
+            macro.commands = std::move( *commands );
+        }
+        if ( macro.uuid.empty() )
+        {
+            return true;
+        }
+
+        // The first macro of a name wins, as with a linear search.
+        size_t index = catalog->macros.size();
+        catalog->byName.insert( std::make_pair( macro.name, index ) );
+        catalog->byUuid.insert( std::make_pair( macro.uuid, index ) );
+        catalog->macros.push_back( std::move( macro ) );
+        return true;
+    } );
+    if ( !result )
+    {
+        return false;
+    }
+
+    std::atomic_store( &mCatalog, std::shared_ptr<const Catalog>( catalog ) );
+    return true;
+}
+
+std::vector<MacroClient::Macro> MacroClient::getMacros() const
+{
+    std::shared_ptr<const Catalog> catalog = std::atomic_load( &mCatalog );
+    return catalog ? catalog->macros : std::vector<Macro>();
+}
+
+bool MacroClient::findMacroByName( const std::string& in_name, Macro& out_macro ) const
+{
+    std::shared_ptr<const Catalog> catalog = std::atomic_load( &mCatalog );
+    if ( !catalog )
+    {
+        return false;
+    }
+    std::unordered_map<std::string, size_t>::const_iterator it = catalog->byName.find( in_name );
+    if ( it == catalog->byName.end() )
+    {
+        return false;
+    }
+    out_macro = catalog->macros[ it->second ];
+    return true;
+}
+
+bool MacroClient::findMacroById( const std::string& in_uuid, Macro& out_macro ) const
+{
+    std::shared_ptr<const Catalog> catalog = std::atomic_load( &mCatalog );
+    if ( !catalog )
+    {
+        return false;
+    }
+    std::unordered_map<std::string, size_t>::const_iterator it = catalog->byUuid.find( in_uuid );
+    if ( it == catalog->byUuid.end() )
+    {
+        return false;
+    }
+    out_macro = catalog->macros[ it->second ];
+    return true;
+}
+
+void MacroClient::executeMacro( const std::string& in_uuid, const std::string& in_reconKey, Callback in_callback )
+{
+    std::string bearerToken = mTokenManager.getBearerToken();
+    if ( bearerToken.empty() )
+    {
+        std::cout << "Could not retrieve bearer token." << std::endl;
+        if ( in_callback )
+        {
+            RestClient::Response response;
+            response.error = "No bearer token";
+            in_callback( in_uuid, false, response );
+        }
+        return;
+    }
+
+    json body;
+    body[ "uuid" ] = in_uuid;
+    body[ "reconKey" ] = in_reconKey;
+
+    RestClient::Request request;
+    request.method = "POST";
+    request.url = mBaseUrl + MACROS_ENDPOINT + "/execute";
+    request.body = body.dump();
+    request.headers.push_back( "Content-Type: application/json" );
+    request.headers.push_back( "Accept: application/json" );
+    request.headers.push_back( "Authorization: Bearer " + bearerToken );
+
+    mClient.perform( request, [in_uuid, in_callback]( const RestClient::Response& in_response )
+    {
+        bool success = ( in_response.httpCode >= 200 && in_response.httpCode <= 299 );
+        if ( !success )
+        {
+            std::cout << "Execute Ampp Macro " << in_uuid << " error: "
+                << ( in_response.error.empty() ? "http code " + std::to_string( in_response.httpCode ) : in_response.error )
+                << std::endl;
+        }
+        if ( in_callback )
+        {
+            in_callback( in_uuid, success, in_response );
+        }
+    } );
+}
+
+bool MacroClient::executeMacroByName( const std::string& in_name, const std::string& in_reconKey, Callback in_callback )
+{
+    std::shared_ptr<const Catalog> catalog = std::atomic_load( &mCatalog );
+    if ( !catalog )
+    {
+        return false;
+    }
+    std::unordered_map<std::string, size_t>::const_iterator it = catalog->byName.find( in_name );
+    if ( it == catalog->byName.end() )
+    {
+        return false;
+    }
+
+    executeMacro( catalog->macros[ it->second ].uuid, in_reconKey, in_callback );
+    return true;
+}
+
+std::shared_ptr<MacroClient::Batch> MacroClient::executeMacros( const std::vector<std::string>& in_uuids,
+    const std::string& in_reconKey )
+{
+    std::shared_ptr<Batch> batch = std::make_shared<Batch>( in_uuids.size() );
+    for ( size_t i = 0; i < in_uuids.size(); ++i )
+    {
+        executeMacro( in_uuids[ i ], in_reconKey, [batch]( const std::string& in_uuid, bool in_success, const RestClient::Response& )
+        {
+            batch->complete( in_uuid, in_success );
+        } );
+    }
+    return batch;
+}
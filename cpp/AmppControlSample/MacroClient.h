@@ -0,0 +1,118 @@
+//
+// Copyright Grass Valley
+//
+
+#ifndef MACRO_CLIENT_H_
+#define MACRO_CLIENT_H_
+
+#include "AsyncRestClient.h"
+#include "RpcProtocol.h"
+#include "TokenManager.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Lists and executes the macros defined in Ampp Control (the listMacros and
+// executeMacro of the TypeScript and C# SDKs).
+//
+// The catalog is fetched once by refreshCatalog() and indexed by name and by
+// uuid, so triggering a macro by name is a hash lookup followed by the execute
+// request. A refresh builds a new catalog and swaps it in; lookups in
+// progress keep using the previous one.
+//
+// Executions are sent through an AsyncRestClient: any number of them can be in
+// flight at once on its pooled connections (multiplexed over one HTTP/2
+// connection when the server supports it), and the callbacks run on its io
+// thread.
+class MacroClient
+{
+public:
+    struct Macro
+    {
+        std::string uuid;
+        std::string name;
+        std::string description;
+        json commands;
+    };
+
+    // Called with the macro uuid and whether the execution was accepted.
+    typedef std::function<void( const std::string& in_uuid, bool in_success, const RestClient::Response& in_response )> Callback;
+
+    // Completion tracking of macros executed together by executeMacros().
+    class Batch
+    {
+    public:
+        explicit Batch( size_t in_count );
+
+        // Returns true once every execution completed, false on timeout.
+        bool wait( std::chrono::milliseconds in_timeout );
+
+        size_t getPendingCount() const;
+        size_t getSucceededCount() const;
+
+        // uuids of the macros whose execution failed.
+        std::vector<std::string> getFailedMacros() const;
+
+        // Wall time from the submission to the last completion.
+        std::chrono::milliseconds getElapsedTime() const;
+
+    private:
+        friend class MacroClient;
+
+        void complete( const std::string& in_uuid, bool in_success );
+
+        mutable std::mutex mMutex;
+        std::condition_variable mCondition;
+        std::chrono::steady_clock::time_point mStart;
+        std::chrono::steady_clock::time_point mEnd;
+        size_t mPending;
+        size_t mSucceeded;
+        std::vector<std::string> mFailed;
+    };
+
+    MacroClient( AsyncRestClient& in_client, const std::string& in_baseUrl, TokenManager& in_tokenManager );
+
+    // Fetches the catalog and replaces the cached one.
+    bool refreshCatalog();
+
+    // Cached macros, empty before the first refreshCatalog().
+    std::vector<Macro> getMacros() const;
+
+    bool findMacroByName( const std::string& in_name, Macro& out_macro ) const;
+    bool findMacroById( const std::string& in_uuid, Macro& out_macro ) const;
+
+    // Sends the execution of a macro; in_callback (if any) is called when the
+    // server answered.
+    void executeMacro( const std::string& in_uuid, const std::string& in_reconKey, Callback in_callback = Callback() );
+
+    // Same as above for a macro of the cached catalog. Returns false, without
+    // sending anything, if there is no macro with that name.
+    bool executeMacroByName( const std::string& in_name, const std::string& in_reconKey,
+        Callback in_callback = Callback() );
+
+    // Sends the execution of all the macros at once.
+    std::shared_ptr<Batch> executeMacros( const std::vector<std::string>& in_uuids, const std::string& in_reconKey );
+
+private:
+    struct Catalog
+    {
+        std::vector<Macro> macros;
+        std::unordered_map<std::string, size_t> byName;
+        std::unordered_map<std::string, size_t> byUuid;
+    };
+
+    AsyncRestClient& mClient;
+    std::string mBaseUrl;
+    TokenManager& mTokenManager;
+
+    // Read with std::atomic_load, replaced with std::atomic_store.
+    std::shared_ptr<const Catalog> mCatalog;
+};
+
+#endif /* MACRO_CLIENT_H_ */
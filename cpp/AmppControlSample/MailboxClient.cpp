@@ -0,0 +1,338 @@
+//
+// Copyright Grass Valley
+//
+
+#include "MailboxClient.h"
+#include "RestClient.h"
+#include "Util.h"
+
+#include <algorithm>
+#include <curl/curl.h>
+#include <iostream>
+
+namespace
+{
+    // Server side wait of a poll when the mailbox is empty.
+    const int POLL_TIMEOUT_MS = 1000;
+
+    const unsigned int MIN_BATCH_SIZE = 10;
+    const unsigned int INITIAL_BATCH_SIZE = 100;
+    const unsigned int MAX_BATCH_SIZE = 1000; // The mailbox maximumLength.
+
+    const std::chrono::seconds RETRY_DELAY( 1 );
+
+    size_t writeFunction( void* ptr, size_t size, size_t nmemb, std::string* data )
+    {
+        data->append( ( char* ) ptr, size * nmemb );
+        return size * nmemb;
+    }
+
+    struct curl_slist* getHeaders( const std::string& in_bearerToken )
+    {
+        std::string bearerHeaderString = "Authorization: Bearer " + in_bearerToken;
+
+        struct curl_slist* headers = NULL;
+        headers = curl_slist_append( headers, "Content-Type: application/json" );
+        headers = curl_slist_append( headers, "Accept: application/json" );
+        headers = curl_slist_append( headers, bearerHeaderString.c_str() );
+        return headers;
+    }
+
+    // Blocking REST call used for the mailbox management requests.
+    bool sendRequest( const char* in_method, const std::string& in_url, const std::string& in_bearerToken,
+        const std::string& in_body, std::string& out_response )
+    {
+        RestClient::Request request;
+        request.method = in_method;
+        request.url = in_url;
+        request.body = in_body;
+        request.headers.push_back( "Content-Type: application/json" );
+        request.headers.push_back( "Accept: application/json" );
+        request.headers.push_back( "Authorization: Bearer " + in_bearerToken );
+
+        RestClient::Response response;
+        if ( !RestClient::getInstance().perform( request, response ) )
+        {
+            std::cout << "Mailbox " << in_method << " error: " << response.error << std::endl;
+            return false;
+        }
+        if ( response.httpCode < 200 || response.httpCode > 299 )
+        {
+            std::cout << "Mailbox " << in_method << " error. Returned http code: " << response.httpCode << std::endl;
+            return false;
+        }
+        out_response.swap( response.body );
+        return true;
+    }
+}
+
+//********************************************************************************
+// MailboxClient
+//********************************************************************************
+
+MailboxClient::MailboxClient( NotificationDispatcher& in_dispatcher, const std::string& in_baseUrl,
+    TokenManager& in_tokenManager )
+    : mDispatcher( in_dispatcher )
+    , mBaseUrl( in_baseUrl )
+    , mTokenManager( in_tokenManager )
+    , mRunning( false )
+    , mStats()
+    , mTotalLatencyMs( 0 )
+    , mLatencySamples( 0 )
+{
+    mStats.batchSize = INITIAL_BATCH_SIZE;
+
+    // Makes sure libcurl is initialized before the polling thread uses it.
+    RestClient::getInstance();
+}
+
+MailboxClient::~MailboxClient()
+{
+    close();
+}
+
+bool MailboxClient::open()
+{
+    if ( mRunning )
+    {
+        return true;
+    }
+
+    json request;
+    request[ "id" ] = getUuid();
+    request[ "subscription" ] = "gv";
+    request[ "durable" ] = false;
+    request[ "maximumLength" ] = MAX_BATCH_SIZE;
+    request[ "mailboxTTL" ] = 120000;
+
+    std::string response;
+    if ( !sendRequest( "POST", mBaseUrl + "/notifications/api/v1/mailbox", mTokenManager.getBearerToken(), request.dump(), response ) )
+    {
+        return false;
+    }
+
+    json responseJson = json::parse( response, nullptr, false );
+    if ( !responseJson.is_object() || !responseJson.value( "id", json() ).is_string() )
+    {
+        std::cout << "Invalid mailbox creation response: " << response << std::endl;
+        return false;
+    }
+    mMailboxId = responseJson[ "id" ];
+    mSecret = responseJson.value( "secret", "" );
+
+    mRunning = true;
+    mThread = std::thread( &MailboxClient::run, this );
+    return true;
+}
+
+bool MailboxClient::subscribe( const std::string& in_topic )
+{
+    if ( mMailboxId.empty() )
+    {
+        return false;
+    }
+
+    std::string encodedTopic;
+    char* escaped = curl_easy_escape( NULL, in_topic.c_str(), static_cast<int>( in_topic.size() ) );
+    if ( escaped )
+    {
+        encodedTopic = escaped;
+        curl_free( escaped );
+    }
+
+    std::string response;
+    return sendRequest( "POST", mBaseUrl + "/notifications/api/v1/mailbox/" + mMailboxId + "/subscribe/" + encodedTopic,
+        mTokenManager.getBearerToken(), "", response );
+}
+
+void MailboxClient::close()
+{
+    if ( !mRunning )
+    {
+        return;
+    }
+
+    mRunning = false;
+    mThread.join();
+
+    std::string response;
+    sendRequest( "DELETE", mBaseUrl + "/notifications/api/v1/mailbox/" + mMailboxId + "/" + mSecret,
+        mTokenManager.getBearerToken(), "", response );
+    mMailboxId.clear();
+}
+
+MailboxClient::Stats MailboxClient::getStats() const
+{
+    std::lock_guard<std::mutex> lock( mStatsMutex );
+    Stats stats = mStats;
+    stats.averageLatencyMs = mLatencySamples ? mTotalLatencyMs / mLatencySamples : 0;
+    return stats;
+}
+
+void MailboxClient::run()
+{
+    CURLM* multi = curl_multi_init();
+    CURL* curl = curl_easy_init();
+
+    std::string response;
+    std::string bearerToken = mTokenManager.getBearerToken();
+    struct curl_slist* headers = getHeaders( bearerToken );
+    curl_easy_setopt( curl, CURLOPT_HTTPGET, 1 );
+    curl_easy_setopt( curl, CURLOPT_TCP_KEEPALIVE, 1L );
+    curl_easy_setopt( curl, CURLOPT_WRITEFUNCTION, writeFunction );
+    curl_easy_setopt( curl, CURLOPT_WRITEDATA, &response );
+    // Large batches of JSON notifications compress well.
+    curl_easy_setopt( curl, CURLOPT_ACCEPT_ENCODING, "" );
+    curl_easy_setopt( curl, CURLOPT_USERAGENT, "AmppNativeApi" );
+    curl_easy_setopt( curl, CURLOPT_HTTPHEADER, headers );
+    // Guards against a poll the server never answers.
+    curl_easy_setopt( curl, CURLOPT_TIMEOUT_MS, static_cast<long>( POLL_TIMEOUT_MS + 30000 ) );
+
+    const std::string pollUrl = mBaseUrl + "/notifications/api/v1/notifications/" + mMailboxId;
+    unsigned int batchSize = INITIAL_BATCH_SIZE;
+
+    std::string url = pollUrl + "?count=" + std::to_string( batchSize ) + "&timeout=" + std::to_string( POLL_TIMEOUT_MS );
+    curl_easy_setopt( curl, CURLOPT_URL, url.c_str() );
+    curl_multi_add_handle( multi, curl );
+
+    std::string completed;
+    while ( mRunning )
+    {
+        int running = 0;
+        curl_multi_perform( multi, &running );
+
+        CURLcode pollResult = CURLE_OK;
+        bool done = false;
+        int queued = 0;
+        while ( CURLMsg* message = curl_multi_info_read( multi, &queued ) )
+        {
+            if ( message->msg == CURLMSG_DONE )
+            {
+                pollResult = message->data.result;
+                done = true;
+            }
+        }
+        if ( !done )
+        {
+            // Returns early on socket activity, so close() is noticed within 100 ms.
+            curl_multi_wait( multi, NULL, 0, 100, NULL );
+            continue;
+        }
+
+        long httpCode = 0;
+        curl_easy_getinfo( curl, CURLINFO_RESPONSE_CODE, &httpCode );
+        curl_multi_remove_handle( multi, curl );
+        completed.swap( response );
+        response.clear();
+
+        bool failed = ( pollResult != CURLE_OK || httpCode < 200 || httpCode > 299 );
+        unsigned int count = 0;
+        json messages;
+        if ( !failed )
+        {
+            messages = json::parse( completed, nullptr, false );
+            if ( messages.is_array() )
+            {
+                count = static_cast<unsigned int>( messages.size() );
+            }
+        }
+
+        // Full polls mean the mailbox is backing up, nearly empty ones that
+        // smaller responses would do.
+        if ( count >= batchSize )
+        {
+            batchSize = std::min( batchSize * 2, MAX_BATCH_SIZE );
+        }
+        else if ( count < batchSize / 4 )
+        {
+            batchSize = std::max( batchSize / 2, MIN_BATCH_SIZE );
+        }
+
+        if ( failed )
+        {
+            std::cout << "Mailbox poll error: " << ( pollResult != CURLE_OK ? curl_easy_strerror( pollResult ) : "" )
+                << " http code " << httpCode << std::endl;
+            for ( std::chrono::steady_clock::time_point retry = std::chrono::steady_clock::now() + RETRY_DELAY;
+                mRunning && std::chrono::steady_clock::now() < retry; )
+            {
+                std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) );
+            }
+        }
+
+        // The token manager replaces the token before it expires.
+        std::string currentToken = mTokenManager.getBearerToken();
+        if ( !currentToken.empty() && currentToken != bearerToken )
+        {
+            bearerToken.swap( currentToken );
+            curl_slist_free_all( headers );
+            headers = getHeaders( bearerToken );
+            curl_easy_setopt( curl, CURLOPT_HTTPHEADER, headers );
+        }
+
+        // Issue the next poll before delivering this one.
+        url = pollUrl + "?count=" + std::to_string( batchSize ) + "&timeout=" + std::to_string( POLL_TIMEOUT_MS );
+        curl_easy_setopt( curl, CURLOPT_URL, url.c_str() );
+        curl_multi_add_handle( multi, curl );
+        curl_multi_perform( multi, &running );
+
+        {
+            std::lock_guard<std::mutex> lock( mStatsMutex );
+            ++mStats.polls;
+            mStats.failedPolls += failed ? 1 : 0;
+            mStats.batchSize = batchSize;
+        }
+
+        if ( count > 0 )
+        {
+            deliver( messages );
+        }
+    }
+
+    curl_multi_remove_handle( multi, curl );
+    curl_easy_cleanup( curl );
+    curl_multi_cleanup( multi );
+    curl_slist_free_all( headers );
+}
+
+void MailboxClient::deliver( json& io_messages )
+{
+    std::chrono::system_clock::time_point now = std::chrono::system_clock::now();
+    double totalLatencyMs = 0;
+    double maxLatencyMs = 0;
+    uint64_t latencySamples = 0;
+    uint64_t received = 0;
+
+    for ( json::iterator it = io_messages.begin(); it != io_messages.end(); ++it )
+    {
+        // Mailbox messages carry the content as JSON rather than as a string.
+        json::iterator content = it->find( "content" );
+        if ( content != it->end() && !content->is_string() && !content->is_null() )
+        {
+            *content = content->dump();
+        }
+
+        ReceivedNotificationModel notification;
+        if ( !notification.setFromJson( *it ) )
+        {
+            continue;
+        }
+
+        std::chrono::system_clock::time_point published;
+        if ( parseTimeString( notification.getTime(), published ) )
+        {
+            double latencyMs = std::chrono::duration<double, std::milli>( now - published ).count();
+            totalLatencyMs += latencyMs;
+            maxLatencyMs = std::max( maxLatencyMs, latencyMs );
+            ++latencySamples;
+        }
+        ++received;
+
+        mDispatcher.post( std::move( notification ) );
+    }
+
+    std::lock_guard<std::mutex> lock( mStatsMutex );
+    mStats.received += received;
+    mTotalLatencyMs += totalLatencyMs;
+    mLatencySamples += latencySamples;
+    mStats.maxLatencyMs = std::max( mStats.maxLatencyMs, maxLatencyMs );
+}
@@ -0,0 +1,75 @@
+//
+// Copyright Grass Valley
+//
+
+#ifndef MAILBOX_CLIENT_H_
+#define MAILBOX_CLIENT_H_
+
+#include "NotificationDispatcher.h"
+#include "TokenManager.h"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Receives notifications through a notification service mailbox, over plain
+// HTTPS, for sites where websockets are blocked.
+//
+// The mailbox is created and subscribed to through REST. A background thread
+// keeps one long-poll request outstanding at all times on a reused curl easy
+// handle (so on one keep-alive connection): as soon as a poll returns, the next
+// one is issued before the notifications it carried are posted to the
+// dispatcher, the same path as the websocket notifications. The number of
+// notifications asked for per poll grows when polls come back full and shrinks
+// when they come back mostly empty.
+class MailboxClient
+{
+public:
+    struct Stats
+    {
+        uint64_t polls;
+        uint64_t failedPolls;
+        uint64_t received;
+        unsigned int batchSize;
+        // Delay between the "time" stamped by the publisher and the post to
+        // the dispatcher. Includes any clock difference between both hosts.
+        double averageLatencyMs;
+        double maxLatencyMs;
+    };
+
+    MailboxClient( NotificationDispatcher& in_dispatcher, const std::string& in_baseUrl,
+        TokenManager& in_tokenManager );
+
+    // Stops polling and deletes the mailbox.
+    ~MailboxClient();
+
+    // Creates the mailbox and starts polling it.
+    bool open();
+
+    bool subscribe( const std::string& in_topic );
+
+    void close();
+
+    Stats getStats() const;
+
+private:
+    void run();
+    void deliver( json& io_messages );
+
+    NotificationDispatcher& mDispatcher;
+    std::string mBaseUrl;
+    TokenManager& mTokenManager;
+    std::string mMailboxId;
+    std::string mSecret;
+
+    std::atomic<bool> mRunning;
+    std::thread mThread;
+
+    mutable std::mutex mStatsMutex;
+    Stats mStats;
+    double mTotalLatencyMs;
+    uint64_t mLatencySamples;
+};
+
+#endif /* MAILBOX_CLIENT_H_ */
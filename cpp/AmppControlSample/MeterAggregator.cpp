@@ -0,0 +1,239 @@
+//
+// Copyright Grass Valley
+//
+
+#include "MeterAggregator.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    // History entries are hundredths of dB.
+    inline int16_t toHistory( float in_level )
+    {
+        float hundredths = std::min( std::max( in_level * 100.0f, -32768.0f ), 32767.0f );
+        return static_cast<int16_t>( std::lround( hundredths ) );
+    }
+}
+
+//********************************************************************************
+// MeterAggregator
+//********************************************************************************
+
+MeterAggregator::MeterAggregator( const Options& in_options, const MeterKernels& in_kernels )
+    : mOptions( in_options )
+    , mKernels( in_kernels )
+    , mRingLength( 1 )
+{
+    if ( mOptions.rmsWindows.size() > METER_KERNEL_MAX_WINDOWS )
+    {
+        mOptions.rmsWindows.resize( METER_KERNEL_MAX_WINDOWS );
+    }
+    for ( size_t w = 0; w < mOptions.rmsWindows.size(); ++w )
+    {
+        mOptions.rmsWindows[ w ] = std::max( mOptions.rmsWindows[ w ], 1u );
+        mRingLength = std::max<size_t>( mRingLength, mOptions.rmsWindows[ w ] );
+    }
+    mOptions.decimation = std::max( mOptions.decimation, 1u );
+    mOptions.historyLength = std::max<size_t>( mOptions.historyLength, 1 );
+    mArrayCount = SUMS + mOptions.rmsWindows.size() + mRingLength;
+}
+
+size_t MeterAggregator::addProbe( size_t in_channelCount )
+{
+    Probe probe;
+    probe.channelCount = static_cast<uint32_t>( std::min<size_t>( std::max<size_t>( in_channelCount, 1 ), SoundProbeClient::MAX_CHANNELS ) );
+    probe.paddedCount = static_cast<uint32_t>( ( probe.channelCount + METER_KERNEL_LANES - 1 ) / METER_KERNEL_LANES * METER_KERNEL_LANES );
+    probe.offset = mState.size();
+    probe.historyOffset = mHistory.size();
+    probe.ringPosition = 0;
+    probe.decimated = 0;
+    probe.updates = 0;
+    probe.historyEntries = 0;
+
+    // Sums, ring and decimated power start at 0, the levels at the floor.
+    mState.resize( mState.size() + mArrayCount * probe.paddedCount, 0.0f );
+    std::fill_n( getArray( probe, HOLD ), probe.paddedCount, METER_FLOOR_DB );
+    std::fill_n( getArray( probe, DECIMATED_PEAK ), probe.paddedCount, METER_FLOOR_DB );
+    mHistory.resize( mHistory.size() + mOptions.historyLength * 2 * probe.paddedCount, toHistory( METER_FLOOR_DB ) );
+
+    mProbes.push_back( probe );
+    return mProbes.size() - 1;
+}
+
+bool MeterAggregator::update( size_t in_probe, const SoundProbeClient::Meters& in_meters, float in_elapsed )
+{
+    if ( in_probe >= mProbes.size() )
+    {
+        return false;
+    }
+    Probe& probe = mProbes[ in_probe ];
+
+    // The kernels read whole groups of lanes: the channels are copied to
+    // arrays padded with silence.
+    float rms[ SoundProbeClient::MAX_CHANNELS ];
+    float peak[ SoundProbeClient::MAX_CHANNELS ];
+    size_t rmsCount = std::min<size_t>( in_meters.rmsCount, probe.channelCount );
+    size_t peakCount = std::min<size_t>( in_meters.peakCount, probe.channelCount );
+    std::copy( in_meters.rms, in_meters.rms + rmsCount, rms );
+    std::fill( rms + rmsCount, rms + probe.paddedCount, METER_FLOOR_DB );
+    std::copy( in_meters.peak, in_meters.peak + peakCount, peak );
+    std::fill( peak + peakCount, peak + probe.paddedCount, METER_FLOOR_DB );
+
+    MeterKernelArgs args;
+    args.count = probe.paddedCount;
+    args.rms = rms;
+    args.peak = peak;
+    args.elapsed = std::max( in_elapsed, 0.0f );
+    args.hold = getArray( probe, HOLD );
+    args.holdAge = getArray( probe, HOLD_AGE );
+    args.holdTime = mOptions.holdTime;
+    args.decay = mOptions.decay;
+    args.power = getRingRow( probe, probe.ringPosition );
+    args.windowCount = mOptions.rmsWindows.size();
+    for ( size_t w = 0; w < args.windowCount; ++w )
+    {
+        // Zero until the ring is full, as the ring starts at 0.
+        args.expired[ w ] = getRingRow( probe, ( probe.ringPosition + mRingLength - mOptions.rmsWindows[ w ] ) % mRingLength );
+        args.sums[ w ] = getArray( probe, SUMS + w );
+    }
+    args.decimatedPower = getArray( probe, DECIMATED_POWER );
+    args.decimatedPeak = getArray( probe, DECIMATED_PEAK );
+    mKernels.update( args );
+
+    ++probe.updates;
+    probe.ringPosition = static_cast<uint32_t>( ( probe.ringPosition + 1 ) % mRingLength );
+    if ( probe.ringPosition == 0 )
+    {
+        resumWindows( probe );
+    }
+    if ( ++probe.decimated == mOptions.decimation )
+    {
+        decimate( probe );
+    }
+    return true;
+}
+
+bool MeterAggregator::getPeakHold( size_t in_probe, float* out_levels ) const
+{
+    if ( in_probe >= mProbes.size() )
+    {
+        return false;
+    }
+    const Probe& probe = mProbes[ in_probe ];
+    const float* hold = getArray( probe, HOLD );
+    std::copy( hold, hold + probe.channelCount, out_levels );
+    return true;
+}
+
+bool MeterAggregator::getRmsLevels( size_t in_probe, size_t in_window, float* out_levels ) const
+{
+    if ( in_probe >= mProbes.size() || in_window >= mOptions.rmsWindows.size() )
+    {
+        return false;
+    }
+    const Probe& probe = mProbes[ in_probe ];
+
+    // A window not filled yet is averaged over the updates received.
+    uint64_t updates = std::min<uint64_t>( probe.updates, mOptions.rmsWindows[ in_window ] );
+    float levels[ SoundProbeClient::MAX_CHANNELS ];
+    mKernels.toDecibels( getArray( probe, SUMS + in_window ), updates > 0 ? 1.0f / updates : 0.0f, levels, probe.paddedCount );
+    std::copy( levels, levels + probe.channelCount, out_levels );
+    return true;
+}
+
+bool MeterAggregator::getHistory( size_t in_probe, size_t in_channel, std::vector<float>& out_rms, std::vector<float>& out_peak ) const
+{
+    out_rms.clear();
+    out_peak.clear();
+    if ( in_probe >= mProbes.size() || in_channel >= mProbes[ in_probe ].channelCount )
+    {
+        return false;
+    }
+    const Probe& probe = mProbes[ in_probe ];
+
+    size_t count = static_cast<size_t>( std::min<uint64_t>( probe.historyEntries, mOptions.historyLength ) );
+    size_t first = static_cast<size_t>( ( probe.historyEntries - count ) % mOptions.historyLength );
+    for ( size_t i = 0; i < count; ++i )
+    {
+        const int16_t* entry = &mHistory[ probe.historyOffset + ( first + i ) % mOptions.historyLength * 2 * probe.paddedCount ];
+        out_rms.push_back( entry[ in_channel ] / 100.0f );
+        out_peak.push_back( entry[ probe.paddedCount + in_channel ] / 100.0f );
+    }
+    return true;
+}
+
+size_t MeterAggregator::getProbeCount() const
+{
+    return mProbes.size();
+}
+
+size_t MeterAggregator::getChannelCount( size_t in_probe ) const
+{
+    return ( in_probe < mProbes.size() ) ? mProbes[ in_probe ].channelCount : 0;
+}
+
+size_t MeterAggregator::getStateBytes() const
+{
+    return mState.size() * sizeof( float ) + mProbes.size() * sizeof( Probe );
+}
+
+size_t MeterAggregator::getHistoryBytes() const
+{
+    return mHistory.size() * sizeof( int16_t );
+}
+
+const char* MeterAggregator::getKernelName() const
+{
+    return mKernels.name;
+}
+
+float* MeterAggregator::getArray( const Probe& in_probe, size_t in_array )
+{
+    return &mState[ in_probe.offset + in_array * in_probe.paddedCount ];
+}
+
+const float* MeterAggregator::getArray( const Probe& in_probe, size_t in_array ) const
+{
+    return &mState[ in_probe.offset + in_array * in_probe.paddedCount ];
+}
+
+float* MeterAggregator::getRingRow( const Probe& in_probe, size_t in_row )
+{
+    return getArray( in_probe, SUMS + mOptions.rmsWindows.size() + in_row );
+}
+
+void MeterAggregator::resumWindows( const Probe& in_probe )
+{
+    // Called when the ring wraps: its last row is the latest update.
+    for ( size_t w = 0; w < mOptions.rmsWindows.size(); ++w )
+    {
+        float* sums = getArray( in_probe, SUMS + w );
+        std::fill_n( sums, in_probe.paddedCount, 0.0f );
+        for ( size_t row = mRingLength - mOptions.rmsWindows[ w ]; row < mRingLength; ++row )
+        {
+            mKernels.accumulate( sums, getRingRow( in_probe, row ), in_probe.paddedCount );
+        }
+    }
+}
+
+void MeterAggregator::decimate( Probe& io_probe )
+{
+    int16_t* entry = &mHistory[ io_probe.historyOffset + io_probe.historyEntries % mOptions.historyLength * 2 * io_probe.paddedCount ];
+    float* power = getArray( io_probe, DECIMATED_POWER );
+    float* peak = getArray( io_probe, DECIMATED_PEAK );
+
+    float levels[ SoundProbeClient::MAX_CHANNELS ];
+    mKernels.toDecibels( power, 1.0f / io_probe.decimated, levels, io_probe.paddedCount );
+    for ( size_t i = 0; i < io_probe.paddedCount; ++i )
+    {
+        entry[ i ] = toHistory( levels[ i ] );
+        entry[ io_probe.paddedCount + i ] = toHistory( peak[ i ] );
+    }
+
+    std::fill_n( power, io_probe.paddedCount, 0.0f );
+    std::fill_n( peak, io_probe.paddedCount, METER_FLOOR_DB );
+    io_probe.decimated = 0;
+    ++io_probe.historyEntries;
+}
@@ -0,0 +1,124 @@
+//
+// Copyright Grass Valley
+//
+
+#ifndef METER_AGGREGATOR_H_
+#define METER_AGGREGATOR_H_
+
+#include "MeterKernels.h"
+#include "SoundProbeClient.h"
+
+#include <cstdint>
+#include <vector>
+
+// Aggregates the audio meters of many probes: peak hold with decay, RMS over
+// windows of the last updates and decimation of the levels into a history for
+// long-term loudness logging.
+//
+// The state of every probe is a block of channel arrays (structure of arrays,
+// each padded to METER_KERNEL_LANES channels) in one arena, updated by the
+// vectorized MeterKernels of the host. With the default options, a probe of 64
+// channels takes 4 KB: the state of 200 such probes fits in a 1 MB L2 cache.
+// Only this per-update state is meant to stay in L2. The decimated history is
+// kept apart, as 16-bit hundredths of dB, and only written once every
+// decimation updates: with the default options it takes 90 KB per probe of 64
+// channels (18 MB for 200 probes) and is left to memory.
+//
+// Levels are in dBFS. RMS windows are averaged in power, the peak hold and the
+// decimated peaks are the maximum of the peaks.
+//
+// Not thread-safe: driven by a single thread, e.g. the one reading the
+// MeterBuffers of the probes.
+class MeterAggregator
+{
+public:
+    struct Options
+    {
+        Options()
+            : holdTime( 2.0f )
+            , decay( 20.0f )
+            , decimation( 10 )
+            , historyLength( 360 )
+        {
+            rmsWindows.push_back( 3 );
+            rmsWindows.push_back( 10 );
+        }
+
+        float holdTime; // Seconds a peak is held.
+        float decay; // dB per second once held.
+        std::vector<unsigned int> rmsWindows; // In updates, at most METER_KERNEL_MAX_WINDOWS.
+        unsigned int decimation; // Updates per history entry.
+        size_t historyLength; // History entries kept per probe.
+    };
+
+    MeterAggregator( const Options& in_options = Options(), const MeterKernels& in_kernels = getBestMeterKernels() );
+
+    // Adds a probe of up to SoundProbeClient::MAX_CHANNELS channels and returns
+    // its index.
+    size_t addProbe( size_t in_channelCount );
+
+    // Folds an update of a probe, received in_elapsed seconds after its previous
+    // one. Missing channels are read as silence. Returns false for an unknown probe.
+    bool update( size_t in_probe, const SoundProbeClient::Meters& in_meters, float in_elapsed );
+
+    // Copy one level per channel of the probe to out_levels. Return false for an
+    // unknown probe or window.
+    bool getPeakHold( size_t in_probe, float* out_levels ) const;
+    bool getRmsLevels( size_t in_probe, size_t in_window, float* out_levels ) const;
+
+    // The decimated RMS levels and peaks of a channel, oldest first.
+    bool getHistory( size_t in_probe, size_t in_channel, std::vector<float>& out_rms, std::vector<float>& out_peak ) const;
+
+    size_t getProbeCount() const;
+    size_t getChannelCount( size_t in_probe ) const;
+
+    // Bytes of the per-update state of all probes, and of their histories.
+    size_t getStateBytes() const;
+    size_t getHistoryBytes() const;
+
+    const char* getKernelName() const;
+
+private:
+    struct Probe
+    {
+        size_t offset; // In mState.
+        size_t historyOffset; // In mHistory.
+        uint32_t channelCount;
+        uint32_t paddedCount;
+        uint32_t ringPosition;
+        uint32_t decimated; // Updates in the decimation sums.
+        uint64_t updates;
+        uint64_t historyEntries;
+    };
+
+    // Arrays of the state of a probe, each of paddedCount floats.
+    enum Array
+    {
+        HOLD = 0,
+        HOLD_AGE,
+        DECIMATED_POWER,
+        DECIMATED_PEAK,
+        SUMS // Then one per window, then the ring of powers.
+    };
+
+    float* getArray( const Probe& in_probe, size_t in_array );
+    const float* getArray( const Probe& in_probe, size_t in_array ) const;
+    float* getRingRow( const Probe& in_probe, size_t in_row );
+
+    // Replaces the window sums, which drift by rounding, with the sums of the ring.
+    void resumWindows( const Probe& in_probe );
+
+    // Writes the decimated levels to the history and restarts the decimation.
+    void decimate( Probe& io_probe );
+
+    Options mOptions;
+    const MeterKernels& mKernels;
+    size_t mRingLength;
+    size_t mArrayCount;
+
+    std::vector<Probe> mProbes;
+    std::vector<float> mState;
+    std::vector<int16_t> mHistory;
+};
+
+#endif /* METER_AGGREGATOR_H_ */
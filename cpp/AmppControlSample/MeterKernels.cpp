@@ -0,0 +1,225 @@
+//
+// Copyright Grass Valley
+//
+
+#include "MeterKernels.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined( __aarch64__ ) || defined( _M_ARM64 )
+#include <arm_neon.h>
+#define METER_KERNELS_NEON
+#elif defined( _MSC_VER ) && ( defined( _M_X64 ) || defined( _M_IX86 ) )
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+namespace
+{
+    //********************************************************************************
+    // Scalar kernels, also the reference of the vectorized ones
+    //********************************************************************************
+
+    inline float sanitize( float in_level )
+    {
+        // NaN (a missing value) compares false, and is replaced by the floor too.
+        return ( in_level >= METER_FLOOR_DB ) ? in_level : METER_FLOOR_DB;
+    }
+
+    void updateScalar( const MeterKernelArgs& in_args )
+    {
+        const float decayed = in_args.decay * in_args.elapsed;
+        for ( size_t i = 0; i < in_args.count; ++i )
+        {
+            float peak = sanitize( in_args.peak[ i ] );
+            float rms = sanitize( in_args.rms[ i ] );
+
+            if ( peak >= in_args.hold[ i ] )
+            {
+                in_args.hold[ i ] = peak;
+                in_args.holdAge[ i ] = 0.0f;
+            }
+            else
+            {
+                in_args.holdAge[ i ] += in_args.elapsed;
+                if ( in_args.holdAge[ i ] > in_args.holdTime )
+                {
+                    in_args.hold[ i ] = std::max( peak, in_args.hold[ i ] - decayed );
+                }
+            }
+
+            float power = std::pow( 10.0f, rms / 10.0f );
+            for ( size_t w = 0; w < in_args.windowCount; ++w )
+            {
+                in_args.sums[ w ][ i ] = std::max( in_args.sums[ w ][ i ] + ( power - in_args.expired[ w ][ i ] ), 0.0f );
+            }
+            in_args.power[ i ] = power;
+
+            in_args.decimatedPower[ i ] += power;
+            in_args.decimatedPeak[ i ] = std::max( in_args.decimatedPeak[ i ], peak );
+        }
+    }
+
+    void accumulateScalar( float* io_sums, const float* in_values, size_t in_count )
+    {
+        for ( size_t i = 0; i < in_count; ++i )
+        {
+            io_sums[ i ] += in_values[ i ];
+        }
+    }
+
+    void toDecibelsScalar( const float* in_power, float in_scale, float* out_levels, size_t in_count )
+    {
+        for ( size_t i = 0; i < in_count; ++i )
+        {
+            out_levels[ i ] = 10.0f * std::log10( std::max( in_power[ i ] * in_scale, 1e-20f ) );
+        }
+    }
+
+    const MeterKernels SCALAR_KERNELS = { "scalar", updateScalar, accumulateScalar, toDecibelsScalar };
+
+#ifdef METER_KERNELS_NEON
+    //********************************************************************************
+    // NEON kernels, four lanes at a time (twice per group of METER_KERNEL_LANES)
+    //********************************************************************************
+
+    // 2^x: 2^round( x ) from the exponent bits, times 2^f for the remaining
+    // f in [-0.5, 0.5] from its Taylor series.
+    inline float32x4_t exp2Neon( float32x4_t in_x )
+    {
+        float32x4_t x = vmaxq_f32( vminq_f32( in_x, vdupq_n_f32( 126.0f ) ), vdupq_n_f32( -126.0f ) );
+        float32x4_t whole = vrndnq_f32( x );
+        float32x4_t f = vsubq_f32( x, whole );
+
+        float32x4_t p = vdupq_n_f32( 1.5403530e-4f );
+        p = vfmaq_f32( vdupq_n_f32( 1.3333558e-3f ), p, f );
+        p = vfmaq_f32( vdupq_n_f32( 9.6181291e-3f ), p, f );
+        p = vfmaq_f32( vdupq_n_f32( 5.5504109e-2f ), p, f );
+        p = vfmaq_f32( vdupq_n_f32( 2.4022651e-1f ), p, f );
+        p = vfmaq_f32( vdupq_n_f32( 6.9314718e-1f ), p, f );
+        p = vfmaq_f32( vdupq_n_f32( 1.0f ), p, f );
+
+        int32x4_t exponent = vshlq_n_s32( vaddq_s32( vcvtq_s32_f32( whole ), vdupq_n_s32( 127 ) ), 23 );
+        return vmulq_f32( p, vreinterpretq_f32_s32( exponent ) );
+    }
+
+    // log2( x ) for x > 0: the exponent bits, plus log2 of the mantissa m in
+    // [1, 2) from the series of t = ( m - 1 ) / ( m + 1 ).
+    inline float32x4_t log2Neon( float32x4_t in_x )
+    {
+        uint32x4_t bits = vreinterpretq_u32_f32( in_x );
+        float32x4_t exponent = vcvtq_f32_s32( vsubq_s32( vreinterpretq_s32_u32( vshrq_n_u32( bits, 23 ) ), vdupq_n_s32( 127 ) ) );
+        float32x4_t m = vreinterpretq_f32_u32( vorrq_u32( vandq_u32( bits, vdupq_n_u32( 0x007FFFFF ) ), vdupq_n_u32( 0x3F800000 ) ) );
+
+        float32x4_t one = vdupq_n_f32( 1.0f );
+        float32x4_t t = vdivq_f32( vsubq_f32( m, one ), vaddq_f32( m, one ) );
+        float32x4_t t2 = vmulq_f32( t, t );
+        float32x4_t s = vdupq_n_f32( 1.0f / 9.0f );
+        s = vfmaq_f32( vdupq_n_f32( 1.0f / 7.0f ), s, t2 );
+        s = vfmaq_f32( vdupq_n_f32( 1.0f / 5.0f ), s, t2 );
+        s = vfmaq_f32( vdupq_n_f32( 1.0f / 3.0f ), s, t2 );
+        s = vfmaq_f32( one, s, t2 );
+        return vfmaq_f32( exponent, vmulq_f32( t, s ), vdupq_n_f32( 2.8853900817779268f ) );
+    }
+
+    inline float32x4_t sanitizeNeon( float32x4_t in_levels )
+    {
+        float32x4_t floor = vdupq_n_f32( METER_FLOOR_DB );
+        return vbslq_f32( vcgeq_f32( in_levels, floor ), in_levels, floor );
+    }
+
+    void updateNeon( const MeterKernelArgs& in_args )
+    {
+        const float32x4_t elapsed = vdupq_n_f32( in_args.elapsed );
+        const float32x4_t holdTime = vdupq_n_f32( in_args.holdTime );
+        const float32x4_t decayed = vdupq_n_f32( in_args.decay * in_args.elapsed );
+        const float32x4_t decibelsToLog2Power = vdupq_n_f32( 0.33219281f ); // log2( 10 ) / 10
+        const float32x4_t zero = vdupq_n_f32( 0.0f );
+
+        for ( size_t i = 0; i < in_args.count; i += 4 )
+        {
+            float32x4_t peak = sanitizeNeon( vld1q_f32( in_args.peak + i ) );
+            float32x4_t rms = sanitizeNeon( vld1q_f32( in_args.rms + i ) );
+
+            float32x4_t hold = vld1q_f32( in_args.hold + i );
+            uint32x4_t newPeak = vcgeq_f32( peak, hold );
+            float32x4_t age = vbslq_f32( newPeak, zero, vaddq_f32( vld1q_f32( in_args.holdAge + i ), elapsed ) );
+            float32x4_t decaying = vmaxq_f32( peak, vsubq_f32( hold, decayed ) );
+            hold = vbslq_f32( vcgtq_f32( age, holdTime ), decaying, hold );
+            vst1q_f32( in_args.hold + i, vbslq_f32( newPeak, peak, hold ) );
+            vst1q_f32( in_args.holdAge + i, age );
+
+            float32x4_t power = exp2Neon( vmulq_f32( rms, decibelsToLog2Power ) );
+            for ( size_t w = 0; w < in_args.windowCount; ++w )
+            {
+                float32x4_t sum = vaddq_f32( vld1q_f32( in_args.sums[ w ] + i ), vsubq_f32( power, vld1q_f32( in_args.expired[ w ] + i ) ) );
+                vst1q_f32( in_args.sums[ w ] + i, vmaxq_f32( sum, zero ) );
+            }
+            vst1q_f32( in_args.power + i, power );
+
+            vst1q_f32( in_args.decimatedPower + i, vaddq_f32( vld1q_f32( in_args.decimatedPower + i ), power ) );
+            vst1q_f32( in_args.decimatedPeak + i, vmaxq_f32( vld1q_f32( in_args.decimatedPeak + i ), peak ) );
+        }
+    }
+
+    void accumulateNeon( float* io_sums, const float* in_values, size_t in_count )
+    {
+        for ( size_t i = 0; i < in_count; i += 4 )
+        {
+            vst1q_f32( io_sums + i, vaddq_f32( vld1q_f32( io_sums + i ), vld1q_f32( in_values + i ) ) );
+        }
+    }
+
+    void toDecibelsNeon( const float* in_power, float in_scale, float* out_levels, size_t in_count )
+    {
+        const float32x4_t minimum = vdupq_n_f32( 1e-20f ); // METER_FLOOR_DB
+        const float32x4_t log2ToDecibels = vdupq_n_f32( 3.0102999566f ); // 10 * log10( 2 )
+        for ( size_t i = 0; i < in_count; i += 4 )
+        {
+            float32x4_t power = vmaxq_f32( vmulq_n_f32( vld1q_f32( in_power + i ), in_scale ), minimum );
+            vst1q_f32( out_levels + i, vmulq_f32( log2Neon( power ), log2ToDecibels ) );
+        }
+    }
+
+    const MeterKernels NEON_KERNELS = { "neon", updateNeon, accumulateNeon, toDecibelsNeon };
+#endif
+
+#if defined( __x86_64__ ) || defined( __i386__ ) || defined( _M_X64 ) || defined( _M_IX86 )
+    bool hasAvx2()
+    {
+#if defined( _MSC_VER )
+        int info[ 4 ];
+        __cpuid( info, 1 );
+        bool fma = ( info[ 2 ] & ( 1 << 12 ) ) != 0;
+        bool osxsave = ( info[ 2 ] & ( 1 << 27 ) ) != 0;
+        if ( !fma || !osxsave || ( _xgetbv( 0 ) & 6 ) != 6 )
+        {
+            return false;
+        }
+        __cpuidex( info, 7, 0 );
+        return ( info[ 1 ] & ( 1 << 5 ) ) != 0;
+#else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "fma" );
+#endif
+    }
+#endif
+}
+
+const MeterKernels& getScalarMeterKernels()
+{
+    return SCALAR_KERNELS;
+}
+
+const MeterKernels& getBestMeterKernels()
+{
+#if defined( METER_KERNELS_NEON )
+    return NEON_KERNELS;
+#elif defined( __x86_64__ ) || defined( __i386__ ) || defined( _M_X64 ) || defined( _M_IX86 )
+    static const bool avx2 = hasAvx2();
+    return avx2 ? getAvx2MeterKernels() : SCALAR_KERNELS;
+#else
+    return SCALAR_KERNELS;
+#endif
+}
@@ -0,0 +1,82 @@
+//
+// Copyright Grass Valley
+//
+
+#ifndef METER_KERNELS_H_
+#define METER_KERNELS_H_
+
+#include <cstddef>
+#include <cstdint>
+
+// Reductions of audio meters run by the MeterAggregator, with a scalar
+// version and vectorized ones (AVX2 and FMA on x86, NEON on ARM64).
+//
+// The kernels work on arrays of in_count floats, one per channel, with
+// in_count a multiple of METER_KERNEL_LANES. Levels are in dBFS; powers are
+// linear (1.0 at full scale). The vectorized versions compute the powers and
+// levels with polynomial approximations, within 0.001 dB of the scalar ones.
+//
+// This header is included by the AVX2 translation unit, built for AVX2
+// itself: it must not pull in any inline function of the standard library.
+
+const size_t METER_KERNEL_LANES = 8;
+const size_t METER_KERNEL_MAX_WINDOWS = 4;
+
+// Lowest level kept, silence and missing (NaN) values included.
+const float METER_FLOOR_DB = -200.0f;
+
+struct MeterKernelArgs
+{
+    size_t count;
+
+    // The update.
+    const float* rms;
+    const float* peak;
+    float elapsed; // Seconds since the previous update.
+
+    // Peak hold: a peak is held for holdTime seconds, then decays by decay
+    // dB per second.
+    float* hold;
+    float* holdAge;
+    float holdTime;
+    float decay;
+
+    // RMS windows: the power of the update is written to power, a row of the
+    // ring of the last updates, and added to the sum of every window, from
+    // which the row leaving the window (read before power is written, it may
+    // be the same row) is subtracted.
+    float* power;
+    size_t windowCount;
+    const float* expired[ METER_KERNEL_MAX_WINDOWS ];
+    float* sums[ METER_KERNEL_MAX_WINDOWS ];
+
+    // Decimation: power sum and peak maximum since the last decimated entry.
+    float* decimatedPower;
+    float* decimatedPeak;
+};
+
+struct MeterKernels
+{
+    const char* name;
+
+    // Folds an update into the hold, window and decimation states.
+    void ( *update )( const MeterKernelArgs& in_args );
+
+    // io_sums += in_values.
+    void ( *accumulate )( float* io_sums, const float* in_values, size_t in_count );
+
+    // out_levels = 10 * log10( in_power * in_scale ), not below METER_FLOOR_DB.
+    void ( *toDecibels )( const float* in_power, float in_scale, float* out_levels, size_t in_count );
+};
+
+const MeterKernels& getScalarMeterKernels();
+
+// The vectorized kernels of the host, the scalar ones if it has none.
+const MeterKernels& getBestMeterKernels();
+
+#if defined( __x86_64__ ) || defined( __i386__ ) || defined( _M_X64 ) || defined( _M_IX86 )
+// Defined in MeterKernelsAvx2.cpp; only to be used when the CPU supports AVX2 and FMA.
+const MeterKernels& getAvx2MeterKernels();
+#endif
+
+#endif /* METER_KERNELS_H_ */
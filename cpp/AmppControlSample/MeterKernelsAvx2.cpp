@@ -0,0 +1,129 @@
+//
+// Copyright Grass Valley
+//
+
+// The whole translation unit is built for AVX2 and FMA; it is only called
+// once getBestMeterKernels() checked that the CPU supports them.
+#if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+#pragma GCC target( "avx2,fma" )
+#endif
+
+#include "MeterKernels.h"
+
+#if defined( __x86_64__ ) || defined( __i386__ ) || defined( _M_X64 ) || defined( _M_IX86 )
+
+#include <immintrin.h>
+
+namespace
+{
+    // 2^x: 2^round( x ) from the exponent bits, times 2^f for the remaining
+    // f in [-0.5, 0.5] from its Taylor series.
+    inline __m256 exp2Avx2( __m256 in_x )
+    {
+        __m256 x = _mm256_max_ps( _mm256_min_ps( in_x, _mm256_set1_ps( 126.0f ) ), _mm256_set1_ps( -126.0f ) );
+        __m256 whole = _mm256_round_ps( x, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC );
+        __m256 f = _mm256_sub_ps( x, whole );
+
+        __m256 p = _mm256_set1_ps( 1.5403530e-4f );
+        p = _mm256_fmadd_ps( p, f, _mm256_set1_ps( 1.3333558e-3f ) );
+        p = _mm256_fmadd_ps( p, f, _mm256_set1_ps( 9.6181291e-3f ) );
+        p = _mm256_fmadd_ps( p, f, _mm256_set1_ps( 5.5504109e-2f ) );
+        p = _mm256_fmadd_ps( p, f, _mm256_set1_ps( 2.4022651e-1f ) );
+        p = _mm256_fmadd_ps( p, f, _mm256_set1_ps( 6.9314718e-1f ) );
+        p = _mm256_fmadd_ps( p, f, _mm256_set1_ps( 1.0f ) );
+
+        __m256i exponent = _mm256_slli_epi32( _mm256_add_epi32( _mm256_cvtps_epi32( whole ), _mm256_set1_epi32( 127 ) ), 23 );
+        return _mm256_mul_ps( p, _mm256_castsi256_ps( exponent ) );
+    }
+
+    // log2( x ) for x > 0: the exponent bits, plus log2 of the mantissa m in
+    // [1, 2) from the series of t = ( m - 1 ) / ( m + 1 ).
+    inline __m256 log2Avx2( __m256 in_x )
+    {
+        __m256i bits = _mm256_castps_si256( in_x );
+        __m256 exponent = _mm256_cvtepi32_ps( _mm256_sub_epi32( _mm256_srli_epi32( bits, 23 ), _mm256_set1_epi32( 127 ) ) );
+        __m256 m = _mm256_castsi256_ps( _mm256_or_si256( _mm256_and_si256( bits, _mm256_set1_epi32( 0x007FFFFF ) ),
+            _mm256_set1_epi32( 0x3F800000 ) ) );
+
+        __m256 one = _mm256_set1_ps( 1.0f );
+        __m256 t = _mm256_div_ps( _mm256_sub_ps( m, one ), _mm256_add_ps( m, one ) );
+        __m256 t2 = _mm256_mul_ps( t, t );
+        __m256 s = _mm256_set1_ps( 1.0f / 9.0f );
+        s = _mm256_fmadd_ps( s, t2, _mm256_set1_ps( 1.0f / 7.0f ) );
+        s = _mm256_fmadd_ps( s, t2, _mm256_set1_ps( 1.0f / 5.0f ) );
+        s = _mm256_fmadd_ps( s, t2, _mm256_set1_ps( 1.0f / 3.0f ) );
+        s = _mm256_fmadd_ps( s, t2, one );
+        return _mm256_fmadd_ps( _mm256_mul_ps( t, s ), _mm256_set1_ps( 2.8853900817779268f ), exponent );
+    }
+
+    // NaN (a missing value) compares false, and is replaced by the floor too.
+    inline __m256 sanitizeAvx2( __m256 in_levels )
+    {
+        __m256 floor = _mm256_set1_ps( METER_FLOOR_DB );
+        return _mm256_blendv_ps( floor, in_levels, _mm256_cmp_ps( in_levels, floor, _CMP_GE_OQ ) );
+    }
+
+    void updateAvx2( const MeterKernelArgs& in_args )
+    {
+        const __m256 elapsed = _mm256_set1_ps( in_args.elapsed );
+        const __m256 holdTime = _mm256_set1_ps( in_args.holdTime );
+        const __m256 decayed = _mm256_set1_ps( in_args.decay * in_args.elapsed );
+        const __m256 decibelsToLog2Power = _mm256_set1_ps( 0.33219281f ); // log2( 10 ) / 10
+        const __m256 zero = _mm256_setzero_ps();
+
+        for ( size_t i = 0; i < in_args.count; i += 8 )
+        {
+            __m256 peak = sanitizeAvx2( _mm256_loadu_ps( in_args.peak + i ) );
+            __m256 rms = sanitizeAvx2( _mm256_loadu_ps( in_args.rms + i ) );
+
+            __m256 hold = _mm256_loadu_ps( in_args.hold + i );
+            __m256 newPeak = _mm256_cmp_ps( peak, hold, _CMP_GE_OQ );
+            __m256 age = _mm256_blendv_ps( _mm256_add_ps( _mm256_loadu_ps( in_args.holdAge + i ), elapsed ), zero, newPeak );
+            __m256 decaying = _mm256_max_ps( peak, _mm256_sub_ps( hold, decayed ) );
+            hold = _mm256_blendv_ps( hold, decaying, _mm256_cmp_ps( age, holdTime, _CMP_GT_OQ ) );
+            _mm256_storeu_ps( in_args.hold + i, _mm256_blendv_ps( hold, peak, newPeak ) );
+            _mm256_storeu_ps( in_args.holdAge + i, age );
+
+            __m256 power = exp2Avx2( _mm256_mul_ps( rms, decibelsToLog2Power ) );
+            for ( size_t w = 0; w < in_args.windowCount; ++w )
+            {
+                __m256 sum = _mm256_add_ps( _mm256_loadu_ps( in_args.sums[ w ] + i ),
+                    _mm256_sub_ps( power, _mm256_loadu_ps( in_args.expired[ w ] + i ) ) );
+                _mm256_storeu_ps( in_args.sums[ w ] + i, _mm256_max_ps( sum, zero ) );
+            }
+            _mm256_storeu_ps( in_args.power + i, power );
+
+            _mm256_storeu_ps( in_args.decimatedPower + i, _mm256_add_ps( _mm256_loadu_ps( in_args.decimatedPower + i ), power ) );
+            _mm256_storeu_ps( in_args.decimatedPeak + i, _mm256_max_ps( _mm256_loadu_ps( in_args.decimatedPeak + i ), peak ) );
+        }
+    }
+
+    void accumulateAvx2( float* io_sums, const float* in_values, size_t in_count )
+    {
+        for ( size_t i = 0; i < in_count; i += 8 )
+        {
+            _mm256_storeu_ps( io_sums + i, _mm256_add_ps( _mm256_loadu_ps( io_sums + i ), _mm256_loadu_ps( in_values + i ) ) );
+        }
+    }
+
+    void toDecibelsAvx2( const float* in_power, float in_scale, float* out_levels, size_t in_count )
+    {
+        const __m256 scale = _mm256_set1_ps( in_scale );
+        const __m256 minimum = _mm256_set1_ps( 1e-20f ); // METER_FLOOR_DB
+        const __m256 log2ToDecibels = _mm256_set1_ps( 3.0102999566f ); // 10 * log10( 2 )
+        for ( size_t i = 0; i < in_count; i += 8 )
+        {
+            __m256 power = _mm256_max_ps( _mm256_mul_ps( _mm256_loadu_ps( in_power + i ), scale ), minimum );
+            _mm256_storeu_ps( out_levels + i, _mm256_mul_ps( log2Avx2( power ), log2ToDecibels ) );
+        }
+    }
+
+    const MeterKernels AVX2_KERNELS = { "avx2", updateAvx2, accumulateAvx2, toDecibelsAvx2 };
+}
+
+const MeterKernels& getAvx2MeterKernels()
+{
+    return AVX2_KERNELS;
+}
+
+#endif
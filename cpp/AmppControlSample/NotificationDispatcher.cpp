@@ -0,0 +1,169 @@
+//
+// Copyright Grass Valley
+//
+
+#include "NotificationDispatcher.h"
+
+#include <iostream>
+
+namespace
+{
+    const std::string CONTROL_TOPIC_PREFIX = "gv.ampp.control.";
+
+    void printNotification( const ReceivedNotificationModel& in_notification )
+    {
+        std::cout << "Received notification on \"" << in_notification.getTopic() << "\":" << std::endl;
+        std::cout << in_notification.getContent() << std::endl;
+    }
+}
+
+NotificationDispatcher::NotificationDispatcher( unsigned int in_threadCount )
+    : mHandler( std::make_shared<const Handler>( printNotification ) )
+    , mPool( in_threadCount )
+{
+}
+
+void NotificationDispatcher::setHandler( Handler in_handler )
+{
+    std::shared_ptr<const Handler> handler = std::make_shared<const Handler>( std::move( in_handler ) );
+    std::atomic_store( &mHandler, handler );
+}
+
+std::string NotificationDispatcher::getLaneKey( const std::string& in_topic )
+{
+    if ( in_topic.compare( 0, CONTROL_TOPIC_PREFIX.size(), CONTROL_TOPIC_PREFIX ) == 0 )
+    {
+        size_t end = in_topic.find( '.', CONTROL_TOPIC_PREFIX.size() );
+        return in_topic.substr( CONTROL_TOPIC_PREFIX.size(), end - CONTROL_TOPIC_PREFIX.size() );
+    }
+    return in_topic;
+}
+
+NotificationDispatcher::LanePtr NotificationDispatcher::getLane( const std::string& in_key )
+{
+    std::lock_guard<std::mutex> lock( mLanesMutex );
+    LanePtr& lane = mLanes[ in_key ];
+    if ( !lane )
+    {
+        lane = std::make_shared<Lane>( in_key );
+    }
+    return lane;
+}
+
+void NotificationDispatcher::post( ReceivedNotificationModel&& in_notification )
+{
+    LanePtr lane = getLane( getLaneKey( in_notification.getTopic() ) );
+
+    Entry entry;
+    entry.notification = std::move( in_notification );
+    entry.enqueued = Clock::now();
+
+    bool schedule = false;
+    {
+        std::lock_guard<std::mutex> lock( lane->mutex );
+        lane->queue.push_back( std::move( entry ) );
+        if ( lane->queue.size() > lane->maxDepth )
+        {
+            lane->maxDepth = lane->queue.size();
+        }
+        if ( !lane->scheduled )
+        {
+            lane->scheduled = true;
+            schedule = true;
+        }
+    }
+
+    if ( schedule )
+    {
+        mPool.submit( [this, lane]() { drain( lane ); } );
+    }
+}
+
+void NotificationDispatcher::drain( const LanePtr& in_lane )
+{
+    std::shared_ptr<const Handler> handler = std::atomic_load( &mHandler );
+
+    for ( size_t count = 0; count < DRAIN_BATCH; ++count )
+    {
+        Entry entry;
+        {
+            std::lock_guard<std::mutex> lock( in_lane->mutex );
+            if ( in_lane->queue.empty() )
+            {
+                in_lane->scheduled = false;
+                return;
+            }
+            entry = std::move( in_lane->queue.front() );
+            in_lane->queue.pop_front();
+        }
+
+        Clock::time_point start = Clock::now();
+        try
+        {
+            ( *handler )( entry.notification );
+        }
+        catch ( std::exception& e )
+        {
+            std::cout << "Notification handler error on \"" << entry.notification.getTopic() << "\": "
+                << e.what() << std::endl;
+        }
+        Clock::time_point end = Clock::now();
+
+        uint64_t queueDelayNs = std::chrono::duration_cast<std::chrono::nanoseconds>( start - entry.enqueued ).count();
+        uint64_t handlerNs = std::chrono::duration_cast<std::chrono::nanoseconds>( end - start ).count();
+        in_lane->processed.fetch_add( 1, std::memory_order_relaxed );
+        in_lane->totalQueueDelayNs.fetch_add( queueDelayNs, std::memory_order_relaxed );
+        in_lane->totalHandlerNs.fetch_add( handlerNs, std::memory_order_relaxed );
+        if ( handlerNs > in_lane->maxHandlerNs.load( std::memory_order_relaxed ) )
+        {
+            in_lane->maxHandlerNs.store( handlerNs, std::memory_order_relaxed );
+        }
+    }
+
+    // The batch is exhausted but the lane may still hold notifications: requeue
+    // it behind the other tasks of this worker instead of monopolizing it.
+    {
+        std::lock_guard<std::mutex> lock( in_lane->mutex );
+        if ( in_lane->queue.empty() )
+        {
+            in_lane->scheduled = false;
+            return;
+        }
+    }
+    LanePtr lane = in_lane;
+    mPool.defer( [this, lane]() { drain( lane ); } );
+}
+
+std::vector<NotificationDispatcher::LaneStats> NotificationDispatcher::getLaneStats() const
+{
+    std::vector<LanePtr> lanes;
+    {
+        std::lock_guard<std::mutex> lock( mLanesMutex );
+        lanes.reserve( mLanes.size() );
+        for ( auto it = mLanes.begin(); it != mLanes.end(); ++it )
+        {
+            lanes.push_back( it->second );
+        }
+    }
+
+    std::vector<LaneStats> stats;
+    stats.reserve( lanes.size() );
+    for ( size_t i = 0; i < lanes.size(); ++i )
+    {
+        const Lane& lane = *lanes[ i ];
+        LaneStats laneStats;
+        laneStats.key = lane.key;
+        {
+            std::lock_guard<std::mutex> lock( lanes[ i ]->mutex );
+            laneStats.queueDepth = lane.queue.size();
+            laneStats.maxQueueDepth = lane.maxDepth;
+        }
+        laneStats.processed = lane.processed.load( std::memory_order_relaxed );
+        double processed = laneStats.processed > 0 ? static_cast<double>( laneStats.processed ) : 1.0;
+        laneStats.averageQueueDelayUs = lane.totalQueueDelayNs.load( std::memory_order_relaxed ) / processed / 1000.0;
+        laneStats.averageHandlerUs = lane.totalHandlerNs.load( std::memory_order_relaxed ) / processed / 1000.0;
+        laneStats.maxHandlerUs = lane.maxHandlerNs.load( std::memory_order_relaxed ) / 1000.0;
+        stats.push_back( laneStats );
+    }
+    return stats;
+}
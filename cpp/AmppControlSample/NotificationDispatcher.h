@@ -0,0 +1,115 @@
+//
+// Copyright Grass Valley
+//
+
+#ifndef NOTIFICATION_DISPATCHER_H_
+#define NOTIFICATION_DISPATCHER_H_
+
+#include "RpcProtocol.h"
+#include "WorkStealingPool.h"
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Runs notification handlers on a work-stealing thread pool instead of the
+// websocket io thread.
+//
+// Notifications are grouped in lanes keyed by workload id (parsed from the
+// "gv.ampp.control.<workload>.*" topic; other topics use the full topic as
+// their key). A lane is drained by at most one worker at a time, so the
+// notifications of one workload are handled in the order they were received,
+// while different workloads are handled in parallel.
+class NotificationDispatcher
+{
+public:
+    typedef std::function<void( const ReceivedNotificationModel& )> Handler;
+
+    struct LaneStats
+    {
+        std::string key;
+        size_t queueDepth;
+        size_t maxQueueDepth;
+        uint64_t processed;
+        double averageQueueDelayUs;
+        double averageHandlerUs;
+        double maxHandlerUs;
+    };
+
+    // A thread count of 0 uses the number of hardware threads.
+    explicit NotificationDispatcher( unsigned int in_threadCount = 0 );
+
+    // Sets the handler called for every notification. It may be called
+    // concurrently for notifications of different lanes.
+    void setHandler( Handler in_handler );
+
+    // Queues a notification on its lane. Called from the io thread.
+    void post( ReceivedNotificationModel&& in_notification );
+
+    // Returns a snapshot of the statistics of every lane seen so far.
+    std::vector<LaneStats> getLaneStats() const;
+
+    // Returns the lane key for a topic: the workload id for AMPP Control
+    // topics, the topic itself otherwise.
+    static std::string getLaneKey( const std::string& in_topic );
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Entry
+    {
+        ReceivedNotificationModel notification;
+        Clock::time_point enqueued;
+    };
+
+    struct Lane
+    {
+        Lane( const std::string& in_key )
+            : key( in_key )
+            , scheduled( false )
+            , maxDepth( 0 )
+            , processed( 0 )
+            , totalQueueDelayNs( 0 )
+            , totalHandlerNs( 0 )
+            , maxHandlerNs( 0 )
+        {
+        }
+
+        const std::string key;
+
+        // Guarded by mutex.
+        std::mutex mutex;
+        std::deque<Entry> queue;
+        bool scheduled;
+        size_t maxDepth;
+
+        // Only updated by the worker currently draining the lane.
+        std::atomic<uint64_t> processed;
+        std::atomic<uint64_t> totalQueueDelayNs;
+        std::atomic<uint64_t> totalHandlerNs;
+        std::atomic<uint64_t> maxHandlerNs;
+    };
+    typedef std::shared_ptr<Lane> LanePtr;
+
+    // Maximum number of notifications handled before a lane yields its worker.
+    static const size_t DRAIN_BATCH = 32;
+
+    LanePtr getLane( const std::string& in_key );
+    void drain( const LanePtr& in_lane );
+
+    std::shared_ptr<const Handler> mHandler;
+
+    mutable std::mutex mLanesMutex;
+    std::unordered_map<std::string, LanePtr> mLanes;
+
+    // Declared last so the workers stop before the lanes are destroyed.
+    WorkStealingPool mPool;
+};
+
+#endif /* NOTIFICATION_DISPATCHER_H_ */
@@ -0,0 +1,335 @@
+//
+// Copyright Grass Valley
+//
+
+#include "NotificationGateway.h"
+#include "PushNotificationServer.h"
+#include "Util.h"
+
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <vector>
+
+namespace
+{
+    const uint32_t GATEWAY_MAGIC = 0x41475731; // "AGW1"
+    const uint32_t GATEWAY_VERSION = 1;
+
+    const char COMMAND_SUBSCRIBE = 'S';
+    const char COMMAND_UNSUBSCRIBE = 'U';
+    const char COMMAND_PUBLISH = 'P';
+
+    // Idle period of the threads polling the shared memory.
+    const std::chrono::milliseconds POLL_INTERVAL( 1 );
+
+    struct GatewayHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t ringOffset;
+        uint64_t queueOffset;
+        std::atomic<uint32_t> ready;
+    };
+
+    size_t alignUp( size_t in_value )
+    {
+        return ( in_value + 63 ) & ~static_cast<size_t>( 63 );
+    }
+
+    std::string getSegmentName( const std::string& in_name )
+    {
+#ifdef _WIN32
+        return "Local\\" + in_name;
+#else
+        return "/" + in_name;
+#endif
+    }
+}
+
+//********************************************************************************
+// NotificationGateway
+//********************************************************************************
+
+NotificationGateway::NotificationGateway( websocket_endpoint& in_endpoint, int in_connectionId,
+    const std::string& in_name, const Options& in_options )
+    : mEndpoint( in_endpoint )
+    , mConnectionId( in_connectionId )
+    , mName( in_name )
+    , mOptions( in_options )
+    , mRunning( false )
+    , mPublished( 0 )
+    , mOversized( 0 )
+    , mCommands( 0 )
+    , mBadCommands( 0 )
+{
+}
+
+NotificationGateway::~NotificationGateway()
+{
+    stop();
+}
+
+bool NotificationGateway::start()
+{
+    if ( mRunning )
+    {
+        return true;
+    }
+    if ( mOptions.commandCells == 0 || ( mOptions.commandCells & ( mOptions.commandCells - 1 ) ) != 0 )
+    {
+        std::cout << "> Gateway command cell count must be a power of two." << std::endl;
+        return false;
+    }
+
+    size_t ringOffset = alignUp( sizeof( GatewayHeader ) );
+    size_t queueOffset = ringOffset + alignUp( SharedBroadcastRing::getRequiredSize( mOptions.ringSlots, mOptions.slotSize ) );
+    size_t size = queueOffset + SharedCommandQueue::getRequiredSize( mOptions.commandCells, mOptions.commandSize );
+
+    if ( !mSegment.create( getSegmentName( mName ), size ) )
+    {
+        return false;
+    }
+
+    GatewayHeader* header = new ( mSegment.getData() ) GatewayHeader();
+    header->magic = GATEWAY_MAGIC;
+    header->version = GATEWAY_VERSION;
+    header->ringOffset = ringOffset;
+    header->queueOffset = queueOffset;
+    mRing.create( mSegment.getData() + ringOffset, mOptions.ringSlots, mOptions.slotSize );
+    mCommandQueue.create( mSegment.getData() + queueOffset, mOptions.commandCells, mOptions.commandSize );
+    header->ready.store( 1, std::memory_order_release );
+
+    mEndpoint.get_dispatcher().setHandler( [this]( const ReceivedNotificationModel& in_notification )
+    {
+        onNotification( in_notification );
+    } );
+
+    mRunning = true;
+    mCommandThread = std::thread( &NotificationGateway::runCommands, this );
+
+    std::cout << "> Gateway \"" << mName << "\" started (" << size / ( 1024 * 1024 ) << " MB of shared memory)" << std::endl;
+    return true;
+}
+
+void NotificationGateway::stop()
+{
+    if ( !mRunning )
+    {
+        return;
+    }
+
+    mRunning = false;
+    mCommandThread.join();
+
+    // Notifications may still be in flight on the dispatcher.
+    mEndpoint.get_dispatcher().setHandler( []( const ReceivedNotificationModel& ) {} );
+    std::lock_guard<std::mutex> lock( mPublishMutex );
+
+    for ( std::map<std::string, int>::const_iterator it = mSubscriptions.begin(); it != mSubscriptions.end(); ++it )
+    {
+        pushNotificationServerUnsubscribe( mEndpoint, mConnectionId, getUuid(), it->first );
+    }
+    mSubscriptions.clear();
+
+    mSegment.close();
+}
+
+void NotificationGateway::onNotification( const ReceivedNotificationModel& in_notification )
+{
+    std::vector<std::uint8_t> record = json::to_bson( in_notification.toJson() );
+
+    std::lock_guard<std::mutex> lock( mPublishMutex );
+    if ( !mSegment.getData() )
+    {
+        return;
+    }
+    if ( mRing.publish( record.data(), record.size() ) )
+    {
+        ++mPublished;
+    }
+    else
+    {
+        ++mOversized;
+    }
+}
+
+void NotificationGateway::runCommands()
+{
+    std::string command;
+    uint64_t bad = 0;
+    while ( mRunning )
+    {
+        bool popped = mCommandQueue.pop( command, bad );
+        mBadCommands = bad;
+        if ( popped )
+        {
+            ++mCommands;
+            executeCommand( command );
+        }
+        else
+        {
+            std::this_thread::sleep_for( POLL_INTERVAL );
+        }
+    }
+}
+
+void NotificationGateway::executeCommand( const std::string& in_command )
+{
+    // Record layout: type, topic, '\0', content.
+    size_t topicEnd = in_command.find( '\0', 1 );
+    if ( in_command.empty() || topicEnd == std::string::npos )
+    {
+        std::cout << "> Gateway received an invalid command." << std::endl;
+        return;
+    }
+    std::string topic = in_command.substr( 1, topicEnd - 1 );
+
+    switch ( in_command[ 0 ] )
+    {
+    case COMMAND_SUBSCRIBE:
+        if ( mSubscriptions[ topic ]++ == 0 )
+        {
+            pushNotificationServerSubscribe( mEndpoint, mConnectionId, getUuid(), topic );
+        }
+        break;
+    case COMMAND_UNSUBSCRIBE:
+    {
+        std::map<std::string, int>::iterator it = mSubscriptions.find( topic );
+        if ( it != mSubscriptions.end() && --it->second == 0 )
+        {
+            mSubscriptions.erase( it );
+            pushNotificationServerUnsubscribe( mEndpoint, mConnectionId, getUuid(), topic );
+        }
+        break;
+    }
+    case COMMAND_PUBLISH:
+        pushNotificationServerSendNotification( mEndpoint, mConnectionId, getUuid(), topic,
+            in_command.substr( topicEnd + 1 ) );
+        break;
+    default:
+        std::cout << "> Gateway received an unknown command." << std::endl;
+        break;
+    }
+}
+
+//********************************************************************************
+// GatewaySubscriber
+//********************************************************************************
+
+GatewaySubscriber::GatewaySubscriber( const std::string& in_name )
+    : mName( in_name )
+    , mCursor( 0 )
+    , mLost( 0 )
+{
+}
+
+GatewaySubscriber::~GatewaySubscriber()
+{
+    if ( mSegment.getData() )
+    {
+        while ( !mTopics.empty() )
+        {
+            unsubscribe( *mTopics.begin() );
+        }
+    }
+}
+
+bool GatewaySubscriber::open()
+{
+    if ( !mSegment.open( getSegmentName( mName ) ) )
+    {
+        return false;
+    }
+
+    const GatewayHeader* header = reinterpret_cast<const GatewayHeader*>( mSegment.getData() );
+    if ( mSegment.getSize() < sizeof( GatewayHeader ) || header->ready.load( std::memory_order_acquire ) != 1
+        || header->magic != GATEWAY_MAGIC || header->version != GATEWAY_VERSION )
+    {
+        std::cout << "> \"" << mName << "\" is not a running gateway." << std::endl;
+        mSegment.close();
+        return false;
+    }
+
+    mRing.attach( mSegment.getData() + header->ringOffset );
+    mCommandQueue.attach( mSegment.getData() + header->queueOffset );
+    mCursor = mRing.getWriteSequence();
+    return true;
+}
+
+bool GatewaySubscriber::sendCommand( char in_type, const std::string& in_topic, const std::string& in_content )
+{
+    if ( !mSegment.getData() )
+    {
+        return false;
+    }
+
+    mRecord.clear();
+    mRecord += in_type;
+    mRecord += in_topic;
+    mRecord += '\0';
+    mRecord += in_content;
+    return mCommandQueue.push( mRecord.data(), mRecord.size() );
+}
+
+bool GatewaySubscriber::subscribe( const std::string& in_topic )
+{
+    if ( mTopics.count( in_topic ) )
+    {
+        return true;
+    }
+    if ( !sendCommand( COMMAND_SUBSCRIBE, in_topic, "" ) )
+    {
+        return false;
+    }
+    mTopics.insert( in_topic );
+    return true;
+}
+
+bool GatewaySubscriber::unsubscribe( const std::string& in_topic )
+{
+    if ( !mTopics.erase( in_topic ) )
+    {
+        return true;
+    }
+    return sendCommand( COMMAND_UNSUBSCRIBE, in_topic, "" );
+}
+
+bool GatewaySubscriber::publish( const std::string& in_topic, const std::string& in_content )
+{
+    return sendCommand( COMMAND_PUBLISH, in_topic, in_content );
+}
+
+bool GatewaySubscriber::receive( ReceivedNotificationModel& out_notification, std::chrono::milliseconds in_timeout )
+{
+    if ( !mSegment.getData() )
+    {
+        return false;
+    }
+
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + in_timeout;
+    for ( ;; )
+    {
+        while ( mRing.read( mCursor, mRecord, mLost ) )
+        {
+            json j = json::from_bson( mRecord.begin(), mRecord.end(), true, false );
+            if ( j.is_discarded() || !out_notification.setFromJson( j ) )
+            {
+                continue;
+            }
+            for ( std::set<std::string>::const_iterator it = mTopics.begin(); it != mTopics.end(); ++it )
+            {
+                if ( topicMatches( *it, out_notification.getTopic() ) )
+                {
+                    return true;
+                }
+            }
+        }
+
+        if ( std::chrono::steady_clock::now() >= deadline )
+        {
+            return false;
+        }
+        std::this_thread::sleep_for( POLL_INTERVAL );
+    }
+}
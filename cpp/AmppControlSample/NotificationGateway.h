@@ -0,0 +1,154 @@
+//
+// Copyright Grass Valley
+//
+
+#ifndef NOTIFICATION_GATEWAY_H_
+#define NOTIFICATION_GATEWAY_H_
+
+#include "RpcProtocol.h"
+#include "SharedMemory.h"
+#include "Sockets.h"
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+// Local fan-out of one push notification connection to many processes.
+//
+// The gateway owns the upstream websocket connection (one TLS session, one
+// bearer token). It writes every notification it receives, BSON encoded, to a
+// shared memory broadcast ring read by any number of subscriber processes, and
+// executes the commands (subscribe, unsubscribe, publish) that subscribers
+// push to a lock-free shared memory queue. Subscriptions are reference counted
+// so a topic wanted by several processes is subscribed to only once.
+//
+// Both sides run on the same host and must be built with the same layout.
+class NotificationGateway
+{
+public:
+    struct Options
+    {
+        Options()
+            : ringSlots( 2048 )
+            , slotSize( 32 * 1024 )
+            , commandCells( 256 )
+            , commandSize( 16 * 1024 )
+        {
+        }
+
+        uint32_t ringSlots;
+        uint32_t slotSize;
+        uint32_t commandCells; // Must be a power of two.
+        uint32_t commandSize;
+    };
+
+    NotificationGateway( websocket_endpoint& in_endpoint, int in_connectionId,
+        const std::string& in_name, const Options& in_options = Options() );
+    ~NotificationGateway();
+
+    // Creates the shared memory segment, takes over the endpoint's notification
+    // handler and starts executing subscriber commands.
+    bool start();
+
+    void stop();
+
+    uint64_t getPublishedCount() const
+    {
+        return mPublished.load();
+    }
+
+    // Notifications that did not fit in a ring slot.
+    uint64_t getOversizedCount() const
+    {
+        return mOversized.load();
+    }
+
+    uint64_t getCommandCount() const
+    {
+        return mCommands.load();
+    }
+
+    // Commands skipped as corrupt.
+    uint64_t getBadCommandCount() const
+    {
+        return mBadCommands.load();
+    }
+
+private:
+    void onNotification( const ReceivedNotificationModel& in_notification );
+    void runCommands();
+    void executeCommand( const std::string& in_command );
+
+    websocket_endpoint& mEndpoint;
+    int mConnectionId;
+    std::string mName;
+    Options mOptions;
+
+    SharedMemorySegment mSegment;
+    SharedBroadcastRing mRing;
+    SharedCommandQueue mCommandQueue;
+
+    // The dispatcher may call onNotification() from several workers while the
+    // ring only supports a single producer.
+    std::mutex mPublishMutex;
+
+    std::map<std::string, int> mSubscriptions;
+
+    std::atomic<bool> mRunning;
+    std::thread mCommandThread;
+    std::atomic<uint64_t> mPublished;
+    std::atomic<uint64_t> mOversized;
+    std::atomic<uint64_t> mCommands;
+    std::atomic<uint64_t> mBadCommands;
+};
+
+
+// The subscriber side of a NotificationGateway, used by the local processes
+// sharing its connection.
+class GatewaySubscriber
+{
+public:
+    explicit GatewaySubscriber( const std::string& in_name );
+
+    // Unsubscribes from every topic still subscribed.
+    ~GatewaySubscriber();
+
+    // Attaches to the gateway's shared memory. Only notifications published
+    // after this call are received.
+    bool open();
+
+    bool subscribe( const std::string& in_topic );
+    bool unsubscribe( const std::string& in_topic );
+
+    // Asks the gateway to publish a notification (e.g. an AMPP Control command).
+    bool publish( const std::string& in_topic, const std::string& in_content );
+
+    // Returns the next notification matching one of this subscriber's topics,
+    // waiting up to in_timeout for one.
+    bool receive( ReceivedNotificationModel& out_notification,
+        std::chrono::milliseconds in_timeout = std::chrono::milliseconds( 0 ) );
+
+    // Notifications overwritten in the ring before this subscriber read them.
+    uint64_t getLostCount() const
+    {
+        return mLost;
+    }
+
+private:
+    bool sendCommand( char in_type, const std::string& in_topic, const std::string& in_content );
+
+    std::string mName;
+    SharedMemorySegment mSegment;
+    SharedBroadcastRing mRing;
+    SharedCommandQueue mCommandQueue;
+    uint64_t mCursor;
+    uint64_t mLost;
+    std::set<std::string> mTopics;
+    std::string mRecord;
+};
+
+#endif /* NOTIFICATION_GATEWAY_H_ */
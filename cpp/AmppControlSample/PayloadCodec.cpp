@@ -0,0 +1,624 @@
+//
+// Copyright Grass Valley
+//
+
+#include "PayloadCodec.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+    bool isWhitespace( char in_c )
+    {
+        return in_c == ' ' || in_c == '\t' || in_c == '\r' || in_c == '\n';
+    }
+
+    bool equalsIgnoreCase( const char* in_name, size_t in_length, const char* in_lowercase )
+    {
+        size_t i = 0;
+        for ( ; i < in_length && in_lowercase[ i ]; ++i )
+        {
+            char c = in_name[ i ];
+            if ( c >= 'A' && c <= 'Z' )
+            {
+                c = static_cast<char>( c - 'A' + 'a' );
+            }
+            if ( c != in_lowercase[ i ] )
+            {
+                return false;
+            }
+        }
+        return i == in_length && !in_lowercase[ i ];
+    }
+
+    int hexValue( char in_c )
+    {
+        if ( in_c >= '0' && in_c <= '9' ) return in_c - '0';
+        if ( in_c >= 'a' && in_c <= 'f' ) return in_c - 'a' + 10;
+        if ( in_c >= 'A' && in_c <= 'F' ) return in_c - 'A' + 10;
+        return -1;
+    }
+
+    void appendUtf8( unsigned long in_codePoint, std::string& io_value )
+    {
+        if ( in_codePoint < 0x80 )
+        {
+            io_value += static_cast<char>( in_codePoint );
+        }
+        else if ( in_codePoint < 0x800 )
+        {
+            io_value += static_cast<char>( 0xC0 | ( in_codePoint >> 6 ) );
+            io_value += static_cast<char>( 0x80 | ( in_codePoint & 0x3F ) );
+        }
+        else if ( in_codePoint < 0x10000 )
+        {
+            io_value += static_cast<char>( 0xE0 | ( in_codePoint >> 12 ) );
+            io_value += static_cast<char>( 0x80 | ( ( in_codePoint >> 6 ) & 0x3F ) );
+            io_value += static_cast<char>( 0x80 | ( in_codePoint & 0x3F ) );
+        }
+        else
+        {
+            io_value += static_cast<char>( 0xF0 | ( in_codePoint >> 18 ) );
+            io_value += static_cast<char>( 0x80 | ( ( in_codePoint >> 12 ) & 0x3F ) );
+            io_value += static_cast<char>( 0x80 | ( ( in_codePoint >> 6 ) & 0x3F ) );
+            io_value += static_cast<char>( 0x80 | ( in_codePoint & 0x3F ) );
+        }
+    }
+
+    // Formats backwards from the end of the buffer, returns the first character.
+    char* formatInteger( long long in_value, char* in_end )
+    {
+        unsigned long long magnitude = ( in_value < 0 ) ? 0ULL - static_cast<unsigned long long>( in_value )
+            : static_cast<unsigned long long>( in_value );
+        char* start = in_end;
+        do
+        {
+            *--start = static_cast<char>( '0' + magnitude % 10 );
+            magnitude /= 10;
+        } while ( magnitude != 0 );
+        if ( in_value < 0 )
+        {
+            *--start = '-';
+        }
+        return start;
+    }
+}
+
+//********************************************************************************
+// PayloadWriter
+//********************************************************************************
+
+PayloadWriter::PayloadWriter( std::string& io_content, const std::string& in_key )
+    : mContent( io_content )
+    , mFirst( true )
+{
+    mContent.clear();
+    mContent += "{\"Key\":";
+    writeEscaped( in_key );
+    mContent += ",\"Payload\":{";
+}
+
+void PayloadWriter::writeInteger( const PayloadField& in_field, long long in_value )
+{
+    char buffer[ 32 ];
+    char* end = buffer + sizeof( buffer );
+    char* start = formatInteger( in_value, end );
+    writeName( in_field );
+    mContent.append( start, end - start );
+}
+
+void PayloadWriter::writeNumber( const PayloadField& in_field, double in_value )
+{
+    writeName( in_field );
+    if ( !std::isfinite( in_value ) )
+    {
+        // Not representable in JSON.
+        mContent += "null";
+        return;
+    }
+
+    // Levels and the like are mostly whole numbers, written as integers.
+    char buffer[ 32 ];
+    if ( in_value == std::floor( in_value ) && std::fabs( in_value ) < 1e15 )
+    {
+        char* end = buffer + sizeof( buffer );
+        char* start = formatInteger( static_cast<long long>( in_value ), end );
+        mContent.append( start, end - start );
+        return;
+    }
+
+    // The shortest of the two precisions that reads back as the same value.
+    int length = snprintf( buffer, sizeof( buffer ), "%.15g", in_value );
+    if ( strtod( buffer, NULL ) != in_value )
+    {
+        length = snprintf( buffer, sizeof( buffer ), "%.17g", in_value );
+    }
+    mContent.append( buffer, length );
+}
+
+void PayloadWriter::writeBoolean( const PayloadField& in_field, bool in_value )
+{
+    writeName( in_field );
+    mContent += in_value ? "true" : "false";
+}
+
+void PayloadWriter::writeString( const PayloadField& in_field, const std::string& in_value )
+{
+    writeName( in_field );
+    writeEscaped( in_value );
+}
+
+void PayloadWriter::end()
+{
+    mContent += "}}";
+}
+
+void PayloadWriter::writeName( const PayloadField& in_field )
+{
+    if ( !mFirst )
+    {
+        mContent += ',';
+    }
+    mFirst = false;
+
+    // Names are checked by the generator, they never need escaping.
+    mContent += '"';
+    mContent.append( in_field.name, in_field.nameLength );
+    mContent += "\":";
+}
+
+void PayloadWriter::writeEscaped( const std::string& in_value )
+{
+    static const char* const hexDigits = "0123456789abcdef";
+
+    mContent += '"';
+    size_t start = 0;
+    for ( size_t i = 0; i < in_value.size(); ++i )
+    {
+        unsigned char c = static_cast<unsigned char>( in_value[ i ] );
+        if ( c >= 0x20 && c != '"' && c != '\\' )
+        {
+            continue;
+        }
+
+        mContent.append( in_value, start, i - start );
+        start = i + 1;
+        switch ( c )
+        {
+        case '"': mContent += "\\\""; break;
+        case '\\': mContent += "\\\\"; break;
+        case '\n': mContent += "\\n"; break;
+        case '\r': mContent += "\\r"; break;
+        case '\t': mContent += "\\t"; break;
+        default:
+            mContent += "\\u00";
+            mContent += hexDigits[ c >> 4 ];
+            mContent += hexDigits[ c & 0xF ];
+            break;
+        }
+    }
+    mContent.append( in_value, start, std::string::npos );
+    mContent += '"';
+}
+
+//********************************************************************************
+// PayloadReader
+//********************************************************************************
+
+PayloadReader::PayloadReader( const std::string& in_content, std::string* out_key )
+    : mPosition( in_content.c_str() )
+    , mEnd( in_content.c_str() + in_content.size() )
+    , mKey( out_key )
+    , mState( STATE_ERROR )
+    , mFoundPayload( false )
+    , mPendingValue( false )
+{
+    skipWhitespace();
+    if ( mPosition < mEnd && *mPosition == '{' )
+    {
+        ++mPosition;
+        mState = STATE_ENVELOPE;
+    }
+}
+
+bool PayloadReader::nextField( const PayloadField* in_fields, size_t in_count, size_t& out_index )
+{
+    if ( mPendingValue )
+    {
+        // The value of the previous field was not read.
+        mPendingValue = false;
+        if ( !skipValue() )
+        {
+            return fail();
+        }
+        endMember();
+    }
+
+    const char* name;
+    size_t length;
+    while ( mState == STATE_ENVELOPE || mState == STATE_PAYLOAD )
+    {
+        skipWhitespace();
+        if ( mPosition < mEnd && *mPosition == '}' )
+        {
+            ++mPosition;
+            if ( mState == STATE_ENVELOPE )
+            {
+                mState = STATE_DONE;
+                return false;
+            }
+            mState = STATE_ENVELOPE;
+            endMember();
+            continue;
+        }
+
+        if ( !readName( name, length ) )
+        {
+            return fail();
+        }
+        skipWhitespace();
+
+        if ( mState == STATE_ENVELOPE )
+        {
+            if ( equalsIgnoreCase( name, length, "payload" ) )
+            {
+                if ( mPosition >= mEnd || *mPosition != '{' )
+                {
+                    return fail();
+                }
+                ++mPosition;
+                mFoundPayload = true;
+                mState = STATE_PAYLOAD;
+                continue;
+            }
+
+            bool readKey = ( mKey && mPosition < mEnd && *mPosition == '"' && equalsIgnoreCase( name, length, "key" ) );
+            if ( !( readKey ? readStringValue( mKey ) : skipValue() ) )
+            {
+                return fail();
+            }
+            endMember();
+            continue;
+        }
+
+        // A null value is the same as an absent one.
+        if ( mEnd - mPosition >= 4 && memcmp( mPosition, "null", 4 ) == 0 )
+        {
+            mPosition += 4;
+            endMember();
+            continue;
+        }
+
+        for ( size_t i = 0; i < in_count; ++i )
+        {
+            if ( in_fields[ i ].nameLength == length && memcmp( in_fields[ i ].name, name, length ) == 0 )
+            {
+                out_index = i;
+                mPendingValue = true;
+                return true;
+            }
+        }
+
+        if ( !skipValue() )
+        {
+            return fail();
+        }
+        endMember();
+    }
+    return false;
+}
+
+bool PayloadReader::readInteger( const PayloadField& in_field, long long& out_value )
+{
+    if ( !mPendingValue )
+    {
+        return fail();
+    }
+    mPendingValue = false;
+
+    // The content is a std::string, strtoll and strtod stop at its terminating null at worst.
+    char* end;
+    long long value = strtoll( mPosition, &end, 10 );
+    if ( end == mPosition )
+    {
+        return fail();
+    }
+    if ( *end == '.' || *end == 'e' || *end == 'E' )
+    {
+        // 1.0 and 1e2 are integers too.
+        double number = strtod( mPosition, &end );
+        if ( std::floor( number ) != number )
+        {
+            return fail();
+        }
+        value = static_cast<long long>( number );
+    }
+    mPosition = end;
+    if ( !checkRange( in_field, static_cast<double>( value ) ) )
+    {
+        return false;
+    }
+    out_value = value;
+    endMember();
+    return true;
+}
+
+bool PayloadReader::readNumber( const PayloadField& in_field, double& out_value )
+{
+    if ( !mPendingValue )
+    {
+        return fail();
+    }
+    mPendingValue = false;
+
+    char* end;
+    double value = strtod( mPosition, &end );
+    if ( end == mPosition || *mPosition == 'n' || *mPosition == 'N' || *mPosition == 'i' || *mPosition == 'I' )
+    {
+        // strtod accepts nan and inf, JSON does not.
+        return fail();
+    }
+    mPosition = end;
+    if ( !checkRange( in_field, value ) )
+    {
+        return false;
+    }
+    out_value = value;
+    endMember();
+    return true;
+}
+
+bool PayloadReader::readBoolean( bool& out_value )
+{
+    if ( !mPendingValue )
+    {
+        return fail();
+    }
+    mPendingValue = false;
+
+    if ( mEnd - mPosition >= 4 && memcmp( mPosition, "true", 4 ) == 0 )
+    {
+        mPosition += 4;
+        out_value = true;
+    }
+    else if ( mEnd - mPosition >= 5 && memcmp( mPosition, "false", 5 ) == 0 )
+    {
+        mPosition += 5;
+        out_value = false;
+    }
+    else
+    {
+        return fail();
+    }
+    endMember();
+    return true;
+}
+
+bool PayloadReader::readString( std::string& out_value )
+{
+    if ( !mPendingValue )
+    {
+        return fail();
+    }
+    mPendingValue = false;
+
+    if ( !readStringValue( &out_value ) )
+    {
+        return fail();
+    }
+    endMember();
+    return true;
+}
+
+bool PayloadReader::fail()
+{
+    mState = STATE_ERROR;
+    return false;
+}
+
+void PayloadReader::skipWhitespace()
+{
+    while ( mPosition < mEnd && isWhitespace( *mPosition ) )
+    {
+        ++mPosition;
+    }
+}
+
+bool PayloadReader::readName( const char*& out_name, size_t& out_length )
+{
+    if ( mPosition >= mEnd || *mPosition != '"' )
+    {
+        return false;
+    }
+
+    // Names are compared as written; escaped names never match a field.
+    out_name = ++mPosition;
+    while ( mPosition < mEnd && *mPosition != '"' )
+    {
+        if ( *mPosition == '\\' )
+        {
+            ++mPosition;
+        }
+        ++mPosition;
+    }
+    if ( mPosition >= mEnd )
+    {
+        return false;
+    }
+    out_length = mPosition - out_name;
+    ++mPosition;
+
+    skipWhitespace();
+    if ( mPosition >= mEnd || *mPosition != ':' )
+    {
+        return false;
+    }
+    ++mPosition;
+    return true;
+}
+
+bool PayloadReader::readStringValue( std::string* out_value )
+{
+    skipWhitespace();
+    if ( mPosition >= mEnd || *mPosition != '"' )
+    {
+        return false;
+    }
+    ++mPosition;
+    if ( out_value )
+    {
+        out_value->clear();
+    }
+
+    while ( mPosition < mEnd )
+    {
+        // Runs of plain characters are copied at once.
+        const char* start = mPosition;
+        while ( mPosition < mEnd && *mPosition != '"' && *mPosition != '\\' )
+        {
+            ++mPosition;
+        }
+        if ( out_value )
+        {
+            out_value->append( start, mPosition - start );
+        }
+        if ( mPosition >= mEnd )
+        {
+            return false;
+        }
+        if ( *mPosition == '"' )
+        {
+            ++mPosition;
+            return true;
+        }
+
+        // An escape sequence.
+        if ( mEnd - mPosition < 2 )
+        {
+            return false;
+        }
+        char escaped = mPosition[ 1 ];
+        mPosition += 2;
+        if ( escaped == 'u' )
+        {
+            unsigned long codePoint = 0;
+            for ( int i = 0; i < 4; ++i )
+            {
+                int digit = ( mPosition < mEnd ) ? hexValue( *mPosition ) : -1;
+                if ( digit < 0 )
+                {
+                    return false;
+                }
+                codePoint = ( codePoint << 4 ) | digit;
+                ++mPosition;
+            }
+
+            // A high surrogate followed by a low one.
+            if ( codePoint >= 0xD800 && codePoint <= 0xDBFF && mEnd - mPosition >= 6 && mPosition[ 0 ] == '\\' && mPosition[ 1 ] == 'u' )
+            {
+                unsigned long low = 0;
+                bool valid = true;
+                for ( int i = 2; i < 6 && valid; ++i )
+                {
+                    int digit = hexValue( mPosition[ i ] );
+                    valid = ( digit >= 0 );
+                    low = ( low << 4 ) | ( valid ? digit : 0 );
+                }
+                if ( valid && low >= 0xDC00 && low <= 0xDFFF )
+                {
+                    codePoint = 0x10000 + ( ( codePoint - 0xD800 ) << 10 ) + ( low - 0xDC00 );
+                    mPosition += 6;
+                }
+            }
+            if ( out_value )
+            {
+                appendUtf8( codePoint, *out_value );
+            }
+            continue;
+        }
+
+        if ( out_value )
+        {
+            switch ( escaped )
+            {
+            case 'b': *out_value += '\b'; break;
+            case 'f': *out_value += '\f'; break;
+            case 'n': *out_value += '\n'; break;
+            case 'r': *out_value += '\r'; break;
+            case 't': *out_value += '\t'; break;
+            default: *out_value += escaped; break;
+            }
+        }
+    }
+    return false;
+}
+
+bool PayloadReader::skipValue()
+{
+    skipWhitespace();
+    if ( mPosition >= mEnd )
+    {
+        return false;
+    }
+
+    if ( *mPosition == '"' )
+    {
+        return readStringValue( NULL );
+    }
+
+    if ( *mPosition == '{' || *mPosition == '[' )
+    {
+        int depth = 0;
+        while ( mPosition < mEnd )
+        {
+            char c = *mPosition;
+            if ( c == '"' )
+            {
+                if ( !readStringValue( NULL ) )
+                {
+                    return false;
+                }
+                continue;
+            }
+            ++mPosition;
+            if ( c == '{' || c == '[' )
+            {
+                ++depth;
+            }
+            else if ( ( c == '}' || c == ']' ) && --depth == 0 )
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // A number or a literal.
+    const char* start = mPosition;
+    while ( mPosition < mEnd && *mPosition != ',' && *mPosition != '}' && *mPosition != ']' && !isWhitespace( *mPosition ) )
+    {
+        ++mPosition;
+    }
+    return mPosition > start;
+}
+
+bool PayloadReader::checkRange( const PayloadField& in_field, double in_value )
+{
+    if ( ( in_field.hasMinimum && in_value < in_field.minimum ) || ( in_field.hasMaximum && in_value > in_field.maximum ) )
+    {
+        return fail();
+    }
+    return true;
+}
+
+void PayloadReader::endMember()
+{
+    skipWhitespace();
+    if ( mPosition < mEnd && *mPosition == ',' )
+    {
+        ++mPosition;
+    }
+}
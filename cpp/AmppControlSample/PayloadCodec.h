@@ -0,0 +1,115 @@
+//
+// Copyright Grass Valley
+//
+
+#ifndef PAYLOAD_CODEC_H_
+#define PAYLOAD_CODEC_H_
+
+#include <string>
+
+// Support of the typed payload structs generated from command schemas by
+// tools/generate_payload.py (see schemas/).
+//
+// A generated struct has one member per property of the schema and a table of
+// PayloadField describing them, built at compile time. It writes its content
+// with a PayloadWriter and reads it back with a PayloadReader, straight
+// between the members and the text: no JSON document is built either way.
+
+enum PayloadFieldType
+{
+    PAYLOAD_INTEGER,
+    PAYLOAD_NUMBER,
+    PAYLOAD_BOOLEAN,
+    PAYLOAD_STRING
+};
+
+struct PayloadField
+{
+    const char* name;
+    size_t nameLength;
+    PayloadFieldType type;
+    bool hasMinimum;
+    bool hasMaximum;
+    double minimum;
+    double maximum;
+};
+
+// Writes { "Key" : ..., "Payload" : { ... } } into a string. The previous text
+// is replaced but the capacity of the string is kept, so reusing the same
+// string for every command does not allocate once it is large enough.
+class PayloadWriter
+{
+public:
+    PayloadWriter( std::string& io_content, const std::string& in_key );
+
+    void writeInteger( const PayloadField& in_field, long long in_value );
+    void writeNumber( const PayloadField& in_field, double in_value );
+    void writeBoolean( const PayloadField& in_field, bool in_value );
+    void writeString( const PayloadField& in_field, const std::string& in_value );
+
+    // Closes the payload and the content.
+    void end();
+
+private:
+    void writeName( const PayloadField& in_field );
+    void writeEscaped( const std::string& in_value );
+
+    std::string& mContent;
+    bool mFirst;
+};
+
+// Reads the payload of a content, { "Key" : ..., "Payload" : { ... } } (the
+// member names of the envelope are matched regardless of case, notifications
+// use "key" and "payload").
+//
+// nextField() moves to the next member of the payload found in the field
+// table, skipping the others and the null ones, then the matching read
+// function reads its value; an unread value is skipped by the next call.
+class PayloadReader
+{
+public:
+    // in_content must outlive the reader. The key, if found, is copied to
+    // *out_key unless out_key is NULL.
+    PayloadReader( const std::string& in_content, std::string* out_key );
+
+    // Returns false at the end of the payload, or on error.
+    bool nextField( const PayloadField* in_fields, size_t in_count, size_t& out_index );
+
+    // Return false if the value has the wrong type or is out of range.
+    bool readInteger( const PayloadField& in_field, long long& out_value );
+    bool readNumber( const PayloadField& in_field, double& out_value );
+    bool readBoolean( bool& out_value );
+    bool readString( std::string& out_value );
+
+    // True once the whole content was read without error and had a payload.
+    bool isComplete() const
+    {
+        return mState == STATE_DONE && mFoundPayload;
+    }
+
+private:
+    enum State
+    {
+        STATE_ENVELOPE,
+        STATE_PAYLOAD,
+        STATE_DONE,
+        STATE_ERROR
+    };
+
+    bool fail();
+    void skipWhitespace();
+    bool readName( const char*& out_name, size_t& out_length );
+    bool readStringValue( std::string* out_value );
+    bool skipValue();
+    bool checkRange( const PayloadField& in_field, double in_value );
+    void endMember();
+
+    const char* mPosition;
+    const char* mEnd;
+    std::string* mKey;
+    State mState;
+    bool mFoundPayload;
+    bool mPendingValue;
+};
+
+#endif /* PAYLOAD_CODEC_H_ */
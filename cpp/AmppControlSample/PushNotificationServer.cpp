@@ -38,26 +38,47 @@ void pushNotificationServerUnsubscribe( websocket_endpoint& in_endpoint,
     in_endpoint.send( in_connectionId, jsonString );
 }
 
+namespace
+{
+    std::string getPublishRequest( const std::string& in_requestId, const std::string& in_topic,
+        const std::string& in_message )
+    {
+        PublishNotification notif;
+
+        notif.setRequestId( in_requestId );
+        notif.setHubName( "" );
+        notif.setHubMethod( RpcRequest::HubMethod::PUBLISH_NOTIFICATION );
+        notif.setId( in_requestId );
+        notif.setTime( getCurrentTimeString() );
+        notif.setTopic( in_topic );
+        notif.setSource( "TestApplication" );
+        notif.setTtl( 30000 );
+        notif.setContent( in_message );
+        notif.setContentType( "application/json" );
+        notif.setContentLength( static_cast<uint16_t>(in_message.size()) );
+        notif.setCorrelationId( in_requestId );
+        return notif.toJson().dump();
+    }
+}
+
 void pushNotificationServerSendNotification( websocket_endpoint& in_endpoint,
     const int in_connectionId, const std::string& in_requestId,
     const std::string& in_topic, const std::string& in_message )
 {
-    PublishNotification notif;
-
-    notif.setRequestId( in_requestId );
-    notif.setHubName( "" );
-    notif.setHubMethod( RpcRequest::HubMethod::PUBLISH_NOTIFICATION );
-    notif.setId( in_requestId );
-    notif.setTime( getCurrentTimeString() );
-    notif.setTopic( in_topic );
-    notif.setSource( "TestApplication" );
-    notif.setTtl( 30000 );
-    notif.setContent( in_message );
-    notif.setContentType( "application/json" );
-    notif.setContentLength( static_cast<uint16_t>(in_message.size()) );
-    notif.setCorrelationId( in_requestId );
-    std::string jsonString = notif.toJson().dump();
+    std::string jsonString = getPublishRequest( in_requestId, in_topic, in_message );
 
     in_endpoint.send( in_connectionId, jsonString );
 }
 
+void pushNotificationServerSendNotifications( websocket_endpoint& in_endpoint,
+    const int in_connectionId, const std::vector<std::pair<std::string, std::string> >& in_notifications )
+{
+    std::vector<std::string> jsonStrings;
+    jsonStrings.reserve( in_notifications.size() );
+    for ( size_t i = 0; i < in_notifications.size(); ++i )
+    {
+        jsonStrings.push_back( getPublishRequest( getUuid(), in_notifications[ i ].first, in_notifications[ i ].second ) );
+    }
+
+    in_endpoint.send( in_connectionId, jsonStrings );
+}
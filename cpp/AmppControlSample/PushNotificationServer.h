@@ -20,5 +20,9 @@ void pushNotificationServerSendNotification( websocket_endpoint& in_endpoint,
     const int in_connectionId, const std::string& in_requestId,
     const std::string& in_topic, const std::string& in_message );
 
+// Send several notifications, given as ( topic, message ) pairs, one after the
+// other on the connection. Each gets its own request id.
+void pushNotificationServerSendNotifications( websocket_endpoint& in_endpoint,
+    const int in_connectionId, const std::vector<std::pair<std::string, std::string> >& in_notifications );
 
 #endif /* PUSH_NOTIFICATION_SERVER_H_ */
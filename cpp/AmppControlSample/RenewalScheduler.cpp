@@ -0,0 +1,323 @@
+//
+// Copyright Grass Valley
+//
+
+#include "RenewalScheduler.h"
+#include "PushNotificationServer.h"
+
+#include <algorithm>
+
+const uint32_t RenewalScheduler::NONE;
+
+namespace
+{
+    // Level 0 has a slot per tick, levels 1 and 2 a slot per turn of the level below.
+    const uint64_t LEVEL0_BITS = 8;
+    const uint64_t LEVEL_BITS = 6;
+    const uint64_t LEVEL0_SLOTS = 1 << LEVEL0_BITS;
+    const uint64_t LEVEL_SLOTS = 1 << LEVEL_BITS;
+    const uint64_t LEVEL1_SHIFT = LEVEL0_BITS;
+    const uint64_t LEVEL2_SHIFT = LEVEL0_BITS + LEVEL_BITS;
+    const size_t LEVEL1_FIRST_SLOT = LEVEL0_SLOTS;
+    const size_t LEVEL2_FIRST_SLOT = LEVEL0_SLOTS + LEVEL_SLOTS;
+    const size_t SLOT_COUNT = LEVEL0_SLOTS + 2 * LEVEL_SLOTS;
+
+    bool isConnectionLess( const std::pair<int, size_t>& in_left, const std::pair<int, size_t>& in_right )
+    {
+        return in_left.first < in_right.first;
+    }
+}
+
+//********************************************************************************
+// RenewalScheduler
+//********************************************************************************
+
+RenewalScheduler::RenewalScheduler( websocket_endpoint& in_endpoint, const Options& in_options )
+    : mEndpoint( in_endpoint )
+    , mOptions( in_options )
+    , mTick( std::max( in_options.tick, std::chrono::milliseconds( 1 ) ) )
+    , mStart( Clock::now() )
+    , mFree( NONE )
+    , mSlots( SLOT_COUNT, NONE )
+    , mCurrentTick( 0 )
+    , mSpread( 0 )
+    , mRunning( false )
+    , mScheduled( 0 )
+    , mRenewed( 0 )
+    , mBatches( 0 )
+    , mLargestTick( 0 )
+{
+    mPeriodTicks = std::max<uint64_t>( std::chrono::duration_cast<std::chrono::milliseconds>( mOptions.period ) / mTick, 1 );
+}
+
+RenewalScheduler::~RenewalScheduler()
+{
+    stop();
+}
+
+RenewalScheduler::Handle RenewalScheduler::schedule( int in_connectionId, const std::string& in_topic,
+    const std::string& in_content )
+{
+    std::lock_guard<std::mutex> lock( mMutex );
+
+    uint32_t index = mFree;
+    if ( index != NONE )
+    {
+        mFree = mEntries[ index ].next;
+    }
+    else
+    {
+        index = static_cast<uint32_t>( mEntries.size() );
+        mEntries.push_back( Entry() );
+        mEntries[ index ].generation = 1;
+    }
+
+    // The fractional parts of n times the golden ratio are spread evenly over
+    // [0, 1) for any count n.
+    double point = static_cast<double>( ( ++mSpread * 0x9E3779B97F4A7C15ULL ) >> 11 ) / 9007199254740992.0; // 2^53
+
+    Entry& entry = mEntries[ index ];
+    entry.due = std::max( getTick( Clock::now() ), mCurrentTick ) + 1 + static_cast<uint64_t>( point * mPeriodTicks ) % mPeriodTicks;
+    entry.connectionId = in_connectionId;
+    entry.topic = in_topic;
+    entry.content = in_content;
+    insert( index );
+
+    ++mScheduled;
+    return ( static_cast<uint64_t>( entry.generation ) << 32 ) | index;
+}
+
+bool RenewalScheduler::cancel( Handle in_renewal )
+{
+    uint32_t index = static_cast<uint32_t>( in_renewal & 0xFFFFFFFF );
+    uint32_t generation = static_cast<uint32_t>( in_renewal >> 32 );
+
+    std::lock_guard<std::mutex> sendLock( mSendMutex );
+    std::lock_guard<std::mutex> lock( mMutex );
+    if ( index >= mEntries.size() || mEntries[ index ].generation != generation || mEntries[ index ].slot == NONE )
+    {
+        return false;
+    }
+
+    Entry& entry = mEntries[ index ];
+    unlink( index );
+    ++entry.generation;
+    entry.topic.clear();
+    entry.content.clear();
+    entry.next = mFree;
+    mFree = index;
+
+    --mScheduled;
+    return true;
+}
+
+void RenewalScheduler::start()
+{
+    std::lock_guard<std::mutex> lock( mMutex );
+    if ( mRunning )
+    {
+        return;
+    }
+    mRunning = true;
+    mThread = std::thread( &RenewalScheduler::run, this );
+}
+
+void RenewalScheduler::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock( mMutex );
+        if ( !mRunning )
+        {
+            return;
+        }
+        mRunning = false;
+    }
+    mCondition.notify_all();
+    mThread.join();
+}
+
+RenewalScheduler::Stats RenewalScheduler::getStats() const
+{
+    Stats stats;
+    stats.scheduled = mScheduled.load();
+    stats.renewed = mRenewed.load();
+    stats.batches = mBatches.load();
+    stats.largestTick = mLargestTick.load();
+    return stats;
+}
+
+uint64_t RenewalScheduler::getTick( Clock::time_point in_time ) const
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>( in_time - mStart ) / mTick;
+}
+
+void RenewalScheduler::insert( uint32_t in_index )
+{
+    Entry& entry = mEntries[ in_index ];
+    uint64_t due = std::max( entry.due, mCurrentTick );
+
+    // A slot of a level is only used while it comes around before the due
+    // tick; beyond the wheel, entries wait in the last slot of level 2 and are
+    // placed again when it is cascaded.
+    size_t slot;
+    if ( due - mCurrentTick < LEVEL0_SLOTS )
+    {
+        slot = due & ( LEVEL0_SLOTS - 1 );
+    }
+    else if ( ( due >> LEVEL1_SHIFT ) - ( mCurrentTick >> LEVEL1_SHIFT ) < LEVEL_SLOTS )
+    {
+        slot = LEVEL1_FIRST_SLOT + ( ( due >> LEVEL1_SHIFT ) & ( LEVEL_SLOTS - 1 ) );
+    }
+    else if ( ( due >> LEVEL2_SHIFT ) - ( mCurrentTick >> LEVEL2_SHIFT ) < LEVEL_SLOTS )
+    {
+        slot = LEVEL2_FIRST_SLOT + ( ( due >> LEVEL2_SHIFT ) & ( LEVEL_SLOTS - 1 ) );
+    }
+    else
+    {
+        slot = LEVEL2_FIRST_SLOT + ( ( ( mCurrentTick >> LEVEL2_SHIFT ) + LEVEL_SLOTS - 1 ) & ( LEVEL_SLOTS - 1 ) );
+    }
+
+    entry.slot = static_cast<uint32_t>( slot );
+    entry.previous = NONE;
+    entry.next = mSlots[ slot ];
+    if ( entry.next != NONE )
+    {
+        mEntries[ entry.next ].previous = in_index;
+    }
+    mSlots[ slot ] = in_index;
+}
+
+void RenewalScheduler::unlink( uint32_t in_index )
+{
+    Entry& entry = mEntries[ in_index ];
+    if ( entry.previous != NONE )
+    {
+        mEntries[ entry.previous ].next = entry.next;
+    }
+    else
+    {
+        mSlots[ entry.slot ] = entry.next;
+    }
+    if ( entry.next != NONE )
+    {
+        mEntries[ entry.next ].previous = entry.previous;
+    }
+    entry.slot = NONE;
+}
+
+uint32_t RenewalScheduler::takeSlot( size_t in_slot )
+{
+    uint32_t head = mSlots[ in_slot ];
+    mSlots[ in_slot ] = NONE;
+    return head;
+}
+
+void RenewalScheduler::advance( uint64_t in_tick, std::vector<Renewal>& out_due )
+{
+    while ( mCurrentTick <= in_tick )
+    {
+        // Every turn of a level, the next slot of the level above is spread
+        // over it, level 2 before level 1 as it may fill level 1.
+        if ( ( mCurrentTick & ( LEVEL0_SLOTS - 1 ) ) == 0 )
+        {
+            if ( ( ( mCurrentTick >> LEVEL1_SHIFT ) & ( LEVEL_SLOTS - 1 ) ) == 0 )
+            {
+                for ( uint32_t index = takeSlot( LEVEL2_FIRST_SLOT + ( ( mCurrentTick >> LEVEL2_SHIFT ) & ( LEVEL_SLOTS - 1 ) ) ); index != NONE; )
+                {
+                    uint32_t next = mEntries[ index ].next;
+                    insert( index );
+                    index = next;
+                }
+            }
+            for ( uint32_t index = takeSlot( LEVEL1_FIRST_SLOT + ( ( mCurrentTick >> LEVEL1_SHIFT ) & ( LEVEL_SLOTS - 1 ) ) ); index != NONE; )
+            {
+                uint32_t next = mEntries[ index ].next;
+                insert( index );
+                index = next;
+            }
+        }
+
+        uint64_t renewals = 0;
+        for ( uint32_t index = takeSlot( mCurrentTick & ( LEVEL0_SLOTS - 1 ) ); index != NONE; ++renewals )
+        {
+            Entry& entry = mEntries[ index ];
+            uint32_t next = entry.next;
+
+            Renewal renewal;
+            renewal.handle = ( static_cast<uint64_t>( entry.generation ) << 32 ) | index;
+            renewal.connectionId = entry.connectionId;
+            renewal.topic = entry.topic;
+            renewal.content = entry.content;
+            out_due.push_back( renewal );
+
+            entry.due += mPeriodTicks;
+            insert( index );
+            index = next;
+        }
+        if ( renewals > mLargestTick )
+        {
+            mLargestTick = renewals;
+        }
+        ++mCurrentTick;
+    }
+}
+
+void RenewalScheduler::send( std::vector<Renewal>& io_due )
+{
+    // Grouped by connection, in their order otherwise, without those cancelled
+    // since they were taken from the wheel.
+    std::vector<std::pair<int, size_t> > order;
+    order.reserve( io_due.size() );
+    {
+        std::lock_guard<std::mutex> lock( mMutex );
+        for ( size_t i = 0; i < io_due.size(); ++i )
+        {
+            uint32_t index = static_cast<uint32_t>( io_due[ i ].handle & 0xFFFFFFFF );
+            if ( mEntries[ index ].generation == static_cast<uint32_t>( io_due[ i ].handle >> 32 ) )
+            {
+                order.push_back( std::make_pair( io_due[ i ].connectionId, i ) );
+            }
+        }
+    }
+    std::stable_sort( order.begin(), order.end(), isConnectionLess );
+
+    std::vector<std::pair<std::string, std::string> > batch;
+    for ( size_t i = 0; i < order.size(); ++i )
+    {
+        Renewal& renewal = io_due[ order[ i ].second ];
+        batch.push_back( std::make_pair( std::string(), std::string() ) );
+        batch.back().first.swap( renewal.topic );
+        batch.back().second.swap( renewal.content );
+        if ( i + 1 == order.size() || order[ i + 1 ].first != renewal.connectionId )
+        {
+            pushNotificationServerSendNotifications( mEndpoint, renewal.connectionId, batch );
+            mRenewed += batch.size();
+            ++mBatches;
+            batch.clear();
+        }
+    }
+}
+
+void RenewalScheduler::run()
+{
+    std::vector<Renewal> due;
+
+    std::unique_lock<std::mutex> lock( mMutex );
+    while ( mRunning )
+    {
+        advance( getTick( Clock::now() ), due );
+        if ( due.empty() )
+        {
+            mCondition.wait_until( lock, mStart + mTick * mCurrentTick );
+            continue;
+        }
+
+        lock.unlock();
+        {
+            std::lock_guard<std::mutex> sendLock( mSendMutex );
+            send( due );
+        }
+        due.clear();
+        lock.lock();
+    }
+}
@@ -0,0 +1,152 @@
+//
+// Copyright Grass Valley
+//
+
+#ifndef RENEWAL_SCHEDULER_H_
+#define RENEWAL_SCHEDULER_H_
+
+#include "Sockets.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Renews subscriptions that must be requested again every period (keyframes,
+// audio meter probes...) by republishing their request.
+//
+// Instead of renewing every subscription at once, each renewal is given its
+// own point of the period when scheduled, spread evenly among all renewals (a
+// golden ratio sequence), then is renewed once every period from there. The
+// renewals falling on the same tick are sent together, one batch per
+// connection.
+//
+// Renewals are kept in a hierarchical timer wheel of three levels: 256 slots
+// of one tick, 64 of 256 ticks and 64 of 16384 ticks (about 29 hours with the
+// default tick of 100 ms). Each slot is an intrusive list of entries taken
+// from a pool, so scheduling and cancelling are O(1), and a tick only touches
+// the renewals due then, plus the slot cascaded to the level below every 256
+// ticks.
+class RenewalScheduler
+{
+public:
+    // 0 is never a valid handle.
+    typedef uint64_t Handle;
+
+    struct Options
+    {
+        Options()
+            : period( 60 )
+            , tick( 100 )
+        {
+        }
+
+        std::chrono::seconds period;
+        std::chrono::milliseconds tick;
+    };
+
+    struct Stats
+    {
+        uint64_t scheduled; // Renewals currently scheduled.
+        uint64_t renewed;
+        uint64_t batches; // One per connection per tick with renewals.
+        uint64_t largestTick; // Most renewals sent on one tick.
+    };
+
+    RenewalScheduler( websocket_endpoint& in_endpoint, const Options& in_options = Options() );
+
+    // Stops the thread; scheduled renewals are dropped.
+    ~RenewalScheduler();
+
+    // Republishes in_content on in_topic over a connection once every period,
+    // first within a period from now. Returns the handle to cancel it.
+    Handle schedule( int in_connectionId, const std::string& in_topic, const std::string& in_content );
+
+    // Returns false if the renewal was already cancelled. Once it returns, the
+    // renewal is not sent again: a batch being sent is waited for.
+    bool cancel( Handle in_renewal );
+
+    // Starts the thread sending the renewals due. Renewals can be scheduled
+    // before.
+    void start();
+
+    void stop();
+
+    Stats getStats() const;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    static const uint32_t NONE = 0xFFFFFFFF;
+
+    struct Entry
+    {
+        uint32_t next; // In the slot list, or the free list.
+        uint32_t previous;
+        uint32_t slot; // NONE while free.
+        uint32_t generation; // Incremented when freed, so stale handles are rejected.
+        uint64_t due; // Tick.
+        int connectionId;
+        std::string topic;
+        std::string content;
+    };
+
+    struct Renewal
+    {
+        Handle handle;
+        int connectionId;
+        std::string topic;
+        std::string content;
+    };
+
+    uint64_t getTick( Clock::time_point in_time ) const;
+
+    // Links an entry to the slot of its due tick, relative to mCurrentTick.
+    void insert( uint32_t in_index );
+    void unlink( uint32_t in_index );
+
+    // Detaches the list of a slot and returns its head.
+    uint32_t takeSlot( size_t in_slot );
+
+    // Runs the ticks up to in_tick and appends their renewals to out_due.
+    void advance( uint64_t in_tick, std::vector<Renewal>& out_due );
+
+    // Sends the renewals due and not cancelled since, in one batch per
+    // connection. Called with mSendMutex locked.
+    void send( std::vector<Renewal>& io_due );
+
+    void run();
+
+    websocket_endpoint& mEndpoint;
+    const Options mOptions;
+    std::chrono::milliseconds mTick; // Of at least 1 ms.
+    uint64_t mPeriodTicks;
+    const Clock::time_point mStart; // Of tick 0.
+
+    // The wheel, guarded by mMutex.
+    std::vector<Entry> mEntries;
+    uint32_t mFree; // First free entry, chained by next.
+    std::vector<uint32_t> mSlots; // Heads of the slot lists of the three levels.
+    uint64_t mCurrentTick; // Next tick to run.
+    uint64_t mSpread; // Renewals scheduled so far, for their point in the period.
+
+    // Held while sending, and by cancel(), so a renewal cancelled after being
+    // taken from the wheel is not sent. Locked before mMutex.
+    std::mutex mSendMutex;
+
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    bool mRunning;
+    std::thread mThread;
+
+    std::atomic<uint64_t> mScheduled;
+    std::atomic<uint64_t> mRenewed;
+    std::atomic<uint64_t> mBatches;
+    std::atomic<uint64_t> mLargestTick;
+};
+
+#endif /* RENEWAL_SCHEDULER_H_ */
@@ -0,0 +1,252 @@
+//
+// Copyright Grass Valley
+//
+
+#include "RestClient.h"
+
+namespace
+{
+    // Idle connections kept alive, per handle or in the shared cache. The
+    // libcurl default of 5 would close connections under concurrent calls.
+    const long MAX_CONNECTIONS = 32;
+}
+
+//********************************************************************************
+// RestClient
+//********************************************************************************
+
+RestClient& RestClient::getInstance()
+{
+    static RestClient instance;
+    return instance;
+}
+
+RestClient::RestClient()
+    : mShare( NULL )
+    , mCache( NULL )
+    , mCalls( 0 )
+    , mNewConnections( 0 )
+    , mTotalTimeUs( 0 )
+{
+    curl_global_init( CURL_GLOBAL_DEFAULT );
+
+    mShare = curl_share_init();
+    curl_share_setopt( mShare, CURLSHOPT_LOCKFUNC, &RestClient::lockShare );
+    curl_share_setopt( mShare, CURLSHOPT_UNLOCKFUNC, &RestClient::unlockShare );
+    curl_share_setopt( mShare, CURLSHOPT_USERDATA, this );
+    curl_share_setopt( mShare, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS );
+    curl_share_setopt( mShare, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION );
+#if LIBCURL_VERSION_NUM >= 0x073900
+    curl_share_setopt( mShare, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT );
+#endif
+}
+
+RestClient::~RestClient()
+{
+    for ( size_t i = 0; i < mIdleHandles.size(); ++i )
+    {
+        curl_easy_cleanup( mIdleHandles[ i ] );
+    }
+    curl_share_cleanup( mShare );
+    curl_global_cleanup();
+}
+
+void RestClient::lockShare( CURL*, curl_lock_data in_data, curl_lock_access, void* in_client )
+{
+    static_cast<RestClient*>( in_client )->mShareMutexes[ in_data ].lock();
+}
+
+void RestClient::unlockShare( CURL*, curl_lock_data in_data, void* in_client )
+{
+    static_cast<RestClient*>( in_client )->mShareMutexes[ in_data ].unlock();
+}
+
+CURL* RestClient::acquireHandle()
+{
+    {
+        std::lock_guard<std::mutex> lock( mPoolMutex );
+        if ( !mIdleHandles.empty() )
+        {
+            CURL* handle = mIdleHandles.back();
+            mIdleHandles.pop_back();
+            return handle;
+        }
+    }
+    return curl_easy_init();
+}
+
+void RestClient::releaseHandle( CURL* in_handle )
+{
+    // Resetting keeps the handle's own connection and caches alive.
+    curl_easy_reset( in_handle );
+
+    std::lock_guard<std::mutex> lock( mPoolMutex );
+    mIdleHandles.push_back( in_handle );
+}
+
+bool RestClient::perform( const Request& in_request, Response& out_response )
+{
+    out_response = Response();
+
+    CURL* curl = acquireHandle();
+    if ( !curl )
+    {
+        out_response.error = "Could not create a curl handle";
+        return false;
+    }
+
+    /* ask libcurl to show us the verbose output */
+    //curl_easy_setopt( curl, CURLOPT_VERBOSE, 1L );
+
+    curl_easy_setopt( curl, CURLOPT_SHARE, mShare );
+    curl_easy_setopt( curl, CURLOPT_URL, in_request.url.c_str() );
+    if ( in_request.method == "GET" )
+    {
+        curl_easy_setopt( curl, CURLOPT_HTTPGET, 1L );
+    }
+    else
+    {
+        curl_easy_setopt( curl, CURLOPT_CUSTOMREQUEST, in_request.method.c_str() );
+        curl_easy_setopt( curl, CURLOPT_POSTFIELDS, in_request.body.c_str() );
+        curl_easy_setopt( curl, CURLOPT_POSTFIELDSIZE, static_cast<long>( in_request.body.size() ) );
+    }
+    curl_easy_setopt( curl, CURLOPT_TCP_KEEPALIVE, 1L );
+    curl_easy_setopt( curl, CURLOPT_MAXCONNECTS, MAX_CONNECTIONS );
+    curl_easy_setopt( curl, CURLOPT_USERAGENT, "AmppNativeApi" );
+
+    struct curl_slist* headers = NULL;
+    for ( size_t i = 0; i < in_request.headers.size(); ++i )
+    {
+        headers = curl_slist_append( headers, in_request.headers[ i ].c_str() );
+    }
+
+    BodyWriter writer;
+    writer.handle = curl;
+    writer.request = &in_request;
+    writer.response = &out_response;
+    prepareTransfer( writer, headers );
+    curl_easy_setopt( curl, CURLOPT_HTTPHEADER, headers );
+
+    CURLcode result = curl_easy_perform( curl );
+    completeTransfer( writer, result );
+
+    curl_slist_free_all( headers );
+    releaseHandle( curl );
+
+    ++mCalls;
+    mNewConnections += out_response.newConnection ? 1 : 0;
+    mTotalTimeUs += static_cast<uint64_t>( out_response.totalTimeMs * 1000 );
+
+    return result == CURLE_OK;
+}
+
+void RestClient::prepareTransfer( BodyWriter& io_writer, struct curl_slist*& io_headers )
+{
+    curl_easy_setopt( io_writer.handle, CURLOPT_WRITEFUNCTION, &BodyWriter::write );
+    curl_easy_setopt( io_writer.handle, CURLOPT_WRITEDATA, &io_writer );
+
+    // Every encoding libcurl was built with: gzip and deflate, and brotli or
+    // zstd where available. Bodies are decoded before they reach the writer.
+    curl_easy_setopt( io_writer.handle, CURLOPT_ACCEPT_ENCODING, "" );
+
+    // A streamed body is never held whole, so it cannot be stored: streamed
+    // requests bypass the cache.
+    bool cacheable = ( io_writer.request->method == "GET" && !io_writer.request->onBody );
+    io_writer.cache = cacheable ? getInstance().mCache.load() : NULL;
+    if ( io_writer.cache )
+    {
+        io_writer.cache->addConditionalHeaders( io_writer.request->url, io_headers );
+        curl_easy_setopt( io_writer.handle, CURLOPT_HEADERFUNCTION, &HttpCache::headerFunction );
+        curl_easy_setopt( io_writer.handle, CURLOPT_HEADERDATA, &io_writer.validators );
+    }
+}
+
+void RestClient::completeTransfer( BodyWriter& io_writer, CURLcode in_result )
+{
+    const Request& request = *io_writer.request;
+    Response& response = *io_writer.response;
+
+    double totalTime = 0;
+    long newConnections = 0;
+    curl_easy_getinfo( io_writer.handle, CURLINFO_TOTAL_TIME, &totalTime );
+    curl_easy_getinfo( io_writer.handle, CURLINFO_NUM_CONNECTS, &newConnections );
+    response.totalTimeMs = totalTime * 1000;
+#if LIBCURL_VERSION_NUM >= 0x073700
+    curl_off_t wireBytes = 0;
+    curl_easy_getinfo( io_writer.handle, CURLINFO_SIZE_DOWNLOAD_T, &wireBytes );
+#else
+    double wireBytes = 0;
+    curl_easy_getinfo( io_writer.handle, CURLINFO_SIZE_DOWNLOAD, &wireBytes );
+#endif
+    response.wireBytes = static_cast<uint64_t>( wireBytes );
+    response.newConnection = ( newConnections > 0 );
+    getInstance().recordTransfer( request, response );
+
+    if ( in_result != CURLE_OK )
+    {
+        response.error = curl_easy_strerror( in_result );
+        return;
+    }
+
+    curl_easy_getinfo( io_writer.handle, CURLINFO_RESPONSE_CODE, &response.httpCode );
+    if ( io_writer.cache )
+    {
+        response.fromCache = io_writer.cache->complete( request.url, io_writer.validators, response.httpCode, response.body );
+    }
+}
+
+void RestClient::recordTransfer( const Request& in_request, const Response& in_response )
+{
+    std::string endpoint = in_request.endpoint;
+    if ( endpoint.empty() )
+    {
+        // The URL path, without the scheme, host and query.
+        size_t start = in_request.url.find( "://" );
+        start = in_request.url.find( '/', start == std::string::npos ? 0 : start + 3 );
+        endpoint = ( start == std::string::npos ) ? "/" : in_request.url.substr( start, in_request.url.find( '?', start ) - start );
+    }
+
+    std::lock_guard<std::mutex> lock( mEndpointMutex );
+    EndpointStats& stats = mEndpoints[ in_request.method + " " + endpoint ];
+    ++stats.requests;
+    stats.wireBytes += in_response.wireBytes;
+    stats.decodedBytes += in_response.decodedBytes;
+    stats.totalTimeMs += in_response.totalTimeMs;
+}
+
+std::map<std::string, RestClient::EndpointStats> RestClient::getEndpointStats() const
+{
+    std::lock_guard<std::mutex> lock( mEndpointMutex );
+    return mEndpoints;
+}
+
+size_t RestClient::BodyWriter::write( char* in_data, size_t in_size, size_t in_count, void* in_writer )
+{
+    BodyWriter* writer = static_cast<BodyWriter*>( in_writer );
+    size_t length = in_size * in_count;
+    writer->response->decodedBytes += length;
+    if ( !writer->request->onBody )
+    {
+        writer->response->body.append( in_data, length );
+        return length;
+    }
+
+    // Error bodies are kept for the caller to report.
+    long httpCode = 0;
+    curl_easy_getinfo( writer->handle, CURLINFO_RESPONSE_CODE, &httpCode );
+    if ( httpCode < 200 || httpCode > 299 )
+    {
+        writer->response->body.append( in_data, length );
+        return length;
+    }
+    return writer->request->onBody( in_data, length ) ? length : 0;
+}
+
+RestClient::Stats RestClient::getStats() const
+{
+    Stats stats;
+    stats.calls = mCalls.load();
+    stats.newConnections = mNewConnections.load();
+    stats.averageTimeMs = stats.calls ? mTotalTimeUs.load() / 1000.0 / stats.calls : 0;
+    return stats;
+}
@@ -0,0 +1,184 @@
+//
+// Copyright Grass Valley
+//
+
+#ifndef REST_CLIENT_H_
+#define REST_CLIENT_H_
+
+#include "HttpCache.h"
+
+#include <curl/curl.h>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Process-wide HTTP client used by every REST call of the SDK.
+//
+// libcurl is initialized once, when the client is first used. Easy handles are
+// kept in a pool and reused, and all of them are attached to one share handle
+// holding the DNS cache, the TLS session cache and (libcurl 7.57 and later)
+// the connection cache. Back-to-back calls to the same host therefore ride an
+// existing keep-alive connection instead of redoing DNS, TCP and TLS.
+//
+// With a cache installed, GET requests are revalidated against the cached
+// responses instead of downloading them again (see HttpCache). Requests with a
+// body handler are not cached, their bodies are never held in memory.
+//
+// perform() may be called from any thread.
+class RestClient
+{
+public:
+    // Receives a successful response body chunk by chunk. Returns false to
+    // abort the transfer.
+    typedef std::function<bool( const char* in_data, size_t in_length )> BodyHandler;
+
+    struct Request
+    {
+        Request()
+            : method( "GET" )
+        {
+        }
+
+        std::string method; // "GET", "POST", "DELETE", ...
+        std::string url;
+        std::vector<std::string> headers;
+        std::string body;
+
+        // Name under which the transfer is counted in getEndpointStats(),
+        // the path of the URL if empty.
+        std::string endpoint;
+
+        // If set, a 2xx body is passed to it as it arrives instead of being
+        // collected in Response::body.
+        BodyHandler onBody;
+    };
+
+    struct Response
+    {
+        Response()
+            : httpCode( 0 )
+            , totalTimeMs( 0 )
+            , wireBytes( 0 )
+            , decodedBytes( 0 )
+            , newConnection( false )
+            , fromCache( false )
+        {
+        }
+
+        long httpCode; // 0 if the transfer failed.
+        std::string body; // Error bodies only, with Request::onBody.
+        std::string error;
+        double totalTimeMs;
+        uint64_t wireBytes; // Body bytes received, compressed if the server compressed them.
+        uint64_t decodedBytes; // Body bytes after decoding.
+        bool newConnection; // False if an existing connection was reused.
+        bool fromCache; // The server answered 304 and the body is the cached one.
+    };
+
+    struct Stats
+    {
+        uint64_t calls;
+        uint64_t newConnections;
+        double averageTimeMs;
+    };
+
+    struct EndpointStats
+    {
+        EndpointStats()
+            : requests( 0 )
+            , wireBytes( 0 )
+            , decodedBytes( 0 )
+            , totalTimeMs( 0 )
+        {
+        }
+
+        uint64_t requests;
+        uint64_t wireBytes;
+        uint64_t decodedBytes;
+        double totalTimeMs;
+    };
+
+    static RestClient& getInstance();
+
+    // Returns true if the transfer completed, whatever its http code.
+    bool perform( const Request& in_request, Response& out_response );
+
+    Stats getStats() const;
+
+    // Transfers of RestClient and AsyncRestClient, keyed by method and endpoint.
+    std::map<std::string, EndpointStats> getEndpointStats() const;
+
+    // Installs the cache used by GET requests, or none with NULL. The cache
+    // must outlive the requests using it.
+    void setCache( HttpCache* in_cache )
+    {
+        mCache = in_cache;
+    }
+
+    HttpCache* getCache() const
+    {
+        return mCache;
+    }
+
+    // Destination of a transfer's body, shared with AsyncRestClient.
+    struct BodyWriter
+    {
+        BodyWriter()
+            : handle( NULL )
+            , request( NULL )
+            , response( NULL )
+            , cache( NULL )
+        {
+        }
+
+        CURL* handle;
+        const Request* request;
+        Response* response;
+        HttpCache* cache;
+        HttpCache::Validators validators;
+
+        // CURLOPT_WRITEFUNCTION, with the BodyWriter as CURLOPT_WRITEDATA.
+        static size_t write( char* in_data, size_t in_size, size_t in_count, void* in_writer );
+    };
+
+    // Sets up the body and cache handling of a transfer on io_writer.handle.
+    static void prepareTransfer( BodyWriter& io_writer, struct curl_slist*& io_headers );
+
+    // Completes the response of a finished transfer and counts it: revalidated
+    // bodies come from the cache.
+    static void completeTransfer( BodyWriter& io_writer, CURLcode in_result );
+
+private:
+    RestClient();
+    ~RestClient();
+    RestClient( const RestClient& ) = delete;
+    RestClient& operator=( const RestClient& ) = delete;
+
+    CURL* acquireHandle();
+    void releaseHandle( CURL* in_handle );
+
+    void recordTransfer( const Request& in_request, const Response& in_response );
+
+    static void lockShare( CURL* in_handle, curl_lock_data in_data, curl_lock_access in_access, void* in_client );
+    static void unlockShare( CURL* in_handle, curl_lock_data in_data, void* in_client );
+
+    CURLSH* mShare;
+    std::mutex mShareMutexes[ CURL_LOCK_DATA_LAST ];
+
+    std::mutex mPoolMutex;
+    std::vector<CURL*> mIdleHandles;
+
+    std::atomic<HttpCache*> mCache;
+
+    mutable std::mutex mEndpointMutex;
+    std::map<std::string, EndpointStats> mEndpoints;
+
+    std::atomic<uint64_t> mCalls;
+    std::atomic<uint64_t> mNewConnections;
+    std::atomic<uint64_t> mTotalTimeUs;
+};
+
+#endif /* REST_CLIENT_H_ */
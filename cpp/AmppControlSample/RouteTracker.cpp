@@ -0,0 +1,317 @@
+//
+// Copyright Grass Valley
+//
+
+#include "RouteTracker.h"
+
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+
+namespace
+{
+    std::string getString( const json& in_object, const char* in_key )
+    {
+        json::const_iterator it = in_object.find( in_key );
+        return ( it != in_object.end() && it->is_string() ) ? it->get<std::string>() : std::string();
+    }
+
+    bool isRouteMade( std::string in_status )
+    {
+        std::transform( in_status.begin(), in_status.end(), in_status.begin(), []( char c )
+        {
+            return static_cast<char>( std::tolower( static_cast<unsigned char>( c ) ) );
+        } );
+        return in_status == "completed" || in_status == "complete" || in_status == "success"
+            || in_status == "succeeded" || in_status == "made" || in_status == "done";
+    }
+}
+
+//********************************************************************************
+// RouteTracker
+//********************************************************************************
+
+RouteTracker::RouteTracker( RoutingClient& in_routing, std::chrono::milliseconds in_timeout,
+    std::chrono::milliseconds in_pollInterval, std::chrono::milliseconds in_giveUp )
+    : mRouting( in_routing )
+    , mTimeout( in_timeout )
+    , mPollInterval( in_pollInterval )
+    , mGiveUp( in_giveUp )
+    , mTotalLatencyMs( 0 )
+    , mRunning( false )
+{
+    mStats.tracked = 0;
+    mStats.madeByNotification = 0;
+    mStats.madeByPoll = 0;
+    mStats.failed = 0;
+    mStats.timedOut = 0;
+    mStats.polls = 0;
+    mStats.averageLatencyMs = 0;
+    mStats.maxLatencyMs = 0;
+}
+
+RouteTracker::~RouteTracker()
+{
+    stop();
+}
+
+void RouteTracker::start()
+{
+    std::lock_guard<std::mutex> lock( mMutex );
+    if ( !mRunning )
+    {
+        mRunning = true;
+        mThread = std::thread( &RouteTracker::run, this );
+    }
+}
+
+void RouteTracker::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock( mMutex );
+        if ( !mRunning )
+        {
+            return;
+        }
+        mRunning = false;
+    }
+    mCondition.notify_all();
+    mThread.join();
+}
+
+std::shared_future<RouteTracker::Result> RouteTracker::track( const std::string& in_sourceId,
+    const std::string& in_destinationId, Callback in_callback )
+{
+    std::string key = getKey( in_sourceId, in_destinationId );
+    std::lock_guard<std::mutex> lock( mMutex );
+    EntryPtr& entry = mRoutes[ key ];
+    if ( !entry )
+    {
+        entry = std::make_shared<Entry>();
+        entry->key = key;
+        entry->start = Clock::now();
+        entry->giveUpAt = entry->start + mGiveUp;
+        entry->resolved = false;
+        entry->future = entry->promise.get_future().share();
+        ++mStats.tracked;
+        schedule( entry, entry->start + mTimeout );
+    }
+    if ( in_callback )
+    {
+        entry->callbacks.push_back( in_callback );
+    }
+    return entry->future;
+}
+
+void RouteTracker::setRequestId( const std::string& in_sourceId, const std::string& in_destinationId,
+    const std::string& in_requestId )
+{
+    std::lock_guard<std::mutex> lock( mMutex );
+    std::unordered_map<std::string, EntryPtr>::iterator it = mRoutes.find( getKey( in_sourceId, in_destinationId ) );
+    if ( it != mRoutes.end() )
+    {
+        it->second->requestId = in_requestId;
+    }
+}
+
+void RouteTracker::fail( const std::string& in_sourceId, const std::string& in_destinationId, const std::string& in_error )
+{
+    EntryPtr entry;
+    Result result;
+    result.outcome = ROUTE_FAILED;
+    result.polled = false;
+    result.error = in_error;
+    {
+        std::lock_guard<std::mutex> lock( mMutex );
+        std::unordered_map<std::string, EntryPtr>::iterator it = mRoutes.find( getKey( in_sourceId, in_destinationId ) );
+        if ( it == mRoutes.end() )
+        {
+            return;
+        }
+        entry = it->second;
+        resolve( entry, result );
+    }
+    complete( entry, result );
+}
+
+void RouteTracker::onNotification( const ReceivedNotificationModel& in_notification )
+{
+    const std::string& topic = in_notification.getTopic();
+    std::string fabricId = FabricInventory::getFabricId( topic );
+    if ( fabricId.empty() || topic != getTopic( fabricId ) )
+    {
+        return;
+    }
+
+    json event = json::parse( in_notification.getContent(), nullptr, false );
+    if ( !event.is_object() )
+    {
+        return;
+    }
+
+    EntryPtr entry;
+    Result result;
+    result.outcome = ROUTE_MADE;
+    result.polled = false;
+    {
+        std::lock_guard<std::mutex> lock( mMutex );
+        std::unordered_map<std::string, EntryPtr>::iterator it =
+            mRoutes.find( getKey( getString( event, "sourceId" ), getString( event, "destinationId" ) ) );
+        if ( it == mRoutes.end() )
+        {
+            return;
+        }
+        entry = it->second;
+        resolve( entry, result );
+    }
+    complete( entry, result );
+}
+
+std::string RouteTracker::getTopic( const std::string& in_fabricId )
+{
+    return "gv.cluster.matrix." + in_fabricId + ".routemade";
+}
+
+size_t RouteTracker::getPendingCount() const
+{
+    std::lock_guard<std::mutex> lock( mMutex );
+    return mRoutes.size();
+}
+
+RouteTracker::Stats RouteTracker::getStats() const
+{
+    std::lock_guard<std::mutex> lock( mMutex );
+    Stats stats = mStats;
+    uint64_t made = stats.madeByNotification + stats.madeByPoll;
+    stats.averageLatencyMs = made > 0 ? mTotalLatencyMs / made : 0;
+    return stats;
+}
+
+std::string RouteTracker::getKey( const std::string& in_sourceId, const std::string& in_destinationId )
+{
+    return in_sourceId + '\n' + in_destinationId;
+}
+
+void RouteTracker::resolve( const EntryPtr& in_entry, Result& io_result )
+{
+    in_entry->resolved = true;
+    mRoutes.erase( in_entry->key );
+
+    io_result.latency = std::chrono::duration_cast<std::chrono::microseconds>( Clock::now() - in_entry->start );
+    switch ( io_result.outcome )
+    {
+    case ROUTE_MADE:
+    {
+        if ( io_result.polled )
+        {
+            ++mStats.madeByPoll;
+        }
+        else
+        {
+            ++mStats.madeByNotification;
+        }
+        double latencyMs = io_result.latency.count() / 1000.0;
+        mTotalLatencyMs += latencyMs;
+        mStats.maxLatencyMs = std::max( mStats.maxLatencyMs, latencyMs );
+        break;
+    }
+    case ROUTE_FAILED:
+        ++mStats.failed;
+        break;
+    case ROUTE_TIMED_OUT:
+        ++mStats.timedOut;
+        break;
+    }
+}
+
+void RouteTracker::complete( const EntryPtr& in_entry, const Result& in_result )
+{
+    // The entry left the table when it was resolved: nothing else uses its
+    // callbacks any more.
+    in_entry->promise.set_value( in_result );
+    for ( size_t i = 0; i < in_entry->callbacks.size(); ++i )
+    {
+        in_entry->callbacks[ i ]( in_result );
+    }
+}
+
+void RouteTracker::schedule( const EntryPtr& in_entry, Clock::time_point in_at )
+{
+    in_entry->nextCheck = in_at;
+    Check check;
+    check.at = in_at;
+    check.entry = in_entry;
+    mChecks.push( check );
+    if ( mChecks.top().entry.lock() == in_entry )
+    {
+        mCondition.notify_all();
+    }
+}
+
+void RouteTracker::run()
+{
+    std::unique_lock<std::mutex> lock( mMutex );
+    while ( mRunning )
+    {
+        if ( mChecks.empty() )
+        {
+            mCondition.wait( lock );
+            continue;
+        }
+        Clock::time_point at = mChecks.top().at;
+        if ( Clock::now() < at )
+        {
+            mCondition.wait_until( lock, at );
+            continue;
+        }
+
+        EntryPtr entry = mChecks.top().entry.lock();
+        mChecks.pop();
+        if ( !entry || entry->resolved || entry->nextCheck != at )
+        {
+            continue;
+        }
+
+        Result result;
+        result.polled = true;
+        if ( Clock::now() >= entry->giveUpAt )
+        {
+            result.outcome = ROUTE_TIMED_OUT;
+            result.error = "No routemade notification nor completed status received";
+        }
+        else if ( entry->requestId.empty() )
+        {
+            // Not answered yet: nothing to poll.
+            schedule( entry, Clock::now() + mPollInterval );
+            continue;
+        }
+        else
+        {
+            std::string requestId = entry->requestId;
+            ++mStats.polls;
+            lock.unlock();
+            std::string status;
+            std::string error;
+            bool polled = mRouting.checkRouteRequest( requestId, status, error );
+            lock.lock();
+
+            if ( entry->resolved )
+            {
+                // Notified while polling.
+                continue;
+            }
+            if ( !polled || ( error.empty() && !isRouteMade( status ) ) )
+            {
+                schedule( entry, Clock::now() + mPollInterval );
+                continue;
+            }
+            result.outcome = error.empty() ? ROUTE_MADE : ROUTE_FAILED;
+            result.error = error;
+        }
+
+        resolve( entry, result );
+        lock.unlock();
+        complete( entry, result );
+        lock.lock();
+    }
+}
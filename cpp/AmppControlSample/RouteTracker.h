@@ -0,0 +1,162 @@
+//
+// Copyright Grass Valley
+//
+
+#ifndef ROUTE_TRACKER_H_
+#define ROUTE_TRACKER_H_
+
+#include "RoutingClient.h"
+#include "RpcProtocol.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Confirms routes with their routemade notifications instead of polling their
+// status (the CheckRouteRequest of the TypeScript SDK).
+//
+// A route requested is tracked by its (source id, destination id) pair in a
+// hash table. The routemade notifications passed to onNotification(), from a
+// subscription to getTopic(), resolve the matching routes as they land.
+// A route still unconfirmed after the timeout falls back to polling its
+// routestatus, from a background thread, until it completes or the give-up
+// delay elapses.
+//
+// A polled status counts as made when it is "Completed", "Complete", "Success",
+// "Succeeded", "Made" or "Done" (case-insensitive), and as failed when it comes
+// with an error message. Any other status is polled again.
+class RouteTracker
+{
+public:
+    enum Outcome
+    {
+        ROUTE_MADE,
+        ROUTE_FAILED,
+        ROUTE_TIMED_OUT
+    };
+
+    struct Result
+    {
+        Outcome outcome;
+        bool polled; // Resolved by polling rather than by a notification.
+        std::string error;
+        std::chrono::microseconds latency; // From track() to the resolution.
+    };
+
+    typedef std::function<void( const Result& )> Callback;
+
+    struct Stats
+    {
+        uint64_t tracked;
+        uint64_t madeByNotification;
+        uint64_t madeByPoll;
+        uint64_t failed;
+        uint64_t timedOut;
+        uint64_t polls;
+        double averageLatencyMs; // Of the routes made.
+        double maxLatencyMs;
+    };
+
+    explicit RouteTracker( RoutingClient& in_routing,
+        std::chrono::milliseconds in_timeout = std::chrono::milliseconds( 2000 ),
+        std::chrono::milliseconds in_pollInterval = std::chrono::milliseconds( 1000 ),
+        std::chrono::milliseconds in_giveUp = std::chrono::milliseconds( 30000 ) );
+
+    // Stops the polling.
+    ~RouteTracker();
+
+    // Starts the thread polling the routes that timed out.
+    void start();
+
+    void stop();
+
+    // Tracks a route about to be requested; its notification may come before
+    // the request is answered. in_callback, if any, is called once resolved,
+    // on the thread resolving it. A route already tracked shares its result.
+    std::shared_future<Result> track( const std::string& in_sourceId, const std::string& in_destinationId,
+        Callback in_callback = Callback() );
+
+    // Request id of an accepted route, needed to poll its status.
+    void setRequestId( const std::string& in_sourceId, const std::string& in_destinationId,
+        const std::string& in_requestId );
+
+    // Resolves a route whose request failed.
+    void fail( const std::string& in_sourceId, const std::string& in_destinationId, const std::string& in_error );
+
+    // Resolves the route of a routemade notification. Other notifications are
+    // ignored.
+    void onNotification( const ReceivedNotificationModel& in_notification );
+
+    // The topic of the routemade notifications of a fabric, of every fabric by
+    // default.
+    static std::string getTopic( const std::string& in_fabricId = "*" );
+
+    // Routes not resolved yet.
+    size_t getPendingCount() const;
+
+    Stats getStats() const;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Entry
+    {
+        std::string key;
+        std::string requestId;
+        Clock::time_point start;
+        Clock::time_point nextCheck;
+        Clock::time_point giveUpAt;
+        bool resolved;
+        std::promise<Result> promise;
+        std::shared_future<Result> future;
+        std::vector<Callback> callbacks;
+    };
+    typedef std::shared_ptr<Entry> EntryPtr;
+
+    // Next check of an entry, for the polling thread. Outdated checks (the
+    // entry resolved or rescheduled) are skipped when they come up.
+    struct Check
+    {
+        Clock::time_point at;
+        std::weak_ptr<Entry> entry;
+
+        bool operator>( const Check& in_other ) const
+        {
+            return at > in_other.at;
+        }
+    };
+
+    static std::string getKey( const std::string& in_sourceId, const std::string& in_destinationId );
+
+    // Marks the entry resolved and removes it. Called with mMutex held;
+    // complete() must be called once it is released.
+    void resolve( const EntryPtr& in_entry, Result& io_result );
+    void complete( const EntryPtr& in_entry, const Result& in_result );
+
+    void schedule( const EntryPtr& in_entry, Clock::time_point in_at );
+    void run();
+
+    RoutingClient& mRouting;
+    const std::chrono::milliseconds mTimeout;
+    const std::chrono::milliseconds mPollInterval;
+    const std::chrono::milliseconds mGiveUp;
+
+    mutable std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::unordered_map<std::string, EntryPtr> mRoutes;
+    std::priority_queue<Check, std::vector<Check>, std::greater<Check> > mChecks;
+    Stats mStats;
+    double mTotalLatencyMs;
+    bool mRunning;
+    std::thread mThread;
+};
+
+#endif /* ROUTE_TRACKER_H_ */
@@ -0,0 +1,192 @@
+//
+// Copyright Grass Valley
+//
+
+#include "RoutingClient.h"
+#include "RestClient.h"
+#include "RpcProtocol.h"
+
+#include <iostream>
+
+namespace
+{
+    const char* const REQUESTROUTE_ENDPOINT = "/cluster/matrix/api/v1/routing/requestroute";
+    const char* const ROUTESTATUS_ENDPOINT = "/cluster/matrix/api/v1/routing/routestatus/{id}";
+
+    std::string getString( const json& in_object, const char* in_key )
+    {
+        json::const_iterator it = in_object.find( in_key );
+        return ( it != in_object.end() && it->is_string() ) ? it->get<std::string>() : std::string();
+    }
+
+    bool performMatrixRequest( RestClient::Request& io_request, TokenManager& in_tokenManager, const char* in_description,
+        RestClient::Response& out_response )
+    {
+        std::string bearerToken = in_tokenManager.getBearerToken();
+        if ( bearerToken.empty() )
+        {
+            std::cout << "Could not retrieve bearer token." << std::endl;
+            return false;
+        }
+        io_request.headers.push_back( "Content-Type: application/json" );
+        io_request.headers.push_back( "Accept: application/json" );
+        io_request.headers.push_back( "Authorization: Bearer " + bearerToken );
+
+        if ( !RestClient::getInstance().perform( io_request, out_response ) )
+        {
+            std::cout << in_description << " error: " << out_response.error << std::endl;
+            return false;
+        }
+        if ( out_response.httpCode < 200 || out_response.httpCode > 299 )
+        {
+            std::cout << in_description << " error. Returned http code: " << out_response.httpCode << std::endl;
+            return false;
+        }
+        return true;
+    }
+}
+
+//********************************************************************************
+// RoutingClient
+//********************************************************************************
+
+RoutingClient::RoutingClient( const std::string& in_baseUrl, TokenManager& in_tokenManager,
+    std::chrono::seconds in_revalidationInterval )
+    : mBaseUrl( in_baseUrl )
+    , mTokenManager( in_tokenManager )
+    , mRevalidationInterval( in_revalidationInterval )
+{
+}
+
+bool RoutingClient::refreshFabric( const std::string& in_fabricId )
+{
+    bool loaded;
+    {
+        std::lock_guard<std::mutex> lock( mMutex );
+        loaded = ( mFabrics.find( in_fabricId ) != mFabrics.end() );
+    }
+
+    // A fabric loaded by getInventory() is up to date already.
+    std::shared_ptr<FabricInventory> inventory = getInventory( in_fabricId );
+    return inventory && ( !loaded || inventory->revalidate() );
+}
+
+std::shared_ptr<const RoutingClient::Fabric> RoutingClient::getFabric( const std::string& in_fabricId )
+{
+    std::shared_ptr<FabricInventory> inventory = getInventory( in_fabricId );
+    return inventory ? inventory->getSnapshot() : std::shared_ptr<const Fabric>();
+}
+
+std::shared_ptr<FabricInventory> RoutingClient::getInventory( const std::string& in_fabricId )
+{
+    {
+        std::lock_guard<std::mutex> lock( mMutex );
+        std::unordered_map<std::string, std::shared_ptr<FabricInventory> >::const_iterator it = mFabrics.find( in_fabricId );
+        if ( it != mFabrics.end() )
+        {
+            return it->second;
+        }
+    }
+
+    // Loaded before it is shared, so notifications are only applied to a
+    // loaded inventory.
+    std::shared_ptr<FabricInventory> inventory = std::make_shared<FabricInventory>( mBaseUrl, mTokenManager, in_fabricId );
+    if ( !inventory->load() )
+    {
+        return std::shared_ptr<FabricInventory>();
+    }
+
+    std::lock_guard<std::mutex> lock( mMutex );
+    std::pair<std::unordered_map<std::string, std::shared_ptr<FabricInventory> >::iterator, bool> inserted =
+        mFabrics.insert( std::make_pair( in_fabricId, inventory ) );
+    if ( inserted.second && mRevalidationInterval.count() > 0 )
+    {
+        inventory->start( mRevalidationInterval );
+    }
+    return inserted.first->second;
+}
+
+void RoutingClient::onNotification( const ReceivedNotificationModel& in_notification )
+{
+    std::shared_ptr<FabricInventory> inventory;
+    {
+        std::lock_guard<std::mutex> lock( mMutex );
+        std::unordered_map<std::string, std::shared_ptr<FabricInventory> >::const_iterator it =
+            mFabrics.find( FabricInventory::getFabricId( in_notification.getTopic() ) );
+        if ( it == mFabrics.end() )
+        {
+            return;
+        }
+        inventory = it->second;
+    }
+    inventory->applyNotification( in_notification );
+}
+
+bool RoutingClient::makeRoute( const std::string& in_fabricId, const std::string& in_source,
+    const std::string& in_destination, std::string& out_requestId )
+{
+    std::shared_ptr<const Fabric> fabric = getFabric( in_fabricId );
+    if ( !fabric )
+    {
+        return false;
+    }
+
+    const EndpointTable::Endpoint* producer = fabric->producers->find( in_source );
+    if ( !producer )
+    {
+        std::cout << "Producer \"" << in_source << "\" not found on fabric " << in_fabricId << "." << std::endl;
+        return false;
+    }
+    const EndpointTable::Endpoint* consumer = fabric->consumers->find( in_destination );
+    if ( !consumer )
+    {
+        std::cout << "Consumer \"" << in_destination << "\" not found on fabric " << in_fabricId << "." << std::endl;
+        return false;
+    }
+
+    json body;
+    body[ "sourceId" ] = producer->id;
+    body[ "destinationId" ] = consumer->id;
+
+    RestClient::Request request;
+    request.method = "POST";
+    request.url = mBaseUrl + REQUESTROUTE_ENDPOINT;
+    request.endpoint = REQUESTROUTE_ENDPOINT;
+    request.body = body.dump();
+
+    RestClient::Response response;
+    if ( !performMatrixRequest( request, mTokenManager, "Request Route", response ) )
+    {
+        return false;
+    }
+
+    json responseJson = json::parse( response.body, nullptr, false );
+    out_requestId = responseJson.is_object() ? getString( responseJson, "requestId" ) : std::string();
+    return !out_requestId.empty();
+}
+
+bool RoutingClient::checkRouteRequest( const std::string& in_requestId, std::string& out_status, std::string& out_error )
+{
+    RestClient::Request request;
+    request.url = mBaseUrl + "/cluster/matrix/api/v1/routing/routestatus/" + in_requestId;
+    request.endpoint = ROUTESTATUS_ENDPOINT;
+
+    RestClient::Response response;
+    if ( !performMatrixRequest( request, mTokenManager, "Route Status", response ) )
+    {
+        return false;
+    }
+
+    json responseJson = json::parse( response.body, nullptr, false );
+    if ( !responseJson.is_object() )
+    {
+        return false;
+    }
+
+    // Either the status itself or wrapped with the request id.
+    json::const_iterator status = responseJson.find( "status" );
+    const json& data = ( status != responseJson.end() && status->is_object() ) ? *status : responseJson;
+    out_status = getString( data, "routeStatus" );
+    out_error = getString( data, "routeErrorMessage" );
+    return true;
+}
@@ -0,0 +1,69 @@
+//
+// Copyright Grass Valley
+//
+
+#ifndef ROUTING_CLIENT_H_
+#define ROUTING_CLIENT_H_
+
+#include "FabricInventory.h"
+#include "TokenManager.h"
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Makes routes between the producers (sources) and consumers (destinations) of
+// a fabric through the cluster matrix API (the Router of the TypeScript and C#
+// SDKs).
+//
+// The producers and consumers of a fabric are loaded on first use into a
+// FabricInventory, indexed in EndpointTables, and kept up to date by the
+// notifications passed to onNotification() and by periodic revalidation.
+// Resolving the source and destination of a route is then a few hash lookups,
+// whatever the size of the fabric, and makeRoute() is a single REST call.
+class RoutingClient
+{
+public:
+    typedef FabricInventory::Snapshot Fabric;
+
+    // With a non-zero in_revalidationInterval, the inventory of every fabric
+    // loaded is revalidated at that interval.
+    RoutingClient( const std::string& in_baseUrl, TokenManager& in_tokenManager,
+        std::chrono::seconds in_revalidationInterval = std::chrono::seconds( 0 ) );
+
+    // Revalidates the inventory of a fabric, loading it if needed. Lookups in
+    // progress keep using the previous snapshot.
+    bool refreshFabric( const std::string& in_fabricId );
+
+    // The current snapshot of a fabric, loaded on first use. Returns a null
+    // pointer if it could not be retrieved.
+    std::shared_ptr<const Fabric> getFabric( const std::string& in_fabricId );
+
+    // The inventory of a fabric, loaded on first use, or a null pointer.
+    std::shared_ptr<FabricInventory> getInventory( const std::string& in_fabricId );
+
+    // Applies an inventory notification ("gv.cluster.matrix.<fabric>.*") to the
+    // fabric it concerns, if it was loaded.
+    void onNotification( const ReceivedNotificationModel& in_notification );
+
+    // Requests a route from a producer to a consumer, each given by name, alias
+    // or id. Returns false, without sending anything, if either is unknown.
+    bool makeRoute( const std::string& in_fabricId, const std::string& in_source,
+        const std::string& in_destination, std::string& out_requestId );
+
+    // Status of a route request made by makeRoute().
+    bool checkRouteRequest( const std::string& in_requestId, std::string& out_status, std::string& out_error );
+
+private:
+    std::string mBaseUrl;
+    TokenManager& mTokenManager;
+    std::chrono::seconds mRevalidationInterval;
+
+    // Guards the map only; the inventories synchronize themselves.
+    std::mutex mMutex;
+    std::unordered_map<std::string, std::shared_ptr<FabricInventory> > mFabrics;
+};
+
+#endif /* ROUTING_CLIENT_H_ */
@@ -531,51 +531,167 @@ public:
         , mTtl( 0 )
         , mContent( "" )
         , mContentType( "" )
+        , mContentLength( 0 )
     {
     }
 
-    std::string getAccount()
+    // Fills the model from one element of the "Arguments" array of a
+    // "ReceiveNotification" RpcRequest. The server sends PascalCase keys over
+    // bson-rpc; camelCase keys are accepted as well.
+    bool setFromJson( const json& j )
+    {
+        if ( !setFields( j ) )
+        {
+            return false;
+        }
+
+#if NLOHMANN_JSON_VERSION_MAJOR > 3 || ( NLOHMANN_JSON_VERSION_MAJOR == 3 && NLOHMANN_JSON_VERSION_MINOR >= 8 )
+        // Binary values are only decoded from BSON by nlohmann::json 3.8 and later.
+        const json* binaryContent = find( j, "BinaryContent", "binaryContent" );
+        if ( binaryContent && binaryContent->is_binary() )
+        {
+            mBinaryContent = binaryContent->get_binary();
+        }
+#endif
+
+        return !mTopic.empty();
+    }
+
+    // Same, but takes the binary content (e.g. a keyframe JPEG) over from the
+    // decoded message instead of copying it.
+    bool setFromJson( json&& j )
+    {
+        if ( !setFields( j ) )
+        {
+            return false;
+        }
+
+#if NLOHMANN_JSON_VERSION_MAJOR > 3 || ( NLOHMANN_JSON_VERSION_MAJOR == 3 && NLOHMANN_JSON_VERSION_MINOR >= 8 )
+        json::iterator binaryContent = j.find( "BinaryContent" );
+        if ( binaryContent == j.end() )
+        {
+            binaryContent = j.find( "binaryContent" );
+        }
+        if ( binaryContent != j.end() && binaryContent->is_binary() )
+        {
+            mBinaryContent = std::move( static_cast<std::vector<uint8_t>&>( binaryContent->get_binary() ) );
+        }
+#endif
+
+        return !mTopic.empty();
+    }
+
+    // The inverse of setFromJson(), using the PascalCase keys of bson-rpc.
+    json toJson() const
+    {
+        json j;
+
+        j[ "Account" ] = mAccount;
+        j[ "CorrelationId" ] = mCorrelationId;
+        j[ "Id" ] = mId;
+        j[ "Time" ] = mTime;
+        j[ "Topic" ] = mTopic;
+        j[ "Source" ] = mSource;
+        j[ "Content" ] = mContent;
+        j[ "ContentType" ] = mContentType;
+        j[ "ContentLength" ] = mContentLength;
+#if NLOHMANN_JSON_VERSION_MAJOR > 3 || ( NLOHMANN_JSON_VERSION_MAJOR == 3 && NLOHMANN_JSON_VERSION_MINOR >= 8 )
+        if ( !mBinaryContent.empty() )
+        {
+            j[ "BinaryContent" ] = json::binary( mBinaryContent );
+        }
+#endif
+
+        return j;
+    }
+
+    std::string getAccount() const
     {
         return mAccount;
     }
-    std::string getCorrelationId()
+    std::string getCorrelationId() const
     {
         return mCorrelationId;
     }
-    std::string getId()
+    std::string getId() const
     {
         return mId;
     }
-    std::string getTime()
+    std::string getTime() const
     {
         return mTime;
     }
-    std::string getTopic()
+    const std::string& getTopic() const
     {
         return mTopic;
     }
-    std::string getSource()
+    std::string getSource() const
     {
         return mSource;
     }
-    uint16_t getTtl()
+    uint16_t getTtl() const
     {
         return mTtl;
     }
-    std::string getContent()
+    const std::string& getContent() const
     {
         return mContent;
     }
-    std::string getContentType()
+    std::string getContentType() const
     {
         return mContentType;
     }
-    uint16_t getContentLength()
+    uint16_t getContentLength() const
     {
         return mContentLength;
     }
+    const std::vector<uint8_t>& getBinaryContent() const
+    {
+        return mBinaryContent;
+    }
 
 private:
+    bool setFields( const json& j )
+    {
+        if ( !j.is_object() )
+        {
+            return false;
+        }
+
+        mAccount = getString( j, "Account", "account" );
+        mCorrelationId = getString( j, "CorrelationId", "correlationId" );
+        mId = getString( j, "Id", "id" );
+        mTime = getString( j, "Time", "time" );
+        mTopic = getString( j, "Topic", "topic" );
+        mSource = getString( j, "Source", "source" );
+        mContent = getString( j, "Content", "content" );
+        mContentType = getString( j, "ContentType", "contentType" );
+
+        const json* contentLength = find( j, "ContentLength", "contentLength" );
+        if ( contentLength && contentLength->is_number_unsigned() )
+        {
+            mContentLength = contentLength->get<uint16_t>();
+        }
+
+        return true;
+    }
+
+    static const json* find( const json& j, const char* pascalKey, const char* camelKey )
+    {
+        json::const_iterator it = j.find( pascalKey );
+        if ( it == j.end() )
+        {
+            it = j.find( camelKey );
+        }
+        return ( it != j.end() && !it->is_null() ) ? &( *it ) : nullptr;
+    }
+
+    static std::string getString( const json& j, const char* pascalKey, const char* camelKey )
+    {
+        const json* value = find( j, pascalKey, camelKey );
+        return ( value && value->is_string() ) ? value->get<std::string>() : std::string();
+    }
+
     std::string mAccount;
     std::string mCorrelationId;
     std::string mId;
@@ -0,0 +1,374 @@
+//
+// Copyright Grass Valley
+//
+
+#include "SalvoEngine.h"
+#include "AmppControlUtil.h"
+
+#include <iostream>
+
+namespace
+{
+    const char* const REQUESTROUTE_ENDPOINT = "/cluster/matrix/api/v1/routing/requestroute";
+
+    std::string getString( const json& in_object, const char* in_key )
+    {
+        json::const_iterator it = in_object.find( in_key );
+        return ( it != in_object.end() && it->is_string() ) ? it->get<std::string>() : std::string();
+    }
+}
+
+//********************************************************************************
+// SalvoEngine::Execution
+//********************************************************************************
+
+SalvoEngine::Execution::Execution( const RouteSet& in_routes )
+    : mRoutes( in_routes )
+    , mStart( std::chrono::steady_clock::now() )
+    , mLastRequest( mStart )
+    , mLastRoute( mStart )
+    , mPendingRequests( in_routes.routes.size() )
+    , mPending( in_routes.routes.size() )
+    , mMade( 0 )
+    , mFailed( 0 )
+{
+    RouteProgress progress;
+    progress.state = ROUTE_SENT;
+    mProgress.assign( in_routes.routes.size(), progress );
+}
+
+bool SalvoEngine::Execution::wait( std::chrono::milliseconds in_timeout )
+{
+    std::unique_lock<std::mutex> lock( mMutex );
+    return mCondition.wait_for( lock, in_timeout, [this]()
+    {
+        return mPending == 0;
+    } );
+}
+
+size_t SalvoEngine::Execution::getRouteCount() const
+{
+    return mRoutes.routes.size();
+}
+
+size_t SalvoEngine::Execution::getMadeCount() const
+{
+    std::lock_guard<std::mutex> lock( mMutex );
+    return mMade;
+}
+
+size_t SalvoEngine::Execution::getFailedCount() const
+{
+    std::lock_guard<std::mutex> lock( mMutex );
+    return mFailed;
+}
+
+SalvoEngine::Execution::RouteState SalvoEngine::Execution::getRouteState( size_t in_index ) const
+{
+    std::lock_guard<std::mutex> lock( mMutex );
+    return mProgress[ in_index ].state;
+}
+
+std::string SalvoEngine::Execution::getRequestId( size_t in_index ) const
+{
+    std::lock_guard<std::mutex> lock( mMutex );
+    return mProgress[ in_index ].requestId;
+}
+
+std::chrono::microseconds SalvoEngine::Execution::getTimeToLastRequest() const
+{
+    std::lock_guard<std::mutex> lock( mMutex );
+    return std::chrono::duration_cast<std::chrono::microseconds>( mLastRequest - mStart );
+}
+
+std::chrono::microseconds SalvoEngine::Execution::getTimeToLastRoute() const
+{
+    std::lock_guard<std::mutex> lock( mMutex );
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        ( mPending == 0 ? mLastRoute : std::chrono::steady_clock::now() ) - mStart );
+}
+
+void SalvoEngine::Execution::onRequested( size_t in_index, bool in_success, const std::string& in_requestId )
+{
+    std::lock_guard<std::mutex> lock( mMutex );
+    RouteProgress& progress = mProgress[ in_index ];
+    progress.requestId = in_requestId;
+    if ( --mPendingRequests == 0 )
+    {
+        mLastRequest = std::chrono::steady_clock::now();
+    }
+
+    // The route may have been confirmed before the answer.
+    if ( in_success && progress.state == ROUTE_SENT )
+    {
+        progress.state = ROUTE_REQUESTED;
+    }
+}
+
+void SalvoEngine::Execution::onResolved( size_t in_index, const RouteTracker::Result& in_result )
+{
+    {
+        std::lock_guard<std::mutex> lock( mMutex );
+        RouteProgress& progress = mProgress[ in_index ];
+        if ( progress.state != ROUTE_SENT && progress.state != ROUTE_REQUESTED )
+        {
+            return;
+        }
+        switch ( in_result.outcome )
+        {
+        case RouteTracker::ROUTE_MADE:
+            progress.state = ROUTE_MADE;
+            ++mMade;
+            break;
+        case RouteTracker::ROUTE_FAILED:
+            progress.state = ROUTE_FAILED;
+            ++mFailed;
+            break;
+        case RouteTracker::ROUTE_TIMED_OUT:
+            progress.state = ROUTE_TIMED_OUT;
+            ++mFailed;
+            break;
+        }
+        if ( --mPending == 0 )
+        {
+            mLastRoute = std::chrono::steady_clock::now();
+        }
+    }
+    mCondition.notify_all();
+}
+
+//********************************************************************************
+// SalvoEngine
+//********************************************************************************
+
+SalvoEngine::SalvoEngine( AsyncRestClient& in_client, RoutingClient& in_routing, RouteTracker& in_tracker,
+    const std::string& in_baseUrl, TokenManager& in_tokenManager )
+    : mClient( in_client )
+    , mRouting( in_routing )
+    , mTracker( in_tracker )
+    , mBaseUrl( in_baseUrl )
+    , mTokenManager( in_tokenManager )
+{
+}
+
+bool SalvoEngine::refreshSalvos()
+{
+    std::shared_ptr<Catalog> catalog = std::make_shared<Catalog>();
+    bool result = getMatrixSalvos( mBaseUrl, mTokenManager, [&catalog]( json& in_salvo )
+    {
+        if ( !in_salvo.is_object() )
+        {
+            return true;
+        }
+
+        Salvo salvo;
+        salvo.id = getString( in_salvo, "id" );
+        salvo.name = getString( in_salvo, "name" );
+        salvo.fabricId = getString( in_salvo, "fabricId" );
+        if ( salvo.id.empty() )
+        {
+            return true;
+        }
+
+        // The first salvo of a name wins, as with a linear search.
+        catalog->byName.insert( std::make_pair( salvo.name, catalog->salvos.size() ) );
+        catalog->salvos.push_back( std::move( salvo ) );
+        return true;
+    } );
+    if ( !result )
+    {
+        return false;
+    }
+
+    std::atomic_store( &mCatalog, std::shared_ptr<const Catalog>( catalog ) );
+    return true;
+}
+
+std::vector<SalvoEngine::Salvo> SalvoEngine::getSalvos() const
+{
+    std::shared_ptr<const Catalog> catalog = std::atomic_load( &mCatalog );
+    return catalog ? catalog->salvos : std::vector<Salvo>();
+}
+
+bool SalvoEngine::findSalvo( const std::string& in_name, Salvo& out_salvo ) const
+{
+    std::shared_ptr<const Catalog> catalog = std::atomic_load( &mCatalog );
+    if ( !catalog )
+    {
+        return false;
+    }
+    std::unordered_map<std::string, size_t>::const_iterator it = catalog->byName.find( in_name );
+    if ( it == catalog->byName.end() )
+    {
+        return false;
+    }
+    out_salvo = catalog->salvos[ it->second ];
+    return true;
+}
+
+bool SalvoEngine::executeSalvo( const std::string& in_name, Callback in_callback )
+{
+    Salvo salvo;
+    if ( !findSalvo( in_name, salvo ) )
+    {
+        return false;
+    }
+    postSalvo( salvo.id, "execute", in_callback );
+    return true;
+}
+
+bool SalvoEngine::cancelSalvo( const std::string& in_name, Callback in_callback )
+{
+    Salvo salvo;
+    if ( !findSalvo( in_name, salvo ) )
+    {
+        return false;
+    }
+    postSalvo( salvo.id, "cancel", in_callback );
+    return true;
+}
+
+bool SalvoEngine::buildRouteSet( const std::string& in_fabricId,
+    const std::vector<std::pair<std::string, std::string> >& in_routes, RouteSet& out_routeSet )
+{
+    std::shared_ptr<const RoutingClient::Fabric> fabric = mRouting.getFabric( in_fabricId );
+    if ( !fabric )
+    {
+        return false;
+    }
+
+    out_routeSet.fabricId = in_fabricId;
+    out_routeSet.routes.clear();
+    out_routeSet.routes.reserve( in_routes.size() );
+    bool result = true;
+    for ( size_t i = 0; i < in_routes.size(); ++i )
+    {
+        const EndpointTable::Endpoint* producer = fabric->producers->find( in_routes[ i ].first );
+        const EndpointTable::Endpoint* consumer = fabric->consumers->find( in_routes[ i ].second );
+        if ( !producer || !consumer )
+        {
+            std::cout << ( producer ? "Consumer \"" + in_routes[ i ].second : "Producer \"" + in_routes[ i ].first )
+                << "\" not found on fabric " << in_fabricId << "." << std::endl;
+            result = false;
+            continue;
+        }
+
+        json body;
+        body[ "sourceId" ] = producer->id;
+        body[ "destinationId" ] = consumer->id;
+
+        Route route;
+        route.sourceId = producer->id;
+        route.destinationId = consumer->id;
+        route.body = body.dump();
+        out_routeSet.routes.push_back( std::move( route ) );
+    }
+    return result;
+}
+
+std::shared_ptr<SalvoEngine::Execution> SalvoEngine::execute( const RouteSet& in_routeSet )
+{
+    std::shared_ptr<Execution> execution = std::make_shared<Execution>( in_routeSet );
+    const std::vector<Route>& routes = execution->mRoutes.routes;
+
+    // Tracked before sending: the notification may come before the answer.
+    std::weak_ptr<Execution> weakExecution( execution );
+    for ( size_t i = 0; i < routes.size(); ++i )
+    {
+        mTracker.track( routes[ i ].sourceId, routes[ i ].destinationId, [weakExecution, i]( const RouteTracker::Result& in_result )
+        {
+            std::shared_ptr<Execution> execution = weakExecution.lock();
+            if ( execution )
+            {
+                execution->onResolved( i, in_result );
+            }
+        } );
+    }
+
+    std::string bearerToken = mTokenManager.getBearerToken();
+    if ( bearerToken.empty() )
+    {
+        std::cout << "Could not retrieve bearer token." << std::endl;
+        for ( size_t i = 0; i < routes.size(); ++i )
+        {
+            execution->onRequested( i, false, std::string() );
+            mTracker.fail( routes[ i ].sourceId, routes[ i ].destinationId, "No bearer token" );
+        }
+        return execution;
+    }
+
+    RestClient::Request request;
+    request.method = "POST";
+    request.url = mBaseUrl + REQUESTROUTE_ENDPOINT;
+    request.endpoint = REQUESTROUTE_ENDPOINT;
+    request.headers.push_back( "Content-Type: application/json" );
+    request.headers.push_back( "Accept: application/json" );
+    request.headers.push_back( "Authorization: Bearer " + bearerToken );
+
+    for ( size_t i = 0; i < routes.size(); ++i )
+    {
+        request.body = routes[ i ].body;
+        mClient.perform( request, [this, weakExecution, i]( const RestClient::Response& in_response )
+        {
+            std::shared_ptr<Execution> execution = weakExecution.lock();
+            if ( !execution )
+            {
+                return;
+            }
+
+            const Route& route = execution->mRoutes.routes[ i ];
+            if ( in_response.httpCode < 200 || in_response.httpCode > 299 )
+            {
+                std::string error = in_response.error.empty() ? "http code " + std::to_string( in_response.httpCode ) : in_response.error;
+                std::cout << "Request Route " << route.sourceId << " -> " << route.destinationId << " error: " << error << std::endl;
+                execution->onRequested( i, false, std::string() );
+                mTracker.fail( route.sourceId, route.destinationId, error );
+                return;
+            }
+
+            json responseJson = json::parse( in_response.body, nullptr, false );
+            std::string requestId = responseJson.is_object() ? getString( responseJson, "requestId" ) : std::string();
+            mTracker.setRequestId( route.sourceId, route.destinationId, requestId );
+            execution->onRequested( i, true, requestId );
+        } );
+    }
+    return execution;
+}
+
+void SalvoEngine::postSalvo( const std::string& in_id, const char* in_action, Callback in_callback )
+{
+    std::string bearerToken = mTokenManager.getBearerToken();
+    if ( bearerToken.empty() )
+    {
+        std::cout << "Could not retrieve bearer token." << std::endl;
+        if ( in_callback )
+        {
+            in_callback( in_id, false );
+        }
+        return;
+    }
+
+    RestClient::Request request;
+    request.method = "POST";
+    request.url = mBaseUrl + "/cluster/matrix/api/v1/salvo/" + in_id + "/" + in_action;
+    request.endpoint = std::string( "/cluster/matrix/api/v1/salvo/{id}/" ) + in_action;
+    request.headers.push_back( "Content-Type: application/json" );
+    request.headers.push_back( "Accept: application/json" );
+    request.headers.push_back( "Authorization: Bearer " + bearerToken );
+
+    std::string action( in_action );
+    mClient.perform( request, [in_id, action, in_callback]( const RestClient::Response& in_response )
+    {
+        bool success = ( in_response.httpCode >= 200 && in_response.httpCode <= 299 );
+        if ( !success )
+        {
+            std::cout << "Salvo " << in_id << " " << action << " error: "
+                << ( in_response.error.empty() ? "http code " + std::to_string( in_response.httpCode ) : in_response.error )
+                << std::endl;
+        }
+        if ( in_callback )
+        {
+            in_callback( in_id, success );
+        }
+    } );
+}
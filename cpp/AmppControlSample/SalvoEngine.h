@@ -0,0 +1,171 @@
+//
+// Copyright Grass Valley
+//
+
+#ifndef SALVO_ENGINE_H_
+#define SALVO_ENGINE_H_
+
+#include "AsyncRestClient.h"
+#include "RouteTracker.h"
+#include "RoutingClient.h"
+#include "TokenManager.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Executes router salvos: the salvos defined on the server (the ExecuteSalvo
+// and CancelSalvo of the TypeScript and C# SDKs), and client-side salvos, sets
+// of routes between producers and consumers of a fabric.
+//
+// The server salvos are fetched once by refreshSalvos() and indexed by name.
+//
+// A client-side salvo is resolved to producer and consumer ids by
+// buildRouteSet(), ahead of time, along with the body of each route request.
+// execute() then only sends: every route request is handed to the
+// AsyncRestClient at once, so they are all in flight together on its pooled
+// (or multiplexed) connections. Each route is confirmed by the RouteTracker,
+// with its routemade notification; an Execution reports the progress of every
+// route and the time taken by the last one.
+class SalvoEngine
+{
+public:
+    struct Salvo
+    {
+        std::string id;
+        std::string name;
+        std::string fabricId;
+    };
+
+    struct Route
+    {
+        std::string sourceId;
+        std::string destinationId;
+        std::string body; // The requestroute body.
+    };
+
+    // Routes of a fabric resolved by buildRouteSet().
+    struct RouteSet
+    {
+        std::string fabricId;
+        std::vector<Route> routes;
+    };
+
+    // Called with the salvo id and whether the server accepted the request.
+    typedef std::function<void( const std::string& in_id, bool in_success )> Callback;
+
+    // Progress of the routes of a RouteSet sent by execute().
+    class Execution
+    {
+    public:
+        enum RouteState
+        {
+            ROUTE_SENT, // Sent, not answered yet.
+            ROUTE_REQUESTED, // Accepted, waiting for its confirmation.
+            ROUTE_MADE,
+            ROUTE_FAILED, // Rejected, or the request failed.
+            ROUTE_TIMED_OUT // Neither notified nor completed in time.
+        };
+
+        explicit Execution( const RouteSet& in_routes );
+
+        // Returns true once every route was resolved, false on timeout.
+        bool wait( std::chrono::milliseconds in_timeout );
+
+        size_t getRouteCount() const;
+        size_t getMadeCount() const;
+        size_t getFailedCount() const; // Including the routes that timed out.
+
+        RouteState getRouteState( size_t in_index ) const;
+
+        // Request id returned by the server for a route, empty until accepted.
+        std::string getRequestId( size_t in_index ) const;
+
+        // From execute() to the answer of the last route request.
+        std::chrono::microseconds getTimeToLastRequest() const;
+
+        // From execute() to the last route resolved, so far if some routes are
+        // still pending.
+        std::chrono::microseconds getTimeToLastRoute() const;
+
+    private:
+        friend class SalvoEngine;
+
+        struct RouteProgress
+        {
+            RouteState state;
+            std::string requestId;
+        };
+
+        // Route answered by the server.
+        void onRequested( size_t in_index, bool in_success, const std::string& in_requestId );
+
+        // Route resolved by the tracker.
+        void onResolved( size_t in_index, const RouteTracker::Result& in_result );
+
+        const RouteSet mRoutes;
+
+        mutable std::mutex mMutex;
+        std::condition_variable mCondition;
+        std::chrono::steady_clock::time_point mStart;
+        std::chrono::steady_clock::time_point mLastRequest;
+        std::chrono::steady_clock::time_point mLastRoute;
+        std::vector<RouteProgress> mProgress;
+        size_t mPendingRequests;
+        size_t mPending;
+        size_t mMade;
+        size_t mFailed;
+    };
+
+    SalvoEngine( AsyncRestClient& in_client, RoutingClient& in_routing, RouteTracker& in_tracker,
+        const std::string& in_baseUrl, TokenManager& in_tokenManager );
+
+    // Fetches the server salvos and replaces the cached ones.
+    bool refreshSalvos();
+
+    // Cached server salvos, empty before the first refreshSalvos().
+    std::vector<Salvo> getSalvos() const;
+
+    bool findSalvo( const std::string& in_name, Salvo& out_salvo ) const;
+
+    // Execute or cancel a server salvo of the cached list. Return false,
+    // without sending anything, if there is no salvo with that name.
+    bool executeSalvo( const std::string& in_name, Callback in_callback = Callback() );
+    bool cancelSalvo( const std::string& in_name, Callback in_callback = Callback() );
+
+    // Resolves the (source, destination) pairs, each given by name, alias or
+    // id, with the current inventory of the fabric. Returns false if any of
+    // them is unknown.
+    bool buildRouteSet( const std::string& in_fabricId, const std::vector<std::pair<std::string, std::string> >& in_routes,
+        RouteSet& out_routeSet );
+
+    // Tracks and sends every route of the set at once. The engine must
+    // outlive the requests in flight.
+    std::shared_ptr<Execution> execute( const RouteSet& in_routeSet );
+
+private:
+    struct Catalog
+    {
+        std::vector<Salvo> salvos;
+        std::unordered_map<std::string, size_t> byName;
+    };
+
+    void postSalvo( const std::string& in_id, const char* in_action, Callback in_callback );
+
+    AsyncRestClient& mClient;
+    RoutingClient& mRouting;
+    RouteTracker& mTracker;
+    std::string mBaseUrl;
+    TokenManager& mTokenManager;
+
+    // Read with std::atomic_load, replaced with std::atomic_store.
+    std::shared_ptr<const Catalog> mCatalog;
+};
+
+#endif /* SALVO_ENGINE_H_ */
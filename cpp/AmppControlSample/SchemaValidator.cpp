@@ -0,0 +1,756 @@
+//
+// Copyright Grass Valley
+//
+
+#include "SchemaValidator.h"
+#include "AmppControlUtil.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+namespace
+{
+    // $ref chains deeper than this are not followed (recursive schemas).
+    const int MAX_SCHEMA_DEPTH = 32;
+
+    std::string getString( const json& in_object, const char* in_key )
+    {
+        json::const_iterator it = in_object.find( in_key );
+        if ( it == in_object.end() )
+        {
+            return std::string();
+        }
+        return it->is_string() ? it->get<std::string>() : ( it->is_number() ? it->dump() : std::string() );
+    }
+
+    bool getNumber( const json& in_object, const char* in_key, double& out_value )
+    {
+        json::const_iterator it = in_object.find( in_key );
+        if ( it == in_object.end() || !it->is_number() )
+        {
+            return false;
+        }
+        out_value = it->get<double>();
+        return true;
+    }
+
+    unsigned int getTypeBits( const std::string& in_type )
+    {
+        if ( in_type == "null" ) return PayloadValidator::TYPE_NULL;
+        if ( in_type == "boolean" ) return PayloadValidator::TYPE_BOOLEAN;
+        if ( in_type == "integer" ) return PayloadValidator::TYPE_INTEGER;
+        if ( in_type == "number" ) return PayloadValidator::TYPE_NUMBER;
+        if ( in_type == "string" ) return PayloadValidator::TYPE_STRING;
+        if ( in_type == "object" ) return PayloadValidator::TYPE_OBJECT;
+        if ( in_type == "array" ) return PayloadValidator::TYPE_ARRAY;
+        return PayloadValidator::TYPE_ANY;
+    }
+
+    // Resolves a local reference such as "#/definitions/Channel".
+    const json* resolveReference( const json& in_root, const std::string& in_reference )
+    {
+        if ( in_reference.empty() || in_reference[ 0 ] != '#' )
+        {
+            return NULL;
+        }
+
+        const json* node = &in_root;
+        size_t position = 1;
+        while ( position < in_reference.size() )
+        {
+            if ( in_reference[ position ] != '/' || !node->is_object() )
+            {
+                return NULL;
+            }
+            size_t next = in_reference.find( '/', position + 1 );
+            if ( next == std::string::npos )
+            {
+                next = in_reference.size();
+            }
+            json::const_iterator it = node->find( in_reference.substr( position + 1, next - position - 1 ) );
+            if ( it == node->end() )
+            {
+                return NULL;
+            }
+            node = &*it;
+            position = next;
+        }
+        return node;
+    }
+
+    // Compares "1.10" after "1.9".
+    int compareVersions( const std::string& in_left, const std::string& in_right )
+    {
+        const char* left = in_left.c_str();
+        const char* right = in_right.c_str();
+        while ( *left || *right )
+        {
+            char* leftEnd;
+            char* rightEnd;
+            unsigned long leftNumber = strtoul( left, &leftEnd, 10 );
+            unsigned long rightNumber = strtoul( right, &rightEnd, 10 );
+            if ( leftEnd == left || rightEnd == right )
+            {
+                // Not numeric, fall back to the text.
+                int result = strcmp( left, right );
+                return result < 0 ? -1 : ( result > 0 ? 1 : 0 );
+            }
+            if ( leftNumber != rightNumber )
+            {
+                return leftNumber < rightNumber ? -1 : 1;
+            }
+            left = ( *leftEnd == '.' ) ? leftEnd + 1 : leftEnd;
+            right = ( *rightEnd == '.' ) ? rightEnd + 1 : rightEnd;
+        }
+        return 0;
+    }
+
+    std::string formatNumber( double in_value )
+    {
+        std::ostringstream stream;
+        stream << in_value;
+        return stream.str();
+    }
+}
+
+//********************************************************************************
+// PayloadValidator::Sax
+//********************************************************************************
+
+// Checks each value against the rule of its path, as the parser reports it.
+// Returning false stops the parse at the first error.
+class PayloadValidator::Sax : public nlohmann::json_sax<json>
+{
+public:
+    Sax( const PayloadValidator& in_validator, bool in_content )
+        : mValidator( in_validator )
+        , mContent( in_content )
+        , mActive( !in_content )
+        , mFoundPayload( false )
+    {
+    }
+
+    bool null() override
+    {
+        return checkValue( TYPE_NULL, NULL ) && checkLiteral( LITERAL_NULL );
+    }
+
+    bool boolean( bool in_value ) override
+    {
+        return checkValue( TYPE_BOOLEAN, NULL ) && checkLiteral( in_value ? LITERAL_TRUE : LITERAL_FALSE );
+    }
+
+    bool number_integer( number_integer_t in_value ) override
+    {
+        return checkNumber( TYPE_INTEGER, static_cast<double>( in_value ) );
+    }
+
+    bool number_unsigned( number_unsigned_t in_value ) override
+    {
+        return checkNumber( TYPE_INTEGER, static_cast<double>( in_value ) );
+    }
+
+    bool number_float( number_float_t in_value, const string_t& ) override
+    {
+        // 1.0 is an integer as far as JSON schema is concerned.
+        return checkNumber( std::floor( in_value ) == in_value ? TYPE_INTEGER : TYPE_NUMBER, in_value );
+    }
+
+    bool string( string_t& in_value ) override
+    {
+        const Rule* rule = NULL;
+        if ( !checkValue( TYPE_STRING, &rule ) )
+        {
+            return false;
+        }
+        if ( !rule )
+        {
+            return true;
+        }
+        if ( in_value.size() < rule->minLength || in_value.size() > rule->maxLength )
+        {
+            return fail( "length " + std::to_string( in_value.size() ) + " is out of range" );
+        }
+        if ( rule->hasEnum )
+        {
+            for ( size_t i = 0; i < rule->enumStrings.size(); ++i )
+            {
+                if ( rule->enumStrings[ i ] == in_value )
+                {
+                    return true;
+                }
+            }
+            return fail( "\"" + in_value + "\" is not one of the allowed values" );
+        }
+        return true;
+    }
+
+#if NLOHMANN_JSON_VERSION_MAJOR > 3 || ( NLOHMANN_JSON_VERSION_MAJOR == 3 && NLOHMANN_JSON_VERSION_MINOR >= 8 )
+    bool binary( binary_t& ) override
+    {
+        return fail( "binary values are not allowed" );
+    }
+#endif
+
+    bool start_object( std::size_t ) override
+    {
+        const Rule* rule = NULL;
+        if ( mFrames.empty() && mContent )
+        {
+            // The envelope of the content; only its Payload is checked.
+            mFrames.push_back( Frame( false, false, false, mPath.size() ) );
+            return true;
+        }
+        if ( !checkValue( TYPE_OBJECT, &rule ) )
+        {
+            return false;
+        }
+        mFrames.push_back( Frame( false, mActive, mActive && rule && rule->closed, mPath.size() ) );
+        return true;
+    }
+
+    bool key( string_t& in_key ) override
+    {
+        const Frame& frame = mFrames.back();
+        if ( mContent && mFrames.size() == 1 )
+        {
+            mActive = ( in_key == "Payload" );
+            mFoundPayload = mFoundPayload || mActive;
+            return true;
+        }
+
+        mPath.resize( frame.base );
+        if ( !mPath.empty() )
+        {
+            mPath += '.';
+        }
+        mPath += in_key;
+        mActive = frame.active;
+        if ( frame.closed && !mValidator.findRule( mPath ) )
+        {
+            return fail( "is not a known property" );
+        }
+        return true;
+    }
+
+    bool end_object() override
+    {
+        return endContainer();
+    }
+
+    bool start_array( std::size_t ) override
+    {
+        if ( mFrames.empty() && mContent )
+        {
+            return fail( "the content is not an object" );
+        }
+        if ( !checkValue( TYPE_ARRAY, NULL ) )
+        {
+            return false;
+        }
+        mFrames.push_back( Frame( true, mActive, false, mPath.size() ) );
+        mPath += "[]";
+        return true;
+    }
+
+    bool end_array() override
+    {
+        return endContainer();
+    }
+
+    bool parse_error( std::size_t, const std::string&, const nlohmann::detail::exception& in_exception ) override
+    {
+        mError = in_exception.what();
+        return false;
+    }
+
+    bool isPayloadFound() const
+    {
+        return !mContent || mFoundPayload;
+    }
+
+    const std::string& getError() const
+    {
+        return mError;
+    }
+
+private:
+    struct Frame
+    {
+        Frame( bool in_array, bool in_active, bool in_closed, size_t in_base )
+            : array( in_array )
+            , active( in_active )
+            , closed( in_closed )
+            , base( in_base )
+        {
+        }
+
+        bool array;
+        bool active; // Values of the container are checked.
+        bool closed; // Keys without a rule are rejected.
+        size_t base; // Length of the path of the container.
+    };
+
+    bool checkValue( unsigned int in_type, const Rule** out_rule )
+    {
+        if ( out_rule )
+        {
+            *out_rule = NULL;
+        }
+        if ( !mActive )
+        {
+            return true;
+        }
+        if ( mFrames.empty() && in_type != TYPE_OBJECT )
+        {
+            return fail( "the payload is not an object" );
+        }
+
+        const Rule* rule = mValidator.findRule( mPath );
+        if ( !rule )
+        {
+            // Not described by the schema.
+            return true;
+        }
+        bool allowed = ( rule->types & in_type ) != 0
+            || ( in_type == TYPE_INTEGER && ( rule->types & TYPE_NUMBER ) != 0 );
+        if ( !allowed )
+        {
+            return fail( "has the wrong type" );
+        }
+        if ( out_rule )
+        {
+            *out_rule = rule;
+        }
+        return true;
+    }
+
+    bool checkNumber( unsigned int in_type, double in_value )
+    {
+        const Rule* rule = NULL;
+        if ( !checkValue( in_type, &rule ) )
+        {
+            return false;
+        }
+        if ( !rule )
+        {
+            return true;
+        }
+        if ( rule->hasMinimum && ( in_value < rule->minimum || ( rule->exclusiveMinimum && in_value == rule->minimum ) ) )
+        {
+            return fail( formatNumber( in_value ) + " is below the minimum " + formatNumber( rule->minimum ) );
+        }
+        if ( rule->hasMaximum && ( in_value > rule->maximum || ( rule->exclusiveMaximum && in_value == rule->maximum ) ) )
+        {
+            return fail( formatNumber( in_value ) + " is above the maximum " + formatNumber( rule->maximum ) );
+        }
+        if ( rule->hasEnum )
+        {
+            for ( size_t i = 0; i < rule->enumNumbers.size(); ++i )
+            {
+                if ( rule->enumNumbers[ i ] == in_value )
+                {
+                    return true;
+                }
+            }
+            return fail( formatNumber( in_value ) + " is not one of the allowed values" );
+        }
+        return true;
+    }
+
+    bool checkLiteral( unsigned int in_literal )
+    {
+        if ( !mActive )
+        {
+            return true;
+        }
+        const Rule* rule = mValidator.findRule( mPath );
+        if ( rule && rule->hasEnum && ( rule->enumLiterals & in_literal ) == 0 )
+        {
+            return fail( "is not one of the allowed values" );
+        }
+        return true;
+    }
+
+    bool endContainer()
+    {
+        mPath.resize( mFrames.back().base );
+        mFrames.pop_back();
+        if ( !mFrames.empty() )
+        {
+            mActive = mFrames.back().active;
+            if ( mContent && mFrames.size() == 1 )
+            {
+                mActive = false;
+            }
+        }
+        return true;
+    }
+
+    bool fail( const std::string& in_message )
+    {
+        mError = ( mPath.empty() ? std::string( "Payload" ) : mPath ) + ": " + in_message;
+        return false;
+    }
+
+    const PayloadValidator& mValidator;
+    bool mContent;
+    bool mActive;
+    bool mFoundPayload;
+    std::vector<Frame> mFrames;
+    std::string mPath;
+    std::string mError;
+};
+
+//********************************************************************************
+// PayloadValidator
+//********************************************************************************
+
+PayloadValidator::Rule::Rule()
+    : types( TYPE_ANY )
+    , hasMinimum( false )
+    , hasMaximum( false )
+    , exclusiveMinimum( false )
+    , exclusiveMaximum( false )
+    , minimum( 0.0 )
+    , maximum( 0.0 )
+    , minLength( 0 )
+    , maxLength( static_cast<size_t>( -1 ) )
+    , hasEnum( false )
+    , enumLiterals( 0 )
+    , closed( false )
+{
+}
+
+PayloadValidator::PayloadValidator()
+{
+}
+
+bool PayloadValidator::compile( const json& in_schema, std::string& out_error )
+{
+    mRules.clear();
+    mIndex.clear();
+    if ( !in_schema.is_object() )
+    {
+        out_error = "The schema is not an object";
+        return false;
+    }
+    compileRule( in_schema, in_schema, "", 0 );
+    return true;
+}
+
+void PayloadValidator::compileRule( const json& in_root, const json& in_schema, const std::string& in_path, int in_depth )
+{
+    if ( !in_schema.is_object() || in_depth > MAX_SCHEMA_DEPTH || mIndex.find( in_path ) != mIndex.end() )
+    {
+        return;
+    }
+
+    json::const_iterator reference = in_schema.find( "$ref" );
+    if ( reference != in_schema.end() && reference->is_string() )
+    {
+        const json* target = resolveReference( in_root, reference->get<std::string>() );
+        if ( target )
+        {
+            compileRule( in_root, *target, in_path, in_depth + 1 );
+        }
+        return;
+    }
+
+    Rule rule;
+    rule.path = in_path;
+
+    json::const_iterator type = in_schema.find( "type" );
+    if ( type != in_schema.end() )
+    {
+        if ( type->is_string() )
+        {
+            rule.types = getTypeBits( type->get<std::string>() );
+        }
+        else if ( type->is_array() )
+        {
+            rule.types = 0;
+            for ( json::const_iterator it = type->begin(); it != type->end(); ++it )
+            {
+                rule.types |= it->is_string() ? getTypeBits( it->get<std::string>() ) : static_cast<unsigned int>( TYPE_ANY );
+            }
+        }
+    }
+
+    rule.hasMinimum = getNumber( in_schema, "minimum", rule.minimum );
+    rule.hasMaximum = getNumber( in_schema, "maximum", rule.maximum );
+
+    // Draft 4 uses booleans qualifying minimum and maximum, later drafts the bounds themselves.
+    json::const_iterator exclusive = in_schema.find( "exclusiveMinimum" );
+    if ( exclusive != in_schema.end() )
+    {
+        if ( exclusive->is_boolean() )
+        {
+            rule.exclusiveMinimum = exclusive->get<bool>();
+        }
+        else if ( exclusive->is_number() && ( !rule.hasMinimum || exclusive->get<double>() >= rule.minimum ) )
+        {
+            rule.hasMinimum = true;
+            rule.exclusiveMinimum = true;
+            rule.minimum = exclusive->get<double>();
+        }
+    }
+    exclusive = in_schema.find( "exclusiveMaximum" );
+    if ( exclusive != in_schema.end() )
+    {
+        if ( exclusive->is_boolean() )
+        {
+            rule.exclusiveMaximum = exclusive->get<bool>();
+        }
+        else if ( exclusive->is_number() && ( !rule.hasMaximum || exclusive->get<double>() <= rule.maximum ) )
+        {
+            rule.hasMaximum = true;
+            rule.exclusiveMaximum = true;
+            rule.maximum = exclusive->get<double>();
+        }
+    }
+
+    double length;
+    if ( getNumber( in_schema, "minLength", length ) )
+    {
+        rule.minLength = static_cast<size_t>( length );
+    }
+    if ( getNumber( in_schema, "maxLength", length ) )
+    {
+        rule.maxLength = static_cast<size_t>( length );
+    }
+
+    json::const_iterator values = in_schema.find( "enum" );
+    if ( values != in_schema.end() && values->is_array() )
+    {
+        rule.hasEnum = true;
+        for ( json::const_iterator it = values->begin(); it != values->end(); ++it )
+        {
+            if ( it->is_string() )
+            {
+                rule.enumStrings.push_back( it->get<std::string>() );
+            }
+            else if ( it->is_number() )
+            {
+                rule.enumNumbers.push_back( it->get<double>() );
+            }
+            else if ( it->is_null() )
+            {
+                rule.enumLiterals |= LITERAL_NULL;
+            }
+            else if ( it->is_boolean() )
+            {
+                rule.enumLiterals |= it->get<bool>() ? LITERAL_TRUE : LITERAL_FALSE;
+            }
+        }
+    }
+
+    json::const_iterator additional = in_schema.find( "additionalProperties" );
+    rule.closed = ( additional != in_schema.end() && additional->is_boolean() && !additional->get<bool>() );
+
+    // The rule is added before the nested ones, which may refer to it.
+    mIndex[ in_path ] = mRules.size();
+    mRules.push_back( rule );
+
+    json::const_iterator properties = in_schema.find( "properties" );
+    if ( properties != in_schema.end() && properties->is_object() )
+    {
+        for ( json::const_iterator it = properties->begin(); it != properties->end(); ++it )
+        {
+            compileRule( in_root, it.value(), in_path.empty() ? it.key() : in_path + "." + it.key(), in_depth + 1 );
+        }
+    }
+
+    json::const_iterator items = in_schema.find( "items" );
+    if ( items != in_schema.end() )
+    {
+        compileRule( in_root, *items, in_path + "[]", in_depth + 1 );
+    }
+}
+
+const PayloadValidator::Rule* PayloadValidator::findRule( const std::string& in_path ) const
+{
+    std::unordered_map<std::string, size_t>::const_iterator it = mIndex.find( in_path );
+    return ( it != mIndex.end() ) ? &mRules[ it->second ] : NULL;
+}
+
+bool PayloadValidator::validatePayload( const std::string& in_payload, std::string& out_error ) const
+{
+    return validate( in_payload, false, out_error );
+}
+
+bool PayloadValidator::validateContent( const std::string& in_content, std::string& out_error ) const
+{
+    return validate( in_content, true, out_error );
+}
+
+bool PayloadValidator::validate( const std::string& in_json, bool in_content, std::string& out_error ) const
+{
+    Sax sax( *this, in_content );
+    if ( !json::sax_parse( in_json, &sax ) )
+    {
+        out_error = sax.getError().empty() ? std::string( "Invalid JSON" ) : sax.getError();
+        return false;
+    }
+    if ( !sax.isPayloadFound() )
+    {
+        out_error = "The content has no Payload";
+        return false;
+    }
+    return true;
+}
+
+//********************************************************************************
+// SchemaCache
+//********************************************************************************
+
+SchemaCache::SchemaCache( const std::string& in_baseUrl, TokenManager& in_tokenManager )
+    : mBaseUrl( in_baseUrl )
+    , mTokenManager( in_tokenManager )
+{
+}
+
+bool SchemaCache::load( const std::string& in_application )
+{
+    {
+        std::lock_guard<std::mutex> lock( mMutex );
+        if ( mApplications.find( in_application ) != mApplications.end() )
+        {
+            return true;
+        }
+    }
+
+    std::shared_ptr<Application> application = std::make_shared<Application>();
+    bool result = getAmppControlSchemaVersions( mBaseUrl, mTokenManager, in_application, [this, &application]( json& in_entry )
+    {
+        if ( !in_entry.is_object() )
+        {
+            return true;
+        }
+
+        // Either one command per entry, or the commands of a workload.
+        std::string workload = getString( in_entry, "id" );
+        if ( in_entry.find( "schema" ) != in_entry.end() )
+        {
+            addCommand( *application, workload, in_entry );
+            return true;
+        }
+        static const char* const listKeys[] = { "commands", "schemas", "schemaVersions" };
+        for ( size_t i = 0; i < sizeof( listKeys ) / sizeof( listKeys[ 0 ] ); ++i )
+        {
+            json::const_iterator commands = in_entry.find( listKeys[ i ] );
+            if ( commands != in_entry.end() && commands->is_array() )
+            {
+                for ( json::const_iterator it = commands->begin(); it != commands->end(); ++it )
+                {
+                    addCommand( *application, workload, *it );
+                }
+            }
+        }
+        return true;
+    } );
+    if ( !result )
+    {
+        return false;
+    }
+
+    std::cout << "Compiled " << application->validators.size() << " command schemas of \"" << in_application << "\"" << std::endl;
+
+    std::lock_guard<std::mutex> lock( mMutex );
+    mApplications.insert( std::make_pair( in_application, std::shared_ptr<const Application>( application ) ) );
+    return true;
+}
+
+void SchemaCache::addCommand( Application& io_application, const std::string& in_workload, const json& in_command )
+{
+    if ( !in_command.is_object() )
+    {
+        return;
+    }
+    std::string name = getString( in_command, "name" );
+    if ( name.empty() )
+    {
+        name = getString( in_command, "command" );
+    }
+    std::string version = getString( in_command, "version" );
+    json::const_iterator schema = in_command.find( "schema" );
+    if ( name.empty() || schema == in_command.end() )
+    {
+        return;
+    }
+
+    if ( !in_workload.empty() )
+    {
+        io_application.workloadVersions[ in_workload + "/" + name ] = version;
+    }
+    std::unordered_map<std::string, std::string>::iterator latest = io_application.latestVersions.find( name );
+    if ( latest == io_application.latestVersions.end() )
+    {
+        io_application.latestVersions.insert( std::make_pair( name, version ) );
+    }
+    else if ( compareVersions( version, latest->second ) > 0 )
+    {
+        latest->second = version;
+    }
+
+    // Workloads running the same version share the validator.
+    std::string key = name + "/" + version;
+    if ( io_application.validators.find( key ) != io_application.validators.end() )
+    {
+        return;
+    }
+
+    // The schema is usually sent as a string holding the JSON document.
+    json document = schema->is_string() ? json::parse( schema->get<std::string>(), nullptr, false ) : *schema;
+    std::shared_ptr<PayloadValidator> validator = std::make_shared<PayloadValidator>();
+    std::string error;
+    if ( document.is_discarded() || !validator->compile( document, error ) )
+    {
+        std::cout << "Could not compile the schema of \"" << name << "\" version " << version << ": "
+            << ( error.empty() ? std::string( "invalid JSON" ) : error ) << std::endl;
+        return;
+    }
+    io_application.validators.insert( std::make_pair( key, std::shared_ptr<const PayloadValidator>( validator ) ) );
+}
+
+std::shared_ptr<const PayloadValidator> SchemaCache::getValidator( const std::string& in_application,
+    const std::string& in_command, const std::string& in_workload ) const
+{
+    std::shared_ptr<const Application> application;
+    {
+        std::lock_guard<std::mutex> lock( mMutex );
+        std::unordered_map<std::string, std::shared_ptr<const Application> >::const_iterator it = mApplications.find( in_application );
+        if ( it == mApplications.end() )
+        {
+            return std::shared_ptr<const PayloadValidator>();
+        }
+        application = it->second;
+    }
+
+    const std::string* version = NULL;
+    std::unordered_map<std::string, std::string>::const_iterator it;
+    if ( !in_workload.empty() )
+    {
+        it = application->workloadVersions.find( in_workload + "/" + in_command );
+        if ( it != application->workloadVersions.end() )
+        {
+            version = &it->second;
+        }
+    }
+    if ( !version )
+    {
+        it = application->latestVersions.find( in_command );
+        if ( it == application->latestVersions.end() )
+        {
+            return std::shared_ptr<const PayloadValidator>();
+        }
+        version = &it->second;
+    }
+
+    std::unordered_map<std::string, std::shared_ptr<const PayloadValidator> >::const_iterator validator =
+        application->validators.find( in_command + "/" + *version );
+    return ( validator != application->validators.end() ) ? validator->second : std::shared_ptr<const PayloadValidator>();
+}
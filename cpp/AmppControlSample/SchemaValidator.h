@@ -0,0 +1,140 @@
+//
+// Copyright Grass Valley
+//
+
+#ifndef SCHEMA_VALIDATOR_H_
+#define SCHEMA_VALIDATOR_H_
+
+#include "RpcProtocol.h"
+#include "TokenManager.h"
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Validates command payloads against the JSON schema of the command, before
+// they are sent.
+//
+// The schema is compiled once into a flat table of rules, one per property
+// path ("Index", "Source.Name", "Levels[]"): allowed types, numeric range,
+// string length and enumerated values. A payload is checked in a single SAX
+// pass over its text, looking up the rule of each value by path; no DOM of the
+// payload is built.
+//
+// Payloads may be partial objects, as Ampp Control accepts them, so "required"
+// is not enforced. Keywords other than the ones above are ignored.
+class PayloadValidator
+{
+public:
+    enum Type
+    {
+        TYPE_NULL = 1,
+        TYPE_BOOLEAN = 2,
+        TYPE_INTEGER = 4,
+        TYPE_NUMBER = 8,
+        TYPE_STRING = 16,
+        TYPE_OBJECT = 32,
+        TYPE_ARRAY = 64,
+        TYPE_ANY = 127
+    };
+
+    // Enumerated values that are neither strings nor numbers.
+    enum Literal
+    {
+        LITERAL_NULL = 1,
+        LITERAL_FALSE = 2,
+        LITERAL_TRUE = 4
+    };
+
+    struct Rule
+    {
+        Rule();
+
+        std::string path;
+        unsigned int types; // Type bits; TYPE_NUMBER accepts integers too.
+        bool hasMinimum;
+        bool hasMaximum;
+        bool exclusiveMinimum;
+        bool exclusiveMaximum;
+        double minimum;
+        double maximum;
+        size_t minLength;
+        size_t maxLength;
+        bool hasEnum;
+        std::vector<std::string> enumStrings;
+        std::vector<double> enumNumbers;
+        unsigned int enumLiterals; // Literal bits.
+        bool closed; // Objects only: additionalProperties is false.
+    };
+
+    PayloadValidator();
+
+    bool compile( const json& in_schema, std::string& out_error );
+
+    // Validates the payload of a command, e.g. {"Index": 1, "Level": 33}.
+    bool validatePayload( const std::string& in_payload, std::string& out_error ) const;
+
+    // Validates the "Payload" member of a notification content, e.g.
+    // { "Key" : "...", "Payload" : {"Index": 1, "Level": 33} }.
+    bool validateContent( const std::string& in_content, std::string& out_error ) const;
+
+    const std::vector<Rule>& getRules() const
+    {
+        return mRules;
+    }
+
+private:
+    class Sax;
+
+    void compileRule( const json& in_root, const json& in_schema, const std::string& in_path, int in_depth );
+    const Rule* findRule( const std::string& in_path ) const;
+    bool validate( const std::string& in_json, bool in_content, std::string& out_error ) const;
+
+    std::vector<Rule> mRules;
+    std::unordered_map<std::string, size_t> mIndex;
+};
+
+
+// Command schemas of applications, fetched from
+// /control/application/{application}/schemaversions and compiled once.
+//
+// The response is expected to list, per workload ("id"), the commands it
+// supports with their "name", "version" and "schema". Validators are shared
+// between the workloads using the same version of a command.
+class SchemaCache
+{
+public:
+    SchemaCache( const std::string& in_baseUrl, TokenManager& in_tokenManager );
+
+    // Fetches and compiles the schemas of an application, once.
+    bool load( const std::string& in_application );
+
+    // The validator of a command, for the version of the given workload, or
+    // for the highest version known if the workload is empty or unknown.
+    // Returns a null pointer if the command has no schema.
+    std::shared_ptr<const PayloadValidator> getValidator( const std::string& in_application,
+        const std::string& in_command, const std::string& in_workload = "" ) const;
+
+private:
+    struct Application
+    {
+        // "command/version" -> validator.
+        std::unordered_map<std::string, std::shared_ptr<const PayloadValidator> > validators;
+        // command -> highest version.
+        std::unordered_map<std::string, std::string> latestVersions;
+        // "workload/command" -> version.
+        std::unordered_map<std::string, std::string> workloadVersions;
+    };
+
+    void addCommand( Application& io_application, const std::string& in_workload, const json& in_command );
+
+    std::string mBaseUrl;
+    TokenManager& mTokenManager;
+
+    mutable std::mutex mMutex;
+    std::unordered_map<std::string, std::shared_ptr<const Application> > mApplications;
+};
+
+#endif /* SCHEMA_VALIDATOR_H_ */
@@ -0,0 +1,456 @@
+//
+// Copyright Grass Valley
+//
+
+#include "SharedMemory.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <new>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    const size_t CACHE_LINE = 64;
+
+    size_t alignUp( size_t in_value, size_t in_alignment )
+    {
+        return ( in_value + in_alignment - 1 ) & ~( in_alignment - 1 );
+    }
+}
+
+//********************************************************************************
+// SharedMemorySegment
+//********************************************************************************
+
+SharedMemorySegment::SharedMemorySegment()
+    : mData( nullptr )
+    , mSize( 0 )
+    , mOwner( false )
+#ifdef _WIN32
+    , mHandle( nullptr )
+#endif
+{
+}
+
+SharedMemorySegment::~SharedMemorySegment()
+{
+    close();
+}
+
+#ifdef _WIN32
+
+bool SharedMemorySegment::create( const std::string& in_name, size_t in_size )
+{
+    close();
+
+    unsigned long long size = in_size;
+    mHandle = CreateFileMappingA( INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+        static_cast<DWORD>( size >> 32 ), static_cast<DWORD>( size & 0xFFFFFFFF ), in_name.c_str() );
+    if ( !mHandle )
+    {
+        std::cout << "> Could not create shared memory \"" << in_name << "\": " << GetLastError() << std::endl;
+        return false;
+    }
+    if ( GetLastError() == ERROR_ALREADY_EXISTS )
+    {
+        // The mapping only outlives its last handle, so someone is using it.
+        std::cout << "> Shared memory \"" << in_name << "\" already exists: another gateway is using this name." << std::endl;
+        close();
+        return false;
+    }
+
+    mData = static_cast<uint8_t*>( MapViewOfFile( mHandle, FILE_MAP_ALL_ACCESS, 0, 0, in_size ) );
+    if ( !mData )
+    {
+        std::cout << "> Could not map shared memory \"" << in_name << "\": " << GetLastError() << std::endl;
+        close();
+        return false;
+    }
+
+    mName = in_name;
+    mSize = in_size;
+    mOwner = true;
+    return true;
+}
+
+bool SharedMemorySegment::open( const std::string& in_name )
+{
+    close();
+
+    mHandle = OpenFileMappingA( FILE_MAP_ALL_ACCESS, FALSE, in_name.c_str() );
+    if ( !mHandle )
+    {
+        std::cout << "> Could not open shared memory \"" << in_name << "\": " << GetLastError() << std::endl;
+        return false;
+    }
+
+    mData = static_cast<uint8_t*>( MapViewOfFile( mHandle, FILE_MAP_ALL_ACCESS, 0, 0, 0 ) );
+    if ( !mData )
+    {
+        std::cout << "> Could not map shared memory \"" << in_name << "\": " << GetLastError() << std::endl;
+        close();
+        return false;
+    }
+
+    MEMORY_BASIC_INFORMATION info;
+    VirtualQuery( mData, &info, sizeof( info ) );
+    mName = in_name;
+    mSize = info.RegionSize;
+    mOwner = false;
+    return true;
+}
+
+void SharedMemorySegment::close()
+{
+    if ( mData )
+    {
+        UnmapViewOfFile( mData );
+        mData = nullptr;
+    }
+    if ( mHandle )
+    {
+        CloseHandle( mHandle );
+        mHandle = nullptr;
+    }
+    mSize = 0;
+    mOwner = false;
+}
+
+#else
+
+bool SharedMemorySegment::create( const std::string& in_name, size_t in_size )
+{
+    close();
+
+    // Never take over a segment that may belong to a running gateway.
+    int fd = shm_open( in_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0660 );
+    if ( fd < 0 && errno == EEXIST )
+    {
+        std::cout << "> Shared memory \"" << in_name << "\" already exists: another gateway may be using this name."
+            << " If none is running, remove /dev/shm" << in_name << " left by a crashed one." << std::endl;
+        return false;
+    }
+    if ( fd < 0 )
+    {
+        std::cout << "> Could not create shared memory \"" << in_name << "\": " << strerror( errno ) << std::endl;
+        return false;
+    }
+
+    if ( ftruncate( fd, static_cast<off_t>( in_size ) ) != 0 )
+    {
+        std::cout << "> Could not size shared memory \"" << in_name << "\": " << strerror( errno ) << std::endl;
+        ::close( fd );
+        shm_unlink( in_name.c_str() );
+        return false;
+    }
+
+    void* data = mmap( nullptr, in_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    ::close( fd );
+    if ( data == MAP_FAILED )
+    {
+        std::cout << "> Could not map shared memory \"" << in_name << "\": " << strerror( errno ) << std::endl;
+        shm_unlink( in_name.c_str() );
+        return false;
+    }
+
+    mName = in_name;
+    mData = static_cast<uint8_t*>( data );
+    mSize = in_size;
+    mOwner = true;
+    return true;
+}
+
+bool SharedMemorySegment::open( const std::string& in_name )
+{
+    close();
+
+    int fd = shm_open( in_name.c_str(), O_RDWR, 0660 );
+    if ( fd < 0 )
+    {
+        std::cout << "> Could not open shared memory \"" << in_name << "\": " << strerror( errno ) << std::endl;
+        return false;
+    }
+
+    struct stat info;
+    if ( fstat( fd, &info ) != 0 || info.st_size == 0 )
+    {
+        ::close( fd );
+        return false;
+    }
+
+    void* data = mmap( nullptr, static_cast<size_t>( info.st_size ), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    ::close( fd );
+    if ( data == MAP_FAILED )
+    {
+        std::cout << "> Could not map shared memory \"" << in_name << "\": " << strerror( errno ) << std::endl;
+        return false;
+    }
+
+    mName = in_name;
+    mData = static_cast<uint8_t*>( data );
+    mSize = static_cast<size_t>( info.st_size );
+    mOwner = false;
+    return true;
+}
+
+void SharedMemorySegment::close()
+{
+    if ( mData )
+    {
+        munmap( mData, mSize );
+        mData = nullptr;
+    }
+    if ( mOwner )
+    {
+        shm_unlink( mName.c_str() );
+    }
+    mSize = 0;
+    mOwner = false;
+}
+
+#endif
+
+//********************************************************************************
+// SharedBroadcastRing
+//********************************************************************************
+
+size_t SharedBroadcastRing::getRequiredSize( uint32_t in_slotCount, uint32_t in_slotSize )
+{
+    size_t stride = alignUp( sizeof( Slot ) + in_slotSize, CACHE_LINE );
+    return alignUp( sizeof( Header ), CACHE_LINE ) + stride * in_slotCount;
+}
+
+SharedBroadcastRing::SharedBroadcastRing()
+    : mHeader( nullptr )
+    , mSlots( nullptr )
+    , mSlotStride( 0 )
+{
+}
+
+void SharedBroadcastRing::create( void* in_memory, uint32_t in_slotCount, uint32_t in_slotSize )
+{
+    mHeader = new ( in_memory ) Header();
+    mHeader->slotCount = in_slotCount;
+    mHeader->slotSize = in_slotSize;
+    mHeader->writeSequence.store( 0, std::memory_order_relaxed );
+
+    mSlots = static_cast<uint8_t*>( in_memory ) + alignUp( sizeof( Header ), CACHE_LINE );
+    mSlotStride = alignUp( sizeof( Slot ) + in_slotSize, CACHE_LINE );
+    for ( uint32_t i = 0; i < in_slotCount; ++i )
+    {
+        Slot* slot = new ( mSlots + i * mSlotStride ) Slot();
+        slot->sequence.store( 0, std::memory_order_relaxed );
+        slot->length = 0;
+    }
+    std::atomic_thread_fence( std::memory_order_release );
+}
+
+void SharedBroadcastRing::attach( void* in_memory )
+{
+    mHeader = static_cast<Header*>( in_memory );
+    mSlots = static_cast<uint8_t*>( in_memory ) + alignUp( sizeof( Header ), CACHE_LINE );
+    mSlotStride = alignUp( sizeof( Slot ) + mHeader->slotSize, CACHE_LINE );
+}
+
+SharedBroadcastRing::Slot* SharedBroadcastRing::getSlot( uint64_t in_sequence ) const
+{
+    return reinterpret_cast<Slot*>( mSlots + ( in_sequence % mHeader->slotCount ) * mSlotStride );
+}
+
+bool SharedBroadcastRing::publish( const void* in_data, size_t in_length )
+{
+    if ( in_length > mHeader->slotSize )
+    {
+        return false;
+    }
+
+    uint64_t sequence = mHeader->writeSequence.load( std::memory_order_relaxed );
+    Slot* slot = getSlot( sequence );
+
+    // Odd: being written. Even: holds record ( value / 2 - 1 ).
+    slot->sequence.store( sequence * 2 + 1, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_release );
+
+    slot->length = static_cast<uint32_t>( in_length );
+    memcpy( reinterpret_cast<uint8_t*>( slot ) + sizeof( Slot ), in_data, in_length );
+
+    slot->sequence.store( sequence * 2 + 2, std::memory_order_release );
+    mHeader->writeSequence.store( sequence + 1, std::memory_order_release );
+    return true;
+}
+
+uint64_t SharedBroadcastRing::getWriteSequence() const
+{
+    return mHeader->writeSequence.load( std::memory_order_acquire );
+}
+
+bool SharedBroadcastRing::read( uint64_t& io_cursor, std::string& out_data, uint64_t& out_lost ) const
+{
+    for ( ;; )
+    {
+        uint64_t writeSequence = mHeader->writeSequence.load( std::memory_order_acquire );
+        if ( io_cursor >= writeSequence )
+        {
+            return false;
+        }
+        if ( writeSequence - io_cursor > mHeader->slotCount )
+        {
+            uint64_t oldest = writeSequence - mHeader->slotCount;
+            out_lost += oldest - io_cursor;
+            io_cursor = oldest;
+        }
+
+        const Slot* slot = getSlot( io_cursor );
+        uint64_t before = slot->sequence.load( std::memory_order_acquire );
+        if ( before == io_cursor * 2 + 2 )
+        {
+            uint32_t length = slot->length;
+            bool valid = ( length <= mHeader->slotSize );
+            if ( valid )
+            {
+                out_data.assign( reinterpret_cast<const char*>( slot ) + sizeof( Slot ), length );
+            }
+            std::atomic_thread_fence( std::memory_order_acquire );
+            if ( slot->sequence.load( std::memory_order_relaxed ) == before )
+            {
+                ++io_cursor;
+                if ( valid )
+                {
+                    return true;
+                }
+
+                // A stable record longer than a slot is corrupt: it is skipped as lost.
+                ++out_lost;
+                continue;
+            }
+        }
+
+        // The slot is being overwritten by a newer record: this consumer was lapped.
+        ++out_lost;
+        ++io_cursor;
+    }
+}
+
+//********************************************************************************
+// SharedCommandQueue
+//********************************************************************************
+
+size_t SharedCommandQueue::getRequiredSize( uint32_t in_cellCount, uint32_t in_cellSize )
+{
+    size_t stride = alignUp( sizeof( Cell ) + in_cellSize, CACHE_LINE );
+    return alignUp( sizeof( Header ), CACHE_LINE ) + stride * in_cellCount;
+}
+
+SharedCommandQueue::SharedCommandQueue()
+    : mHeader( nullptr )
+    , mCells( nullptr )
+    , mCellStride( 0 )
+{
+}
+
+void SharedCommandQueue::create( void* in_memory, uint32_t in_cellCount, uint32_t in_cellSize )
+{
+    mHeader = new ( in_memory ) Header();
+    mHeader->cellCount = in_cellCount;
+    mHeader->cellSize = in_cellSize;
+    mHeader->enqueuePosition.store( 0, std::memory_order_relaxed );
+    mHeader->dequeuePosition.store( 0, std::memory_order_relaxed );
+
+    mCells = static_cast<uint8_t*>( in_memory ) + alignUp( sizeof( Header ), CACHE_LINE );
+    mCellStride = alignUp( sizeof( Cell ) + in_cellSize, CACHE_LINE );
+    for ( uint32_t i = 0; i < in_cellCount; ++i )
+    {
+        Cell* cell = new ( mCells + i * mCellStride ) Cell();
+        cell->sequence.store( i, std::memory_order_relaxed );
+        cell->length = 0;
+    }
+    std::atomic_thread_fence( std::memory_order_release );
+}
+
+void SharedCommandQueue::attach( void* in_memory )
+{
+    mHeader = static_cast<Header*>( in_memory );
+    mCells = static_cast<uint8_t*>( in_memory ) + alignUp( sizeof( Header ), CACHE_LINE );
+    mCellStride = alignUp( sizeof( Cell ) + mHeader->cellSize, CACHE_LINE );
+}
+
+SharedCommandQueue::Cell* SharedCommandQueue::getCell( uint64_t in_position ) const
+{
+    return reinterpret_cast<Cell*>( mCells + ( in_position & ( mHeader->cellCount - 1 ) ) * mCellStride );
+}
+
+bool SharedCommandQueue::push( const void* in_data, size_t in_length )
+{
+    if ( in_length > mHeader->cellSize )
+    {
+        return false;
+    }
+
+    uint64_t position = mHeader->enqueuePosition.load( std::memory_order_relaxed );
+    Cell* cell;
+    for ( ;; )
+    {
+        cell = getCell( position );
+        uint64_t sequence = cell->sequence.load( std::memory_order_acquire );
+        int64_t difference = static_cast<int64_t>( sequence ) - static_cast<int64_t>( position );
+        if ( difference == 0 )
+        {
+            if ( mHeader->enqueuePosition.compare_exchange_weak( position, position + 1, std::memory_order_relaxed ) )
+            {
+                break;
+            }
+        }
+        else if ( difference < 0 )
+        {
+            // Full: the consumer has not released this cell yet.
+            return false;
+        }
+        else
+        {
+            position = mHeader->enqueuePosition.load( std::memory_order_relaxed );
+        }
+    }
+
+    cell->length = static_cast<uint32_t>( in_length );
+    memcpy( reinterpret_cast<uint8_t*>( cell ) + sizeof( Cell ), in_data, in_length );
+    cell->sequence.store( position + 1, std::memory_order_release );
+    return true;
+}
+
+bool SharedCommandQueue::pop( std::string& out_data, uint64_t& out_bad )
+{
+    for ( ;; )
+    {
+        uint64_t position = mHeader->dequeuePosition.load( std::memory_order_relaxed );
+        Cell* cell = getCell( position );
+        uint64_t sequence = cell->sequence.load( std::memory_order_acquire );
+        if ( sequence != position + 1 )
+        {
+            return false;
+        }
+
+        uint32_t length = cell->length;
+        bool valid = ( length <= mHeader->cellSize );
+        if ( valid )
+        {
+            out_data.assign( reinterpret_cast<const char*>( cell ) + sizeof( Cell ), length );
+        }
+        mHeader->dequeuePosition.store( position + 1, std::memory_order_relaxed );
+        cell->sequence.store( position + mHeader->cellCount, std::memory_order_release );
+        if ( valid )
+        {
+            return true;
+        }
+        ++out_bad;
+    }
+}
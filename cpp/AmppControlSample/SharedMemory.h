@@ -0,0 +1,167 @@
+//
+// Copyright Grass Valley
+//
+
+#ifndef SHARED_MEMORY_H_
+#define SHARED_MEMORY_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// The ring and the queue below live in memory shared between processes: their
+// atomics must not rely on a lock hidden in the process.
+static_assert( ATOMIC_LLONG_LOCK_FREE == 2, "64 bit atomics must be lock free to be shared between processes" );
+
+// A named memory segment shared between processes (POSIX shm_open()/mmap() or
+// a Windows file mapping).
+class SharedMemorySegment
+{
+public:
+    SharedMemorySegment();
+    ~SharedMemorySegment();
+
+    // Creates the segment, failing if the name already exists. The creator
+    // removes the name when the segment is closed.
+    bool create( const std::string& in_name, size_t in_size );
+
+    // Maps an existing segment.
+    bool open( const std::string& in_name );
+
+    void close();
+
+    uint8_t* getData() const
+    {
+        return mData;
+    }
+
+    size_t getSize() const
+    {
+        return mSize;
+    }
+
+private:
+    SharedMemorySegment( const SharedMemorySegment& );
+    SharedMemorySegment& operator=( const SharedMemorySegment& );
+
+    std::string mName;
+    uint8_t* mData;
+    size_t mSize;
+    bool mOwner;
+#ifdef _WIN32
+    void* mHandle;
+#endif
+};
+
+
+// Single producer, multiple consumer broadcast ring.
+//
+// Every consumer keeps its own cursor and reads every record; the producer
+// never waits for consumers and overwrites the oldest slot when the ring is
+// full. Each slot is guarded by a sequence number (seqlock): a consumer that
+// was lapped detects it, skips ahead and counts the records it lost.
+class SharedBroadcastRing
+{
+public:
+    struct Header
+    {
+        uint32_t slotCount;
+        uint32_t slotSize;
+        alignas( 64 ) std::atomic<uint64_t> writeSequence;
+    };
+
+    // Bytes needed for a ring of in_slotCount slots of in_slotSize payload bytes.
+    static size_t getRequiredSize( uint32_t in_slotCount, uint32_t in_slotSize );
+
+    SharedBroadcastRing();
+
+    // Initializes a new ring in in_memory (producer side).
+    void create( void* in_memory, uint32_t in_slotCount, uint32_t in_slotSize );
+
+    // Attaches to a ring initialized by another process (consumer side).
+    void attach( void* in_memory );
+
+    // Writes one record. Fails if it is larger than a slot.
+    bool publish( const void* in_data, size_t in_length );
+
+    // Returns the sequence of the next record to be published. Consumers
+    // start from here to only receive new records.
+    uint64_t getWriteSequence() const;
+
+    // Copies the record at io_cursor into out_data (resized to fit) and
+    // advances io_cursor. Returns false if no record is available.
+    // out_lost is increased by the number of records that were overwritten
+    // before this consumer could read them.
+    bool read( uint64_t& io_cursor, std::string& out_data, uint64_t& out_lost ) const;
+
+    uint32_t getSlotSize() const
+    {
+        return mHeader ? mHeader->slotSize : 0;
+    }
+
+private:
+    struct Slot
+    {
+        std::atomic<uint64_t> sequence;
+        uint32_t length;
+    };
+
+    Slot* getSlot( uint64_t in_sequence ) const;
+
+    Header* mHeader;
+    uint8_t* mSlots;
+    size_t mSlotStride;
+};
+
+
+// Bounded multiple producer, single consumer queue of variable length records
+// (up to the cell size). Producers claim a cell with a CAS on the enqueue
+// position and publish it through the cell's sequence number, so concurrent
+// producers in different processes never take a lock.
+class SharedCommandQueue
+{
+public:
+    struct Header
+    {
+        uint32_t cellCount;
+        uint32_t cellSize;
+        alignas( 64 ) std::atomic<uint64_t> enqueuePosition;
+        alignas( 64 ) std::atomic<uint64_t> dequeuePosition;
+    };
+
+    // in_cellCount must be a power of two.
+    static size_t getRequiredSize( uint32_t in_cellCount, uint32_t in_cellSize );
+
+    SharedCommandQueue();
+
+    void create( void* in_memory, uint32_t in_cellCount, uint32_t in_cellSize );
+    void attach( void* in_memory );
+
+    // Returns false if the queue is full or the record is larger than a cell.
+    bool push( const void* in_data, size_t in_length );
+
+    // Single consumer only. Records claiming to be larger than a cell (written
+    // by a faulty process) are released unread and counted in out_bad.
+    bool pop( std::string& out_data, uint64_t& out_bad );
+
+    uint32_t getCellSize() const
+    {
+        return mHeader ? mHeader->cellSize : 0;
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<uint64_t> sequence;
+        uint32_t length;
+    };
+
+    Cell* getCell( uint64_t in_position ) const;
+
+    Header* mHeader;
+    uint8_t* mCells;
+    size_t mCellStride;
+};
+
+#endif /* SHARED_MEMORY_H_ */
@@ -0,0 +1,353 @@
+//
+// Copyright Grass Valley
+//
+
+#include "SignalRProtocol.h"
+#include "RestClient.h"
+
+#include <iostream>
+
+namespace
+{
+    const char RECORD_SEPARATOR = 0x1E;
+
+    void appendVarInt( size_t in_value, std::string& out_data )
+    {
+        do
+        {
+            uint8_t byte = in_value & 0x7F;
+            in_value >>= 7;
+            if ( in_value > 0 )
+            {
+                byte |= 0x80;
+            }
+            out_data += static_cast<char>( byte );
+        } while ( in_value > 0 );
+    }
+
+    // Returns false if the VarInt is truncated or longer than 5 bytes.
+    bool readVarInt( const std::string& in_data, size_t& io_offset, size_t& out_value )
+    {
+        out_value = 0;
+        for ( unsigned int shift = 0; shift < 35; shift += 7 )
+        {
+            if ( io_offset >= in_data.size() )
+            {
+                return false;
+            }
+            uint8_t byte = static_cast<uint8_t>( in_data[ io_offset++ ] );
+            out_value |= static_cast<size_t>( byte & 0x7F ) << shift;
+            if ( !( byte & 0x80 ) )
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::string getOptionalString( const json& in_value )
+    {
+        return in_value.is_string() ? in_value.get<std::string>() : std::string();
+    }
+}
+
+//********************************************************************************
+// SignalRMessage
+//********************************************************************************
+
+SignalRMessage SignalRMessage::fromRpcPacket( const json& in_packet )
+{
+    SignalRMessage message;
+    message.type = INVOCATION;
+
+    json::const_iterator payload = in_packet.find( "payload" );
+    if ( payload != in_packet.end() )
+    {
+        message.invocationId = getOptionalString( payload->value( "requestId", json() ) );
+        message.target = getOptionalString( payload->value( "hubMethod", json() ) );
+        message.arguments = payload->value( "arguments", json::array() );
+    }
+
+    return message;
+}
+
+//********************************************************************************
+// SignalRHubProtocol
+//********************************************************************************
+
+SignalRHubProtocol::SignalRHubProtocol( Format in_format )
+    : mFormat( in_format )
+{
+}
+
+std::string SignalRHubProtocol::getHandshakeRequest() const
+{
+    json j;
+    j[ "protocol" ] = ( mFormat == MESSAGEPACK ) ? "messagepack" : "json";
+    j[ "version" ] = 1;
+    return j.dump() + RECORD_SEPARATOR;
+}
+
+bool SignalRHubProtocol::parseHandshakeResponse( std::string& io_data, std::string& out_error )
+{
+    size_t end = io_data.find( RECORD_SEPARATOR );
+    if ( end == std::string::npos )
+    {
+        return false;
+    }
+
+    json response = json::parse( io_data.begin(), io_data.begin() + end, nullptr, false );
+    io_data.erase( 0, end + 1 );
+
+    if ( response.is_discarded() )
+    {
+        out_error = "Invalid handshake response";
+    }
+    else if ( response.find( "error" ) != response.end() )
+    {
+        out_error = getOptionalString( response[ "error" ] );
+    }
+    return true;
+}
+
+void SignalRHubProtocol::encode( const SignalRMessage& in_message, std::string& out_frame ) const
+{
+    if ( mFormat == MESSAGEPACK )
+    {
+        encodeMessagePack( in_message, out_frame );
+    }
+    else
+    {
+        encodeJson( in_message, out_frame );
+    }
+}
+
+void SignalRHubProtocol::encodeJson( const SignalRMessage& in_message, std::string& out_frame ) const
+{
+    json j;
+    j[ "type" ] = static_cast<int>( in_message.type );
+
+    switch ( in_message.type )
+    {
+    case SignalRMessage::INVOCATION:
+        if ( !in_message.invocationId.empty() )
+        {
+            j[ "invocationId" ] = in_message.invocationId;
+        }
+        j[ "target" ] = in_message.target;
+        j[ "arguments" ] = in_message.arguments.is_array() ? in_message.arguments : json::array();
+        break;
+    case SignalRMessage::COMPLETION:
+        j[ "invocationId" ] = in_message.invocationId;
+        if ( !in_message.error.empty() )
+        {
+            j[ "error" ] = in_message.error;
+        }
+        else if ( !in_message.result.is_null() )
+        {
+            j[ "result" ] = in_message.result;
+        }
+        break;
+    case SignalRMessage::CLOSE:
+        if ( !in_message.error.empty() )
+        {
+            j[ "error" ] = in_message.error;
+        }
+        break;
+    default:
+        break;
+    }
+
+    out_frame += j.dump();
+    out_frame += RECORD_SEPARATOR;
+}
+
+void SignalRHubProtocol::encodeMessagePack( const SignalRMessage& in_message, std::string& out_frame ) const
+{
+    json j = json::array();
+    j.push_back( static_cast<int>( in_message.type ) );
+
+    switch ( in_message.type )
+    {
+    case SignalRMessage::INVOCATION:
+        // [ 1, Headers, InvocationId, Target, [ Arguments ], [ StreamIds ] ]
+        j.push_back( json::object() );
+        j.push_back( in_message.invocationId.empty() ? json() : json( in_message.invocationId ) );
+        j.push_back( in_message.target );
+        j.push_back( in_message.arguments.is_array() ? in_message.arguments : json::array() );
+        j.push_back( json::array() );
+        break;
+    case SignalRMessage::COMPLETION:
+        // [ 3, Headers, InvocationId, ResultKind, Result? ]
+        j.push_back( json::object() );
+        j.push_back( in_message.invocationId );
+        if ( !in_message.error.empty() )
+        {
+            j.push_back( 1 );
+            j.push_back( in_message.error );
+        }
+        else if ( in_message.result.is_null() )
+        {
+            j.push_back( 2 );
+        }
+        else
+        {
+            j.push_back( 3 );
+            j.push_back( in_message.result );
+        }
+        break;
+    case SignalRMessage::CLOSE:
+        // [ 7, Error, AllowReconnect ]
+        j.push_back( in_message.error.empty() ? json() : json( in_message.error ) );
+        j.push_back( false );
+        break;
+    default:
+        break;
+    }
+
+    std::vector<std::uint8_t> packed = json::to_msgpack( j );
+    appendVarInt( packed.size(), out_frame );
+    out_frame.append( packed.begin(), packed.end() );
+}
+
+bool SignalRHubProtocol::decode( const std::string& in_data, std::vector<SignalRMessage>& out_messages ) const
+{
+    size_t offset = 0;
+    while ( offset < in_data.size() )
+    {
+        SignalRMessage message;
+        if ( mFormat == MESSAGEPACK )
+        {
+            size_t length = 0;
+            if ( !readVarInt( in_data, offset, length ) || offset + length > in_data.size() )
+            {
+                return false;
+            }
+            json j = json::from_msgpack( in_data.begin() + offset, in_data.begin() + offset + length, true, false );
+            offset += length;
+            if ( j.is_discarded() || !decodeMessagePack( j, message ) )
+            {
+                return false;
+            }
+        }
+        else
+        {
+            size_t end = in_data.find( RECORD_SEPARATOR, offset );
+            if ( end == std::string::npos )
+            {
+                return false;
+            }
+            json j = json::parse( in_data.begin() + offset, in_data.begin() + end, nullptr, false );
+            offset = end + 1;
+            if ( j.is_discarded() || !decodeJson( j, message ) )
+            {
+                return false;
+            }
+        }
+        out_messages.push_back( std::move( message ) );
+    }
+    return true;
+}
+
+bool SignalRHubProtocol::decodeJson( const json& in_json, SignalRMessage& out_message ) const
+{
+    json::const_iterator type = in_json.find( "type" );
+    if ( !in_json.is_object() || type == in_json.end() || !type->is_number_integer() )
+    {
+        return false;
+    }
+
+    out_message.type = static_cast<SignalRMessage::MessageType>( type->get<int>() );
+    out_message.invocationId = getOptionalString( in_json.value( "invocationId", json() ) );
+    out_message.target = getOptionalString( in_json.value( "target", json() ) );
+    out_message.arguments = in_json.value( "arguments", json::array() );
+    out_message.result = in_json.value( "result", json() );
+    out_message.error = getOptionalString( in_json.value( "error", json() ) );
+    return true;
+}
+
+bool SignalRHubProtocol::decodeMessagePack( const json& in_array, SignalRMessage& out_message ) const
+{
+    if ( !in_array.is_array() || in_array.empty() || !in_array[ 0 ].is_number_integer() )
+    {
+        return false;
+    }
+
+    out_message.type = static_cast<SignalRMessage::MessageType>( in_array[ 0 ].get<int>() );
+    switch ( out_message.type )
+    {
+    case SignalRMessage::INVOCATION:
+        if ( in_array.size() < 5 )
+        {
+            return false;
+        }
+        out_message.invocationId = getOptionalString( in_array[ 2 ] );
+        out_message.target = getOptionalString( in_array[ 3 ] );
+        out_message.arguments = in_array[ 4 ];
+        break;
+    case SignalRMessage::COMPLETION:
+        if ( in_array.size() < 4 )
+        {
+            return false;
+        }
+        out_message.invocationId = getOptionalString( in_array[ 2 ] );
+        if ( in_array[ 3 ] == 1 && in_array.size() > 4 )
+        {
+            out_message.error = getOptionalString( in_array[ 4 ] );
+        }
+        else if ( in_array[ 3 ] == 3 && in_array.size() > 4 )
+        {
+            out_message.result = in_array[ 4 ];
+        }
+        break;
+    case SignalRMessage::CLOSE:
+        if ( in_array.size() > 1 )
+        {
+            out_message.error = getOptionalString( in_array[ 1 ] );
+        }
+        break;
+    default:
+        break;
+    }
+    return true;
+}
+
+//********************************************************************************
+// Negotiation
+//********************************************************************************
+
+bool negotiateSignalRConnection( const std::string& in_hubUrl, const std::string& in_bearerToken,
+    std::string& out_connectionToken )
+{
+    RestClient::Request request;
+    request.method = "POST";
+    request.url = in_hubUrl + "/negotiate?negotiateVersion=1";
+    request.headers.push_back( "Accept: application/json" );
+    request.headers.push_back( "Authorization: Bearer " + in_bearerToken );
+
+    RestClient::Response response;
+    if ( !RestClient::getInstance().perform( request, response ) )
+    {
+        std::cout << "SignalR negotiate error: " << response.error << std::endl;
+        return false;
+    }
+    if ( response.httpCode < 200 || response.httpCode > 299 )
+    {
+        std::cout << "SignalR negotiate error. Returned http code: " << response.httpCode << std::endl;
+        return false;
+    }
+
+    json responseJson = json::parse( response.body, nullptr, false );
+    if ( !responseJson.is_object() )
+    {
+        std::cout << "SignalR negotiate error: the response is not a JSON object." << std::endl;
+        return false;
+    }
+    // negotiateVersion 1 servers return a connectionToken, older ones only a connectionId.
+    out_connectionToken = getOptionalString( responseJson.value( "connectionToken", json() ) );
+    if ( out_connectionToken.empty() )
+    {
+        out_connectionToken = getOptionalString( responseJson.value( "connectionId", json() ) );
+    }
+    return !out_connectionToken.empty();
+}
@@ -0,0 +1,113 @@
+//
+// Copyright Grass Valley
+//
+
+#ifndef SIGNALR_PROTOCOL_H_
+#define SIGNALR_PROTOCOL_H_
+
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+// IMPORTANT NOTE:
+//    - This is a minimal client side implementation of the SignalR hub
+//      protocol spoken by /pushnotificationshub, limited to what the push
+//      notification service uses: invocations (Subscribe, Unsubscribe,
+//      PublishNotification, Ping from the client; ReceiveNotification, Pong
+//      from the server), completions, pings and close messages.
+//      Streaming messages are ignored.
+//
+//    - Two hub protocols are supported:
+//        "json":        UTF-8 JSON messages, each terminated by the 0x1E record separator.
+//        "messagepack": MessagePack arrays, each prefixed by its VarInt encoded length.
+//      The handshake is always JSON, whatever the hub protocol.
+
+using json = nlohmann::json;
+
+class SignalRMessage
+{
+public:
+    enum MessageType
+    {
+        INVOCATION = 1,
+        STREAM_ITEM = 2,
+        COMPLETION = 3,
+        STREAM_INVOCATION = 4,
+        CANCEL_INVOCATION = 5,
+        PING = 6,
+        CLOSE = 7
+    };
+
+    SignalRMessage()
+        : type( PING )
+    {
+    }
+
+    // Builds an invocation from an RpcPacket request ("payload" holding
+    // "requestId", "hubMethod" and "arguments"), so the RpcProtocol.h
+    // builders can be used unchanged over SignalR.
+    static SignalRMessage fromRpcPacket( const json& in_packet );
+
+    MessageType type;
+    std::string invocationId; // Empty for non-blocking invocations.
+    std::string target;
+    json arguments;           // Invocation arguments.
+    json result;              // Completion result.
+    std::string error;        // Completion or close error.
+};
+
+
+class SignalRHubProtocol
+{
+public:
+    enum Format
+    {
+        JSON,
+        MESSAGEPACK
+    };
+
+    explicit SignalRHubProtocol( Format in_format );
+
+    Format getFormat() const
+    {
+        return mFormat;
+    }
+
+    // MessagePack frames are sent as binary websocket messages, JSON as text.
+    bool isBinary() const
+    {
+        return mFormat == MESSAGEPACK;
+    }
+
+    // The handshake request sent as the first text message of the connection.
+    std::string getHandshakeRequest() const;
+
+    // Parses the handshake response at the start of in_data and removes it.
+    // Returns false while the response is incomplete; out_error is set if the
+    // server rejected the handshake.
+    static bool parseHandshakeResponse( std::string& io_data, std::string& out_error );
+
+    // Appends one framed message to out_frame.
+    void encode( const SignalRMessage& in_message, std::string& out_frame ) const;
+
+    // Decodes every complete message of a received websocket message.
+    // Returns false if a message is malformed.
+    bool decode( const std::string& in_data, std::vector<SignalRMessage>& out_messages ) const;
+
+private:
+    void encodeJson( const SignalRMessage& in_message, std::string& out_frame ) const;
+    void encodeMessagePack( const SignalRMessage& in_message, std::string& out_frame ) const;
+    bool decodeJson( const json& in_json, SignalRMessage& out_message ) const;
+    bool decodeMessagePack( const json& in_array, SignalRMessage& out_message ) const;
+
+    Format mFormat;
+};
+
+
+// Negotiates a connection with the SignalR hub at in_hubUrl
+// (e.g. "https://{platform}/pushnotificationshub") and returns the token to
+// pass as the "id" query parameter of the websocket connection.
+bool negotiateSignalRConnection( const std::string& in_hubUrl, const std::string& in_bearerToken,
+    std::string& out_connectionToken );
+
+#endif /* SIGNALR_PROTOCOL_H_ */
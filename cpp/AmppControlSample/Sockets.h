@@ -16,6 +16,7 @@
 //      inspired on the websocketpp library samples.
 
 #include <iostream>
+#include <memory>
 #include <websocketpp/config/asio_client.hpp>
 #include <websocketpp/client.hpp>
 
@@ -28,10 +29,50 @@ using websocketpp::lib::bind;
 
 #include <nlohmann/json.hpp>
 
+#include "NotificationDispatcher.h"
+#include "RpcProtocol.h"
+#include "SignalRProtocol.h"
+
+// Wire protocol of a push notification connection.
+enum TransportProtocol
+{
+    TRANSPORT_BSON_RPC,           // "bson-rpc" sub-protocol of /pushnotifications-ws.
+    TRANSPORT_JSON_RPC,           // "json-rpc" sub-protocol of /pushnotifications-ws.
+    TRANSPORT_SIGNALR_JSON,       // SignalR JSON hub protocol of /pushnotificationshub.
+    TRANSPORT_SIGNALR_MESSAGEPACK // SignalR MessagePack hub protocol of /pushnotificationshub.
+};
+
 namespace
 {
-    const std::string SUB_PROTOCOL = "bson-rpc";
-    // const std::string SUB_PROTOCOL = "json-rpc";
+    const TransportProtocol DEFAULT_TRANSPORT = TRANSPORT_BSON_RPC;
+
+    // SignalR closes connections that have been silent for 30 seconds.
+    const long SIGNALR_KEEPALIVE_MS = 15000;
+
+    inline bool getTransportProtocol( const std::string& in_name, TransportProtocol& out_transport )
+    {
+        if ( in_name == "bson-rpc" )
+        {
+            out_transport = TRANSPORT_BSON_RPC;
+        }
+        else if ( in_name == "json-rpc" )
+        {
+            out_transport = TRANSPORT_JSON_RPC;
+        }
+        else if ( in_name == "signalr-json" )
+        {
+            out_transport = TRANSPORT_SIGNALR_JSON;
+        }
+        else if ( in_name == "signalr-messagepack" )
+        {
+            out_transport = TRANSPORT_SIGNALR_MESSAGEPACK;
+        }
+        else
+        {
+            return false;
+        }
+        return true;
+    }
 }
 
 // for convenience
@@ -42,13 +83,22 @@ class connection_metadata
 public:
     typedef websocketpp::lib::shared_ptr<connection_metadata> ptr;
 
-    connection_metadata( int id, websocketpp::connection_hdl hdl, std::string uri )
+    connection_metadata( int id, websocketpp::connection_hdl hdl, std::string uri, TransportProtocol transport,
+        NotificationDispatcher* dispatcher )
         : m_id( id )
         , m_hdl( hdl )
         , m_status( "Connecting" )
         , m_uri( uri )
         , m_server( "N/A" )
+        , m_transport( transport )
+        , m_handshake_done( false )
+        , m_dispatcher( dispatcher )
     {
+        if ( transport == TRANSPORT_SIGNALR_JSON || transport == TRANSPORT_SIGNALR_MESSAGEPACK )
+        {
+            m_signalr.reset( new SignalRHubProtocol( transport == TRANSPORT_SIGNALR_JSON ?
+                SignalRHubProtocol::JSON : SignalRHubProtocol::MESSAGEPACK ) );
+        }
     }
 
     void on_open( client* c, websocketpp::connection_hdl hdl )
@@ -57,6 +107,18 @@ public:
 
         client::connection_ptr con = c->get_con_from_hdl( hdl );
         m_server = con->get_response_header( "Server" );
+
+        if ( m_signalr )
+        {
+            // Invocations sent before the handshake response arrives are
+            // buffered by the server, nothing needs to wait here.
+            websocketpp::lib::error_code ec;
+            c->send( hdl, m_signalr->getHandshakeRequest(), websocketpp::frame::opcode::text, ec );
+            if ( ec )
+            {
+                std::cout << "> Error sending SignalR handshake: " << ec.message() << std::endl;
+            }
+        }
     }
 
     void on_fail( client* c, websocketpp::connection_hdl hdl )
@@ -81,27 +143,43 @@ public:
 
     void on_message( websocketpp::connection_hdl, client::message_ptr msg )
     {
-        if ( msg->get_opcode() == websocketpp::frame::opcode::text )
+        if ( m_signalr )
         {
-            std::cout << "Receiving TEXT message:" << std::endl;
-            std::cout << msg->get_payload() << std::endl;
+            on_signalr_message( msg->get_payload() );
+            return;
+        }
 
-            m_messages.push_back( "<< " + msg->get_payload() );
+        json j;
+        try
+        {
+            if ( msg->get_opcode() == websocketpp::frame::opcode::text )
+            {
+                j = json::parse( msg->get_payload() );
+            }
+            else
+            {
+                const std::string& rawString = msg->get_raw_payload();
+                j = json::from_bson( rawString.begin(), rawString.end() );
+            }
         }
-        else
+        catch ( json::exception& e )
         {
-            std::cout << "Receiving BINARY message." << std::endl;
-            m_messages.push_back( "<< " + websocketpp::utility::to_hex( msg->get_payload() ) );
-            std::string rawString = msg->get_raw_payload();
-            // Transfer to a std::vector:
-            std::vector<uint8_t> binaryBuffer( rawString.begin(), rawString.end() );
-            json j_from_bson = json::from_bson( binaryBuffer );
-
-            std::cout << "*** From BSON to JSON: ***" << std::endl;
-            std::cout << j_from_bson.dump() << std::endl;
-            std::cout << "***************************" << std::endl;
+            std::cout << "Could not decode message: " << e.what() << std::endl;
+            return;
+        }
 
+        // Notifications are only queued here; their handlers run on the
+        // dispatcher's thread pool so a slow handler never stalls this io thread.
+        if ( dispatch_notifications( j ) )
+        {
+            return;
         }
+
+        std::cout << "Receiving " << ( msg->get_opcode() == websocketpp::frame::opcode::text ? "TEXT" : "BINARY" )
+            << " message:" << std::endl;
+        std::cout << j.dump() << std::endl;
+
+        m_messages.push_back( "<< " + j.dump() );
     }
 
     websocketpp::connection_hdl get_hdl() const
@@ -119,12 +197,136 @@ public:
         return m_status;
     }
 
+    TransportProtocol get_transport() const
+    {
+        return m_transport;
+    }
+
+    // Null unless this is a SignalR connection.
+    const SignalRHubProtocol* get_signalr() const
+    {
+        return m_signalr.get();
+    }
+
+    void set_keepalive_timer( client::timer_ptr timer )
+    {
+        m_keepalive_timer = timer;
+    }
+
+    client::timer_ptr get_keepalive_timer() const
+    {
+        return m_keepalive_timer;
+    }
+
     void record_sent_message( std::string message )
     {
         m_messages.push_back( ">> " + message );
     }
 
 private:
+    void on_signalr_message( std::string data )
+    {
+        if ( !m_handshake_done )
+        {
+            // The handshake response is always a JSON record, possibly
+            // followed by the first hub messages in the same frame.
+            m_handshake_buffer += data;
+            std::string error;
+            if ( !SignalRHubProtocol::parseHandshakeResponse( m_handshake_buffer, error ) )
+            {
+                return;
+            }
+            if ( !error.empty() )
+            {
+                std::cout << "> SignalR handshake failed: " << error << std::endl;
+                m_error_reason = error;
+                return;
+            }
+            m_handshake_done = true;
+            data.swap( m_handshake_buffer );
+            m_handshake_buffer.clear();
+        }
+
+        std::vector<SignalRMessage> messages;
+        if ( !m_signalr->decode( data, messages ) )
+        {
+            std::cout << "Could not decode SignalR message" << std::endl;
+        }
+
+        for ( size_t i = 0; i < messages.size(); ++i )
+        {
+            const SignalRMessage& message = messages[ i ];
+            if ( message.type == SignalRMessage::PING )
+            {
+                continue;
+            }
+            if ( message.type == SignalRMessage::INVOCATION && message.target == "ReceiveNotification" )
+            {
+                for ( json::const_iterator it = message.arguments.begin(); it != message.arguments.end(); ++it )
+                {
+                    ReceivedNotificationModel notification;
+                    if ( notification.setFromJson( *it ) )
+                    {
+                        m_dispatcher->post( std::move( notification ) );
+                    }
+                }
+                continue;
+            }
+
+            json j;
+            j[ "type" ] = static_cast<int>( message.type );
+            j[ "invocationId" ] = message.invocationId;
+            if ( !message.target.empty() )
+            {
+                j[ "target" ] = message.target;
+            }
+            if ( !message.result.is_null() )
+            {
+                j[ "result" ] = message.result;
+            }
+            if ( !message.error.empty() )
+            {
+                j[ "error" ] = message.error;
+            }
+
+            std::cout << "Receiving SignalR message:" << std::endl;
+            std::cout << j.dump() << std::endl;
+
+            m_messages.push_back( "<< " + j.dump() );
+        }
+    }
+
+    // Posts the notifications carried by a "ReceiveNotification" RpcRequest to
+    // the dispatcher. Returns false for any other packet.
+    bool dispatch_notifications( json& j )
+    {
+        json::iterator payload = j.find( "Payload" );
+        if ( payload == j.end() || !payload->is_object() )
+        {
+            return false;
+        }
+        json::const_iterator hubMethod = payload->find( "HubMethod" );
+        if ( hubMethod == payload->end() || *hubMethod != "ReceiveNotification" )
+        {
+            return false;
+        }
+
+        json::iterator arguments = payload->find( "Arguments" );
+        if ( arguments != payload->end() && arguments->is_array() )
+        {
+            for ( json::iterator it = arguments->begin(); it != arguments->end(); ++it )
+            {
+                // The binary content moves from the decoded BSON to the handler without a copy.
+                ReceivedNotificationModel notification;
+                if ( notification.setFromJson( std::move( *it ) ) )
+                {
+                    m_dispatcher->post( std::move( notification ) );
+                }
+            }
+        }
+        return true;
+    }
+
     int m_id;
     websocketpp::connection_hdl m_hdl;
     std::string m_status;
@@ -132,6 +334,12 @@ private:
     std::string m_server;
     std::string m_error_reason;
     std::vector<std::string> m_messages;
+    TransportProtocol m_transport;
+    std::unique_ptr<SignalRHubProtocol> m_signalr;
+    bool m_handshake_done;
+    std::string m_handshake_buffer;
+    client::timer_ptr m_keepalive_timer;
+    NotificationDispatcher* m_dispatcher;
 };
 
 
@@ -162,6 +370,23 @@ public:
     {
         m_endpoint.stop_perpetual();
 
+        // Pending keepalive timers would keep the io thread running.
+        for ( con_list::const_iterator it = m_connection_list.begin(); it != m_connection_list.end(); ++it )
+        {
+            if ( it->second->get_signalr() )
+            {
+                connection_metadata::ptr metadata = it->second;
+                m_endpoint.get_io_service().post( [metadata]()
+                {
+                    client::timer_ptr timer = metadata->get_keepalive_timer();
+                    if ( timer )
+                    {
+                        timer->cancel();
+                    }
+                } );
+            }
+        }
+
         for ( con_list::const_iterator it = m_connection_list.begin(); it != m_connection_list.end(); ++it )
         {
             if ( it->second->get_status() != "Open" )
@@ -237,7 +462,9 @@ public:
 
 
 
-    int connect( std::string const& uri )
+    // For the SignalR transports, uri must carry the connection token
+    // returned by negotiateSignalRConnection() in its "id" query parameter.
+    int connect( std::string const& uri, TransportProtocol transport = DEFAULT_TRANSPORT )
     {
         websocketpp::lib::error_code ec;
 
@@ -250,7 +477,8 @@ public:
         }
 
         int new_id = m_next_id++;
-        connection_metadata::ptr metadata_ptr = websocketpp::lib::make_shared<connection_metadata>( new_id, con->get_handle(), uri );
+        connection_metadata::ptr metadata_ptr = websocketpp::lib::make_shared<connection_metadata>( new_id, con->get_handle(), uri,
+            transport, &m_dispatcher );
         m_connection_list[ new_id ] = metadata_ptr;
 
         con->set_open_handler( websocketpp::lib::bind(
@@ -278,10 +506,25 @@ public:
             websocketpp::lib::placeholders::_2
         ) );
 
-        con->add_subprotocol( SUB_PROTOCOL );
+        if ( transport == TRANSPORT_BSON_RPC )
+        {
+            con->add_subprotocol( "bson-rpc" );
+        }
+        else if ( transport == TRANSPORT_JSON_RPC )
+        {
+            con->add_subprotocol( "json-rpc" );
+        }
 
         m_endpoint.connect( con );
 
+        if ( metadata_ptr->get_signalr() )
+        {
+            m_endpoint.get_io_service().post( [this, metadata_ptr]()
+            {
+                schedule_keepalive( metadata_ptr );
+            } );
+        }
+
         return new_id;
     }
 
@@ -305,8 +548,20 @@ public:
 
     void send( int id, std::string message )
     {
-        websocketpp::lib::error_code ec;
+        con_list::iterator metadata_it = m_connection_list.find( id );
+        if ( metadata_it == m_connection_list.end() )
+        {
+            std::cout << "> No connection found with id " << id << std::endl;
+            return;
+        }
 
+        send_message( metadata_it->second, message );
+    }
+
+    // Sends several messages on a connection, looked up once. Stops at the
+    // first error.
+    void send( int id, const std::vector<std::string>& messages )
+    {
         con_list::iterator metadata_it = m_connection_list.find( id );
         if ( metadata_it == m_connection_list.end() )
         {
@@ -314,50 +569,108 @@ public:
             return;
         }
 
+        for ( size_t i = 0; i < messages.size(); ++i )
+        {
+            if ( !send_message( metadata_it->second, messages[ i ] ) )
+            {
+                return;
+            }
+        }
+    }
+
+
+    connection_metadata::ptr get_metadata( int id ) const
+    {
+        con_list::const_iterator metadata_it = m_connection_list.find( id );
+        if ( metadata_it == m_connection_list.end() )
+        {
+            return connection_metadata::ptr();
+        }
+        else
+        {
+            return metadata_it->second;
+        }
+    }
+
+    // The io_service of the endpoint's thread, on which other asio based
+    // clients (e.g. AsyncRestClient) can run.
+    websocketpp::lib::asio::io_service& get_io_service()
+    {
+        return m_endpoint.get_io_service();
+    }
 
+    // The dispatcher running the notification handlers of every connection
+    // of this endpoint.
+    NotificationDispatcher& get_dispatcher()
+    {
+        return m_dispatcher;
+    }
+private:
+    typedef std::map<int, connection_metadata::ptr> con_list;
+
+    bool send_message( connection_metadata::ptr metadata, const std::string& message )
+    {
+        websocketpp::lib::error_code ec;
 
-        if ( SUB_PROTOCOL == "bson-rpc" )
+        const SignalRHubProtocol* signalr = metadata->get_signalr();
+        if ( signalr )
+        {
+            // RpcPacket requests map one to one onto hub invocations.
+            std::string frame;
+            signalr->encode( SignalRMessage::fromRpcPacket( json::parse( message ) ), frame );
+            m_endpoint.send( metadata->get_hdl(), frame,
+                signalr->isBinary() ? websocketpp::frame::opcode::binary : websocketpp::frame::opcode::text, ec );
+        }
+        else if ( metadata->get_transport() == TRANSPORT_BSON_RPC )
         {
             // serialize to BSON
-            std::vector<uint8_t> binaryBuffer( message.begin(), message.end() );
-
             json messageJson = json::parse( message );
             std::vector<std::uint8_t> v_bson = json::to_bson( messageJson );
-            m_endpoint.send( metadata_it->second->get_hdl(),
+            m_endpoint.send( metadata->get_hdl(),
                 static_cast< void const* >( v_bson.data() ), v_bson.size(),
                 websocketpp::frame::opcode::binary, ec );
 
         }
         else // "json-rpc"
         {
-            // Use the following instead if in "json" sub-protocol
-            m_endpoint.send( metadata_it->second->get_hdl(), message, websocketpp::frame::opcode::text, ec );
+            m_endpoint.send( metadata->get_hdl(), message, websocketpp::frame::opcode::text, ec );
         }
         if ( ec )
         {
             std::cout << "> Error sending message: " << ec.message() << std::endl;
-            return;
+            return false;
         }
 
-        metadata_it->second->record_sent_message( message );
+        metadata->record_sent_message( message );
+        return true;
     }
 
-
-    connection_metadata::ptr get_metadata( int id ) const
+    // Sends a SignalR ping every SIGNALR_KEEPALIVE_MS while the connection is
+    // connecting or open. Runs on the io thread.
+    void schedule_keepalive( connection_metadata::ptr metadata )
     {
-        con_list::const_iterator metadata_it = m_connection_list.find( id );
-        if ( metadata_it == m_connection_list.end() )
+        metadata->set_keepalive_timer( m_endpoint.set_timer( SIGNALR_KEEPALIVE_MS,
+            [this, metadata]( websocketpp::lib::error_code const& ec )
         {
-            return connection_metadata::ptr();
-        }
-        else
-        {
-            return metadata_it->second;
-        }
+            if ( ec || ( metadata->get_status() != "Connecting" && metadata->get_status() != "Open" ) )
+            {
+                return;
+            }
+            if ( metadata->get_status() == "Open" )
+            {
+                std::string frame;
+                metadata->get_signalr()->encode( SignalRMessage(), frame );
+
+                websocketpp::lib::error_code sendError;
+                m_endpoint.send( metadata->get_hdl(), frame, metadata->get_signalr()->isBinary() ?
+                    websocketpp::frame::opcode::binary : websocketpp::frame::opcode::text, sendError );
+            }
+            schedule_keepalive( metadata );
+        } ) );
     }
-private:
-    typedef std::map<int, connection_metadata::ptr> con_list;
 
+    // Declared first so that it outlives the io thread posting to it.
+    NotificationDispatcher m_dispatcher;
     client m_endpoint;
     websocketpp::lib::shared_ptr<websocketpp::lib::thread> m_thread;
 
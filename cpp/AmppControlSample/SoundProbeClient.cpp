@@ -0,0 +1,582 @@
+//
+// Copyright Grass Valley
+//
+
+#include "SoundProbeClient.h"
+#include "PushNotificationServer.h"
+#include "Util.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+const size_t SoundProbeClient::MAX_CHANNELS;
+
+namespace
+{
+    const char* const TOPIC_PREFIX = "gv.ampp.audiometer.";
+
+    // Powers of ten exactly represented by a double.
+    const double POWERS_OF_TEN[] =
+    {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    const int MAX_EXACT_POWER = 22;
+
+    // A mantissa of up to 19 digits fits in a uint64_t.
+    const int MAX_MANTISSA_DIGITS = 19;
+
+    bool isDigit( char c )
+    {
+        return c >= '0' && c <= '9';
+    }
+
+    // Whether the eight characters of a chunk are all digits, tested at once
+    // (SWAR: the chunk is handled as eight lanes of a 64-bit register).
+    bool isEightDigits( uint64_t in_chunk )
+    {
+        return ( ( in_chunk & 0xF0F0F0F0F0F0F0F0ULL )
+            | ( ( ( in_chunk + 0x0606060606060606ULL ) & 0xF0F0F0F0F0F0F0F0ULL ) >> 4 ) ) == 0x3333333333333333ULL;
+    }
+
+    // The value of eight digits loaded from memory on a little-endian host:
+    // the digits are combined in pairs, then fours, then all eight, with three
+    // multiplications instead of eight.
+    uint32_t parseEightDigits( uint64_t in_chunk )
+    {
+        const uint64_t mask = 0x000000FF000000FFULL;
+        const uint64_t multiplier1 = 100 + ( 1000000ULL << 32 );
+        const uint64_t multiplier2 = 1 + ( 10000ULL << 32 );
+        in_chunk -= 0x3030303030303030ULL;
+        in_chunk = ( in_chunk * 10 ) + ( in_chunk >> 8 );
+        in_chunk = ( ( ( in_chunk & mask ) * multiplier1 ) + ( ( ( in_chunk >> 16 ) & mask ) * multiplier2 ) ) >> 32;
+        return static_cast<uint32_t>( in_chunk );
+    }
+
+    // Accumulates a run of digits into io_mantissa and returns their count.
+    int readDigits( const char*& io_position, const char* in_end, uint64_t& io_mantissa )
+    {
+        const char* start = io_position;
+#if !defined( __BYTE_ORDER__ ) || __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        while ( in_end - io_position >= 8 )
+        {
+            uint64_t chunk;
+            memcpy( &chunk, io_position, sizeof( chunk ) );
+            if ( !isEightDigits( chunk ) )
+            {
+                break;
+            }
+            io_mantissa = io_mantissa * 100000000 + parseEightDigits( chunk );
+            io_position += 8;
+        }
+#endif
+        while ( io_position < in_end && isDigit( *io_position ) )
+        {
+            io_mantissa = io_mantissa * 10 + static_cast<uint64_t>( *io_position - '0' );
+            ++io_position;
+        }
+        return static_cast<int>( io_position - start );
+    }
+
+    // Parses a JSON number. Numbers whose mantissa or exponent is too large
+    // to be computed exactly fall back to strtod.
+    bool readNumber( const char*& io_position, const char* in_end, double& out_value )
+    {
+        const char* start = io_position;
+        const char* p = io_position;
+        bool negative = ( p < in_end && *p == '-' );
+        if ( negative )
+        {
+            ++p;
+        }
+
+        uint64_t mantissa = 0;
+        int digits = readDigits( p, in_end, mantissa );
+        if ( digits == 0 )
+        {
+            return false;
+        }
+
+        int exponent = 0;
+        if ( p < in_end && *p == '.' )
+        {
+            ++p;
+            int fractionDigits = readDigits( p, in_end, mantissa );
+            if ( fractionDigits == 0 )
+            {
+                return false;
+            }
+            digits += fractionDigits;
+            exponent = -fractionDigits;
+        }
+
+        if ( p < in_end && ( *p == 'e' || *p == 'E' ) )
+        {
+            ++p;
+            bool negativeExponent = ( p < in_end && *p == '-' );
+            if ( p < in_end && ( *p == '-' || *p == '+' ) )
+            {
+                ++p;
+            }
+            int explicitExponent = 0;
+            const char* exponentStart = p;
+            while ( p < in_end && isDigit( *p ) && p - exponentStart < 4 )
+            {
+                explicitExponent = explicitExponent * 10 + ( *p - '0' );
+                ++p;
+            }
+            if ( p == exponentStart || ( p < in_end && isDigit( *p ) ) )
+            {
+                return false;
+            }
+            exponent += negativeExponent ? -explicitExponent : explicitExponent;
+        }
+
+        if ( digits > MAX_MANTISSA_DIGITS || exponent < -MAX_EXACT_POWER || exponent > MAX_EXACT_POWER )
+        {
+            char buffer[ 64 ];
+            size_t length = static_cast<size_t>( p - start );
+            if ( length >= sizeof( buffer ) )
+            {
+                return false;
+            }
+            memcpy( buffer, start, length );
+            buffer[ length ] = '\0';
+            out_value = strtod( buffer, NULL );
+        }
+        else
+        {
+            double value = static_cast<double>( mantissa );
+            value = ( exponent < 0 ) ? value / POWERS_OF_TEN[ -exponent ] : value * POWERS_OF_TEN[ exponent ];
+            out_value = negative ? -value : value;
+        }
+        io_position = p;
+        return true;
+    }
+
+    void skipWhitespace( const char*& io_position, const char* in_end )
+    {
+        while ( io_position < in_end && ( *io_position == ' ' || *io_position == '\t' || *io_position == '\n' || *io_position == '\r' ) )
+        {
+            ++io_position;
+        }
+    }
+
+    bool consume( const char*& io_position, const char* in_end, char in_expected )
+    {
+        skipWhitespace( io_position, in_end );
+        if ( io_position < in_end && *io_position == in_expected )
+        {
+            ++io_position;
+            return true;
+        }
+        return false;
+    }
+
+    bool consumeLiteral( const char*& io_position, const char* in_end, const char* in_literal )
+    {
+        size_t length = strlen( in_literal );
+        if ( static_cast<size_t>( in_end - io_position ) < length || memcmp( io_position, in_literal, length ) != 0 )
+        {
+            return false;
+        }
+        io_position += length;
+        return true;
+    }
+
+    // Moves past a string, io_position on its opening quote.
+    bool skipString( const char*& io_position, const char* in_end )
+    {
+        for ( ++io_position; io_position < in_end; ++io_position )
+        {
+            if ( *io_position == '\\' )
+            {
+                ++io_position;
+            }
+            else if ( *io_position == '"' )
+            {
+                ++io_position;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Moves past a value of any type, without validating its contents.
+    bool skipValue( const char*& io_position, const char* in_end )
+    {
+        skipWhitespace( io_position, in_end );
+        int depth = 0;
+        while ( io_position < in_end )
+        {
+            char c = *io_position;
+            if ( c == '"' )
+            {
+                if ( !skipString( io_position, in_end ) )
+                {
+                    return false;
+                }
+                if ( depth == 0 )
+                {
+                    return true;
+                }
+                continue;
+            }
+            if ( c == '{' || c == '[' )
+            {
+                ++depth;
+            }
+            else if ( c == '}' || c == ']' )
+            {
+                if ( depth == 0 )
+                {
+                    return true;
+                }
+                if ( --depth == 0 )
+                {
+                    ++io_position;
+                    return true;
+                }
+            }
+            else if ( c == ',' && depth == 0 )
+            {
+                return true;
+            }
+            ++io_position;
+        }
+        return depth == 0;
+    }
+
+    // Reads an array of numbers (or nulls) into out_values, keeping the first
+    // MAX_CHANNELS.
+    bool readMeterArray( const char*& io_position, const char* in_end, float* out_values, uint32_t& out_count,
+        uint64_t& io_dropped )
+    {
+        out_count = 0;
+        if ( !consume( io_position, in_end, '[' ) )
+        {
+            return false;
+        }
+        if ( consume( io_position, in_end, ']' ) )
+        {
+            return true;
+        }
+        do
+        {
+            skipWhitespace( io_position, in_end );
+            float value;
+            if ( consumeLiteral( io_position, in_end, "null" ) )
+            {
+                value = std::numeric_limits<float>::quiet_NaN();
+            }
+            else
+            {
+                double number;
+                if ( !readNumber( io_position, in_end, number ) )
+                {
+                    return false;
+                }
+                value = static_cast<float>( number );
+            }
+
+            if ( out_count < SoundProbeClient::MAX_CHANNELS )
+            {
+                out_values[ out_count++ ] = value;
+            }
+            else
+            {
+                ++io_dropped;
+            }
+        }
+        while ( consume( io_position, in_end, ',' ) );
+        return consume( io_position, in_end, ']' );
+    }
+}
+
+//********************************************************************************
+// SoundProbeClient::MeterBuffer
+//********************************************************************************
+
+SoundProbeClient::MeterBuffer::MeterBuffer()
+    : mSequence( 0 )
+{
+    memset( &mMeters, 0, sizeof( mMeters ) );
+}
+
+uint64_t SoundProbeClient::MeterBuffer::read( Meters& out_meters ) const
+{
+    for ( ;; )
+    {
+        uint64_t before = mSequence.load( std::memory_order_acquire );
+        if ( before == 0 )
+        {
+            return 0;
+        }
+        if ( ( before & 1 ) != 0 )
+        {
+            // Being written: the writer only copies a few hundred bytes.
+            continue;
+        }
+
+        memcpy( &out_meters, &mMeters, sizeof( out_meters ) );
+        std::atomic_thread_fence( std::memory_order_acquire );
+        if ( mSequence.load( std::memory_order_relaxed ) == before )
+        {
+            return before / 2;
+        }
+    }
+}
+
+void SoundProbeClient::MeterBuffer::write( const Meters& in_meters )
+{
+    uint64_t sequence = mSequence.load( std::memory_order_relaxed );
+    mSequence.store( sequence + 1, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_release );
+
+    memcpy( &mMeters, &in_meters, sizeof( mMeters ) );
+
+    mSequence.store( sequence + 2, std::memory_order_release );
+}
+
+//********************************************************************************
+// SoundProbeClient
+//********************************************************************************
+
+SoundProbeClient::SoundProbeClient( websocket_endpoint& in_endpoint, int in_connectionId, RenewalScheduler& in_scheduler,
+    const Options& in_options )
+    : mEndpoint( in_endpoint )
+    , mConnectionId( in_connectionId )
+    , mScheduler( in_scheduler )
+    , mOptions( in_options )
+    , mCatalog( std::make_shared<Catalog>() )
+    , mRunning( false )
+    , mReceived( 0 )
+    , mRejected( 0 )
+    , mDroppedChannels( 0 )
+    , mTotalDecodeNs( 0 )
+{
+}
+
+SoundProbeClient::~SoundProbeClient()
+{
+    stop();
+}
+
+std::string SoundProbeClient::addProbe( const std::string& in_nodeId, const std::string& in_flowId,
+    const json& in_descriptor )
+{
+    ProbePtr probe = std::make_shared<Probe>();
+    probe->id = getUuid();
+    probe->nodeId = in_nodeId;
+    probe->flowId = in_flowId;
+    probe->descriptor = in_descriptor;
+    probe->meters = std::make_shared<MeterBuffer>();
+    memset( &probe->decoded, 0, sizeof( probe->decoded ) );
+    probe->renewal = 0;
+
+    std::string topic = getTopic( probe->id );
+    {
+        std::lock_guard<std::mutex> lock( mCatalogMutex );
+        std::shared_ptr<Catalog> catalog = std::make_shared<Catalog>( *std::atomic_load( &mCatalog ) );
+        ( *catalog )[ topic ] = probe;
+        std::atomic_store( &mCatalog, std::shared_ptr<const Catalog>( catalog ) );
+    }
+
+    std::lock_guard<std::mutex> lock( mMutex );
+    if ( mRunning )
+    {
+        pushNotificationServerSubscribe( mEndpoint, mConnectionId, getUuid(), topic );
+        registerProbe( *probe );
+    }
+    return probe->id;
+}
+
+void SoundProbeClient::start()
+{
+    std::lock_guard<std::mutex> lock( mMutex );
+    if ( mRunning )
+    {
+        return;
+    }
+
+    std::shared_ptr<const Catalog> catalog = std::atomic_load( &mCatalog );
+    for ( Catalog::const_iterator it = catalog->begin(); it != catalog->end(); ++it )
+    {
+        pushNotificationServerSubscribe( mEndpoint, mConnectionId, getUuid(), it->first );
+        registerProbe( *it->second );
+    }
+
+    mRunning = true;
+}
+
+void SoundProbeClient::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock( mMutex );
+        if ( !mRunning )
+        {
+            return;
+        }
+        mRunning = false;
+
+        std::shared_ptr<const Catalog> catalog = std::atomic_load( &mCatalog );
+        for ( Catalog::const_iterator it = catalog->begin(); it != catalog->end(); ++it )
+        {
+            mScheduler.cancel( it->second->renewal );
+            it->second->renewal = 0;
+        }
+    }
+
+    std::shared_ptr<const Catalog> catalog = std::atomic_load( &mCatalog );
+    for ( Catalog::const_iterator it = catalog->begin(); it != catalog->end(); ++it )
+    {
+        pushNotificationServerUnsubscribe( mEndpoint, mConnectionId, getUuid(), it->first );
+    }
+}
+
+void SoundProbeClient::onNotification( const ReceivedNotificationModel& in_notification )
+{
+    std::shared_ptr<const Catalog> catalog = std::atomic_load( &mCatalog );
+    Catalog::const_iterator it = catalog->find( in_notification.getTopic() );
+    if ( it == catalog->end() )
+    {
+        return;
+    }
+
+    Probe& probe = *it->second;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint64_t droppedChannels = 0;
+    if ( !decodeMeters( in_notification.getContent(), probe.decoded, droppedChannels ) )
+    {
+        ++mRejected;
+        return;
+    }
+    probe.meters->write( probe.decoded );
+
+    ++mReceived;
+    mDroppedChannels += droppedChannels;
+    mTotalDecodeNs += std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start ).count();
+}
+
+SoundProbeClient::MeterBufferPtr SoundProbeClient::getMeters( const std::string& in_probeId ) const
+{
+    std::shared_ptr<const Catalog> catalog = std::atomic_load( &mCatalog );
+    Catalog::const_iterator it = catalog->find( getTopic( in_probeId ) );
+    return ( it != catalog->end() ) ? it->second->meters : MeterBufferPtr();
+}
+
+SoundProbeClient::Stats SoundProbeClient::getStats() const
+{
+    Stats stats;
+    stats.received = mReceived.load();
+    stats.rejected = mRejected.load();
+    stats.droppedChannels = mDroppedChannels.load();
+    stats.averageDecodeUs = stats.received > 0 ? mTotalDecodeNs.load() / 1000.0 / stats.received : 0;
+    return stats;
+}
+
+std::string SoundProbeClient::getTopic( const std::string& in_probeId )
+{
+    return TOPIC_PREFIX + in_probeId;
+}
+
+bool SoundProbeClient::decodeMeters( const std::string& in_content, Meters& out_meters, uint64_t& out_droppedChannels )
+{
+    const char* position = in_content.data();
+    const char* end = position + in_content.size();
+    if ( !consume( position, end, '{' ) )
+    {
+        return false;
+    }
+
+    bool foundRms = false;
+    bool foundPeak = false;
+    out_meters.updateTimeMs = 0;
+    out_meters.rmsCount = 0;
+    out_meters.peakCount = 0;
+    if ( consume( position, end, '}' ) )
+    {
+        return false;
+    }
+    do
+    {
+        skipWhitespace( position, end );
+        if ( position == end || *position != '"' )
+        {
+            return false;
+        }
+        const char* name = position + 1;
+        if ( !skipString( position, end ) )
+        {
+            return false;
+        }
+        size_t nameLength = static_cast<size_t>( position - name - 1 );
+        if ( !consume( position, end, ':' ) )
+        {
+            return false;
+        }
+        skipWhitespace( position, end );
+
+        if ( nameLength == 3 && memcmp( name, "rms", 3 ) == 0 )
+        {
+            foundRms = readMeterArray( position, end, out_meters.rms, out_meters.rmsCount, out_droppedChannels );
+            if ( !foundRms )
+            {
+                return false;
+            }
+        }
+        else if ( nameLength == 4 && memcmp( name, "peak", 4 ) == 0 )
+        {
+            foundPeak = readMeterArray( position, end, out_meters.peak, out_meters.peakCount, out_droppedChannels );
+            if ( !foundPeak )
+            {
+                return false;
+            }
+        }
+        else if ( nameLength == 12 && memcmp( name, "updateTimeMs", 12 ) == 0 && position < end && *position != 'n' )
+        {
+            if ( !readNumber( position, end, out_meters.updateTimeMs ) )
+            {
+                return false;
+            }
+        }
+        else if ( !skipValue( position, end ) )
+        {
+            return false;
+        }
+    }
+    while ( consume( position, end, ',' ) );
+
+    return consume( position, end, '}' ) && foundRms && foundPeak;
+}
+
+void SoundProbeClient::registerProbe( Probe& io_probe )
+{
+    json flow;
+    flow[ "id" ] = io_probe.flowId;
+    flow[ "dataType" ] = "Snd";
+    flow[ "descriptor" ] = io_probe.descriptor;
+
+    json soundProbe;
+    soundProbe[ "id" ] = io_probe.id;
+    soundProbe[ "flow" ] = flow;
+    soundProbe[ "peak" ] = true;
+    soundProbe[ "rms" ] = true;
+    soundProbe[ "type" ] = "sound";
+    soundProbe[ "rmsWindowPeriodMs" ] = mOptions.rmsWindowPeriodMs;
+    soundProbe[ "updatePeriodMs" ] = mOptions.updatePeriodMs;
+
+    json subscription;
+    subscription[ "clientId" ] = mOptions.clientId;
+    subscription[ "flowId" ] = io_probe.flowId;
+    subscription[ "probeId" ] = io_probe.id;
+    subscription[ "probeObject" ] = soundProbe.dump();
+    subscription[ "probeType" ] = "sound";
+
+    std::string topic = "gv.ampp.audiometerprobe." + io_probe.nodeId;
+    std::string content = subscription.dump();
+    pushNotificationServerSendNotification( mEndpoint, mConnectionId, getUuid(), topic, content );
+    io_probe.renewal = mScheduler.schedule( mConnectionId, topic, content );
+}
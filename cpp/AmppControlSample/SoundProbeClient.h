@@ -0,0 +1,160 @@
+//
+// Copyright Grass Valley
+//
+
+#ifndef SOUND_PROBE_CLIENT_H_
+#define SOUND_PROBE_CLIENT_H_
+
+#include "RenewalScheduler.h"
+#include "RpcProtocol.h"
+#include "Sockets.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Receives the audio meters of sound flows, as the SoundProbeClient of the
+// TypeScript SDK.
+//
+// A probe is registered on the node of a flow ("gv.ampp.audiometerprobe.<node>")
+// at start, then renewed by a RenewalScheduler, and its meters are received on
+// "gv.ampp.audiometer.<probe>" as { "updateTimeMs": ..., "rms": [...],
+// "peak": [...] }. The rms and peak arrays are parsed straight into the float
+// arrays of a Meters (eight digits at a time, see SoundProbeClient.cpp), up to
+// MAX_CHANNELS channels; null values are read as NaN.
+//
+// The latest meters of each probe are published in a MeterBuffer, a seqlock
+// with a single writer (the notifications of a probe are handled one at a
+// time, on their dispatcher lane) and any number of readers: reading takes no
+// lock and allocates nothing, so a meter bridge can read every probe on each
+// frame it draws.
+class SoundProbeClient
+{
+public:
+    static const size_t MAX_CHANNELS = 64;
+
+    struct Options
+    {
+        Options()
+            : clientId( "SDKDemoClient" )
+            , rmsWindowPeriodMs( 250 )
+            , updatePeriodMs( 1000 )
+        {
+        }
+
+        std::string clientId;
+        unsigned int rmsWindowPeriodMs;
+        unsigned int updatePeriodMs;
+    };
+
+    // The meters of one update, one array per meter (structure of arrays).
+    struct Meters
+    {
+        double updateTimeMs;
+        uint32_t rmsCount;
+        uint32_t peakCount;
+        float rms[ MAX_CHANNELS ];
+        float peak[ MAX_CHANNELS ];
+    };
+
+    // Latest meters of a probe.
+    class MeterBuffer
+    {
+    public:
+        MeterBuffer();
+
+        // Copies the latest meters and returns their update number, 0 (and
+        // nothing copied) before the first update.
+        uint64_t read( Meters& out_meters ) const;
+
+    private:
+        friend class SoundProbeClient;
+
+        // Only called by one thread at a time.
+        void write( const Meters& in_meters );
+
+        std::atomic<uint64_t> mSequence; // Odd while written, twice the update number.
+        Meters mMeters;
+    };
+    typedef std::shared_ptr<const MeterBuffer> MeterBufferPtr;
+
+    struct Stats
+    {
+        uint64_t received;
+        uint64_t rejected; // Not a meters content.
+        uint64_t droppedChannels; // Beyond MAX_CHANNELS.
+        double averageDecodeUs;
+    };
+
+    // The probes are renewed by in_scheduler, which must outlive the client.
+    SoundProbeClient( websocket_endpoint& in_endpoint, int in_connectionId, RenewalScheduler& in_scheduler,
+        const Options& in_options = Options() );
+
+    // Unsubscribes and stops renewing the probes.
+    ~SoundProbeClient();
+
+    // Adds a probe of a sound flow of a node and returns its id. The flow
+    // descriptor, if any, is passed on to the node. Probes added once started
+    // are registered at once.
+    std::string addProbe( const std::string& in_nodeId, const std::string& in_flowId,
+        const json& in_descriptor = json() );
+
+    // Subscribes to every probe, registers them and schedules their renewals.
+    void start();
+
+    void stop();
+
+    // Publishes the meters of a notification. Other notifications are ignored.
+    void onNotification( const ReceivedNotificationModel& in_notification );
+
+    // The buffer of a probe, to be kept by its readers; null if the probe was
+    // not added.
+    MeterBufferPtr getMeters( const std::string& in_probeId ) const;
+
+    Stats getStats() const;
+
+    static std::string getTopic( const std::string& in_probeId );
+
+    // Reads a meters content. Returns false if it is not a JSON object with
+    // numeric (or null) rms and peak arrays.
+    static bool decodeMeters( const std::string& in_content, Meters& out_meters, uint64_t& out_droppedChannels );
+
+private:
+    struct Probe
+    {
+        std::string id;
+        std::string nodeId;
+        std::string flowId;
+        json descriptor;
+        std::shared_ptr<MeterBuffer> meters;
+        Meters decoded; // Decoded by the writer before being published.
+        RenewalScheduler::Handle renewal; // Guarded by the client's mMutex.
+    };
+    typedef std::shared_ptr<Probe> ProbePtr;
+
+    typedef std::unordered_map<std::string, ProbePtr> Catalog; // By topic.
+
+    // Registers the probe and schedules its renewal.
+    void registerProbe( Probe& io_probe );
+
+    websocket_endpoint& mEndpoint;
+    int mConnectionId;
+    RenewalScheduler& mScheduler;
+    const Options mOptions;
+
+    // Read with std::atomic_load, replaced with std::atomic_store.
+    std::shared_ptr<const Catalog> mCatalog;
+    std::mutex mCatalogMutex; // Serializes the catalog updates.
+
+    std::mutex mMutex;
+    bool mRunning;
+
+    std::atomic<uint64_t> mReceived;
+    std::atomic<uint64_t> mRejected;
+    std::atomic<uint64_t> mDroppedChannels;
+    std::atomic<uint64_t> mTotalDecodeNs;
+};
+
+#endif /* SOUND_PROBE_CLIENT_H_ */
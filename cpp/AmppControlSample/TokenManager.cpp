@@ -0,0 +1,186 @@
+//
+// Copyright Grass Valley
+//
+
+#include "TokenManager.h"
+#include "BearerToken.h"
+
+#include <iostream>
+
+namespace
+{
+    // Delay before retrying after the identity service failed to answer.
+    const std::chrono::seconds RETRY_DELAY( 10 );
+}
+
+//********************************************************************************
+// TokenManager
+//********************************************************************************
+
+TokenManager::TokenManager( const std::string& in_baseUrl, const std::string& in_credentials )
+    : mBaseUrl( in_baseUrl )
+    , mCredentials( in_credentials )
+    , mRefreshing( false )
+    , mGeneration( 0 )
+    , mRefreshCount( 0 )
+    , mRunning( false )
+{
+}
+
+TokenManager::~TokenManager()
+{
+    stop();
+}
+
+bool TokenManager::start()
+{
+    if ( !getToken() )
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock( mMutex );
+    if ( !mRunning )
+    {
+        mRunning = true;
+        mThread = std::thread( &TokenManager::run, this );
+    }
+    return true;
+}
+
+void TokenManager::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock( mMutex );
+        if ( !mRunning )
+        {
+            return;
+        }
+        mRunning = false;
+    }
+    mCondition.notify_all();
+    mThread.join();
+}
+
+std::shared_ptr<const TokenManager::Token> TokenManager::getToken()
+{
+    std::shared_ptr<const Token> token = std::atomic_load( &mToken );
+    if ( token && Clock::now() < token->expiresAt )
+    {
+        return token;
+    }
+
+    uint64_t generation;
+    {
+        std::lock_guard<std::mutex> lock( mMutex );
+        generation = mGeneration;
+    }
+    // A refresh may have completed before the generation was read.
+    token = std::atomic_load( &mToken );
+    if ( token && Clock::now() < token->expiresAt )
+    {
+        return token;
+    }
+
+    refresh( generation );
+
+    token = std::atomic_load( &mToken );
+    if ( token && Clock::now() < token->expiresAt )
+    {
+        return token;
+    }
+    return std::shared_ptr<const Token>();
+}
+
+std::string TokenManager::getBearerToken()
+{
+    std::shared_ptr<const Token> token = getToken();
+    return token ? token->value : std::string();
+}
+
+uint64_t TokenManager::getRefreshCount() const
+{
+    std::lock_guard<std::mutex> lock( mMutex );
+    return mRefreshCount;
+}
+
+bool TokenManager::refresh( uint64_t in_generation )
+{
+    std::unique_lock<std::mutex> lock( mMutex );
+    while ( mRefreshing )
+    {
+        mCondition.wait( lock );
+    }
+    if ( mGeneration != in_generation )
+    {
+        // Another caller refreshed (or tried to) in the meantime; share its result.
+        return static_cast<bool>( std::atomic_load( &mToken ) );
+    }
+    mRefreshing = true;
+    ++mRefreshCount;
+    lock.unlock();
+
+    // Ends the refresh on every exit, exceptions included, or the callers
+    // waiting for it would wait forever.
+    struct RefreshEnd
+    {
+        ~RefreshEnd()
+        {
+            {
+                std::lock_guard<std::mutex> endLock( manager.mMutex );
+                manager.mRefreshing = false;
+                ++manager.mGeneration;
+            }
+            manager.mCondition.notify_all();
+        }
+
+        TokenManager& manager;
+    } refreshEnd = { *this };
+
+    std::shared_ptr<Token> token = std::make_shared<Token>();
+    Clock::time_point requested = Clock::now();
+    bool result = ::getToken( mBaseUrl, mCredentials, token->value, token->expiresIn );
+    if ( result )
+    {
+        token->expiresAt = requested + std::chrono::seconds( token->expiresIn );
+        std::atomic_store( &mToken, std::shared_ptr<const Token>( token ) );
+    }
+    else
+    {
+        std::cout << "Could not refresh the bearer token." << std::endl;
+    }
+    return result;
+}
+
+void TokenManager::run()
+{
+    std::unique_lock<std::mutex> lock( mMutex );
+    while ( mRunning )
+    {
+        std::shared_ptr<const Token> token = std::atomic_load( &mToken );
+        Clock::time_point refreshAt = Clock::now() + RETRY_DELAY;
+        if ( token )
+        {
+            // Refresh when 75% of the lifetime has elapsed.
+            Clock::time_point proactive = token->expiresAt - std::chrono::seconds( token->expiresIn ) / 4;
+            if ( proactive > Clock::now() )
+            {
+                refreshAt = proactive;
+            }
+        }
+
+        uint64_t generation = mGeneration;
+        if ( mCondition.wait_until( lock, refreshAt, [this, generation]()
+        {
+            return !mRunning || mGeneration != generation;
+        } ) )
+        {
+            // Stopped, or a caller refreshed the token: compute the next deadline.
+            continue;
+        }
+
+        lock.unlock();
+        refresh( generation );
+        lock.lock();
+    }
+}
@@ -0,0 +1,74 @@
+//
+// Copyright Grass Valley
+//
+
+#ifndef TOKEN_MANAGER_H_
+#define TOKEN_MANAGER_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Caches the bearer token of a set of credentials and keeps it fresh.
+//
+// A background thread requests a new token when 75% of the current one's
+// lifetime has elapsed, so callers never wait for the identity service in the
+// normal case. getToken() only loads a shared pointer. If the token expired
+// anyway (e.g. the identity service was unreachable), the next callers refresh
+// it synchronously; concurrent refreshes are merged into a single request.
+class TokenManager
+{
+public:
+    struct Token
+    {
+        std::string value;
+        unsigned int expiresIn; // Lifetime in seconds, as returned by the identity service.
+        std::chrono::steady_clock::time_point expiresAt;
+    };
+
+    TokenManager( const std::string& in_baseUrl, const std::string& in_credentials );
+    ~TokenManager();
+
+    // Gets the first token and starts the background refresh.
+    bool start();
+
+    void stop();
+
+    // Returns the current token, refreshing it first if it has expired.
+    // Returns a null pointer if no token could be obtained.
+    std::shared_ptr<const Token> getToken();
+
+    // Convenience returning the token value, empty on failure.
+    std::string getBearerToken();
+
+    // Number of requests made to the identity service.
+    uint64_t getRefreshCount() const;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    // Requests a new token unless a refresh completed since in_generation,
+    // waiting for the refresh in progress if there is one.
+    bool refresh( uint64_t in_generation );
+    void run();
+
+    std::string mBaseUrl;
+    std::string mCredentials;
+
+    // Read with std::atomic_load, replaced with std::atomic_store.
+    std::shared_ptr<const Token> mToken;
+
+    // Guards the single-flight state below.
+    mutable std::mutex mMutex;
+    std::condition_variable mCondition;
+    bool mRefreshing;
+    uint64_t mGeneration;
+    uint64_t mRefreshCount;
+    bool mRunning;
+    std::thread mThread;
+};
+
+#endif /* TOKEN_MANAGER_H_ */
@@ -4,52 +4,219 @@
 
 #include "Util.h"
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <ctime>
 #include <iomanip>
 #include <iostream>
 #include <random>
 #include <sstream>
 
-// This may not be the best implementation to guarantee UUID uniqueness.
-// Please feel free to use any other librairy of your choice to meet
-// this criteria.
-std::string getUuid()
+namespace
 {
-    static std::random_device              rd;
-    static std::mt19937                    gen( rd() );
-    static std::uniform_int_distribution<> dis( 0, 15 );
-    static std::uniform_int_distribution<> dis2( 8, 11 );
-
-    std::stringstream ss;
-    int i;
-    ss << std::hex;
-    for ( i = 0; i < 8; i++ )
+    // xoshiro256** (Blackman and Vigna), 64 random bits per call.
+    struct RandomGenerator
     {
-        ss << dis( gen );
+        bool seeded;
+        uint64_t state[ 4 ];
+    };
+
+    inline uint64_t rotateLeft( uint64_t in_value, int in_bits )
+    {
+        return ( in_value << in_bits ) | ( in_value >> ( 64 - in_bits ) );
     }
-    ss << "-";
-    for ( i = 0; i < 4; i++ )
+
+    // splitmix64, to spread a seed over the generator state.
+    uint64_t splitMix( uint64_t& io_seed )
     {
-        ss << dis( gen );
+        uint64_t z = ( io_seed += 0x9E3779B97F4A7C15ULL );
+        z = ( z ^ ( z >> 30 ) ) * 0xBF58476D1CE4E5B9ULL;
+        z = ( z ^ ( z >> 27 ) ) * 0x94D049BB133111EBULL;
+        return z ^ ( z >> 31 );
     }
-    ss << "-4";
-    for ( i = 0; i < 3; i++ )
+
+    uint64_t getRandom( RandomGenerator& io_generator )
     {
-        ss << dis( gen );
+        uint64_t* s = io_generator.state;
+        uint64_t result = rotateLeft( s[ 1 ] * 5, 7 ) * 9;
+        uint64_t t = s[ 1 ] << 17;
+        s[ 2 ] ^= s[ 0 ];
+        s[ 3 ] ^= s[ 1 ];
+        s[ 1 ] ^= s[ 2 ];
+        s[ 0 ] ^= s[ 3 ];
+        s[ 2 ] ^= t;
+        s[ 3 ] = rotateLeft( s[ 3 ], 45 );
+        return result;
     }
-    ss << "-";
-    ss << dis2( gen );
-    for ( i = 0; i < 3; i++ )
+
+    // One generator per thread, seeded on its first use from the random
+    // device, the clock and the address of the generator itself.
+    RandomGenerator& getThreadGenerator()
     {
-        ss << dis( gen );
+        thread_local RandomGenerator generator = { false, { 0, 0, 0, 0 } };
+        if ( !generator.seeded )
+        {
+            std::random_device device;
+            uint64_t seed = ( static_cast<uint64_t>( device() ) << 32 ) ^ device();
+            seed ^= static_cast<uint64_t>( std::chrono::high_resolution_clock::now().time_since_epoch().count() );
+            seed ^= static_cast<uint64_t>( reinterpret_cast<uintptr_t>( &generator ) );
+            for ( int i = 0; i < 4; ++i )
+            {
+                generator.state[ i ] = splitMix( seed );
+            }
+            generator.seeded = true;
+        }
+        return generator;
     }
-    ss << "-";
-    for ( i = 0; i < 12; i++ )
+
+    // The two hexadecimal digits of every byte, constant-initialized so it
+    // can be used before the dynamic initialization of this file.
+    const char HEX_PAIRS[] =
+        "000102030405060708090a0b0c0d0e0f"
+        "101112131415161718191a1b1c1d1e1f"
+        "202122232425262728292a2b2c2d2e2f"
+        "303132333435363738393a3b3c3d3e3f"
+        "404142434445464748494a4b4c4d4e4f"
+        "505152535455565758595a5b5c5d5e5f"
+        "606162636465666768696a6b6c6d6e6f"
+        "707172737475767778797a7b7c7d7e7f"
+        "808182838485868788898a8b8c8d8e8f"
+        "909192939495969798999a9b9c9d9e9f"
+        "a0a1a2a3a4a5a6a7a8a9aaabacadaeaf"
+        "b0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+        "c0c1c2c3c4c5c6c7c8c9cacbcccdcecf"
+        "d0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+        "e0e1e2e3e4e5e6e7e8e9eaebecedeeef"
+        "f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+
+    // Version of the UUIDs of getUuid().
+    std::atomic<int> uuidVersion( 4 );
+
+    // Unix time in milliseconds of the last version 7 UUID, shifted left by
+    // 12 bits, plus its counter.
+    std::atomic<uint64_t> lastTimeOrdered( 0 );
+
+    // Writes the 16 bytes, from the most significant of in_high, with dashes
+    // after bytes 4, 6, 8 and 10.
+    void writeUuid( uint64_t in_high, uint64_t in_low, char ( &out_uuid )[ UUID_LENGTH ] )
     {
-        ss << dis( gen );
-    };
-    return ss.str();
+        static const unsigned char POSITIONS[ 16 ] = { 0, 2, 4, 6, 9, 11, 14, 16, 19, 21, 24, 26, 28, 30, 32, 34 };
+        for ( int i = 0; i < 8; ++i )
+        {
+            memcpy( out_uuid + POSITIONS[ i ], HEX_PAIRS + 2 * ( ( in_high >> ( 56 - 8 * i ) ) & 0xFF ), 2 );
+            memcpy( out_uuid + POSITIONS[ 8 + i ], HEX_PAIRS + 2 * ( ( in_low >> ( 56 - 8 * i ) ) & 0xFF ), 2 );
+        }
+        out_uuid[ 8 ] = '-';
+        out_uuid[ 13 ] = '-';
+        out_uuid[ 18 ] = '-';
+        out_uuid[ 23 ] = '-';
+    }
+
+    int getHexDigit( char in_character )
+    {
+        if ( in_character >= '0' && in_character <= '9' )
+        {
+            return in_character - '0';
+        }
+        if ( in_character >= 'a' && in_character <= 'f' )
+        {
+            return in_character - 'a' + 10;
+        }
+        if ( in_character >= 'A' && in_character <= 'F' )
+        {
+            return in_character - 'A' + 10;
+        }
+        return -1;
+    }
+}
+
+void getUuid( char ( &out_uuid )[ UUID_LENGTH ] )
+{
+    if ( uuidVersion.load( std::memory_order_relaxed ) == 7 )
+    {
+        getTimeOrderedUuid( out_uuid );
+        return;
+    }
+
+    RandomGenerator& generator = getThreadGenerator();
+    uint64_t high = getRandom( generator );
+    uint64_t low = getRandom( generator );
+
+    // Version 4 in the high nibble of byte 6, variant 10 in the high bits of byte 8.
+    high = ( high & 0xFFFFFFFFFFFF0FFFULL ) | 0x0000000000004000ULL;
+    low = ( low & 0x3FFFFFFFFFFFFFFFULL ) | 0x8000000000000000ULL;
+    writeUuid( high, low, out_uuid );
+}
+
+std::string getUuid()
+{
+    char uuid[ UUID_LENGTH ];
+    getUuid( uuid );
+    return std::string( uuid, UUID_LENGTH );
+}
+
+bool setUuidVersion( int in_version )
+{
+    if ( in_version != 4 && in_version != 7 )
+    {
+        return false;
+    }
+    uuidVersion = in_version;
+    return true;
+}
+
+void getTimeOrderedUuid( char ( &out_uuid )[ UUID_LENGTH ] )
+{
+    uint64_t now = static_cast<uint64_t>( std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch() ).count() );
+
+    // The 12 bits after the time count the UUIDs of the same millisecond.
+    // Past 4096, or if the clock goes back, the time is taken from the last
+    // UUID, so the UUIDs stay ordered.
+    uint64_t last = lastTimeOrdered.load( std::memory_order_relaxed );
+    uint64_t next;
+    do
+    {
+        next = std::max( last + 1, now << 12 );
+    }
+    while ( !lastTimeOrdered.compare_exchange_weak( last, next, std::memory_order_relaxed ) );
+
+    // 48 bits of time, version 7, 12 bits of counter; variant 10 and 62 random bits.
+    uint64_t high = ( ( next >> 12 ) << 16 ) | 0x7000 | ( next & 0xFFF );
+    uint64_t low = ( getRandom( getThreadGenerator() ) & 0x3FFFFFFFFFFFFFFFULL ) | 0x8000000000000000ULL;
+    writeUuid( high, low, out_uuid );
+}
+
+bool getUuidTime( const std::string& in_uuid, std::chrono::system_clock::time_point& out_time )
+{
+    if ( in_uuid.size() != UUID_LENGTH || in_uuid[ 8 ] != '-' || in_uuid[ 14 ] != '7' )
+    {
+        return false;
+    }
+
+    // The 48 bits of time are the first 12 digits, around the dash.
+    uint64_t milliseconds = 0;
+    for ( size_t i = 0; i < 13; ++i )
+    {
+        if ( i == 8 )
+        {
+            continue;
+        }
+        int digit = getHexDigit( in_uuid[ i ] );
+        if ( digit < 0 )
+        {
+            return false;
+        }
+        milliseconds = ( milliseconds << 4 ) | static_cast<uint64_t>( digit );
+    }
+
+    out_time = std::chrono::system_clock::time_point( std::chrono::duration_cast<std::chrono::system_clock::duration>(
+        std::chrono::milliseconds( milliseconds ) ) );
+    return true;
 }
 
 std::string getCurrentTimeString()
@@ -68,3 +235,70 @@ std::string getCurrentTimeString()
 
     return ss.str();
 }
+
+bool parseTimeString( const std::string& in_time, std::chrono::system_clock::time_point& out_time )
+{
+    int year, month, day, hour, minute, second;
+    char fraction[ 16 ] = "";
+    if ( sscanf( in_time.c_str(), "%4d-%2d-%2dT%2d:%2d:%2d%15[.0-9]",
+        &year, &month, &day, &hour, &minute, &second, fraction ) < 6 )
+    {
+        return false;
+    }
+
+    // Days since 1970-01-01 in the proleptic Gregorian calendar, avoiding
+    // timegm() which is not available on Windows.
+    int y = year - ( month <= 2 ? 1 : 0 );
+    int era = ( y >= 0 ? y : y - 399 ) / 400;
+    int yearOfEra = y - era * 400;
+    int dayOfYear = ( 153 * ( month + ( month > 2 ? -3 : 9 ) ) + 2 ) / 5 + day - 1;
+    int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    long long days = static_cast<long long>( era ) * 146097 + dayOfEra - 719468;
+
+    std::chrono::microseconds sinceEpoch( ( ( days * 24 + hour ) * 60 + minute ) * 60000000LL + second * 1000000LL );
+    if ( fraction[ 0 ] == '.' )
+    {
+        long long scale = 100000;
+        for ( const char* c = fraction + 1; *c && scale > 0; ++c, scale /= 10 )
+        {
+            sinceEpoch += std::chrono::microseconds( ( *c - '0' ) * scale );
+        }
+    }
+
+    out_time = std::chrono::system_clock::time_point( std::chrono::duration_cast<std::chrono::system_clock::duration>( sinceEpoch ) );
+    return true;
+}
+
+bool topicMatches( const std::string& in_pattern, const std::string& in_topic )
+{
+    size_t p = 0;
+    size_t t = 0;
+    for ( ;; )
+    {
+        size_t patternEnd = in_pattern.find( '.', p );
+        size_t topicEnd = in_topic.find( '.', t );
+        if ( patternEnd == std::string::npos )
+        {
+            patternEnd = in_pattern.size();
+        }
+        if ( topicEnd == std::string::npos )
+        {
+            topicEnd = in_topic.size();
+        }
+
+        bool wildcard = ( patternEnd - p == 1 && in_pattern[ p ] == '*' );
+        if ( !wildcard && in_pattern.compare( p, patternEnd - p, in_topic, t, topicEnd - t ) != 0 )
+        {
+            return false;
+        }
+
+        bool patternDone = ( patternEnd == in_pattern.size() );
+        bool topicDone = ( topicEnd == in_topic.size() );
+        if ( patternDone || topicDone )
+        {
+            return patternDone && topicDone;
+        }
+        p = patternEnd + 1;
+        t = topicEnd + 1;
+    }
+}
@@ -5,12 +5,47 @@
 #ifndef UTIL_H_
 #define UTIL_H_
 
+#include <chrono>
+#include <cstddef>
 #include <string>
 
-// Returns a randomly generate UUID string
+// Characters of a UUID string ("xxxxxxxx-xxxx-4xxx-yxxx-xxxxxxxxxxxx").
+const size_t UUID_LENGTH = 36;
+
+// Writes a new UUID to out_uuid, without a terminating null: a random
+// (version 4) one, or a time-ordered (version 7) one once selected with
+// setUuidVersion(). Thread-safe: each thread draws from its own generator, and
+// nothing is allocated.
+void getUuid( char ( &out_uuid )[ UUID_LENGTH ] );
+
+// Returns a new UUID string, for the callers needing one.
 std::string getUuid();
 
+// Selects the version of the UUIDs returned by getUuid(), 4 (default) or 7.
+// Version 7 UUIDs start with their Unix time in milliseconds, followed by a
+// counter: the ids of the process sort in the order they were generated,
+// even within a millisecond and across threads. Returns false for another
+// version.
+bool setUuidVersion( int in_version );
+
+// Writes a new version 7 UUID to out_uuid, whatever the version selected.
+void getTimeOrderedUuid( char ( &out_uuid )[ UUID_LENGTH ] );
+
+// Reads the time a version 7 UUID was generated, to the millisecond, e.g. to
+// time a request from the id echoed in its response. Returns false for
+// another version.
+bool getUuidTime( const std::string& in_uuid, std::chrono::system_clock::time_point& out_time );
+
 // Returns an ISO 8601 formatted string of the current time.
 std::string getCurrentTimeString();
 
+// Parses an ISO 8601 UTC time ("2023-01-31T12:34:56Z", with optional
+// fractional seconds) as sent in the "time" field of notifications.
+bool parseTimeString( const std::string& in_time, std::chrono::system_clock::time_point& out_time );
+
+// Returns true if a notification topic matches a subscription pattern.
+// Topics are period separated words; a "*" word in the pattern matches
+// exactly one word of the topic (e.g. "gv.ampp.control.*.*.notify").
+bool topicMatches( const std::string& in_pattern, const std::string& in_topic );
+
 #endif /* UTIL_H_ */
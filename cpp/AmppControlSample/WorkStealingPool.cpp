@@ -0,0 +1,151 @@
+//
+// Copyright Grass Valley
+//
+
+#include "WorkStealingPool.h"
+
+namespace
+{
+    // Identifies the pool and worker the current thread belongs to, if any.
+    thread_local const WorkStealingPool* tCurrentPool = nullptr;
+    thread_local unsigned int tCurrentIndex = 0;
+}
+
+WorkStealingPool::WorkStealingPool( unsigned int in_threadCount )
+    : mPending( 0 )
+    , mNextWorker( 0 )
+    , mStopping( false )
+{
+    unsigned int threadCount = in_threadCount;
+    if ( threadCount == 0 )
+    {
+        threadCount = std::thread::hardware_concurrency();
+    }
+    if ( threadCount == 0 )
+    {
+        threadCount = 2;
+    }
+
+    for ( unsigned int i = 0; i < threadCount; ++i )
+    {
+        mWorkers.emplace_back( new Worker() );
+    }
+    for ( unsigned int i = 0; i < threadCount; ++i )
+    {
+        mThreads.emplace_back( &WorkStealingPool::run, this, i );
+    }
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        std::lock_guard<std::mutex> lock( mWakeMutex );
+        mStopping = true;
+    }
+    mWakeCondition.notify_all();
+
+    for ( size_t i = 0; i < mThreads.size(); ++i )
+    {
+        mThreads[ i ].join();
+    }
+}
+
+void WorkStealingPool::submit( Task in_task )
+{
+    push( std::move( in_task ), false );
+}
+
+void WorkStealingPool::defer( Task in_task )
+{
+    push( std::move( in_task ), true );
+}
+
+void WorkStealingPool::push( Task in_task, bool in_deferred )
+{
+    unsigned int index;
+    bool front = false;
+    if ( tCurrentPool == this )
+    {
+        index = tCurrentIndex;
+        front = in_deferred;
+    }
+    else
+    {
+        index = mNextWorker.fetch_add( 1, std::memory_order_relaxed ) % mWorkers.size();
+    }
+
+    {
+        // The owner pops from the back, thieves from the front.
+        std::lock_guard<std::mutex> lock( mWorkers[ index ]->mutex );
+        if ( front )
+        {
+            mWorkers[ index ]->tasks.push_front( std::move( in_task ) );
+        }
+        else
+        {
+            mWorkers[ index ]->tasks.push_back( std::move( in_task ) );
+        }
+    }
+    mPending.fetch_add( 1 );
+
+    // Taking the wake mutex orders this notification after the pending count
+    // update, so a worker about to sleep cannot miss it.
+    {
+        std::lock_guard<std::mutex> lock( mWakeMutex );
+    }
+    mWakeCondition.notify_one();
+}
+
+bool WorkStealingPool::popLocal( unsigned int in_index, Task& out_task )
+{
+    Worker& worker = *mWorkers[ in_index ];
+    std::lock_guard<std::mutex> lock( worker.mutex );
+    if ( worker.tasks.empty() )
+    {
+        return false;
+    }
+    out_task = std::move( worker.tasks.back() );
+    worker.tasks.pop_back();
+    return true;
+}
+
+bool WorkStealingPool::steal( unsigned int in_index, Task& out_task )
+{
+    const size_t count = mWorkers.size();
+    for ( size_t offset = 1; offset < count; ++offset )
+    {
+        Worker& victim = *mWorkers[ ( in_index + offset ) % count ];
+        std::unique_lock<std::mutex> lock( victim.mutex, std::try_to_lock );
+        if ( lock.owns_lock() && !victim.tasks.empty() )
+        {
+            out_task = std::move( victim.tasks.front() );
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::run( unsigned int in_index )
+{
+    tCurrentPool = this;
+    tCurrentIndex = in_index;
+
+    for ( ;; )
+    {
+        Task task;
+        if ( popLocal( in_index, task ) || steal( in_index, task ) )
+        {
+            mPending.fetch_sub( 1 );
+            task();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock( mWakeMutex );
+        mWakeCondition.wait( lock, [this]() { return mStopping || mPending.load() > 0; } );
+        if ( mStopping )
+        {
+            return;
+        }
+    }
+}
@@ -0,0 +1,69 @@
+//
+// Copyright Grass Valley
+//
+
+#ifndef WORK_STEALING_POOL_H_
+#define WORK_STEALING_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed size thread pool where every worker owns a task deque.
+// Tasks submitted from a worker thread go to that worker's own deque (and are
+// popped LIFO while still hot in cache); tasks submitted from any other thread
+// are spread round-robin. An idle worker steals the oldest task of its peers.
+class WorkStealingPool
+{
+public:
+    typedef std::function<void()> Task;
+
+    // A thread count of 0 uses the number of hardware threads.
+    explicit WorkStealingPool( unsigned int in_threadCount = 0 );
+
+    // Stops the workers. Tasks that have not started yet are discarded.
+    ~WorkStealingPool();
+
+    void submit( Task in_task );
+
+    // Like submit(), but from a worker thread the task goes to the cold end of
+    // the worker's deque: every task already queued there runs before it, or an
+    // idle peer steals it first. For tasks yielding the worker to the others.
+    void defer( Task in_task );
+
+    unsigned int getThreadCount() const
+    {
+        return static_cast<unsigned int>( mWorkers.size() );
+    }
+
+private:
+    WorkStealingPool( const WorkStealingPool& );
+    WorkStealingPool& operator=( const WorkStealingPool& );
+
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void push( Task in_task, bool in_deferred );
+    void run( unsigned int in_index );
+    bool popLocal( unsigned int in_index, Task& out_task );
+    bool steal( unsigned int in_index, Task& out_task );
+
+    std::vector<std::unique_ptr<Worker>> mWorkers;
+    std::vector<std::thread> mThreads;
+
+    std::mutex mWakeMutex;
+    std::condition_variable mWakeCondition;
+    std::atomic<size_t> mPending;
+    std::atomic<unsigned int> mNextWorker;
+    bool mStopping;
+};
+
+#endif /* WORK_STEALING_POOL_H_ */
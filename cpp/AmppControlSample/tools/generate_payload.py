@@ -0,0 +1,296 @@
+#!/usr/bin/env python3
+#
+# Copyright Grass Valley
+#
+# Generates a typed C++ payload struct from the JSON schema of an Ampp Control
+# command (see PayloadCodec.h).
+#
+# usage: generate_payload.py <schema.json> <StructName> <output.h> [<stamp>]
+#
+# Each property of the schema becomes a member of the struct: "integer" is a
+# long long, "number" a double, "boolean" a bool and "string" a std::string.
+# A "null" type next to one of these is accepted, null values being read as
+# absent ones. Other types are not supported.
+
+import json
+import os
+import re
+import sys
+import textwrap
+
+CPP_TYPES = {
+    "integer": ( "long long", "PAYLOAD_INTEGER", "0" ),
+    "number": ( "double", "PAYLOAD_NUMBER", "0.0" ),
+    "boolean": ( "bool", "PAYLOAD_BOOLEAN", "false" ),
+    "string": ( "std::string", "PAYLOAD_STRING", None ),
+}
+
+# C++ keywords (C++14, with the alternative operator names).
+CPP_KEYWORDS = set( [
+    "alignas", "alignof", "and", "and_eq", "asm", "auto", "bitand", "bitor", "bool", "break", "case", "catch", "char",
+    "char16_t", "char32_t", "class", "compl", "const", "const_cast", "constexpr", "continue", "decltype", "default",
+    "delete", "do", "double", "dynamic_cast", "else", "enum", "explicit", "export", "extern", "false", "float", "for",
+    "friend", "goto", "if", "inline", "int", "long", "mutable", "namespace", "new", "noexcept", "not", "not_eq",
+    "nullptr", "operator", "or", "or_eq", "private", "protected", "public", "register", "reinterpret_cast", "return",
+    "short", "signed", "sizeof", "static", "static_assert", "static_cast", "struct", "switch", "template", "this",
+    "thread_local", "throw", "true", "try", "typedef", "typeid", "typename", "union", "unsigned", "using", "virtual",
+    "void", "volatile", "wchar_t", "while", "xor", "xor_eq" ] )
+
+# Names members cannot take: the keywords, and the members of the generated struct itself.
+RESERVED_NAMES = CPP_KEYWORDS | set( [ "fields", "table", "reader", "writer", "result", "fieldIndex" ] )
+
+MAX_FIELDS = 32
+
+
+def fail( message ):
+    sys.stderr.write( "generate_payload.py: " + message + "\n" )
+    sys.exit( 1 )
+
+
+def member_name( name ):
+    member = name[ 0 ].lower() + name[ 1: ]
+    return member + "_" if member in RESERVED_NAMES else member
+
+
+def constant_name( name ):
+    words = re.sub( r"([a-z0-9])([A-Z])", r"\1_\2", name )
+    return "FIELD_" + words.upper()
+
+
+def format_double( value ):
+    text = repr( float( value ) )
+    return text if ( "." in text or "e" in text ) else text + ".0"
+
+
+def resolve( root, schema ):
+    reference = schema.get( "$ref" )
+    if reference is None:
+        return schema
+    if not reference.startswith( "#/" ):
+        fail( "unsupported reference " + reference )
+    node = root
+    for part in reference[ 2: ].split( "/" ):
+        node = node[ part ]
+    return node
+
+
+def read_fields( root ):
+    properties = root.get( "properties" )
+    if not isinstance( properties, dict ) or not properties:
+        fail( "the schema has no properties" )
+    if len( properties ) > MAX_FIELDS:
+        fail( "more than %d properties" % MAX_FIELDS )
+
+    fields = []
+    for name, schema in properties.items():
+        if not re.match( r"^[A-Za-z_][A-Za-z0-9_]*$", name ):
+            fail( "property \"%s\" is not a valid member name" % name )
+        schema = resolve( root, schema )
+
+        types = schema.get( "type" )
+        types = [ t for t in ( types if isinstance( types, list ) else [ types ] ) if t != "null" ]
+        if len( types ) != 1 or types[ 0 ] not in CPP_TYPES:
+            fail( "property \"%s\" has an unsupported type %s" % ( name, json.dumps( schema.get( "type" ) ) ) )
+
+        if "exclusiveMinimum" in schema or "exclusiveMaximum" in schema:
+            fail( "property \"%s\": exclusive bounds are not supported" % name )
+
+        fields.append( {
+            "name": name,
+            "member": member_name( name ),
+            "constant": constant_name( name ),
+            "type": types[ 0 ],
+            "title": schema.get( "title" ) or schema.get( "description" ),
+            "minimum": schema.get( "minimum" ),
+            "maximum": schema.get( "maximum" ),
+        } )
+    return fields
+
+
+def comment( text ):
+    # Keeps the generated comments on one line.
+    return " ".join( str( text ).split() )
+
+
+def generate( schema_path, struct_name, root ):
+    fields = read_fields( root )
+    guard = struct_name.upper() + "_H_"
+    cpp_types = dict( ( f[ "name" ], CPP_TYPES[ f[ "type" ] ] ) for f in fields )
+
+    out = []
+    out.append( "//" )
+    out.append( "// Copyright Grass Valley" )
+    out.append( "//" )
+    out.append( "// Generated by tools/generate_payload.py from %s, do not edit." % os.path.basename( schema_path ) )
+    out.append( "//" )
+    out.append( "" )
+    out.append( "#ifndef %s" % guard )
+    out.append( "#define %s" % guard )
+    out.append( "" )
+    out.append( "#include \"PayloadCodec.h\"" )
+    out.append( "" )
+    out.append( "#include <string>" )
+    out.append( "" )
+    if root.get( "description" ) or root.get( "title" ):
+        for line in textwrap.wrap( comment( root.get( "description" ) or root.get( "title" ) ), 80 ):
+            out.append( "// " + line )
+        out.append( "//" )
+    out.append( "// Only the members whose bit is set in 'fields' are written; decoding sets the" )
+    out.append( "// bits of the members found." )
+    out.append( "struct %s" % struct_name )
+    out.append( "{" )
+    out.append( "    enum Field" )
+    out.append( "    {" )
+    for i, f in enumerate( fields ):
+        out.append( "        %s = 1u << %d%s" % ( f[ "constant" ], i, "," if i + 1 < len( fields ) else "" ) )
+    out.append( "    };" )
+    out.append( "" )
+    out.append( "    static const size_t FIELD_COUNT = %d;" % len( fields ) )
+    out.append( "" )
+    out.append( "    %s()" % struct_name )
+    separator = ":"
+    for f in fields:
+        default = cpp_types[ f[ "name" ] ][ 2 ]
+        if default is not None:
+            out.append( "        %s %s( %s )" % ( separator, f[ "member" ], default ) )
+            separator = ","
+    out.append( "        %s fields( 0 )" % separator )
+    out.append( "    {" )
+    out.append( "    }" )
+    out.append( "" )
+    for f in fields:
+        line = "    %s %s;" % ( cpp_types[ f[ "name" ] ][ 0 ], f[ "member" ] )
+        if f[ "title" ]:
+            line += " // " + comment( f[ "title" ] )
+            if f[ "minimum" ] is not None and f[ "maximum" ] is not None:
+                line += " (%s to %s)" % ( f[ "minimum" ], f[ "maximum" ] )
+            elif f[ "minimum" ] is not None:
+                line += " (from %s)" % f[ "minimum" ]
+            elif f[ "maximum" ] is not None:
+                line += " (up to %s)" % f[ "maximum" ]
+        out.append( line )
+    out.append( "    unsigned int fields; // Field bits." )
+
+    for f in fields:
+        cpp_type = cpp_types[ f[ "name" ] ][ 0 ]
+        setter = f[ "name" ][ 0 ].upper() + f[ "name" ][ 1: ]
+        parameter = "const std::string&" if cpp_type == "std::string" else cpp_type
+        out.append( "" )
+        out.append( "    void set%s( %s in_value )" % ( setter, parameter ) )
+        out.append( "    {" )
+        out.append( "        %s = in_value;" % f[ "member" ] )
+        out.append( "        fields |= %s;" % f[ "constant" ] )
+        out.append( "    }" )
+        out.append( "" )
+        out.append( "    bool has%s() const" % setter )
+        out.append( "    {" )
+        out.append( "        return ( fields & %s ) != 0;" % f[ "constant" ] )
+        out.append( "    }" )
+
+    out.append( "" )
+    out.append( "    // Field table, in the order of the Field bits." )
+    out.append( "    static const PayloadField* getFields()" )
+    out.append( "    {" )
+    out.append( "        static const PayloadField table[ FIELD_COUNT ] =" )
+    out.append( "        {" )
+    for i, f in enumerate( fields ):
+        out.append( "            { \"%s\", %d, %s, %s, %s, %s, %s }%s" % (
+            f[ "name" ], len( f[ "name" ] ), cpp_types[ f[ "name" ] ][ 1 ],
+            "true" if f[ "minimum" ] is not None else "false",
+            "true" if f[ "maximum" ] is not None else "false",
+            format_double( f[ "minimum" ] if f[ "minimum" ] is not None else 0 ),
+            format_double( f[ "maximum" ] if f[ "maximum" ] is not None else 0 ),
+            "," if i + 1 < len( fields ) else "" ) )
+    out.append( "        };" )
+    out.append( "        return table;" )
+    out.append( "    }" )
+
+    out.append( "" )
+    out.append( "    // Writes { \"Key\" : in_key, \"Payload\" : { ... } } into io_content, reusing its capacity." )
+    out.append( "    void encodeContent( const std::string& in_key, std::string& io_content ) const" )
+    out.append( "    {" )
+    out.append( "        const PayloadField* table = getFields();" )
+    out.append( "        PayloadWriter writer( io_content, in_key );" )
+    for i, f in enumerate( fields ):
+        write = { "integer": "writeInteger", "number": "writeNumber", "boolean": "writeBoolean", "string": "writeString" }[ f[ "type" ] ]
+        out.append( "        if ( fields & %s )" % f[ "constant" ] )
+        out.append( "        {" )
+        out.append( "            writer.%s( table[ %d ], %s );" % ( write, i, f[ "member" ] ) )
+        out.append( "        }" )
+    out.append( "        writer.end();" )
+    out.append( "    }" )
+
+    out.append( "" )
+    out.append( "    // Reads the payload of a content; the members absent from it keep their value" )
+    out.append( "    // but have their bit cleared. Returns false if the content is invalid or a" )
+    out.append( "    // value has the wrong type or is out of range." )
+    out.append( "    bool decodeContent( const std::string& in_content, std::string* out_key = NULL )" )
+    out.append( "    {" )
+    out.append( "        const PayloadField* table = getFields();" )
+    out.append( "        PayloadReader reader( in_content, out_key );" )
+    out.append( "        size_t fieldIndex;" )
+    out.append( "        fields = 0;" )
+    out.append( "        while ( reader.nextField( table, FIELD_COUNT, fieldIndex ) )" )
+    out.append( "        {" )
+    out.append( "            bool result = false;" )
+    out.append( "            switch ( fieldIndex )" )
+    out.append( "            {" )
+    for i, f in enumerate( fields ):
+        if f[ "type" ] in ( "integer", "number" ):
+            read = "reader.%s( table[ %d ], %s )" % ( "readInteger" if f[ "type" ] == "integer" else "readNumber", i, f[ "member" ] )
+        else:
+            read = "reader.%s( %s )" % ( "readBoolean" if f[ "type" ] == "boolean" else "readString", f[ "member" ] )
+        out.append( "            case %d:" % i )
+        out.append( "                result = %s;" % read )
+        out.append( "                break;" )
+    out.append( "            default:" )
+    out.append( "                break;" )
+    out.append( "            }" )
+    out.append( "            if ( !result )" )
+    out.append( "            {" )
+    out.append( "                return false;" )
+    out.append( "            }" )
+    out.append( "            fields |= 1u << fieldIndex;" )
+    out.append( "        }" )
+    out.append( "        return reader.isComplete();" )
+    out.append( "    }" )
+    out.append( "};" )
+    out.append( "" )
+    out.append( "#endif /* %s */" % guard )
+    out.append( "" )
+    return "\n".join( out )
+
+
+def main():
+    if len( sys.argv ) not in ( 4, 5 ):
+        fail( "usage: generate_payload.py <schema.json> <StructName> <output.h> [<stamp>]" )
+    schema_path, struct_name, output_path = sys.argv[ 1:4 ]
+    if not re.match( r"^[A-Za-z_][A-Za-z0-9_]*$", struct_name ) or struct_name in CPP_KEYWORDS:
+        fail( "\"%s\" is not a valid struct name" % struct_name )
+
+    with open( schema_path, "r" ) as schema_file:
+        root = json.load( schema_file )
+    if not isinstance( root, dict ):
+        fail( "the schema is not an object" )
+    text = generate( schema_path, struct_name, root )
+
+    # The header is only rewritten when it changes, so the sources including it
+    # are not rebuilt for nothing. The stamp is always written instead, for the
+    # build to know the header is up to date.
+    directory = os.path.dirname( output_path )
+    if directory and not os.path.isdir( directory ):
+        os.makedirs( directory )
+    unchanged = False
+    if os.path.exists( output_path ):
+        with open( output_path, "r" ) as output_file:
+            unchanged = ( output_file.read() == text )
+    if not unchanged:
+        with open( output_path, "w" ) as output_file:
+            output_file.write( text )
+    if len( sys.argv ) == 5:
+        with open( sys.argv[ 4 ], "w" ) as stamp_file:
+            stamp_file.write( struct_name + "\n" )
+
+
+if __name__ == "__main__":
+    main()